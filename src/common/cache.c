@@ -27,56 +27,101 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-// this implements a concurrent LRU cache
+// this implements a concurrent LRU cache. keys are striped over a number of
+// shards, each with its own mutex, hashtable and lru list. the cost quota is
+// global, garbage collection starts in the shard that needs room and then
+// tries the others without blocking.
 
-void dt_cache_init(
+static inline dt_cache_shard_t *_cache_shard(const dt_cache_t *cache, const uint32_t key)
+{
+  // fibonacci hashing, imgids are consecutive and mip levels live in the top bits
+  const uint32_t h = key * 0x9E3779B1u;
+  return cache->shards + ((h >> 16) & (cache->num_shards - 1));
+}
+
+static inline void _shard_lock(dt_cache_shard_t *shard)
+{
+  if(dt_pthread_mutex_trylock(&shard->lock))
+  {
+    dt_pthread_mutex_lock(&shard->lock);
+    shard->lock_contended++;
+  }
+  shard->lock_count++;
+}
+
+void dt_cache_init_sharded(
     dt_cache_t *cache,
     size_t entry_size,
-    size_t cost_quota)
+    size_t cost_quota,
+    int num_shards)
 {
+  int shards = 1;
+  while(shards < num_shards && shards < DT_CACHE_MAX_SHARDS) shards <<= 1;
+
   cache->cost = 0;
-  cache->lru = 0;
   cache->entry_size = entry_size;
   cache->cost_quota = cost_quota;
-  dt_pthread_mutex_init(&cache->lock, 0);
   cache->allocate = 0;
   cache->allocate_data = 0;
   cache->cleanup = 0;
   cache->cleanup_data = 0;
-  cache->hashtable = g_hash_table_new(0, 0);
+  cache->num_shards = shards;
+  cache->shards = (dt_cache_shard_t *)calloc(shards, sizeof(dt_cache_shard_t));
+  for(int k = 0; k < shards; k++)
+  {
+    dt_cache_shard_t *shard = cache->shards + k;
+    dt_pthread_mutex_init(&shard->lock, 0);
+    shard->hashtable = g_hash_table_new(0, 0);
+  }
+}
+
+void dt_cache_init(
+    dt_cache_t *cache,
+    size_t entry_size,
+    size_t cost_quota)
+{
+  dt_cache_init_sharded(cache, entry_size, cost_quota, 1);
 }
 
 void dt_cache_cleanup(dt_cache_t *cache)
 {
-  g_hash_table_destroy(cache->hashtable);
-  GList *l = cache->lru;
-  while(l)
+  for(int k = 0; k < cache->num_shards; k++)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
-
-    if(cache->cleanup)
+    dt_cache_shard_t *shard = cache->shards + k;
+    g_hash_table_destroy(shard->hashtable);
+    GList *l = shard->lru;
+    while(l)
     {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+      dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
 
-      cache->cleanup(cache->cleanup_data, entry);
-    }
-    else
-      dt_free_align(entry->data);
+      if(cache->cleanup)
+      {
+        assert(entry->data_size);
+        ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
 
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
-    l = g_list_next(l);
+        cache->cleanup(cache->cleanup_data, entry);
+      }
+      else
+        dt_free_align(entry->data);
+
+      dt_pthread_rwlock_destroy(&entry->lock);
+      g_slice_free1(sizeof(*entry), entry);
+      l = g_list_next(l);
+    }
+    g_list_free(shard->lru);
+    dt_pthread_mutex_destroy(&shard->lock);
   }
-  g_list_free(cache->lru);
-  dt_pthread_mutex_destroy(&cache->lock);
+  free(cache->shards);
+  cache->shards = NULL;
+  cache->num_shards = 0;
 }
 
 int32_t dt_cache_contains(dt_cache_t *cache, const uint32_t key)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  int32_t result = g_hash_table_contains(cache->hashtable, GINT_TO_POINTER(key));
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_cache_shard_t *shard = _cache_shard(cache, key);
+  _shard_lock(shard);
+  int32_t result = g_hash_table_contains(shard->hashtable, GINT_TO_POINTER(key));
+  dt_pthread_mutex_unlock(&shard->lock);
   return result;
 }
 
@@ -85,22 +130,26 @@ int dt_cache_for_all(
     int (*process)(const uint32_t key, const void *data, void *user_data),
     void *user_data)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  GHashTableIter iter;
-  gpointer key, value;
-
-  g_hash_table_iter_init (&iter, cache->hashtable);
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  for(int k = 0; k < cache->num_shards; k++)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
-    const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
-    if(err)
+    dt_cache_shard_t *shard = cache->shards + k;
+    _shard_lock(shard);
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init (&iter, shard->hashtable);
+    while (g_hash_table_iter_next (&iter, &key, &value))
     {
-      dt_pthread_mutex_unlock(&cache->lock);
-      return err;
+      dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
+      const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
+      if(err)
+      {
+        dt_pthread_mutex_unlock(&shard->lock);
+        return err;
+      }
     }
+    dt_pthread_mutex_unlock(&shard->lock);
   }
-  dt_pthread_mutex_unlock(&cache->lock);
   return 0;
 }
 
@@ -111,9 +160,10 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
   gpointer orig_key, value;
   gboolean res;
   double start = dt_get_wtime();
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_cache_shard_t *shard = _cache_shard(cache, key);
+  _shard_lock(shard);
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   if(res)
   {
     dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
@@ -123,13 +173,13 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&shard->lock);
       return 0;
     }
     // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    shard->lru = g_list_remove_link(shard->lru, entry->link);
+    shard->lru = g_list_concat(shard->lru, entry->link);
+    dt_pthread_mutex_unlock(&shard->lock);
     double end = dt_get_wtime();
     if(end - start > 0.1)
       fprintf(stderr, "try+ wait time %.06fs mode %c \n", end - start, mode);
@@ -144,13 +194,57 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
 
     return entry;
   }
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   double end = dt_get_wtime();
   if(end - start > 0.1)
     fprintf(stderr, "try- wait time %.06fs\n", end - start);
   return 0;
 }
 
+// best-effort garbage collection of one shard, which has to be locked by the caller.
+// evicts from the tip of its lru list until the global fill ratio is met.
+static void _shard_gc(dt_cache_t *cache, dt_cache_shard_t *shard, const float fill_ratio)
+{
+  GList *l = shard->lru;
+  while(l)
+  {
+    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
+    assert(entry->link->data == entry);
+    l = g_list_next(l); // we might remove this element, so walk to the next one while we still have the pointer..
+    if(cache->cost < cache->cost_quota * fill_ratio) break;
+
+    // if still locked by anyone else give up:
+    if(dt_pthread_rwlock_trywrlock(&entry->lock)) continue;
+
+    if(entry->_lock_demoting)
+    {
+      // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
+      dt_pthread_rwlock_unlock(&entry->lock);
+      continue;
+    }
+
+    // delete!
+    g_hash_table_remove(shard->hashtable, GINT_TO_POINTER(entry->key));
+    shard->lru = g_list_delete_link(shard->lru, entry->link);
+    shard->cost -= entry->cost;
+    __sync_fetch_and_sub(&cache->cost, entry->cost);
+
+    if(cache->cleanup)
+    {
+      assert(entry->data_size);
+      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+
+      cache->cleanup(cache->cleanup_data, entry);
+    }
+    else
+      dt_free_align(entry->data);
+
+    dt_pthread_rwlock_unlock(&entry->lock);
+    dt_pthread_rwlock_destroy(&entry->lock);
+    g_slice_free1(sizeof(*entry), entry);
+  }
+}
+
 // if found, the data void* is returned. if not, it is set to be
 // the given *data and a new hash table entry is created, which can be
 // found using the given key later on.
@@ -160,10 +254,11 @@ dt_cache_entry_t *dt_cache_get_with_caller(dt_cache_t *cache, const uint32_t key
   gboolean res;
   int result;
   double start = dt_get_wtime();
+  dt_cache_shard_t *shard = _cache_shard(cache, key);
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  _shard_lock(shard);
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   if(res)
   { // yay, found. read lock and pass on.
     dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
@@ -172,14 +267,14 @@ restart:
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&shard->lock);
       g_usleep(5);
       goto restart;
     }
     // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    shard->lru = g_list_remove_link(shard->lru, entry->link);
+    shard->lru = g_list_concat(shard->lru, entry->link);
+    dt_pthread_mutex_unlock(&shard->lock);
 
 #ifdef _DEBUG
     const pthread_t writer = dt_pthread_rwlock_get_writer(&entry->lock);
@@ -206,12 +301,19 @@ restart:
 
   // else, not found, need to allocate.
 
-  // first try to clean up.
-  // also wait if we can't free more than the requested fill ratio.
+  // first try to clean up, starting with our own shard. the others are
+  // only tried, never waited for, so two shards can't deadlock each other.
   if(cache->cost > 0.8f * cache->cost_quota)
   {
-    // need to roll back all the way to get a consistent lock state:
-    dt_cache_gc(cache, 0.8f);
+    _shard_gc(cache, shard, 0.8f);
+    for(int k = 0; k < cache->num_shards && cache->cost > 0.8f * cache->cost_quota; k++)
+    {
+      dt_cache_shard_t *other = cache->shards + k;
+      if(other == shard || dt_pthread_mutex_trylock(&other->lock)) continue;
+      other->lock_count++;
+      _shard_gc(cache, other, 0.8f);
+      dt_pthread_mutex_unlock(&other->lock);
+    }
   }
 
   // here dies your 32-bit system:
@@ -225,7 +327,7 @@ restart:
   entry->key = key;
   entry->_lock_demoting = 0;
 
-  g_hash_table_insert(cache->hashtable, GINT_TO_POINTER(key), entry);
+  g_hash_table_insert(shard->hashtable, GINT_TO_POINTER(key), entry);
 
   assert(cache->allocate || entry->data_size);
 
@@ -244,12 +346,13 @@ restart:
   if(write) dt_pthread_rwlock_wrlock_with_caller(&entry->lock, file, line);
   else      dt_pthread_rwlock_rdlock_with_caller(&entry->lock, file, line);
 
-  cache->cost += entry->cost;
+  shard->cost += entry->cost;
+  __sync_fetch_and_add(&cache->cost, entry->cost);
 
   // put at end of lru list (most recently used):
-  cache->lru = g_list_concat(cache->lru, entry->link);
+  shard->lru = g_list_concat(shard->lru, entry->link);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   double end = dt_get_wtime();
   if(end - start > 0.1)
     fprintf(stderr, "wait time %.06fs\n", end - start);
@@ -265,22 +368,23 @@ int dt_cache_remove(dt_cache_t *cache, const uint32_t key)
   gboolean res;
   int result;
   dt_cache_entry_t *entry;
+  dt_cache_shard_t *shard = _cache_shard(cache, key);
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  _shard_lock(shard);
 
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   entry = (dt_cache_entry_t *)value;
   if(!res)
   { // not found in cache, not deleting.
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     return 1;
   }
   // need write lock to be able to delete:
   result = dt_pthread_rwlock_trywrlock(&entry->lock);
   if(result)
   {
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     g_usleep(5);
     goto restart;
   }
@@ -289,15 +393,15 @@ restart:
   {
     // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
     dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     g_usleep(5);
     goto restart;
   }
 
-  gboolean removed = g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(key));
+  gboolean removed = g_hash_table_remove(shard->hashtable, GINT_TO_POINTER(key));
   (void)removed; // make non-assert compile happy
   assert(removed);
-  cache->lru = g_list_delete_link(cache->lru, entry->link);
+  shard->lru = g_list_delete_link(shard->lru, entry->link);
 
   if(cache->cleanup)
   {
@@ -311,55 +415,40 @@ restart:
 
   dt_pthread_rwlock_unlock(&entry->lock);
   dt_pthread_rwlock_destroy(&entry->lock);
-  cache->cost -= entry->cost;
+  shard->cost -= entry->cost;
+  __sync_fetch_and_sub(&cache->cost, entry->cost);
   g_slice_free1(sizeof(*entry), entry);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   return 0;
 }
 
-// best-effort garbage collection. never blocks, never fails. well, sometimes it just doesn't free anything.
+// best-effort garbage collection. never blocks on entries, never fails. well, sometimes it just doesn't free anything.
 void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
 {
-  GList *l = cache->lru;
-  int cnt = 0;
-  while(l)
+  for(int k = 0; k < cache->num_shards && cache->cost >= cache->cost_quota * fill_ratio; k++)
   {
-    cnt++;
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
-    assert(entry->link->data == entry);
-    l = g_list_next(l); // we might remove this element, so walk to the next one while we still have the pointer..
-    if(cache->cost < cache->cost_quota * fill_ratio) break;
-
-    // if still locked by anyone else give up:
-    if(dt_pthread_rwlock_trywrlock(&entry->lock)) continue;
-
-    if(entry->_lock_demoting)
-    {
-      // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
-      dt_pthread_rwlock_unlock(&entry->lock);
-      continue;
-    }
-
-    // delete!
-    g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(entry->key));
-    cache->lru = g_list_delete_link(cache->lru, entry->link);
-    cache->cost -= entry->cost;
-
-    if(cache->cleanup)
-    {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
-
-      cache->cleanup(cache->cleanup_data, entry);
-    }
-    else
-      dt_free_align(entry->data);
+    dt_cache_shard_t *shard = cache->shards + k;
+    _shard_lock(shard);
+    _shard_gc(cache, shard, fill_ratio);
+    dt_pthread_mutex_unlock(&shard->lock);
+  }
+}
 
-    dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
+void dt_cache_print_stats(dt_cache_t *cache, const char *name)
+{
+  uint64_t locks = 0, contended = 0;
+  size_t max_cost = 0;
+  for(int k = 0; k < cache->num_shards; k++)
+  {
+    // statistics only, read without locking
+    locks += cache->shards[k].lock_count;
+    contended += cache->shards[k].lock_contended;
+    max_cost = MAX(max_cost, cache->shards[k].cost);
   }
+  printf("[%s] %d shard(s), %" PRIu64 " locks, %" PRIu64 " contended (%.2f%%), largest shard %.2f%% of fill\n",
+         name, cache->num_shards, locks, contended, locks ? 100.0 * contended / (double)locks : 0.0,
+         cache->cost ? 100.0 * max_cost / (double)cache->cost : 0.0);
 }
 
 void dt_cache_release_with_caller(dt_cache_t *cache, dt_cache_entry_t *entry, const char *file, int line)
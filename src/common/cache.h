@@ -38,17 +38,35 @@ dt_cache_entry_t;
 typedef void((*dt_cache_allocate_t)(void *userdata, dt_cache_entry_t *entry));
 typedef void((*dt_cache_cleanup_t)(void *userdata, dt_cache_entry_t *entry));
 
-typedef struct dt_cache_t
-{
-  dt_pthread_mutex_t lock; // big fat lock. we're only expecting a couple hand full of cpu threads to use this concurrently.
+// upper bound for the number of lock stripes of one cache
+#define DT_CACHE_MAX_SHARDS 64
 
-  size_t entry_size; // cache line allocation
-  size_t cost;       // user supplied cost per cache line (bytes?)
-  size_t cost_quota; // quota to try and meet. but don't use as hard limit.
+// one lock stripe: owns the keys hashing to it, with its own lru list and cost.
+typedef struct dt_cache_shard_t
+{
+  dt_pthread_mutex_t lock; // protects hashtable, lru and cost of this shard only.
 
+  size_t cost;           // cost of the entries in this shard
   GHashTable *hashtable; // stores (key, entry) pairs
   GList *lru;            // last element is most recently used, first is about to be kicked from cache.
 
+  // lock statistics, only updated while holding the lock
+  uint64_t lock_count;     // number of times the shard lock was taken
+  uint64_t lock_contended; // number of times the lock was already held by someone else
+}
+dt_cache_shard_t;
+
+typedef struct dt_cache_t
+{
+  size_t entry_size; // cache line allocation
+  size_t cost;       // user supplied cost per cache line (bytes?), sum over all shards. updated atomically.
+  size_t cost_quota; // quota to try and meet. but don't use as hard limit. shared by all shards.
+
+  // keys are distributed over the shards by hash, so lookups of different images
+  // don't serialize on one mutex. a power of two.
+  int num_shards;
+  dt_cache_shard_t *shards;
+
   // callback functions for cache misses/garbage collection
   dt_cache_allocate_t allocate;
   dt_cache_allocate_t cleanup;
@@ -59,6 +77,9 @@ dt_cache_t;
 
 // entry size is only used if alloc callback is 0
 void dt_cache_init(dt_cache_t *cache, size_t entry_size, size_t cost_quota);
+// same, but stripe the cache into num_shards (rounded to a power of two) independently locked parts.
+// only useful if the quota is large compared to the cost of an entry, as every shard evicts on its own.
+void dt_cache_init_sharded(dt_cache_t *cache, size_t entry_size, size_t cost_quota, int num_shards);
 void dt_cache_cleanup(dt_cache_t *cache);
 
 static inline void dt_cache_set_allocate_callback(dt_cache_t *cache, dt_cache_allocate_t allocate_cb,
@@ -93,6 +114,9 @@ int32_t dt_cache_remove(dt_cache_t *cache, const uint32_t key);
 // is locked)
 void dt_cache_gc(dt_cache_t *cache, const float fill_ratio);
 
+// print lock contention statistics of all shards, prefixed by name.
+void dt_cache_print_stats(dt_cache_t *cache, const char *name);
+
 // iterate over all currently contained data blocks.
 // not thread safe! only use this for init/cleanup!
 // returns non zero the first time process() returns non zero.
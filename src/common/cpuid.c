@@ -58,6 +58,7 @@ dt_cpu_flags_t dt_detect_cpu_features()
       if(cx & 0x00080000) cpuflags |= CPU_FLAG_SSE4_2;
 
       if(cx & 0x08000000) cpuflags |= CPU_FLAG_AVX;
+      if(cx & 0x20000000) cpuflags |= CPU_FLAG_F16C;
     }
 
     /* Are there extensions? */
@@ -48,8 +48,10 @@
 #include "common/imageio_module.h"
 #include "common/iop_order.h"
 #include "common/l10n.h"
+#include "common/lcms_lut.h"
 #include "common/mipmap_cache.h"
 #include "common/noiseprofiles.h"
+#include "common/numa.h"
 #include "common/opencl.h"
 #include "common/points.h"
 #include "common/resource_limits.h"
@@ -61,6 +63,7 @@
 #include "control/signal.h"
 #include "develop/blend.h"
 #include "develop/imageop.h"
+#include "develop/pixelpipe_pool.h"
 #include "gui/gtk.h"
 #include "gui/guides.h"
 #include "gui/presets.h"
@@ -305,9 +308,13 @@ static void dt_codepaths_init()
   {
 #ifdef HAVE_BUILTIN_CPU_SUPPORTS
     darktable.codepath.SSE2 = (__builtin_cpu_supports("sse") && __builtin_cpu_supports("sse2"));
+#if defined(__x86_64__) || defined(__i386__)
+    darktable.codepath.F16C = (__builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c"));
+#endif
 #else
     dt_cpu_flags_t flags = dt_detect_cpu_features();
     darktable.codepath.SSE2 = ((flags & (CPU_FLAG_SSE)) && (flags & (CPU_FLAG_SSE2)));
+    darktable.codepath.F16C = ((flags & (CPU_FLAG_AVX)) && (flags & (CPU_FLAG_F16C)));
 #endif
   }
 
@@ -764,6 +771,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 #ifdef _OPENMP
   omp_set_num_threads(darktable.num_openmp_threads);
 #endif
+  // before any worker thread is started, they may want to be bound to a node
+  dt_numa_init();
   dt_loc_init_datadir(datadir_from_command);
   dt_loc_init_plugindir(moduledir_from_command);
   dt_loc_init_localedir(localedir_from_command);
@@ -946,6 +955,9 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   darktable.mipmap_cache = (dt_mipmap_cache_t *)calloc(1, sizeof(dt_mipmap_cache_t));
   dt_mipmap_cache_init(darktable.mipmap_cache);
 
+  // buffers of the pipes for exports and thumbnails, kept from one image to the next
+  darktable.pixelpipe_pool = dt_dev_pixelpipe_pool_new(dt_dev_pixelpipe_pool_limit(2));
+
   // The GUI must be initialized before the views, because the init()
   // functions of the views depend on darktable.control->accels_* to register
   // their keyboard accelerators
@@ -1148,12 +1160,16 @@ void dt_cleanup()
   free(darktable.image_cache);
   dt_mipmap_cache_cleanup(darktable.mipmap_cache);
   free(darktable.mipmap_cache);
+  if(darktable.unmuted & DT_DEBUG_MEMORY) dt_dev_pixelpipe_pool_print_stats(darktable.pixelpipe_pool, "shared");
+  dt_dev_pixelpipe_pool_destroy(darktable.pixelpipe_pool);
+  darktable.pixelpipe_pool = NULL;
   if(init_gui)
   {
     dt_control_cleanup(darktable.control);
     free(darktable.control);
     dt_undo_cleanup(darktable.undo);
   }
+  dt_lcms_lut_cleanup();
   dt_colorspaces_cleanup(darktable.color_profiles);
   dt_conf_cleanup(darktable.conf);
   free(darktable.conf);
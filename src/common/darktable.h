@@ -228,6 +228,7 @@ typedef enum dt_debug_thread_t
 typedef struct dt_codepath_t
 {
   unsigned int SSE2 : 1;
+  unsigned int F16C : 1; // half float conversion, only used for buffers kept in memory
   unsigned int _no_intrinsics : 1;
   unsigned int OPENMP_SIMD : 1; // always stays the last one
 } dt_codepath_t;
@@ -252,6 +253,7 @@ typedef struct darktable_t
   struct dt_gui_gtk_t *gui;
   struct dt_mipmap_cache_t *mipmap_cache;
   struct dt_image_cache_t *image_cache;
+  struct dt_dev_pixelpipe_pool_t *pixelpipe_pool;
   struct dt_bauhaus_t *bauhaus;
   const struct dt_database_t *db;
   const struct dt_pwstorage_t *pwstorage;
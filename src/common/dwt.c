@@ -18,6 +18,8 @@
 
 #include "control/control.h"
 #include "develop/imageop.h"
+#include "develop/imageop_math.h"
+#include "develop/pixelpipe_pool.h"
 #include "dwt.h"
 #if defined(__SSE__)
 #include <xmmintrin.h>
@@ -105,85 +107,65 @@ int dt_dwt_first_scale_visible(dwt_params_t *p)
   return _first_scale_visible(p->scales, p->preview_scale);
 }
 
-#define INDEX_WT_IMAGE(index, num_channels, channel) (((index) * (num_channels)) + (channel))
-#define INDEX_WT_IMAGE_SSE(index, num_channels) ((index) * (num_channels))
-
-/* code copied from UFRaw (which originates from dcraw) */
-#if defined(__SSE__)
-static void dwt_hat_transform_sse(float *temp, const float *const base, const int st, const int size, int sc,
-                                  const dwt_params_t *const p)
+/* the hat filter of UFRaw (which originates from dcraw) is 2 * b[i] + b[i - sc] + b[i + sc], mirrored at the
+ * borders. these return the mirrored positions of the two outer taps. */
+static inline int _hat_left(const int i, const int sc, const int size)
 {
-  int i;
-  const __m128 hat_mult = _mm_set1_ps(2.f);
-  __m128 valb_1, valb_2, valb_3;
-  sc = (int)(sc * p->preview_scale);
-  if(sc > size) sc = size;
-
-  for(i = 0; i < sc; i++, temp += 4)
-  {
-    valb_1 = _mm_load_ps(&base[INDEX_WT_IMAGE_SSE(st * i, p->ch)]);
-    valb_2 = _mm_load_ps(&base[INDEX_WT_IMAGE_SSE(st * (sc - i), p->ch)]);
-    valb_3 = _mm_load_ps(&base[INDEX_WT_IMAGE_SSE(st * (i + sc), p->ch)]);
-
-    _mm_store_ps(temp, _mm_add_ps(_mm_add_ps(_mm_mul_ps(hat_mult, valb_1), valb_2), valb_3));
-  }
-  for(; i + sc < size; i++, temp += 4)
-  {
-    valb_1 = _mm_load_ps(&base[INDEX_WT_IMAGE_SSE(st * i, p->ch)]);
-    valb_2 = _mm_load_ps(&base[INDEX_WT_IMAGE_SSE(st * (i - sc), p->ch)]);
-    valb_3 = _mm_load_ps(&base[INDEX_WT_IMAGE_SSE(st * (i + sc), p->ch)]);
-
-    _mm_store_ps(temp, _mm_add_ps(_mm_add_ps(_mm_mul_ps(hat_mult, valb_1), valb_2), valb_3));
-  }
-  for(; i < size; i++, temp += 4)
-  {
-    valb_1 = _mm_load_ps(&base[INDEX_WT_IMAGE_SSE(st * i, p->ch)]);
-    valb_2 = _mm_load_ps(&base[INDEX_WT_IMAGE_SSE(st * (i - sc), p->ch)]);
-    valb_3 = _mm_load_ps(&base[INDEX_WT_IMAGE_SSE(st * (2 * size - 2 - (i + sc)), p->ch)]);
+  return i < sc ? MIN(sc - i, size - 1) : i - sc;
+}
 
-    _mm_store_ps(temp, _mm_add_ps(_mm_add_ps(_mm_mul_ps(hat_mult, valb_1), valb_2), valb_3));
-  }
+static inline int _hat_right(const int i, const int sc, const int size)
+{
+  return i + sc < size ? i + sc : MAX(2 * size - 2 - (i + sc), 0);
 }
-#endif
 
-static void dwt_hat_transform(float *temp, const float *const base, const int st, const int size, int sc,
-                              dwt_params_t *const p)
+/* low pass of one scale: lpass = hat(hpass) / 16, with the separable hat filter at distance sc.
+ * runs row by row. the vertical taps of the three input rows are summed into a row buffer of the thread
+ * and the horizontal taps are taken from there, so the image is streamed once per scale instead of being
+ * walked column by column, and all inner loops run over contiguous floats whatever the number of channels. */
+static void dwt_hat_transform(float *const lpass, const float *const hpass, float *const rowbuf,
+                              const size_t rowbuf_size, const int sc, dwt_params_t *const p)
 {
-#if defined(__SSE__)
-  if(p->ch == 4 && p->use_sse)
-  {
-    dwt_hat_transform_sse(temp, base, st, size, sc, p);
-    return;
-  }
+  const int width = p->width;
+  const int height = p->height;
+  const int ch = p->ch;
+  const size_t rowsize = (size_t)width * ch;
+  const float lpass_mult = (1.f / 16.f);
+  // only the taps of the pixels left of left and right of right need to be mirrored
+  const int left = MIN(sc, width);
+  const int right = MAX(width - sc, left);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(lpass, hpass, rowbuf, rowbuf_size, sc, width, height, ch, rowsize, lpass_mult, left, right) \
+  schedule(static)
 #endif
+  for(int row = 0; row < height; row++)
+  {
+    float *const restrict v = rowbuf + rowbuf_size * dt_get_thread_num();
+    const float *const restrict b0 = hpass + rowsize * row;
+    const float *const restrict b1 = hpass + rowsize * _hat_left(row, sc, height);
+    const float *const restrict b2 = hpass + rowsize * _hat_right(row, sc, height);
+    float *const restrict out = lpass + rowsize * row;
 
-  int i, c;
-  const float hat_mult = 2.f;
-  sc = (int)(sc * p->preview_scale);
-  if(sc > size) sc = size;
+    for(size_t k = 0; k < rowsize; k++) v[k] = 2.f * b0[k] + b1[k] + b2[k];
 
-  for(i = 0; i < sc; i++)
-  {
-    for(c = 0; c < p->ch; c++, temp++)
-    {
-      *temp = hat_mult * base[INDEX_WT_IMAGE(st * i, p->ch, c)] + base[INDEX_WT_IMAGE(st * (sc - i), p->ch, c)]
-              + base[INDEX_WT_IMAGE(st * (i + sc), p->ch, c)];
-    }
-  }
-  for(; i + sc < size; i++)
-  {
-    for(c = 0; c < p->ch; c++, temp++)
+    for(int i = 0; i < left; i++)
     {
-      *temp = hat_mult * base[INDEX_WT_IMAGE(st * i, p->ch, c)] + base[INDEX_WT_IMAGE(st * (i - sc), p->ch, c)]
-              + base[INDEX_WT_IMAGE(st * (i + sc), p->ch, c)];
+      const float *const v1 = v + (size_t)_hat_left(i, sc, width) * ch;
+      const float *const v2 = v + (size_t)_hat_right(i, sc, width) * ch;
+      for(int c = 0; c < ch; c++) out[i * ch + c] = (2.f * v[i * ch + c] + v1[c] + v2[c]) * lpass_mult;
     }
-  }
-  for(; i < size; i++)
-  {
-    for(c = 0; c < p->ch; c++, temp++)
+
+    const size_t off = (size_t)sc * ch;
+    for(size_t k = (size_t)left * ch; k < (size_t)right * ch; k++)
+      out[k] = (2.f * v[k] + v[k - off] + v[k + off]) * lpass_mult;
+
+    for(int i = right; i < width; i++)
     {
-      *temp = hat_mult * base[INDEX_WT_IMAGE(st * i, p->ch, c)] + base[INDEX_WT_IMAGE(st * (i - sc), p->ch, c)]
-              + base[INDEX_WT_IMAGE(st * (2 * size - 2 - (i + sc)), p->ch, c)];
+      const float *const v1 = v + (size_t)_hat_left(i, sc, width) * ch;
+      const float *const v2 = v + (size_t)_hat_right(i, sc, width) * ch;
+      for(int c = 0; c < ch; c++) out[i * ch + c] = (2.f * v[i * ch + c] + v1[c] + v2[c]) * lpass_mult;
     }
   }
 }
@@ -232,63 +214,29 @@ static void dwt_get_image_layer(float *const layer, dwt_params_t *const p)
   if(p->image != layer) memcpy(p->image, layer, p->width * p->height * p->ch * sizeof(float));
 }
 
-#if defined(__SSE__)
-static void dwt_subtract_layer_sse(float *bl, float *bh, dwt_params_t *const p)
-{
-  const __m128 v4_lpass_mult = _mm_set1_ps((1.f / 16.f));
-  const int size = p->width * p->height * 4;
-
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(v4_lpass_mult, size) \
-  shared(bl, bh) \
-  schedule(static)
-#endif
-  for(int i = 0; i < size; i += 4)
-  {
-    // rounding errors introduced here (division by 16)
-    _mm_store_ps(&(bl[i]), _mm_mul_ps(_mm_load_ps(&(bl[i])), v4_lpass_mult));
-    _mm_store_ps(&(bh[i]), _mm_sub_ps(_mm_load_ps(&(bh[i])), _mm_load_ps(&(bl[i]))));
-  }
-}
-#endif
-
-static void dwt_subtract_layer(float *bl, float *bh, dwt_params_t *const p)
+static void dwt_subtract_layer(const float *const bl, float *const bh, dwt_params_t *const p)
 {
-#if defined(__SSE__)
-  if(p->ch == 4 && p->use_sse)
-  {
-    dwt_subtract_layer_sse(bl, bh, p);
-    return;
-  }
-#endif
-
-  const float lpass_mult = (1.f / 16.f);
-  const int size = p->width * p->height * p->ch;
+  const size_t size = (size_t)p->width * p->height * p->ch;
 
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(size, lpass_mult) \
-  shared(bl, bh) \
+#pragma omp parallel for SIMD() default(none) \
+  dt_omp_firstprivate(bl, bh, size) \
   schedule(static)
 #endif
-  for(int i = 0; i < size; i++)
-  {
-    // rounding errors introduced here (division by 16)
-    bl[i] = bl[i] * lpass_mult;
-    bh[i] -= bl[i];
-  }
+  for(size_t i = 0; i < size; i++) bh[i] -= bl[i];
 }
 
 /* actual decomposing algorithm */
 static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_func layer_func)
 {
-  float *temp = NULL;
+  float *rowbuf = NULL;
   float *layers = NULL;
   float *merged_layers = NULL;
   float *buffer[2] = { 0, 0 };
   int bcontinue = 1;
-  const int size = p->width * p->height * p->ch;
+  const size_t size = (size_t)p->width * p->height * p->ch;
+  // keep the row buffers of the threads on separate cache lines
+  const size_t rowbuf_size = ((size_t)p->width * p->ch + 15) & ~(size_t)15;
 
   if(layer_func) layer_func(img, p, 0);
 
@@ -297,41 +245,39 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
   /* image buffers */
   buffer[0] = img;
   /* temporary storage */
-  buffer[1] = dt_alloc_align(64, size * sizeof(float));
+  buffer[1] = dt_dev_pixelpipe_scratch_alloc(size * sizeof(float));
   if(buffer[1] == NULL)
   {
     printf("not enough memory for wavelet decomposition");
     goto cleanup;
   }
-  memset(buffer[1], 0, size * sizeof(float));
 
-  // setup a temp buffer
-  temp = dt_alloc_align(64, MAX(p->width, p->height) * p->ch * sizeof(float));
-  if(temp == NULL)
+  // setup the row buffers
+  rowbuf = dt_dev_pixelpipe_scratch_alloc(rowbuf_size * dt_get_num_threads() * sizeof(float));
+  if(rowbuf == NULL)
   {
     printf("not enough memory for wavelet decomposition");
     goto cleanup;
   }
-  memset(temp, 0, MAX(p->width, p->height) * p->ch * sizeof(float));
 
   // buffer to reconstruct the image
-  layers = dt_alloc_align(64, p->width * p->height * p->ch * sizeof(float));
+  layers = dt_dev_pixelpipe_scratch_alloc(size * sizeof(float));
   if(layers == NULL)
   {
     printf("not enough memory for wavelet decomposition");
     goto cleanup;
   }
-  memset(layers, 0, p->width * p->height * p->ch * sizeof(float));
+  memset(layers, 0, size * sizeof(float));
 
   if(p->merge_from_scale > 0)
   {
-    merged_layers = dt_alloc_align(64, p->width * p->height * p->ch * sizeof(float));
+    merged_layers = dt_dev_pixelpipe_scratch_alloc(size * sizeof(float));
     if(merged_layers == NULL)
     {
       printf("not enough memory for wavelet decomposition");
       goto cleanup;
     }
-    memset(merged_layers, 0, p->width * p->height * p->ch * sizeof(float));
+    memset(merged_layers, 0, size * sizeof(float));
   }
 
   // iterate over wavelet scales
@@ -340,21 +286,7 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
   {
     unsigned int lpass = (1 - (lev & 1));
 
-    for(int row = 0; row < p->height; row++)
-    {
-      dwt_hat_transform(temp, buffer[hpass] + (row * p->width * p->ch), 1, p->width, 1 << lev, p);
-      memcpy(&(buffer[lpass][row * p->width * p->ch]), temp, p->width * p->ch * sizeof(float));
-    }
-
-    for(int col = 0; col < p->width; col++)
-    {
-      dwt_hat_transform(temp, buffer[lpass] + col * p->ch, p->width, p->height, 1 << lev, p);
-      for(int row = 0; row < p->height; row++)
-      {
-        for(int c = 0; c < p->ch; c++)
-          buffer[lpass][INDEX_WT_IMAGE(row * p->width + col, p->ch, c)] = temp[INDEX_WT_IMAGE(row, p->ch, c)];
-      }
-    }
+    dwt_hat_transform(buffer[lpass], buffer[hpass], rowbuf, rowbuf_size, (int)((1 << lev) * p->preview_scale), p);
 
     dwt_subtract_layer(buffer[lpass], buffer[hpass], p);
 
@@ -435,15 +367,12 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
   }
 
 cleanup:
-  if(layers) dt_free_align(layers);
-  if(merged_layers) dt_free_align(merged_layers);
-  if(temp) dt_free_align(temp);
-  if(buffer[1]) dt_free_align(buffer[1]);
+  dt_dev_pixelpipe_scratch_free(layers);
+  dt_dev_pixelpipe_scratch_free(merged_layers);
+  dt_dev_pixelpipe_scratch_free(rowbuf);
+  dt_dev_pixelpipe_scratch_free(buffer[1]);
 }
 
-#undef INDEX_WT_IMAGE
-#undef INDEX_WT_IMAGE_SSE
-
 /* this function prepares for decomposing, which is done in the function dwt_wavelet_decompose() */
 void dwt_decompose(dwt_params_t *p, _dwt_layer_func layer_func)
 {
@@ -474,6 +403,246 @@ void dwt_decompose(dwt_params_t *p, _dwt_layer_func layer_func)
   dwt_wavelet_decompose(p->image, p, layer_func);
 }
 
+/* edge-aware a trous wavelets, see "Edge-Optimized A-Trous Wavelets for Local Contrast Enhancement with
+ * Robust Denoising" by Johannes Hanika, Holger Dammertz and Hendrik Lensch */
+
+// tiles of the eaw transform, the rows a tile needs at the largest scales still fit the l2 cache
+#define DWT_EAW_TILE_WIDTH 256
+#define DWT_EAW_TILE_HEIGHT 64
+#define DWT_EAW_MAX_MULT (1 << DWT_EAW_MAX_SCALE)
+
+static inline float _eaw_shrink(const float detail, const float threshold)
+{
+  const float absamt = MAX(0.0f, fabsf(detail) - threshold);
+  return copysignf(absamt, detail);
+}
+
+/* one tile of one scale. the tile is processed row by row in planar layout: the center pixels and the
+ * five input rows of the filter are split into one array per channel, so that the weights of all pixels
+ * of a row are computed side by side, as wide as the cpu's vector units go. the weight type is a constant
+ * in the callers below, so every weight gets its own copy of the inner loop. */
+static inline __attribute__((always_inline)) void
+_eaw_tile(float *const restrict coarse, float *const restrict detail, float *const restrict accum,
+          const float *const restrict in, const int width, const int height, const int mult,
+          const dwt_eaw_weight_t type, const float param, const float *const thrs, const float *const boost,
+          const int first, float *const sum_y2, const int x0, const int x1, const int y0, const int y1)
+{
+  static const float filter[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
+  float ctr[4][DWT_EAW_TILE_WIDTH] __attribute__((aligned(64)));
+  float sum[4][DWT_EAW_TILE_WIDTH] __attribute__((aligned(64)));
+  float wgt[4][DWT_EAW_TILE_WIDTH] __attribute__((aligned(64)));
+  float rowp[4][DWT_EAW_TILE_WIDTH + 4 * DWT_EAW_MAX_MULT] __attribute__((aligned(64)));
+  const int n = x1 - x0;
+  const int span = n + 4 * mult;
+
+  for(int j = y0; j < y1; j++)
+  {
+    const float *const restrict px = in + (size_t)4 * ((size_t)j * width + x0);
+    for(int i = 0; i < n; i++)
+      for(int c = 0; c < 4; c++) ctr[c][i] = px[4 * i + c];
+    for(int c = 0; c < 4; c++)
+      for(int i = 0; i < n; i++) sum[c][i] = wgt[c][i] = 0.0f;
+
+    for(int jj = 0; jj < 5; jj++)
+    {
+      // the part of the row the taps reach, nearest pixel at the borders of the image
+      const float *const restrict row = in + (size_t)4 * width * CLAMP(j + mult * (jj - 2), 0, height - 1);
+      for(int i = 0; i < span; i++)
+      {
+        const int x = CLAMP(x0 - 2 * mult + i, 0, width - 1);
+        for(int c = 0; c < 4; c++) rowp[c][i] = row[4 * x + c];
+      }
+      for(int ii = 0; ii < 5; ii++)
+      {
+        const float f = filter[ii] * filter[jj];
+        const float *const restrict r0 = rowp[0] + ii * mult;
+        const float *const restrict r1 = rowp[1] + ii * mult;
+        const float *const restrict r2 = rowp[2] + ii * mult;
+        const float *const restrict r3 = rowp[3] + ii * mult;
+        const float *const restrict c0 = ctr[0];
+        const float *const restrict c1 = ctr[1];
+        const float *const restrict c2 = ctr[2];
+        float *const restrict s0 = sum[0];
+        float *const restrict s1 = sum[1];
+        float *const restrict s2 = sum[2];
+        float *const restrict s3 = sum[3];
+        float *const restrict w0 = wgt[0];
+        float *const restrict w1 = wgt[1];
+        float *const restrict w2 = wgt[2];
+        float *const restrict w3 = wgt[3];
+        for(int i = 0; i < n; i++)
+        {
+          const float d0 = c0[i] - r0[i];
+          const float d1 = c1[i] - r1[i];
+          const float d2 = c2[i] - r2[i];
+          float wl, wc, wa;
+          if(type == DWT_EAW_WEIGHT_NOISE)
+          {
+            // 3d distance based on color
+            const float dot = (d0 * d0 + d1 * d1 + d2 * d2) * param;
+            const float var
+                = 0.02f; // FIXME: this should ideally depend on the image before noise stabilizing transforms!
+            const float off2 = 9.0f; // (3 sigma)^2
+            wl = wc = wa = f * fast_mexp2f(MAX(0.0f, dot * var - off2));
+          }
+          else
+          {
+            // luma and chroma weighted separately
+            wl = f * dt_fast_expf(-param * (d0 * d0));
+            wc = f * dt_fast_expf(-param * (d1 * d1 + d2 * d2));
+            wa = f;
+          }
+          s0[i] += wl * r0[i];
+          s1[i] += wc * r1[i];
+          s2[i] += wc * r2[i];
+          s3[i] += wa * r3[i];
+          w0[i] += wl;
+          w1[i] += wc;
+          w2[i] += wc;
+          w3[i] += wa;
+        }
+      }
+    }
+
+    const size_t k0 = (size_t)4 * ((size_t)j * width + x0);
+    for(int i = 0; i < n; i++)
+    {
+      const size_t k = k0 + 4 * i;
+      float d[4];
+      for(int c = 0; c < 4; c++)
+      {
+        const float s = sum[c][i] / wgt[c][i];
+        coarse[k + c] = s;
+        d[c] = in[k + c] - s;
+      }
+      if(detail)
+        for(int c = 0; c < 4; c++) detail[k + c] = d[c];
+      if(sum_y2)
+        for(int c = 0; c < 3; c++) sum_y2[c] += d[c] * d[c];
+      if(accum)
+        for(int c = 0; c < 4; c++)
+          accum[k + c] = (first ? 0.0f : accum[k + c]) + boost[c] * _eaw_shrink(d[c], thrs[c]);
+    }
+  }
+}
+
+typedef void((*_eaw_tile_t)(float *const restrict coarse, float *const restrict detail,
+                            float *const restrict accum, const float *const restrict in, const int width,
+                            const int height, const int mult, const float param, const float *const thrs,
+                            const float *const boost, const int first, float *const sum_y2, const int x0,
+                            const int x1, const int y0, const int y1));
+
+static void _eaw_tile_lab(float *const restrict coarse, float *const restrict detail, float *const restrict accum,
+                          const float *const restrict in, const int width, const int height, const int mult,
+                          const float param, const float *const thrs, const float *const boost, const int first,
+                          float *const sum_y2, const int x0, const int x1, const int y0, const int y1)
+{
+  _eaw_tile(coarse, detail, accum, in, width, height, mult, DWT_EAW_WEIGHT_LAB, param, thrs, boost, first, sum_y2,
+            x0, x1, y0, y1);
+}
+
+static void _eaw_tile_noise(float *const restrict coarse, float *const restrict detail,
+                            float *const restrict accum, const float *const restrict in, const int width,
+                            const int height, const int mult, const float param, const float *const thrs,
+                            const float *const boost, const int first, float *const sum_y2, const int x0,
+                            const int x1, const int y0, const int y1)
+{
+  _eaw_tile(coarse, detail, accum, in, width, height, mult, DWT_EAW_WEIGHT_NOISE, param, thrs, boost, first,
+            sum_y2, x0, x1, y0, y1);
+}
+
+static void _eaw_decompose(float *const coarse, float *const detail, float *const accum, const float *const in,
+                           const int width, const int height, const int scale, const dwt_eaw_weight_t type,
+                           const float param, const float *const thrs, const float *const boost, const int first,
+                           float *const sum_y2)
+{
+  const int mult = 1 << MIN(scale, DWT_EAW_MAX_SCALE);
+  const _eaw_tile_t tile = type == DWT_EAW_WEIGHT_NOISE ? _eaw_tile_noise : _eaw_tile_lab;
+  const int tiles_x = (width + DWT_EAW_TILE_WIDTH - 1) / DWT_EAW_TILE_WIDTH;
+  const int tiles_y = (height + DWT_EAW_TILE_HEIGHT - 1) / DWT_EAW_TILE_HEIGHT;
+  const int tiles = tiles_x * tiles_y;
+  const int stats = sum_y2 != NULL;
+  double y2_0 = 0.0, y2_1 = 0.0, y2_2 = 0.0;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(coarse, detail, accum, in, width, height, mult, tile, param, thrs, boost, first, \
+                      tiles_y, tiles, stats) \
+  reduction(+ : y2_0, y2_1, y2_2) \
+  schedule(static)
+#endif
+  for(int t = 0; t < tiles; t++)
+  {
+    // the tiles go down one column of tiles after the other, so that the tiles following each other on one
+    // thread share most of their input rows
+    const int tx = t / tiles_y;
+    const int ty = t % tiles_y;
+    const int x0 = tx * DWT_EAW_TILE_WIDTH;
+    const int y0 = ty * DWT_EAW_TILE_HEIGHT;
+    float y2[3] = { 0.0f, 0.0f, 0.0f };
+    tile(coarse, detail, accum, in, width, height, mult, param, thrs, boost, first, stats ? y2 : NULL, x0,
+         MIN(x0 + DWT_EAW_TILE_WIDTH, width), y0, MIN(y0 + DWT_EAW_TILE_HEIGHT, height));
+    y2_0 += y2[0];
+    y2_1 += y2[1];
+    y2_2 += y2[2];
+  }
+
+  if(stats)
+  {
+    sum_y2[0] = y2_0;
+    sum_y2[1] = y2_1;
+    sum_y2[2] = y2_2;
+  }
+}
+
+void dwt_eaw_decompose(float *const coarse, float *const detail, const float *const in, const int width,
+                       const int height, const int scale, const dwt_eaw_weight_t type, const float param,
+                       float *const sum_y2)
+{
+  _eaw_decompose(coarse, detail, NULL, in, width, height, scale, type, param, NULL, NULL, 0, sum_y2);
+}
+
+void dwt_eaw_decompose_shrink(float *const coarse, float *const accum, const float *const in, const int width,
+                              const int height, const int scale, const dwt_eaw_weight_t type, const float param,
+                              const float *const thrs, const float *const boost, const int first)
+{
+  _eaw_decompose(coarse, NULL, accum, in, width, height, scale, type, param, thrs, boost, first, NULL);
+}
+
+void dwt_eaw_synthesize(float *const out, const float *const in, const float *const detail, const float *const thrs,
+                        const float *const boost, const int width, const int height)
+{
+  const float threshold[4] = { thrs[0], thrs[1], thrs[2], thrs[3] };
+  const float boostf[4] = { boost[0], boost[1], boost[2], boost[3] };
+  const size_t size = (size_t)4 * width * height;
+
+  if(in == NULL)
+  {
+#ifdef _OPENMP
+#pragma omp parallel for SIMD() default(none) \
+  dt_omp_firstprivate(boostf, detail, out, size, threshold) \
+  schedule(static) \
+  collapse(2)
+#endif
+    for(size_t k = 0; k < size; k += 4)
+      for(size_t c = 0; c < 4; c++) out[k + c] = boostf[c] * _eaw_shrink(detail[k + c], threshold[c]);
+    return;
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for SIMD() default(none) \
+  dt_omp_firstprivate(boostf, detail, in, out, size, threshold) \
+  schedule(static) \
+  collapse(2)
+#endif
+  for(size_t k = 0; k < size; k += 4)
+    for(size_t c = 0; c < 4; c++) out[k + c] = in[k + c] + boostf[c] * _eaw_shrink(detail[k + c], threshold[c]);
+}
+
+#undef DWT_EAW_TILE_WIDTH
+#undef DWT_EAW_TILE_HEIGHT
+#undef DWT_EAW_MAX_MULT
+
 #ifdef HAVE_OPENCL
 dt_dwt_cl_global_t *dt_dwt_init_cl_global()
 {
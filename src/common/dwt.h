@@ -68,6 +68,37 @@ int dt_dwt_first_scale_visible(dwt_params_t *p);
  */
 void dwt_decompose(dwt_params_t *p, _dwt_layer_func layer_func);
 
+/* largest scale of the edge-aware a trous transform, the filter then spans 4 * 256 + 1 pixels */
+#define DWT_EAW_MAX_SCALE 8
+
+/* weights of the edge-aware a trous transform */
+typedef enum dwt_eaw_weight_t
+{
+  DWT_EAW_WEIGHT_LAB = 0,  // separate luma and chroma weights exp(-param * d^2) on Lab
+  DWT_EAW_WEIGHT_NOISE = 1 // one weight from the color distance, param is 1/sigma^2 of the noise in the band
+} dwt_eaw_weight_t;
+
+/* one scale of the edge-aware a trous transform of a 4 channel image, cache blocked and run in parallel
+ * coarse: receives the low pass of in with the 5x5 filter spread by 2^scale, scale <= DWT_EAW_MAX_SCALE
+ * detail: receives in - coarse
+ * sum_y2: if not NULL, receives the sums of the squared details of the first three channels
+ */
+void dwt_eaw_decompose(float *const coarse, float *const detail, const float *const in, const int width,
+                       const int height, const int scale, const dwt_eaw_weight_t type, const float param,
+                       float *const sum_y2);
+
+/* like dwt_eaw_decompose() for thresholds known up front: instead of being stored the details are shrunk
+ * right away and added to accum, which is overwritten for the first scale. the image is then the coarsest
+ * scale plus accum, and no detail buffers are needed. */
+void dwt_eaw_decompose_shrink(float *const coarse, float *const accum, const float *const in, const int width,
+                              const int height, const int scale, const dwt_eaw_weight_t type, const float param,
+                              const float *const thrs, const float *const boost, const int first);
+
+/* out = in + boost * shrink(detail, thrs), with soft thresholding. in may be NULL for zero, out may be in or
+ * detail. zero thresholds and unit boost give the plain sum. */
+void dwt_eaw_synthesize(float *const out, const float *const in, const float *const detail, const float *const thrs,
+                        const float *const boost, const int width, const int height);
+
 #ifdef HAVE_OPENCL
 typedef struct dt_dwt_cl_global_t
 {
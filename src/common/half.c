@@ -0,0 +1,179 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/half.h"
+#include "common/darktable.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DT_HALF_F16C
+#include <immintrin.h>
+#endif
+
+// values converted by one thread in one go
+#define DT_HALF_CHUNK 65536
+
+#define DT_HALF_MAX 65504.0f
+
+typedef union _half_bits_t
+{
+  float f;
+  uint32_t u;
+} _half_bits_t;
+
+// round to nearest even, after f. giesen's float_to_half_fast3_rtne
+static inline uint16_t _float_to_half(const float f)
+{
+  _half_bits_t v = { .f = f };
+  const uint32_t sign = (v.u >> 16) & 0x8000u;
+  v.u &= 0x7fffffffu;
+  uint16_t h;
+  if(v.u > 0x7f800000u)
+    h = 0x7e00; // nan
+  else if(v.u >= 0x477ff000u)
+    h = 0x7bff; // rounds beyond the largest half, saturate
+  else if(v.u < 0x38800000u)
+  {
+    // subnormal or zero, let the fpu round by adding 0.5
+    const _half_bits_t magic = { .u = 126u << 23 };
+    v.f += magic.f;
+    h = (uint16_t)(v.u - magic.u);
+  }
+  else
+  {
+    const uint32_t odd = (v.u >> 13) & 1u;
+    v.u += ((uint32_t)(15 - 127) << 23) + 0xfffu + odd;
+    h = (uint16_t)(v.u >> 13);
+  }
+  return h | (uint16_t)sign;
+}
+
+static inline float _half_to_float(const uint16_t h)
+{
+  const uint32_t shifted_exp = 0x7c00u << 13;
+  _half_bits_t v = { .u = ((uint32_t)h & 0x7fffu) << 13 };
+  const uint32_t exp = shifted_exp & v.u;
+  v.u += (uint32_t)(127 - 15) << 23;
+  if(exp == shifted_exp)
+    v.u += (uint32_t)(128 - 16) << 23; // inf or nan
+  else if(exp == 0)
+  {
+    // subnormal, renormalize
+    const _half_bits_t magic = { .u = 113u << 23 };
+    v.u += 1u << 23;
+    v.f -= magic.f;
+  }
+  v.u |= ((uint32_t)h & 0x8000u) << 16;
+  return v.f;
+}
+
+static void _from_float_plain(const float *const in, uint16_t *const out, const size_t n)
+{
+  for(size_t k = 0; k < n; k++) out[k] = _float_to_half(in[k]);
+}
+
+static void _to_float_plain(const uint16_t *const in, float *const out, const size_t n)
+{
+  for(size_t k = 0; k < n; k++) out[k] = _half_to_float(in[k]);
+}
+
+#ifdef DT_HALF_F16C
+__attribute__((target("avx,f16c")))
+static void _from_float_f16c(const float *const in, uint16_t *const out, const size_t n)
+{
+  const __m256 max = _mm256_set1_ps(DT_HALF_MAX);
+  const __m256 min = _mm256_set1_ps(-DT_HALF_MAX);
+  size_t k = 0;
+  for(; k + 8 <= n; k += 8)
+  {
+    const __m256 v = _mm256_loadu_ps(in + k);
+    // clamp everything but nan, which fails the comparison and is kept
+    const __m256 c = _mm256_blendv_ps(_mm256_max_ps(_mm256_min_ps(v, max), min), v, _mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+    _mm_storeu_si128((__m128i *)(out + k), _mm256_cvtps_ph(c, _MM_FROUND_TO_NEAREST_INT));
+  }
+  _from_float_plain(in + k, out + k, n - k);
+}
+
+__attribute__((target("avx,f16c")))
+static void _to_float_f16c(const uint16_t *const in, float *const out, const size_t n)
+{
+  size_t k = 0;
+  for(; k + 8 <= n; k += 8)
+    _mm256_storeu_ps(out + k, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(in + k))));
+  _to_float_plain(in + k, out + k, n - k);
+}
+#endif
+
+void dt_half_from_float(const float *const in, uint16_t *const out, const size_t n)
+{
+#ifdef DT_HALF_F16C
+  const int f16c = darktable.codepath.F16C;
+#else
+  const int f16c = 0;
+#endif
+  const size_t chunks = (n + DT_HALF_CHUNK - 1) / DT_HALF_CHUNK;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, out, n, chunks, f16c) \
+  schedule(static)
+#endif
+  for(size_t c = 0; c < chunks; c++)
+  {
+    const size_t start = c * DT_HALF_CHUNK;
+    const size_t len = MIN(n - start, (size_t)DT_HALF_CHUNK);
+#ifdef DT_HALF_F16C
+    if(f16c)
+    {
+      _from_float_f16c(in + start, out + start, len);
+      continue;
+    }
+#endif
+    _from_float_plain(in + start, out + start, len);
+  }
+}
+
+void dt_half_to_float(const uint16_t *const in, float *const out, const size_t n)
+{
+#ifdef DT_HALF_F16C
+  const int f16c = darktable.codepath.F16C;
+#else
+  const int f16c = 0;
+#endif
+  const size_t chunks = (n + DT_HALF_CHUNK - 1) / DT_HALF_CHUNK;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, out, n, chunks, f16c) \
+  schedule(static)
+#endif
+  for(size_t c = 0; c < chunks; c++)
+  {
+    const size_t start = c * DT_HALF_CHUNK;
+    const size_t len = MIN(n - start, (size_t)DT_HALF_CHUNK);
+#ifdef DT_HALF_F16C
+    if(f16c)
+    {
+      _to_float_f16c(in + start, out + start, len);
+      continue;
+    }
+#endif
+    _to_float_plain(in + start, out + start, len);
+  }
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,36 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * conversion between float and ieee 754 half floats (binary16) for buffers that only need to be kept, not
+ * processed. runs in parallel and uses the f16c instructions if the cpu has them.
+ */
+
+/** packs n floats, rounding to nearest even. values beyond the half range saturate at +-65504. */
+void dt_half_from_float(const float *const in, uint16_t *const out, const size_t n);
+/** unpacks n half floats. */
+void dt_half_to_float(const uint16_t *const in, float *const out, const size_t n);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
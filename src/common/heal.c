@@ -19,9 +19,6 @@
 #include "control/control.h"
 #include "develop/imageop.h"
 #include "heal.h"
-#if defined(__SSE__)
-#include <xmmintrin.h>
-#endif
 
 /* Based on the original source code of GIMP's Healing Tool, by Jean-Yves Couleaud
  *
@@ -36,9 +33,10 @@
  * but subtract them I2 = I0 - I1, where I0 is the sample image to be
  * corrected, I1 is the reference pattern. Then we solve DeltaI=0
  * (Laplace) with I2 Dirichlet conditions at the borders of the
- * mask. The solver is a red/black checker Gauss-Seidel with over-relaxation.
- * It could benefit from a multi-grid evaluation of an initial solution
- * before the main iteration loop.
+ * mask. The solver is a multigrid one: a full multigrid pass gives the
+ * initial solution, then V-cycles with red/black checker Gauss-Seidel
+ * smoothing run until convergence, so the cost grows about linearly
+ * with the size of the healed area.
  *
  * I reduced the convergence criteria to 0.1% (0.001) as we are
  * dealing here with RGB integer components, more is overkill.
@@ -77,189 +75,317 @@ static void dt_heal_add(const float *const first_buffer, const float *const seco
   for(int i = 0; i < i_size; i++) result_buffer[i] = first_buffer[i] + second_buffer[i];
 }
 
-#if defined(__SSE__)
-static float dt_heal_laplace_iteration_sse(float *pixels, const float *const Adiag, const int *const Aidx,
-                                           const float w, const int nmask_from, const int nmask_to)
+/* one level of the multigrid hierarchy. level 0 works on the difference image itself, coarser
+ * levels on 2x2 reduced copies. u holds the (partial) solution including the fixed values around
+ * the mask, f the right hand side (NULL for a zero one), mask the unknowns. span holds the first and
+ * one past the last unknown column of every row, so sweeps only cover the masked part.
+ */
+typedef struct dt_heal_level_t
+{
+  int width, height;
+  uint8_t *mask;
+  int *span;
+  float *u;
+  float *f;
+} dt_heal_level_t;
+
+#define HEAL_MAX_LEVELS 16
+
+static void dt_heal_spans(const dt_heal_level_t *const l)
 {
-  float err = 0.f;
+  for(int i = 0; i < l->height; i++)
+  {
+    const uint8_t *const row = l->mask + (size_t)i * l->width;
+    int from = 0, to = l->width;
+    while(from < to && !row[from]) from++;
+    while(to > from && !row[to - 1]) to--;
+    l->span[2 * i] = from;
+    l->span[2 * i + 1] = to;
+  }
+}
 
+// red/black Gauss-Seidel sweeps on the unknowns of a level. neighbours off the canvas are left out
+// of the stencil, the same Neumann condition the single grid solver used.
+static void dt_heal_smooth(const dt_heal_level_t *const l, const int ch, const int sweeps)
+{
+  const int width = l->width;
+  const int height = l->height;
+  const uint8_t *const mask = l->mask;
+  const int *const span = l->span;
+  const float *const f = l->f;
+  float *const u = l->u;
+  const int ch1 = (ch == 4) ? ch - 1 : ch;
+
+  for(int s = 0; s < sweeps; s++)
+    for(int parity = 0; parity < 2; parity++)
+    {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(Adiag, Aidx, w, nmask_from, nmask_to) \
-  shared(pixels) \
-  schedule(static) \
-  reduction(+ : err)
+      dt_omp_firstprivate(ch, ch1, f, height, mask, parity, span, u, width) \
+      schedule(static)
 #endif
-  for(int i = nmask_from; i < nmask_to; i++)
+      for(int i = 0; i < height; i++)
+      {
+        const int from = span[2 * i] + ((span[2 * i] ^ i ^ parity) & 1);
+        for(int j = from; j < span[2 * i + 1]; j += 2)
+        {
+          const size_t idx = (size_t)i * width + j;
+          if(!mask[idx]) continue;
+          const float a = 4 - (i == 0) - (j == 0) - (i == height - 1) - (j == width - 1);
+          for(int k = 0; k < ch1; k++)
+          {
+            float sum = f ? f[idx * ch + k] : 0.0f;
+            if(j > 0) sum += u[(idx - 1) * ch + k];
+            if(j < width - 1) sum += u[(idx + 1) * ch + k];
+            if(i > 0) sum += u[(idx - width) * ch + k];
+            if(i < height - 1) sum += u[(idx + width) * ch + k];
+            u[idx * ch + k] = sum / a;
+          }
+        }
+      }
+    }
+}
+
+// residual of a level. if coarse is given, it is summed over 2x2 blocks into the coarse right hand side
+// and the coarse correction is reset to zero. returns the sum of squared residuals.
+static float dt_heal_residual(const dt_heal_level_t *const l, const dt_heal_level_t *const coarse, const int ch)
+{
+  const int width = l->width;
+  const int height = l->height;
+  const uint8_t *const mask = l->mask;
+  const int *const span = l->span;
+  const float *const f = l->f;
+  const float *const u = l->u;
+  const int ch1 = (ch == 4) ? ch - 1 : ch;
+  const int cwidth = coarse ? coarse->width : 0;
+  float *const cf = coarse ? coarse->f : NULL;
+  float err = 0.0f;
+
+  if(coarse)
   {
-    int ii = i * 5;
-    int j0 = Aidx[ii + 0];
-    int j1 = Aidx[ii + 1];
-    int j2 = Aidx[ii + 2];
-    int j3 = Aidx[ii + 3];
-    int j4 = Aidx[ii + 4];
-
-    __m128 valb_a = _mm_set1_ps(Adiag[i]);
-    __m128 valb_w = { w, w, w, w };
-
-    __m128 valb_j0 = _mm_load_ps(pixels + j0); // center
-    __m128 valb_j1 = _mm_load_ps(pixels + j1); // E
-    __m128 valb_j2 = _mm_load_ps(pixels + j2); // S
-    __m128 valb_j3 = _mm_load_ps(pixels + j3); // W
-    __m128 valb_j4 = _mm_load_ps(pixels + j4); // N
-
-    /*  float diff = w * (a * pixels[j0 + k] -
-                            (pixels[j1 + k] +
-                             pixels[j2 + k] +
-                             pixels[j3 + k] +
-                             pixels[j4 + k]));*/
-    __m128 valb_diff
-        = _mm_mul_ps(valb_w, _mm_sub_ps(_mm_mul_ps(valb_a, valb_j0),
-                                        _mm_add_ps(valb_j1, _mm_add_ps(valb_j2, _mm_add_ps(valb_j3, valb_j4)))));
-
-    /*  pixels[j0 + k] -= diff;*/
-    _mm_store_ps(pixels + j0, _mm_sub_ps(valb_j0, valb_diff));
-    /*  err += diff * diff;*/
-    union {
-      __m128 v;
-      float f[4];
-    } valb_err;
-    valb_err.v = _mm_mul_ps(valb_diff, valb_diff);
-    err += valb_err.f[0] + valb_err.f[1] + valb_err.f[2];
+    memset(coarse->f, 0, sizeof(float) * ch * coarse->width * coarse->height);
+    memset(coarse->u, 0, sizeof(float) * ch * coarse->width * coarse->height);
   }
 
+  // rows are processed in pairs so that every coarse cell is written by one thread only
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(cf, ch, ch1, cwidth, f, height, mask, span, u, width) \
+  schedule(static) \
+  reduction(+ : err)
+#endif
+  for(int i2 = 0; i2 < height; i2 += 2)
+    for(int i = i2; i < MIN(i2 + 2, height); i++)
+      for(int j = span[2 * i]; j < span[2 * i + 1]; j++)
+      {
+        const size_t idx = (size_t)i * width + j;
+        if(!mask[idx]) continue;
+        const float a = 4 - (i == 0) - (j == 0) - (i == height - 1) - (j == width - 1);
+        for(int k = 0; k < ch1; k++)
+        {
+          float r = (f ? f[idx * ch + k] : 0.0f) - a * u[idx * ch + k];
+          if(j > 0) r += u[(idx - 1) * ch + k];
+          if(j < width - 1) r += u[(idx + 1) * ch + k];
+          if(i > 0) r += u[(idx - width) * ch + k];
+          if(i < height - 1) r += u[(idx + width) * ch + k];
+          err += r * r;
+          if(cf) cf[((size_t)(i / 2) * cwidth + j / 2) * ch + k] += r;
+        }
+      }
+
   return err;
 }
-#endif
 
-// Perform one iteration of Gauss-Seidel, and return the sum squared residual.
-static float dt_heal_laplace_iteration(float *pixels, const float *const Adiag, const int *const Aidx,
-                                       const float w, const int nmask_from, const int nmask_to, const int ch,
-                                       const int use_sse)
+// bilinear interpolation of the coarse solution into the unknowns of the fine level,
+// either replacing them (initial guess) or added to them (coarse grid correction).
+static void dt_heal_prolong(const dt_heal_level_t *const coarse, const dt_heal_level_t *const l, const int ch,
+                            const int add)
 {
-#if defined(__SSE__)
-  if(ch == 4 && use_sse) return dt_heal_laplace_iteration_sse(pixels, Adiag, Aidx, w, nmask_from, nmask_to);
-#endif
-
-  float err = 0.f;
+  const int width = l->width;
+  const int height = l->height;
+  const int cwidth = coarse->width;
+  const int cheight = coarse->height;
+  const uint8_t *const mask = l->mask;
+  const int *const span = l->span;
+  const float *const cu = coarse->u;
+  float *const u = l->u;
   const int ch1 = (ch == 4) ? ch - 1 : ch;
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(Adiag, Aidx, w, nmask_from, nmask_to, ch1) \
-  shared(pixels) \
-  schedule(static) \
-  reduction(+ : err)
+  dt_omp_firstprivate(add, ch, ch1, cheight, cu, cwidth, height, mask, span, u, width) \
+  schedule(static)
 #endif
-  for(int i = nmask_from; i < nmask_to; i++)
+  for(int i = 0; i < height; i++)
   {
-    const int j0 = Aidx[i * 5 + 0];
-    const int j1 = Aidx[i * 5 + 1];
-    const int j2 = Aidx[i * 5 + 2];
-    const int j3 = Aidx[i * 5 + 3];
-    const int j4 = Aidx[i * 5 + 4];
-    const float a = Adiag[i];
-
-    for(int k = 0; k < ch1; k++)
+    const int ci = i / 2;
+    const int ci2 = CLAMPS(ci + ((i & 1) ? 1 : -1), 0, cheight - 1);
+    for(int j = span[2 * i]; j < span[2 * i + 1]; j++)
     {
-      const float diff
-          = w * (a * pixels[j0 + k] - (pixels[j1 + k] + pixels[j2 + k] + pixels[j3 + k] + pixels[j4 + k]));
-
-      pixels[j0 + k] -= diff;
-      err += diff * diff;
+      const size_t idx = (size_t)i * width + j;
+      if(!mask[idx]) continue;
+      const int cj = j / 2;
+      const int cj2 = CLAMPS(cj + ((j & 1) ? 1 : -1), 0, cwidth - 1);
+      const float *const c00 = cu + ((size_t)ci * cwidth + cj) * ch;
+      const float *const c01 = cu + ((size_t)ci * cwidth + cj2) * ch;
+      const float *const c10 = cu + ((size_t)ci2 * cwidth + cj) * ch;
+      const float *const c11 = cu + ((size_t)ci2 * cwidth + cj2) * ch;
+      for(int k = 0; k < ch1; k++)
+      {
+        const float v = 0.5625f * c00[k] + 0.1875f * (c01[k] + c10[k]) + 0.0625f * c11[k];
+        u[idx * ch + k] = add ? u[idx * ch + k] + v : v;
+      }
     }
   }
+}
 
-  return err;
+// one V-cycle on level n and below
+static void dt_heal_vcycle(const dt_heal_level_t *const levels, const int n, const int num_levels, const int ch)
+{
+  if(n == num_levels - 1)
+  {
+    // coarsest level has a handful of cells, just iterate
+    dt_heal_smooth(levels + n, ch, 32);
+    return;
+  }
+  dt_heal_smooth(levels + n, ch, 2);
+  dt_heal_residual(levels + n, levels + n + 1, ch);
+  dt_heal_vcycle(levels, n + 1, num_levels, ch);
+  dt_heal_prolong(levels + n + 1, levels + n, ch, TRUE);
+  dt_heal_smooth(levels + n, ch, 2);
 }
 
 // Solve the laplace equation for pixels and store the result in-place.
 static void dt_heal_laplace_loop(float *pixels, const int width, const int height, const int ch,
-                                 const float *const mask, const int use_sse)
+                                 const float *const mask)
 {
+  dt_heal_level_t levels[HEAL_MAX_LEVELS] = { { 0 } };
+  int num_levels = 0;
   int nmask = 0;
-  int nmask2 = 0;
 
-  float *Adiag = dt_alloc_align(64, sizeof(float) * width * height);
-  int *Aidx = dt_alloc_align(64, sizeof(int) * 5 * width * height);
+  levels[0].width = width;
+  levels[0].height = height;
+  levels[0].u = pixels;
+  levels[0].mask = dt_alloc_align(64, sizeof(uint8_t) * width * height);
+  levels[0].span = dt_alloc_align(64, sizeof(int) * 2 * height);
+  num_levels = 1;
+  if(levels[0].mask == NULL || levels[0].span == NULL) goto error;
 
-  if((Adiag == NULL) || (Aidx == NULL))
+  for(size_t k = 0; k < (size_t)width * height; k++)
   {
-    fprintf(stderr, "dt_heal_laplace_loop: error allocating memory for healing\n");
-    goto cleanup;
+    levels[0].mask[k] = mask[k] != 0.0f;
+    nmask += levels[0].mask[k];
   }
+  if(nmask == 0) goto cleanup;
+  dt_heal_spans(levels);
 
-  /* All off-diagonal elements of A are either -1 or 0. We could store it as a
-   * general-purpose sparse matrix, but that adds some unnecessary overhead to
-   * the inner loop. Instead, assume exactly 4 off-diagonal elements in each
-   * row, all of which have value -1. Any row that in fact wants less than 4
-   * coefs can put them in a dummy column to be multiplied by an empty pixel.
+  /* Build the coarse levels: a coarse cell is unknown only if all of its 2x2 fine cells are, so every
+   * level keeps fixed values around its unknowns. fixed cells get the average of their fixed fine
+   * cells as boundary values for the initial guess. a mask covering the whole canvas has no fixed
+   * values at all and is left to plain Gauss-Seidel.
    */
-  const int zero = ch * width * height;
-  memset(pixels + zero, 0, ch * sizeof(float));
-
-  /* Construct the system of equations.
-   * Arrange Aidx in checkerboard order, so that a single linear pass over that
-   * array results updating all of the red cells and then all of the black cells.
-   */
-  for(int parity = 0; parity < 2; parity++)
+  while(nmask < width * height && num_levels < HEAL_MAX_LEVELS
+        && MAX(levels[num_levels - 1].width, levels[num_levels - 1].height) > 4)
   {
-    if(parity == 1) nmask2 = nmask;
-
-    for(int i = 0; i < height; i++)
-    {
-      for(int j = (i & 1) ^ parity; j < width; j += 2)
+    const dt_heal_level_t *const fine = levels + num_levels - 1;
+    dt_heal_level_t *const l = levels + num_levels;
+    l->width = (fine->width + 1) / 2;
+    l->height = (fine->height + 1) / 2;
+    const size_t size = (size_t)l->width * l->height;
+    l->mask = dt_alloc_align(64, sizeof(uint8_t) * size);
+    l->span = dt_alloc_align(64, sizeof(int) * 2 * l->height);
+    l->u = dt_alloc_align(64, sizeof(float) * ch * size);
+    l->f = dt_alloc_align(64, sizeof(float) * ch * size);
+    num_levels++;
+    if(l->mask == NULL || l->span == NULL || l->u == NULL || l->f == NULL) goto error;
+
+    memset(l->f, 0, sizeof(float) * ch * size);
+    int cmask = 0;
+    for(int i = 0; i < l->height; i++)
+      for(int j = 0; j < l->width; j++)
       {
-        if(mask[j + i * width])
-        {
-#define A_NEIGHBOR(o, di, dj)                                                                                     \
-  if((dj < 0 && j == 0) || (dj > 0 && j == width - 1) || (di < 0 && i == 0) || (di > 0 && i == height - 1))       \
-    Aidx[o + nmask * 5] = zero;                                                                                   \
-  else                                                                                                            \
-    Aidx[o + nmask * 5] = ((i + di) * width + (j + dj)) * ch;
-
-          /* Omit Dirichlet conditions for any neighbors off the
-           * edge of the canvas.
-           */
-          Adiag[nmask] = 4 - (i == 0) - (j == 0) - (i == height - 1) - (j == width - 1);
-          A_NEIGHBOR(0, 0, 0);
-          A_NEIGHBOR(1, 0, 1);
-          A_NEIGHBOR(2, 1, 0);
-          A_NEIGHBOR(3, 0, -1);
-          A_NEIGHBOR(4, -1, 0);
-          nmask++;
-        }
+        const size_t idx = (size_t)i * l->width + j;
+        int cnt = 0;
+        float avg[4] = { 0.0f };
+        for(int fi = 2 * i; fi < MIN(2 * i + 2, fine->height); fi++)
+          for(int fj = 2 * j; fj < MIN(2 * j + 2, fine->width); fj++)
+          {
+            const size_t fidx = (size_t)fi * fine->width + fj;
+            if(fine->mask[fidx]) continue;
+            for(int k = 0; k < ch; k++) avg[k] += fine->u[fidx * ch + k];
+            cnt++;
+          }
+        l->mask[idx] = cnt == 0;
+        for(int k = 0; k < ch; k++) l->u[idx * ch + k] = cnt ? avg[k] / cnt : 0.0f;
+        cmask += l->mask[idx];
       }
+    dt_heal_spans(l);
+
+    // nothing left to solve on this level, the finer one is the coarsest
+    if(cmask == 0)
+    {
+      num_levels--;
+      dt_free_align(l->mask);
+      dt_free_align(l->span);
+      dt_free_align(l->u);
+      dt_free_align(l->f);
+      memset(l, 0, sizeof(dt_heal_level_t));
+      break;
     }
   }
 
-#undef A_NEIGHBOR
-
-  /* Empirically optimal over-relaxation factor. (Benchmarked on
-   * round brushes, at least. I don't know whether aspect ratio
-   * affects it.)
-   */
-  float w = ((2.0f - 1.0f / (0.1575f * sqrtf(nmask) + 0.8f)) * .25f);
-
-  const int max_iter = 1000;
+  const int max_cycles = 100;
   const float epsilon = (0.1 / 255);
-  const float err_exit = epsilon * epsilon * w * w;
+  const float err_exit = epsilon * epsilon;
+
+  if(num_levels == 1)
+  {
+    // too small to coarsen, plain Gauss-Seidel
+    for(int iter = 0; iter < 1000; iter++)
+    {
+      dt_heal_smooth(levels, ch, 1);
+      if(dt_heal_residual(levels, NULL, ch) < err_exit) break;
+    }
+    goto cleanup;
+  }
 
-  /* Gauss-Seidel with successive over-relaxation */
-  for(int iter = 0; iter < max_iter; iter++)
+  /* Full multigrid start: solve the coarsest level, then interpolate every solution into the next
+   * finer level as its initial guess and improve it with one V-cycle there.
+   */
+  dt_heal_smooth(levels + num_levels - 1, ch, 32);
+  for(int n = num_levels - 2; n >= 0; n--)
   {
-    // process red/black cells separate
-    float err = dt_heal_laplace_iteration(pixels, Adiag, Aidx, w, 0, nmask2, ch, use_sse);
-    err += dt_heal_laplace_iteration(pixels, Adiag, Aidx, w, nmask2, nmask, ch, use_sse);
+    dt_heal_prolong(levels + n + 1, levels + n, ch, FALSE);
+    dt_heal_vcycle(levels, n, num_levels, ch);
+  }
 
-    if(err < err_exit) break;
+  /* V-cycles on the full resolution until the residual meets the same 0.1/255 criterion
+   * the single grid solver used.
+   */
+  for(int cycle = 0; cycle < max_cycles; cycle++)
+  {
+    dt_heal_smooth(levels, ch, 2);
+    if(dt_heal_residual(levels, levels + 1, ch) < err_exit) break;
+    dt_heal_vcycle(levels, 1, num_levels, ch);
+    dt_heal_prolong(levels + 1, levels, ch, TRUE);
   }
+  goto cleanup;
+
+error:
+  fprintf(stderr, "dt_heal_laplace_loop: error allocating memory for healing\n");
 
 cleanup:
-  if(Adiag) dt_free_align(Adiag);
-  if(Aidx) dt_free_align(Aidx);
+  for(int n = 0; n < num_levels; n++)
+  {
+    if(levels[n].mask) dt_free_align(levels[n].mask);
+    if(levels[n].span) dt_free_align(levels[n].span);
+    if(n > 0 && levels[n].u) dt_free_align(levels[n].u);
+    if(levels[n].f) dt_free_align(levels[n].f);
+  }
 }
 
+#undef HEAL_MAX_LEVELS
+
 
 /* Original Algorithm Design:
  *
@@ -267,9 +393,9 @@ cleanup:
  * http://www.tgeorgiev.net/Photoshop_Healing.pdf
  */
 void dt_heal(const float *const src_buffer, float *dest_buffer, const float *const mask_buffer, const int width,
-             const int height, const int ch, const int use_sse)
+             const int height, const int ch)
 {
-  float *diff_buffer = dt_alloc_align(64, width * (height + 1) * ch * sizeof(float));
+  float *diff_buffer = dt_alloc_align(64, (size_t)width * height * ch * sizeof(float));
 
   if(diff_buffer == NULL)
   {
@@ -280,7 +406,7 @@ void dt_heal(const float *const src_buffer, float *dest_buffer, const float *con
   /* subtract pattern from image and store the result in diff */
   dt_heal_sub(dest_buffer, src_buffer, diff_buffer, width, height, ch);
 
-  dt_heal_laplace_loop(diff_buffer, width, height, ch, mask_buffer, use_sse);
+  dt_heal_laplace_loop(diff_buffer, width, height, ch, mask_buffer);
 
   /* add solution to original image and store in dest */
   dt_heal_add(diff_buffer, src_buffer, dest_buffer, width, height, ch);
@@ -368,7 +494,7 @@ cl_int dt_heal_cl(heal_params_cl_t *p, cl_mem dev_src, cl_mem dev_dest, const fl
   }
 
   // I couldn't make it run fast on opencl (the reduction takes forever), so just call the cpu version
-  dt_heal(src_buffer, dest_buffer, mask_buffer, width, height, ch, 0);
+  dt_heal(src_buffer, dest_buffer, mask_buffer, width, height, ch);
 
   err = dt_opencl_write_buffer_to_device(p->devid, dest_buffer, dev_dest, 0, width * height * ch * sizeof(float),
                                          TRUE);
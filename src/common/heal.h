@@ -23,7 +23,7 @@
  * the 3 buffers must have the same size, but mask_buffer is 1 channel and is tested for != 0.f
  */
 void dt_heal(const float *const src_buffer, float *dest_buffer, const float *const mask_buffer, const int width,
-             const int height, const int ch, const int use_sse);
+             const int height, const int ch);
 
 #ifdef HAVE_OPENCL
 
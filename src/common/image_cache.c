@@ -176,7 +176,8 @@ void dt_image_cache_init(dt_image_cache_t *cache)
   //       can we get away with a fixed size?
   const uint32_t max_mem = 50 * 1024 * 1024;
   const uint32_t num = (uint32_t)(1.5f * max_mem / sizeof(dt_image_t));
-  dt_cache_init(&cache->cache, sizeof(dt_image_t), max_mem);
+  // lookups from thumbnail and export workers are spread over several lock stripes
+  dt_cache_init_sharded(&cache->cache, sizeof(dt_image_t), max_mem, 16);
   dt_cache_set_allocate_callback(&cache->cache, &dt_image_cache_allocate, cache);
   dt_cache_set_cleanup_callback(&cache->cache, &dt_image_cache_deallocate, cache);
 
@@ -193,6 +194,7 @@ void dt_image_cache_print(dt_image_cache_t *cache)
   printf("[image cache] fill %.2f/%.2f MB (%.2f%%)\n", cache->cache.cost / (1024.0 * 1024.0),
          cache->cache.cost_quota / (1024.0 * 1024.0),
          (float)cache->cache.cost / (float)cache->cache.cost_quota);
+  dt_cache_print_stats(&cache->cache, "image cache");
 }
 
 dt_image_t *dt_image_cache_get(dt_image_cache_t *cache, const uint32_t imgid, char mode)
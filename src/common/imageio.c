@@ -613,6 +613,64 @@ int dt_imageio_export(const uint32_t imgid, const char *filename, dt_imageio_mod
                                         storage, storage_params, num, total, metadata);
 }
 
+static gboolean _export_module_is_scale_invariant(const dt_iop_module_t *module)
+{
+  if(!(module->flags() & IOP_FLAGS_SCALE_INVARIANT)) return FALSE;
+  // drawn, parametric and raster masks can be feathered or blurred, which is not point-wise
+  if(module->blend_params && (module->blend_params->mask_mode & ~DEVELOP_MASK_ENABLED)) return FALSE;
+  return TRUE;
+}
+
+/*
+ * plan where a high quality export downscales. everything after the last module which
+ * is not scale invariant can run at output size without changing the result beyond
+ * resampling precision. returns FALSE if planning is disabled (by preference or by a
+ * per-style override in plugins/lighttable/export/downscale_planning/<style>),
+ * otherwise *after is set to the module after which finalscale has to be moved, or
+ * NULL if the whole pipe after demosaic is scale invariant. *moved receives the number
+ * of enabled modules which now run at output size.
+ */
+static gboolean _export_plan_downscale(dt_develop_t *dev, const char *style, dt_iop_module_t **after,
+                                       int *moved)
+{
+  gchar *mode = NULL;
+  if(style && style[0])
+  {
+    gchar *key = g_strdup_printf("plugins/lighttable/export/downscale_planning/%s", style);
+    if(dt_conf_key_exists(key)) mode = dt_conf_get_string(key);
+    g_free(key);
+  }
+  if(!mode) mode = dt_conf_get_string("plugins/lighttable/export/downscale_planning");
+  const gboolean enabled = g_strcmp0(mode, "full resolution") != 0;
+  g_free(mode);
+
+  *after = NULL;
+  *moved = 0;
+  if(!enabled) return FALSE;
+
+  for(GList *modules = dev->iop; modules; modules = g_list_next(modules))
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    if(!strcmp(module->op, "finalscale")) break;
+    if(!module->enabled) continue;
+
+    if(!strcmp(module->op, "demosaic"))
+    {
+      // raw stage modules never see a downscaled input, they don't count
+      *after = NULL;
+      *moved = 0;
+    }
+    else if(!_export_module_is_scale_invariant(module))
+    {
+      *after = module;
+      *moved = 0;
+    }
+    else
+      (*moved)++;
+  }
+  return TRUE;
+}
+
 // internal function: to avoid exif blob reading + 8-bit byteorder flag + high-quality override
 int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
                                  dt_imageio_module_format_t *format, dt_imageio_module_data_t *format_params,
@@ -696,6 +754,21 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
 
   dt_ioppr_resync_modules_order(&dev);
 
+  // for high quality exports, move the downscale step as early as the history allows
+  dt_iop_module_t *downscale_after = NULL;
+  int downscale_moved = 0;
+  gboolean downscale_planned
+      = !thumbnail_export && high_quality
+        && _export_plan_downscale(&dev, format_params->style, &downscale_after, &downscale_moved);
+  if(downscale_planned && downscale_after)
+  {
+    // only where the module order allows it, otherwise the whole pipe runs at full resolution
+    dt_iop_module_t *finalscale = dt_iop_get_module_by_op_priority(dev.iop, "finalscale", 0);
+    if(!finalscale || !dt_ioppr_check_can_move_after_iop(dev.iop, finalscale, downscale_after)
+       || !dt_ioppr_move_iop_after(&dev, finalscale, downscale_after))
+      downscale_planned = FALSE;
+  }
+
   dt_dev_pixelpipe_set_icc(&pipe, icc_type, icc_filename, icc_intent);
   dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
   dt_dev_pixelpipe_create_nodes(&pipe, &dev);
@@ -739,12 +812,14 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     sRGB = 0;
   }
 
-  // get only once at the beginning, in case the user changes it on the way:
+  // get only once at the beginning, in case the user changes it on the way.
+  // if the planner found nothing after demosaic that depends on the resolution,
+  // downsampling right after demosaic gives the same result for less work.
   const gboolean high_quality_processing
       = ((format_params->max_width == 0 || format_params->max_width >= pipe.processed_width)
          && (format_params->max_height == 0 || format_params->max_height >= pipe.processed_height))
             ? FALSE
-            : high_quality;
+            : (high_quality && !(downscale_planned && !downscale_after));
 
 
   int width = format_params->max_width > 0 ? format_params->max_width : 0;
@@ -829,6 +904,12 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
   dt_show_times(&start, thumbnail_export ? "[dev_process_thumbnail] pixel pipeline processing"
                                          : "[dev_process_export] pixel pipeline processing");
 
+  if(downscale_planned && high_quality && scale < 1.0)
+    dt_print(DT_DEBUG_PERF,
+             "[export] downscale planned after `%s', %d module(s) processed at %.1f%% of the full resolution"
+             " pixel count\n",
+             downscale_after ? downscale_after->op : "demosaic", downscale_moved, 100.0 * scale * scale);
+
   uint8_t *outbuf = pipe.backbuf;
 
   // downconversion to low-precision formats:
@@ -32,6 +32,7 @@ extern "C" {
 #include "common/exif.h"
 #include "common/file_location.h"
 #include "common/imageio_rawspeed.h"
+#include "common/rawcache.h"
 #include "imageio.h"
 #include "common/tags.h"
 #include <stdint.h>
@@ -115,6 +116,12 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
 {
   if(!img->exif_inited) (void)dt_exif_read(img, filename);
 
+  // decoded sensor data might be on disk already, that skips decompression
+  const dt_imageio_retval_t cached = dt_rawcache_load(img, filename, mbuf);
+  if(cached == DT_IMAGEIO_OK || cached == DT_IMAGEIO_CACHE_FULL) return cached;
+
+  const double decode_start = dt_get_wtime();
+
   char filen[PATH_MAX] = { 0 };
   snprintf(filen, sizeof(filen), "%s", filename);
   FileReader f(filen);
@@ -345,6 +352,8 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
       dt_imageio_flip_buffers((char *)buf, (char *)r->getDataUncropped(0, 0), r->getBpp(), dimUncropped.x,
                               dimUncropped.y, dimUncropped.x, dimUncropped.y, r->pitch, ORIENTATION_NONE);
     }
+
+    dt_rawcache_store(img, filename, buf, dt_get_wtime() - decode_start);
   }
   catch(const std::exception &exc)
   {
@@ -22,6 +22,7 @@
 #include "common/darktable.h"
 #include "common/iop_profile.h"
 #include "common/debug.h"
+#include "common/lcms_lut.h"
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
 #include "develop/pixelpipe.h"
@@ -47,11 +48,38 @@
                       "tree-vectorize")
 #endif
 
+static void _xform_exact(const void *data, const float *in, float *out, const size_t n)
+{
+  cmsDoTransform((cmsHTRANSFORM)data, in, out, n);
+}
+
+// run xform over the image, through its baked lut if there is one
+static void _transform_image_lcms2(cmsHTRANSFORM xform, const dt_lcms_lut_t *const lut,
+                                   const float *const image_in, float *const image_out, const int width,
+                                   const int height)
+{
+  const int ch = 4;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(image_in, image_out, width, height, ch, xform, lut) \
+  schedule(static)
+#endif
+  for(int y = 0; y < height; y++)
+  {
+    const float *const in = image_in + (size_t)y * width * ch;
+    float *const out = image_out + (size_t)y * width * ch;
+
+    if(lut)
+      dt_lcms_lut_apply(lut, in, out, width, _xform_exact, xform);
+    else
+      cmsDoTransform(xform, in, out, width);
+  }
+}
+
 static void _transform_from_to_rgb_lab_lcms2(const float *const image_in, float *const image_out, const int width,
                                              const int height, const dt_colorspaces_color_profile_type_t type,
                                              const char *filename, const int intent, const int direction)
 {
-  const int ch = 4;
   cmsHTRANSFORM *xform = NULL;
   cmsHPROFILE *rgb_profile = NULL;
   cmsHPROFILE *lab_profile = NULL;
@@ -107,19 +135,14 @@ static void _transform_from_to_rgb_lab_lcms2(const float *const image_in, float
   xform = cmsCreateTransform(input_profile, input_format, output_profile, output_format, intent, 0);
   if(xform)
   {
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-    dt_omp_firstprivate(image_in, image_out, width, height, ch) \
-    shared(xform) \
-    schedule(static)
-#endif
-    for(int y = 0; y < height; y++)
-    {
-      const float *const in = image_in + y * width * ch;
-      float *const out = image_out + y * width * ch;
+    const cmsHPROFILE profiles[2] = { input_profile, output_profile };
+    gchar *key = dt_lcms_lut_key(profiles, 2, intent, direction == 1 ? "rgb to lab" : "lab to rgb");
+    dt_lcms_lut_t *lut
+        = dt_lcms_lut_get(key, direction == 1 ? DT_LCMS_LUT_RGB : DT_LCMS_LUT_LAB, _xform_exact, xform);
+    g_free(key);
 
-      cmsDoTransform(xform, in, out, width);
-    }
+    _transform_image_lcms2(xform, lut, image_in, image_out, width, height);
+    dt_lcms_lut_release(lut);
   }
   else
     fprintf(stderr, "[_transform_from_to_rgb_lab_lcms2] cannot create transform\n");
@@ -133,7 +156,6 @@ static void _transform_rgb_to_rgb_lcms2(const float *const image_in, float *cons
                                         const dt_colorspaces_color_profile_type_t type_to, const char *filename_to,
                                         const int intent)
 {
-  const int ch = 4;
   cmsHTRANSFORM *xform = NULL;
   cmsHPROFILE *from_rgb_profile = NULL;
   cmsHPROFILE *to_rgb_profile = NULL;
@@ -197,8 +219,14 @@ static void _transform_rgb_to_rgb_lcms2(const float *const image_in, float *cons
   output_profile = to_rgb_profile;
   output_format = TYPE_RGBA_FLT;
 
+  gchar *key = NULL;
   if(input_profile && output_profile)
+  {
     xform = cmsCreateTransform(input_profile, input_format, output_profile, output_format, intent, 0);
+    // display profiles can only be read under the lock
+    const cmsHPROFILE profiles[2] = { input_profile, output_profile };
+    if(xform) key = dt_lcms_lut_key(profiles, 2, intent, "rgb to rgb");
+  }
 
   if(type_from == DT_COLORSPACE_DISPLAY || type_to == DT_COLORSPACE_DISPLAY || type_from == DT_COLORSPACE_DISPLAY2
      || type_to == DT_COLORSPACE_DISPLAY2)
@@ -206,22 +234,13 @@ static void _transform_rgb_to_rgb_lcms2(const float *const image_in, float *cons
 
   if(xform)
   {
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-    dt_omp_firstprivate(image_in, image_out, width, height, ch) \
-    shared(xform) \
-    schedule(static)
-#endif
-    for(int y = 0; y < height; y++)
-    {
-      const float *const in = image_in + y * width * ch;
-      float *const out = image_out + y * width * ch;
-
-      cmsDoTransform(xform, in, out, width);
-    }
+    dt_lcms_lut_t *lut = dt_lcms_lut_get(key, DT_LCMS_LUT_RGB, _xform_exact, xform);
+    _transform_image_lcms2(xform, lut, image_in, image_out, width, height);
+    dt_lcms_lut_release(lut);
   }
   else
     fprintf(stderr, "[_transform_rgb_to_rgb_lcms2] cannot create transform\n");
+  g_free(key);
 
   if(xform) cmsDeleteTransform(xform);
 }
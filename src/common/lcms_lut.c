@@ -0,0 +1,359 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/lcms_lut.h"
+#include "common/darktable.h"
+#include "common/file_location.h"
+#include "control/conf.h"
+
+#include <glib/gstdio.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DT_LCMS_LUT_MAGIC 0xD71C3D
+#define DT_LCMS_LUT_VERSION 1
+// 65^3 nodes, 4.4MB per lut. enough to keep interpolation errors well below what lcms2 itself
+// introduces with its own 16 bit precalculated pipelines.
+#define DT_LCMS_LUT_LEVEL 65
+
+typedef struct dt_lcms_lut_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t domain;
+  uint32_t level;
+} dt_lcms_lut_header_t;
+
+static GMutex _lut_lock;
+static GHashTable *_luts = NULL;
+
+static void _lut_free(dt_lcms_lut_t *lut)
+{
+  if(!lut) return;
+  dt_free_align(lut->clut);
+  g_free(lut->key);
+  free(lut);
+}
+
+static dt_lcms_lut_t *_lut_new(const char *key, const dt_lcms_lut_domain_t domain, const int level)
+{
+  dt_lcms_lut_t *lut = (dt_lcms_lut_t *)calloc(1, sizeof(dt_lcms_lut_t));
+  if(!lut) return NULL;
+  lut->domain = domain;
+  lut->level = level;
+  lut->clut = dt_alloc_align(64, sizeof(float) * 4 * level * level * level);
+  lut->key = g_strdup(key);
+  lut->refcount = 1;
+  if(!lut->clut)
+  {
+    _lut_free(lut);
+    return NULL;
+  }
+  return lut;
+}
+
+static void _lut_filename(const char *key, char *path, size_t size)
+{
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  snprintf(path, size, "%s/lcms_lut/%s.lut", cachedir, key);
+}
+
+static gboolean _lut_read(dt_lcms_lut_t *lut)
+{
+  char path[PATH_MAX] = { 0 };
+  _lut_filename(lut->key, path, sizeof(path));
+  FILE *f = g_fopen(path, "rb");
+  if(!f) return FALSE;
+
+  const size_t nodes = (size_t)lut->level * lut->level * lut->level;
+  dt_lcms_lut_header_t header;
+  const gboolean ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == DT_LCMS_LUT_MAGIC
+                      && header.version == DT_LCMS_LUT_VERSION && header.domain == lut->domain
+                      && header.level == lut->level && fread(lut->clut, sizeof(float) * 4, nodes, f) == nodes;
+  fclose(f);
+  if(!ok) g_unlink(path);
+  return ok;
+}
+
+static void _lut_write(const dt_lcms_lut_t *lut)
+{
+  char path[PATH_MAX] = { 0 };
+  _lut_filename(lut->key, path, sizeof(path));
+  gchar *dir = g_path_get_dirname(path);
+  const int err = g_mkdir_with_parents(dir, 0750);
+  g_free(dir);
+  if(err) return;
+
+  // write to a temporary file first, a concurrent reader must never see a partial lut
+  gchar *tmp = g_strdup_printf("%s.%p", path, (void *)lut);
+  FILE *f = g_fopen(tmp, "wb");
+  if(!f)
+  {
+    g_free(tmp);
+    return;
+  }
+  const size_t nodes = (size_t)lut->level * lut->level * lut->level;
+  const dt_lcms_lut_header_t header
+      = { DT_LCMS_LUT_MAGIC, DT_LCMS_LUT_VERSION, (uint32_t)lut->domain, (uint32_t)lut->level };
+  const gboolean ok
+      = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(lut->clut, sizeof(float) * 4, nodes, f) == nodes;
+  if(fclose(f) || !ok || g_rename(tmp, path)) g_unlink(tmp);
+  g_free(tmp);
+}
+
+// value of grid node i along axis c
+static inline float _lut_node(const dt_lcms_lut_domain_t domain, const int level, const int c, const int i)
+{
+  const float x = i / (float)(level - 1);
+  if(domain == DT_LCMS_LUT_RGB) return x * x;
+  return c == 0 ? 100.0f * x : 256.0f * x - 128.0f;
+}
+
+static void _lut_bake(dt_lcms_lut_t *lut, dt_lcms_lut_exact_t exact, const void *data)
+{
+  const int level = lut->level;
+  const dt_lcms_lut_domain_t domain = lut->domain;
+  float *const clut = lut->clut;
+
+  // one plane of constant third coordinate per task, transformed in place
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(clut, level, domain, exact, data) \
+  schedule(static)
+#endif
+  for(int k = 0; k < level; k++)
+  {
+    float *const plane = clut + (size_t)4 * level * level * k;
+    for(int j = 0; j < level; j++)
+      for(int i = 0; i < level; i++)
+      {
+        float *node = plane + (size_t)4 * (j * level + i);
+        node[0] = _lut_node(domain, level, 0, i);
+        node[1] = _lut_node(domain, level, 1, j);
+        node[2] = _lut_node(domain, level, 2, k);
+        node[3] = 0.0f;
+      }
+    exact(data, plane, plane, (size_t)level * level);
+  }
+}
+
+gchar *dt_lcms_lut_key(const cmsHPROFILE *profiles, const int num_profiles, const int intent, const char *tag)
+{
+  GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA1);
+  for(int k = 0; k < num_profiles; k++)
+  {
+    cmsUInt32Number size = 0;
+    if(!profiles[k] || !cmsSaveProfileToMem(profiles[k], NULL, &size) || size == 0)
+    {
+      g_checksum_free(checksum);
+      return NULL;
+    }
+    void *blob = malloc(size);
+    if(!blob || !cmsSaveProfileToMem(profiles[k], blob, &size))
+    {
+      free(blob);
+      g_checksum_free(checksum);
+      return NULL;
+    }
+    g_checksum_update(checksum, (const guchar *)blob, size);
+    free(blob);
+  }
+  const int32_t header[3] = { intent, DT_LCMS_LUT_LEVEL, LCMS_VERSION };
+  g_checksum_update(checksum, (const guchar *)header, sizeof(header));
+  if(tag) g_checksum_update(checksum, (const guchar *)tag, -1);
+  gchar *key = g_strdup(g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+  return key;
+}
+
+dt_lcms_lut_t *dt_lcms_lut_get(const char *key, const dt_lcms_lut_domain_t domain, dt_lcms_lut_exact_t exact,
+                               const void *data)
+{
+  if(!key || !exact || !dt_conf_get_bool("lcms_lut_transforms")) return NULL;
+
+  // held over the bake as well, so concurrent pipes asking for the same transform wait instead of
+  // sampling it twice. baking takes a few ms on current machines.
+  g_mutex_lock(&_lut_lock);
+  if(!_luts) _luts = g_hash_table_new(g_str_hash, g_str_equal);
+
+  dt_lcms_lut_t *lut = (dt_lcms_lut_t *)g_hash_table_lookup(_luts, key);
+  if(lut && lut->domain == domain)
+  {
+    lut->refcount++;
+    g_mutex_unlock(&_lut_lock);
+    return lut;
+  }
+
+  lut = _lut_new(key, domain, DT_LCMS_LUT_LEVEL);
+  if(!lut)
+  {
+    g_mutex_unlock(&_lut_lock);
+    return NULL;
+  }
+
+  if(_lut_read(lut))
+    dt_print(DT_DEBUG_PERF, "[lcms_lut] loaded lut %s from disk\n", key);
+  else
+  {
+    const double start = dt_get_wtime();
+    _lut_bake(lut, exact, data);
+    _lut_write(lut);
+    dt_print(DT_DEBUG_PERF, "[lcms_lut] baked lut %s in %.3f secs\n", key, dt_get_wtime() - start);
+  }
+
+  // one reference for the table, one for the caller
+  dt_lcms_lut_t *old = (dt_lcms_lut_t *)g_hash_table_lookup(_luts, key);
+  if(old)
+  {
+    g_hash_table_remove(_luts, key);
+    if(--old->refcount == 0) _lut_free(old);
+  }
+  g_hash_table_insert(_luts, lut->key, lut);
+  lut->refcount++;
+  g_mutex_unlock(&_lut_lock);
+  return lut;
+}
+
+void dt_lcms_lut_release(dt_lcms_lut_t *lut)
+{
+  if(!lut) return;
+  g_mutex_lock(&_lut_lock);
+  if(--lut->refcount == 0) _lut_free(lut);
+  g_mutex_unlock(&_lut_lock);
+}
+
+void dt_lcms_lut_cleanup()
+{
+  g_mutex_lock(&_lut_lock);
+  if(_luts)
+  {
+    GHashTableIter it;
+    gpointer value;
+    g_hash_table_iter_init(&it, _luts);
+    while(g_hash_table_iter_next(&it, NULL, &value))
+    {
+      dt_lcms_lut_t *lut = (dt_lcms_lut_t *)value;
+      g_hash_table_iter_steal(&it);
+      if(--lut->refcount == 0) _lut_free(lut);
+    }
+    g_hash_table_destroy(_luts);
+    _luts = NULL;
+  }
+  g_mutex_unlock(&_lut_lock);
+}
+
+static inline int _lut_coords(const dt_lcms_lut_domain_t domain, const float scale, const float *const in,
+                              float *const x)
+{
+  if(domain == DT_LCMS_LUT_RGB)
+  {
+    // written so that NaN ends up outside the domain as well
+    if(!(in[0] >= 0.0f && in[0] <= 1.0f && in[1] >= 0.0f && in[1] <= 1.0f && in[2] >= 0.0f && in[2] <= 1.0f))
+      return 0;
+    for(int c = 0; c < 3; c++) x[c] = sqrtf(in[c]) * scale;
+  }
+  else
+  {
+    if(!(in[0] >= 0.0f && in[0] <= 100.0f && in[1] >= -128.0f && in[1] <= 128.0f && in[2] >= -128.0f
+         && in[2] <= 128.0f))
+      return 0;
+    x[0] = in[0] * (scale / 100.0f);
+    x[1] = (in[1] + 128.0f) * (scale / 256.0f);
+    x[2] = (in[2] + 128.0f) * (scale / 256.0f);
+  }
+  return 1;
+}
+
+static inline void _lut_tetrahedral(const float *const clut, const int level, const float *const x,
+                                    float *const out)
+{
+  const int i = MIN((int)x[0], level - 2);
+  const int j = MIN((int)x[1], level - 2);
+  const int k = MIN((int)x[2], level - 2);
+  const float fx = x[0] - i, fy = x[1] - j, fz = x[2] - k;
+
+  const size_t sx = 4, sy = (size_t)4 * level, sz = (size_t)4 * level * level;
+  const float *const c000 = clut + i * sx + j * sy + k * sz;
+  const float *const c100 = c000 + sx;
+  const float *const c010 = c000 + sy;
+  const float *const c001 = c000 + sz;
+  const float *const c110 = c100 + sy;
+  const float *const c101 = c100 + sz;
+  const float *const c011 = c010 + sz;
+  const float *const c111 = c110 + sz;
+
+  if(fx > fy)
+  {
+    if(fy > fz)
+      for(int c = 0; c < 3; c++)
+        out[c] = c000[c] + fx * (c100[c] - c000[c]) + fy * (c110[c] - c100[c]) + fz * (c111[c] - c110[c]);
+    else if(fx > fz)
+      for(int c = 0; c < 3; c++)
+        out[c] = c000[c] + fx * (c100[c] - c000[c]) + fz * (c101[c] - c100[c]) + fy * (c111[c] - c101[c]);
+    else
+      for(int c = 0; c < 3; c++)
+        out[c] = c000[c] + fz * (c001[c] - c000[c]) + fx * (c101[c] - c001[c]) + fy * (c111[c] - c101[c]);
+  }
+  else
+  {
+    if(fz > fy)
+      for(int c = 0; c < 3; c++)
+        out[c] = c000[c] + fz * (c001[c] - c000[c]) + fy * (c011[c] - c001[c]) + fx * (c111[c] - c011[c]);
+    else if(fz > fx)
+      for(int c = 0; c < 3; c++)
+        out[c] = c000[c] + fy * (c010[c] - c000[c]) + fz * (c011[c] - c010[c]) + fx * (c111[c] - c011[c]);
+    else
+      for(int c = 0; c < 3; c++)
+        out[c] = c000[c] + fy * (c010[c] - c000[c]) + fx * (c110[c] - c010[c]) + fz * (c111[c] - c110[c]);
+  }
+}
+
+void dt_lcms_lut_apply(const dt_lcms_lut_t *const lut, const float *const in, float *const out, const size_t n,
+                       dt_lcms_lut_exact_t exact, const void *data)
+{
+  const float scale = (float)(lut->level - 1);
+  // runs of pixels outside the domain are collected and sent through the exact transform in one go.
+  // their input is left untouched until then, which keeps this safe for in == out.
+  size_t run = 0;
+  for(size_t k = 0; k < n; k++)
+  {
+    float x[3];
+    if(!_lut_coords(lut->domain, scale, in + 4 * k, x))
+    {
+      run++;
+      continue;
+    }
+    if(run)
+    {
+      exact(data, in + 4 * (k - run), out + 4 * (k - run), run);
+      run = 0;
+    }
+    const float alpha = in[4 * k + 3];
+    _lut_tetrahedral(lut->clut, lut->level, x, out + 4 * k);
+    out[4 * k + 3] = alpha;
+  }
+  if(run) exact(data, in + 4 * (n - run), out + 4 * (n - run), run);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,71 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <lcms2.h>
+#include <stddef.h>
+
+/*
+ * baked 3d luts standing in for lcms2 transforms (or chains of them) that
+ * have no matrix fast path, e.g. lut based camera or display profiles.
+ * the lut is sampled once through the exact transform and then evaluated with
+ * tetrahedral interpolation. pixels outside of the sampled domain (unbounded
+ * values) are handed to the exact transform, so results stay correct there.
+ * luts are shared in memory by key and persisted in the cache directory.
+ */
+
+typedef enum dt_lcms_lut_domain_t
+{
+  DT_LCMS_LUT_RGB = 0, // rgb in [0,1], sampled on a square root grid to give the shadows more nodes
+  DT_LCMS_LUT_LAB = 1  // L in [0,100], a and b in [-128,128], sampled uniformly
+} dt_lcms_lut_domain_t;
+
+// exact transform of n rgba/Laba float pixels, in and out may alias
+typedef void (*dt_lcms_lut_exact_t)(const void *data, const float *in, float *out, const size_t n);
+
+typedef struct dt_lcms_lut_t
+{
+  dt_lcms_lut_domain_t domain;
+  int level;   // nodes per axis
+  float *clut; // level^3 nodes of 4 floats, first axis running fastest
+  gchar *key;
+  int refcount;
+} dt_lcms_lut_t;
+
+// key identifying the transform through the given chain of profiles. tag has to tell
+// apart everything else that influences the result (formats, clipping, ...). g_free() it.
+gchar *dt_lcms_lut_key(const cmsHPROFILE *profiles, const int num_profiles, const int intent, const char *tag);
+
+// returns the lut for key, from memory, from disk, or freshly sampled through exact.
+// NULL if luts are disabled in preferences or key is NULL. release with dt_lcms_lut_release().
+dt_lcms_lut_t *dt_lcms_lut_get(const char *key, const dt_lcms_lut_domain_t domain, dt_lcms_lut_exact_t exact,
+                               const void *data);
+void dt_lcms_lut_release(dt_lcms_lut_t *lut);
+
+// transform n pixels, in and out may be the same buffer. not parallel, meant to be called per row.
+void dt_lcms_lut_apply(const dt_lcms_lut_t *const lut, const float *const in, float *const out, const size_t n,
+                       dt_lcms_lut_exact_t exact, const void *data);
+
+// drop all luts held in memory, called on shutdown
+void dt_lcms_lut_cleanup();
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
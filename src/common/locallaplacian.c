@@ -18,6 +18,7 @@
 
 #include "common/darktable.h"
 #include "common/locallaplacian.h"
+#include "develop/pixelpipe_pool.h"
 
 #include <string.h>
 #include <stdint.h>
@@ -587,7 +588,7 @@ void local_laplacian_internal(
 
   // allocate pyramid pointers for padded input
   for(int l=1;l<=last_level;l++)
-    padded[l] = dt_alloc_align(64, sizeof(float)*dl(w,l)*dl(h,l));
+    padded[l] = dt_dev_pixelpipe_scratch_alloc(sizeof(float)*dl(w,l)*dl(h,l));
 
   // allocate pyramid pointers for output
   float *output[max_levels] = {0};
@@ -618,7 +619,7 @@ void local_laplacian_internal(
   // allocate memory for intermediate laplacian pyramids
   float *buf[num_gamma][max_levels] = {{0}};
   for(int k=0;k<num_gamma;k++) for(int l=0;l<=last_level;l++)
-    buf[k][l] = dt_alloc_align(64, sizeof(float)*dl(w,l)*dl(h,l));
+    buf[k][l] = dt_dev_pixelpipe_scratch_alloc(sizeof(float)*dl(w,l)*dl(h,l));
 
   // the paper says remapping only level 3 not 0 does the trick, too
   // (but i really like the additional octave of sharpness we get,
@@ -757,9 +758,10 @@ void local_laplacian_internal(
   // free all buffers except the ones passed out for preview rendering
   for(int l=0;l<max_levels;l++)
   {
-    if(!b || b->mode != 1 || l)   dt_free_align(padded[l]);
+    if(l)                         dt_dev_pixelpipe_scratch_free(padded[l]);
+    else if(!b || b->mode != 1)   dt_free_align(padded[l]);
     if(!b || b->mode != 1)        dt_free_align(output[l]);
-    for(int k=0; k<num_gamma;k++) dt_free_align(buf[k][l]);
+    for(int k=0; k<num_gamma;k++) dt_dev_pixelpipe_scratch_free(buf[k][l]);
   }
 }
 
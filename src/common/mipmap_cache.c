@@ -47,6 +47,8 @@
 #endif
 
 #if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/statvfs.h>
 #else
 //statvfs does not exist in Windows, providing implementation
@@ -61,7 +63,8 @@ typedef enum dt_mipmap_buffer_dsc_flags
 {
   DT_MIPMAP_BUFFER_DSC_FLAG_NONE = 0,
   DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE = 1 << 0,
-  DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE = 1 << 1
+  DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE = 1 << 1,
+  DT_MIPMAP_BUFFER_DSC_FLAG_MAPPED = 1 << 2 // entry->data is a private mapping of a spill file
 } dt_mipmap_buffer_dsc_flags;
 
 // the embedded Exif data to tag thumbnails as sRGB or AdobeRGB
@@ -198,6 +201,216 @@ static inline dt_mipmap_size_t get_size(const uint32_t key)
   return (dt_mipmap_size_t)(key >> 28);
 }
 
+#if !defined(_WIN32)
+#define DT_MIPMAP_SPILL_MAGIC 0xD7F5911
+
+// header of a spilled float buffer. it occupies the first page of the file,
+// the buffer descriptor and pixels follow page aligned so they can be mapped directly.
+typedef struct dt_mipmap_spill_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t imgid;
+  int64_t mtime; // of the source file, the float buffer only depends on the raw data
+  size_t size;   // bytes of descriptor and pixels following the header page
+} dt_mipmap_spill_header_t;
+
+// an evicted float buffer waiting to be written, see _spill_drain()
+typedef struct dt_mipmap_spill_pending_t
+{
+  uint32_t imgid;
+  struct dt_mipmap_buffer_dsc *dsc;
+} dt_mipmap_spill_pending_t;
+
+// spill file mapped by this thread for the allocate callback, see _spill_premap()
+static __thread void *_spill_premapped = NULL;
+static __thread size_t _spill_premapped_size = 0;
+static __thread uint32_t _spill_premapped_key = 0;
+
+static int64_t _spill_source_mtime(const uint32_t imgid)
+{
+  char filename[PATH_MAX] = { 0 };
+  gboolean from_cache = TRUE;
+  dt_image_full_path(imgid, filename, sizeof(filename), &from_cache);
+  GStatBuf st;
+  if(!*filename || g_stat(filename, &st)) return -1;
+  return (int64_t)st.st_mtime;
+}
+
+static void _spill_filename(const dt_mipmap_cache_t *cache, const uint32_t imgid, char *filename, size_t size)
+{
+  snprintf(filename, size, "%s/%" PRIu32 ".mipf", cache->spilldir, imgid);
+}
+
+// bytes a spill file counts against the quota: descriptor and pixels, without the header page. 0 if there is none.
+static size_t _spill_file_size(const char *filename)
+{
+  GStatBuf st;
+  const long page = sysconf(_SC_PAGESIZE);
+  if(g_stat(filename, &st) || st.st_size < page) return 0;
+  return (size_t)st.st_size - page;
+}
+
+static void _spill_unlink(dt_mipmap_cache_t *cache, const char *filename)
+{
+  const size_t size = _spill_file_size(filename);
+  if(!g_unlink(filename) && size) __sync_fetch_and_sub(&cache->spill_size, size);
+}
+
+static void _spill_clear(dt_mipmap_cache_t *cache, const char *spilldir)
+{
+  GDir *dir = g_dir_open(spilldir, 0, NULL);
+  if(!dir) return;
+  const gchar *name;
+  while((name = g_dir_read_name(dir)))
+  {
+    gchar *path = g_build_filename(spilldir, name, NULL);
+    g_unlink(path);
+    g_free(path);
+  }
+  g_dir_close(dir);
+  cache->spill_size = 0;
+}
+
+// write an evicted float buffer to the scratch directory. called with spill_io_lock held.
+static void _spill_write(dt_mipmap_cache_t *cache, const uint32_t imgid, const struct dt_mipmap_buffer_dsc *dsc)
+{
+  const size_t size = sizeof(*dsc) + sizeof(float) * 4 * (size_t)dsc->width * dsc->height;
+  char filename[PATH_MAX] = { 0 }, tmpname[PATH_MAX] = { 0 };
+  _spill_filename(cache, imgid, filename, sizeof(filename));
+  // a spill file of this image left from an earlier eviction gets replaced
+  const size_t replaced = _spill_file_size(filename);
+  if(cache->spill_size - replaced + size > cache->spill_quota) return;
+
+  const int64_t mtime = _spill_source_mtime(imgid);
+  if(mtime < 0) return;
+
+  const long page = sysconf(_SC_PAGESIZE);
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+
+  uint8_t *headpage = calloc(1, page);
+  if(!headpage) return;
+  FILE *f = g_fopen(tmpname, "wb");
+  if(!f)
+  {
+    free(headpage);
+    return;
+  }
+  dt_mipmap_spill_header_t *header = (dt_mipmap_spill_header_t *)headpage;
+  header->magic = DT_MIPMAP_SPILL_MAGIC;
+  header->version = DT_MIPMAP_CACHE_FILE_VERSION;
+  header->imgid = imgid;
+  header->mtime = mtime;
+  header->size = size;
+  int ok = fwrite(headpage, 1, page, f) == (size_t)page && fwrite(dsc, 1, size, f) == size;
+  free(headpage);
+  // a full disk may only show up when the buffered data is flushed
+  if(fclose(f)) ok = 0;
+
+  if(ok && !g_rename(tmpname, filename))
+  {
+    __sync_fetch_and_add(&cache->spill_size, size);
+    if(replaced) __sync_fetch_and_sub(&cache->spill_size, replaced);
+    dt_print(DT_DEBUG_CACHE, "[mipmap_cache] spilled float buffer for image %" PRIu32 " (%zu bytes)\n", imgid,
+             size);
+  }
+  else
+    g_unlink(tmpname);
+}
+
+// map a spilled float buffer back. returns the (copy on write) mapping of descriptor
+// and pixels, or NULL if there is no valid spill file for this image. called with spill_io_lock held.
+static void *_spill_map(dt_mipmap_cache_t *cache, const uint32_t imgid, size_t *size)
+{
+  char filename[PATH_MAX] = { 0 };
+  _spill_filename(cache, imgid, filename, sizeof(filename));
+  const int fd = g_open(filename, O_RDONLY, 0);
+  if(fd < 0) return NULL;
+
+  void *data = NULL;
+  dt_mipmap_spill_header_t header;
+  struct stat st;
+  const long page = sysconf(_SC_PAGESIZE);
+  // a truncated file would only fault once the pixels past its end are touched
+  if(read(fd, &header, sizeof(header)) == sizeof(header) && header.magic == DT_MIPMAP_SPILL_MAGIC
+     && header.version == DT_MIPMAP_CACHE_FILE_VERSION && header.imgid == imgid
+     && header.size >= sizeof(struct dt_mipmap_buffer_dsc) && !fstat(fd, &st) && st.st_size >= page
+     && header.size <= (size_t)(st.st_size - page) && header.mtime == _spill_source_mtime(imgid))
+  {
+    data = mmap(NULL, header.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, page);
+    if(data == MAP_FAILED) data = NULL;
+  }
+  close(fd);
+
+  if(!data)
+  {
+    // stale or broken, don't try again
+    _spill_unlink(cache, filename);
+    return NULL;
+  }
+  *size = header.size;
+  return data;
+}
+
+// hand an evicted float buffer over for writing. this runs in the cleanup callback under
+// the shard lock, so the file io is left to _spill_drain() called without it.
+static void _spill_queue(dt_mipmap_cache_t *cache, const uint32_t imgid, struct dt_mipmap_buffer_dsc *dsc)
+{
+  dt_mipmap_spill_pending_t *pending = g_slice_new(dt_mipmap_spill_pending_t);
+  pending->imgid = imgid;
+  pending->dsc = dsc;
+  dt_pthread_mutex_lock(&cache->spill_lock);
+  cache->spill_pending = g_list_prepend(cache->spill_pending, pending);
+  dt_pthread_mutex_unlock(&cache->spill_lock);
+}
+
+// write out and free the float buffers queued by evictions. must not be called with a shard lock held.
+static void _spill_drain(dt_mipmap_cache_t *cache)
+{
+  dt_pthread_mutex_lock(&cache->spill_lock);
+  GList *pending = cache->spill_pending;
+  cache->spill_pending = NULL;
+  dt_pthread_mutex_unlock(&cache->spill_lock);
+  if(!pending) return;
+
+  dt_pthread_mutex_lock(&cache->spill_io_lock);
+  for(GList *l = pending; l; l = g_list_next(l))
+  {
+    dt_mipmap_spill_pending_t *p = (dt_mipmap_spill_pending_t *)l->data;
+    if(cache->spilldir[0]) _spill_write(cache, p->imgid, p->dsc);
+    dt_free_align(p->dsc);
+    g_slice_free(dt_mipmap_spill_pending_t, p);
+  }
+  dt_pthread_mutex_unlock(&cache->spill_io_lock);
+  g_list_free(pending);
+}
+
+// map the spill file of a float buffer before asking the cache for it, so the
+// allocate callback running under the shard lock only has to pick the mapping up.
+static void _spill_premap(dt_mipmap_cache_t *cache, const uint32_t imgid)
+{
+  const uint32_t key = get_key(imgid, DT_MIPMAP_F);
+  if(!cache->spilldir[0] || dt_cache_contains(&cache->mip_f.cache, key)) return;
+
+  size_t size = 0;
+  dt_pthread_mutex_lock(&cache->spill_io_lock);
+  void *mapped = _spill_map(cache, imgid, &size);
+  dt_pthread_mutex_unlock(&cache->spill_io_lock);
+  if(!mapped) return;
+
+  _spill_premapped = mapped;
+  _spill_premapped_size = size;
+  _spill_premapped_key = key;
+}
+
+// drop a mapping the allocate callback didn't take, another thread may have inserted the entry meanwhile
+static void _spill_premap_release(void)
+{
+  if(_spill_premapped) munmap(_spill_premapped, _spill_premapped_size);
+  _spill_premapped = NULL;
+}
+#endif
+
 static int dt_mipmap_cache_get_filename(gchar *mipmapfilename, size_t size)
 {
   int r = -1;
@@ -315,6 +528,24 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
   struct dt_mipmap_buffer_dsc *dsc = entry->data;
   const dt_mipmap_size_t mip = get_size(entry->key);
 
+#if !defined(_WIN32)
+  // float buffers evicted earlier in this session are mapped back instead of regenerated,
+  // the mapping was set up by _spill_premap() before the shard got locked
+  if(!dsc && mip == DT_MIPMAP_F && _spill_premapped && _spill_premapped_key == entry->key)
+  {
+    dt_print(DT_DEBUG_CACHE, "[mipmap_cache] map float buffer for image %" PRIu32 " from spill file\n",
+             get_imgid(entry->key));
+    entry->data = _spill_premapped;
+    entry->data_size = _spill_premapped_size;
+    _spill_premapped = NULL;
+    dsc = entry->data;
+    dsc->size = entry->data_size;
+    dsc->flags = DT_MIPMAP_BUFFER_DSC_FLAG_MAPPED;
+    entry->cost = 1;
+    return;
+  }
+#endif
+
   // alloc mere minimum for the header + broken image buffer:
   if(!dsc)
   {
@@ -516,6 +747,25 @@ write_error:
       }
     }
   }
+#if !defined(_WIN32)
+  else if(mip == DT_MIPMAP_F)
+  {
+    struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+    if(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_MAPPED)
+    {
+      // the spill file is still valid, just drop the mapping
+      munmap(entry->data, entry->data_size);
+      return;
+    }
+    if(cache->spilldir[0] && dsc->width > 8 && dsc->height > 8
+       && !(dsc->flags & (DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE | DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE)))
+    {
+      // freed once written
+      _spill_queue(cache, get_imgid(entry->key), dsc);
+      return;
+    }
+  }
+#endif
   dt_free_align(entry->data);
 }
 
@@ -583,7 +833,9 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->mip_full.stats_fetches = 0;
   cache->mip_full.stats_standin = 0;
 
-  dt_cache_init(&cache->mip_thumbs.cache, 0, max_mem);
+  // the thumbnail levels see most of the concurrent traffic, stripe their lock.
+  // full and float buffers only hold a few entries each, a single shard keeps their quota exact.
+  dt_cache_init_sharded(&cache->mip_thumbs.cache, 0, max_mem, 16);
   dt_cache_set_allocate_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_allocate_dynamic, cache);
   dt_cache_set_cleanup_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_deallocate_dynamic, cache);
 
@@ -604,13 +856,47 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->buffer_size[DT_MIPMAP_F] = sizeof(struct dt_mipmap_buffer_dsc)
                                         + 4 * sizeof(float) * cache->max_width[DT_MIPMAP_F]
                                           * cache->max_height[DT_MIPMAP_F];
+
+  // optional spill tier for evicted float buffers, scratch data for this session only
+  cache->spilldir[0] = '\0';
+  cache->spill_size = 0;
+  cache->spill_pending = NULL;
+  dt_pthread_mutex_init(&cache->spill_lock, NULL);
+  dt_pthread_mutex_init(&cache->spill_io_lock, NULL);
+  cache->spill_quota = (size_t)MAX(dt_conf_get_int("cache_spill_float_size"), 0) << 20;
+#if !defined(_WIN32)
+  if(cache->cachedir[0] && dt_conf_get_bool("cache_spill_float") && cache->spill_quota > 0)
+  {
+    snprintf(cache->spilldir, sizeof(cache->spilldir), "%s.d/float-scratch", cache->cachedir);
+    if(g_mkdir_with_parents(cache->spilldir, 0750))
+      cache->spilldir[0] = '\0';
+    else
+      _spill_clear(cache, cache->spilldir); // left over from a crashed session
+  }
+#endif
 }
 
 void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
 {
+#if !defined(_WIN32)
+  // stop spilling first, the scratch directory is thrown away anyway
+  char spilldir[PATH_MAX] = { 0 };
+  g_strlcpy(spilldir, cache->spilldir, sizeof(spilldir));
+  cache->spilldir[0] = '\0';
+#endif
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+#if !defined(_WIN32)
+  _spill_drain(cache); // only frees what is still queued
+  if(spilldir[0])
+  {
+    _spill_clear(cache, spilldir);
+    g_rmdir(spilldir);
+  }
+#endif
+  dt_pthread_mutex_destroy(&cache->spill_lock);
+  dt_pthread_mutex_destroy(&cache->spill_io_lock);
 }
 
 void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
@@ -625,6 +911,9 @@ void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
   printf("[mipmap_cache] full  fill %"PRIu32"/%"PRIu32" slots (%.2f%%)\n",
          (uint32_t)cache->mip_full.cache.cost, (uint32_t)cache->mip_full.cache.cost_quota,
          100.0f * (float)cache->mip_full.cache.cost / (float)cache->mip_full.cache.cost_quota);
+  dt_cache_print_stats(&cache->mip_thumbs.cache, "mipmap_cache thumbs");
+  dt_cache_print_stats(&cache->mip_f.cache, "mipmap_cache float");
+  dt_cache_print_stats(&cache->mip_full.cache, "mipmap_cache full");
 
   uint64_t sum = 0;
   uint64_t sum_fetches = 0;
@@ -744,7 +1033,17 @@ void dt_mipmap_cache_get_with_caller(
   else if(flags == DT_MIPMAP_BLOCKING)
   {
     // simple case: blocking get
+#if !defined(_WIN32)
+    if(mip == DT_MIPMAP_F) _spill_premap(cache, imgid);
+#endif
     dt_cache_entry_t *entry =  dt_cache_get_with_caller(&_get_cache(cache, mip)->cache, key, mode, file, line);
+#if !defined(_WIN32)
+    if(mip == DT_MIPMAP_F)
+    {
+      _spill_premap_release();
+      _spill_drain(cache);
+    }
+#endif
 
     ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
 
@@ -1007,6 +1306,9 @@ void dt_mipmap_cache_evict_at_size(dt_mipmap_cache_t *cache, const uint32_t imgi
   const uint32_t key = get_key(imgid, mip);
   // write thumbnail to disc if not existing there
   dt_cache_remove(&_get_cache(cache, mip)->cache, key);
+#if !defined(_WIN32)
+  if(mip == DT_MIPMAP_F) _spill_drain(cache);
+#endif
 }
 
 void dt_mimap_cache_evict(dt_mipmap_cache_t *cache, const uint32_t imgid)
@@ -99,6 +99,14 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
+
+  // session scratch directory for evicted float buffers, empty if spilling is disabled
+  char spilldir[PATH_MAX];
+  size_t spill_quota; // bytes we may write to spilldir
+  size_t spill_size;  // bytes currently written, updated atomically
+  dt_pthread_mutex_t spill_lock;    // protects spill_pending
+  GList *spill_pending;             // evicted float buffers not yet written
+  dt_pthread_mutex_t spill_io_lock; // serializes writing and mapping spill files
 } dt_mipmap_cache_t;
 
 // dynamic memory allocation interface for imageio backend: a write locked
@@ -0,0 +1,164 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+
+#include "common/numa.h"
+#include "common/darktable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+static int _num_nodes = 1;
+static int _node_num_cpus[DT_NUMA_MAX_NODES] = { 0 };
+
+#ifdef __linux__
+
+#define DT_NUMA_SYSFS "/sys/devices/system/node"
+
+static cpu_set_t _node_cpus[DT_NUMA_MAX_NODES];
+static int8_t _cpu_node[CPU_SETSIZE] = { 0 };
+
+// parses a sysfs cpu list like "0-15,32-47"
+static void _parse_cpulist(const char *list, cpu_set_t *set)
+{
+  CPU_ZERO(set);
+  const char *p = list;
+  while(*p)
+  {
+    char *end = NULL;
+    const long first = strtol(p, &end, 10);
+    if(end == p) break;
+    long last = first;
+    p = end;
+    if(*p == '-')
+    {
+      last = strtol(p + 1, &end, 10);
+      p = end;
+    }
+    for(long c = MAX(first, 0); c <= last && c < CPU_SETSIZE; c++) CPU_SET(c, set);
+    if(*p != ',') break;
+    p++;
+  }
+}
+
+void dt_numa_init(void)
+{
+  _num_nodes = 1;
+  _node_num_cpus[0] = dt_get_num_threads();
+  memset(_cpu_node, 0, sizeof(_cpu_node));
+
+  // only count the cpus we are allowed to run on, taskset and cgroups may have taken some away
+  cpu_set_t allowed;
+  if(sched_getaffinity(0, sizeof(allowed), &allowed)) return;
+
+  GDir *dir = g_dir_open(DT_NUMA_SYSFS, 0, NULL);
+  if(!dir) return;
+
+  int found = 0;
+  const gchar *name = NULL;
+  while((name = g_dir_read_name(dir)) && found < DT_NUMA_MAX_NODES)
+  {
+    if(strncmp(name, "node", 4) || !g_ascii_isdigit(name[4])) continue;
+    gchar *path = g_build_filename(DT_NUMA_SYSFS, name, "cpulist", NULL);
+    gchar *list = NULL;
+    if(g_file_get_contents(path, &list, NULL, NULL))
+    {
+      cpu_set_t cpus;
+      _parse_cpulist(list, &cpus);
+      CPU_AND(&cpus, &cpus, &allowed);
+      // memory only nodes don't get threads
+      const int count = CPU_COUNT(&cpus);
+      if(count > 0)
+      {
+        _node_cpus[found] = cpus;
+        _node_num_cpus[found] = count;
+        for(int c = 0; c < CPU_SETSIZE; c++)
+          if(CPU_ISSET(c, &cpus)) _cpu_node[c] = found;
+        found++;
+      }
+    }
+    g_free(list);
+    g_free(path);
+  }
+  g_dir_close(dir);
+
+  if(found > 1)
+    _num_nodes = found;
+  else
+  {
+    _node_num_cpus[0] = dt_get_num_threads();
+    memset(_cpu_node, 0, sizeof(_cpu_node));
+  }
+
+  dt_print(DT_DEBUG_PERF, "[numa] %d node(s)", _num_nodes);
+  for(int n = 0; n < _num_nodes && _num_nodes > 1; n++) dt_print(DT_DEBUG_PERF, ", %d cpus", _node_num_cpus[n]);
+  dt_print(DT_DEBUG_PERF, "\n");
+}
+
+int dt_numa_current_node(void)
+{
+  if(_num_nodes <= 1) return 0;
+  const int cpu = sched_getcpu();
+  return (cpu >= 0 && cpu < CPU_SETSIZE) ? _cpu_node[cpu] : 0;
+}
+
+gboolean dt_numa_bind_thread(const int node)
+{
+  if(_num_nodes <= 1 || node < 0 || node >= _num_nodes) return FALSE;
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &_node_cpus[node]) == 0;
+}
+
+#else
+
+void dt_numa_init(void)
+{
+  _num_nodes = 1;
+  _node_num_cpus[0] = dt_get_num_threads();
+}
+
+int dt_numa_current_node(void)
+{
+  return 0;
+}
+
+gboolean dt_numa_bind_thread(const int node)
+{
+  return FALSE;
+}
+
+#endif
+
+int dt_numa_num_nodes(void)
+{
+  return _num_nodes;
+}
+
+int dt_numa_node_num_cpus(const int node)
+{
+  return (node >= 0 && node < _num_nodes) ? _node_num_cpus[node] : _node_num_cpus[0];
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,43 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+
+/**
+ * numa topology of the host, as far as darktable cares: the nodes having cpus we may run on and the cpus
+ * belonging to each of them. read from sysfs on linux, everything else is treated as a single node.
+ */
+
+#define DT_NUMA_MAX_NODES 8
+
+/** reads the topology, call once at startup before any worker thread is created. */
+void dt_numa_init(void);
+/** number of nodes with usable cpus, 1 on uma machines. */
+int dt_numa_num_nodes(void);
+/** number of usable cpus on node. */
+int dt_numa_node_num_cpus(const int node);
+/** node of the cpu the calling thread runs on right now. */
+int dt_numa_current_node(void);
+/** restricts the calling thread, and the openmp threads it starts from now on, to the cpus of node. */
+gboolean dt_numa_bind_thread(const int node);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
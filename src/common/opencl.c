@@ -46,8 +46,12 @@
 #include <errno.h>
 #include <libgen.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <zlib.h>
 
+// pipe types in the order of dt_opencl_t.mandatory[]
+static const char *_opencl_pipe_names[5] = { "full", "preview", "export", "thumbnail", "preview2" };
+
 static const char *dt_opencl_get_vendor_by_id(unsigned int id);
 static float dt_opencl_benchmark_gpu(const int devid, const size_t width, const size_t height, const int count, const float sigma);
 static float dt_opencl_benchmark_cpu(const size_t width, const size_t height, const int count, const float sigma);
@@ -350,7 +354,9 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
     printf("     DEVICE_VERSION:           %s\n", deviceversion);
   }
 
-  dt_pthread_mutex_init(&cl->dev[dev].lock, NULL);
+  cl->dev[dev].in_use = 0;
+  cl->dev[dev].gpu_cost = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+  cl->dev[dev].transfer_cost = 0.0f;
 
   cl->dev[dev].context = (cl->dlocl->symbols->dt_clCreateContext)(0, 1, &devid, NULL, NULL, &err);
   if(err != CL_SUCCESS)
@@ -528,6 +534,12 @@ void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboole
 {
   char *str;
   dt_pthread_mutex_init(&cl->lock, NULL);
+  dt_pthread_mutex_init(&cl->dev_lock, NULL);
+  cl->dev_waiters = NULL;
+  cl->dev_ticket = 0;
+  memset(cl->dev_wait, 0, sizeof(cl->dev_wait));
+  dt_pthread_mutex_init(&cl->cost_lock, NULL);
+  cl->cpu_cost = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
   cl->inited = 0;
   cl->enabled = 0;
   cl->stopped = 0;
@@ -671,7 +683,7 @@ void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboole
   cl_device_id *devices = 0;
   if(num_devices)
   {
-    cl->dev = (dt_opencl_device_t *)malloc(sizeof(dt_opencl_device_t) * num_devices);
+    cl->dev = (dt_opencl_device_t *)calloc(num_devices, sizeof(dt_opencl_device_t));
     devices = (cl_device_id *)malloc(sizeof(cl_device_id) * num_devices);
     if(!cl->dev || !devices)
     {
@@ -822,13 +834,13 @@ finally:
   {
     for(int i = 0; cl->dev && i < cl->num_devs; i++)
     {
-      dt_pthread_mutex_destroy(&cl->dev[i].lock);
       for(int k = 0; k < DT_OPENCL_MAX_KERNELS; k++)
         if(cl->dev[i].kernel_used[k]) (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[i].kernel[k]);
       for(int k = 0; k < DT_OPENCL_MAX_PROGRAMS; k++)
         if(cl->dev[i].program_used[k]) (cl->dlocl->symbols->dt_clReleaseProgram)(cl->dev[i].program[k]);
       (cl->dlocl->symbols->dt_clReleaseCommandQueue)(cl->dev[i].cmd_queue);
       (cl->dlocl->symbols->dt_clReleaseContext)(cl->dev[i].context);
+      if(cl->dev[i].gpu_cost) g_hash_table_destroy(cl->dev[i].gpu_cost);
       if(cl->use_events)
       {
         dt_opencl_events_reset(i);
@@ -868,13 +880,13 @@ void dt_opencl_cleanup(dt_opencl_t *cl)
 
     for(int i = 0; i < cl->num_devs; i++)
     {
-      dt_pthread_mutex_destroy(&cl->dev[i].lock);
       for(int k = 0; k < DT_OPENCL_MAX_KERNELS; k++)
         if(cl->dev[i].kernel_used[k]) (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[i].kernel[k]);
       for(int k = 0; k < DT_OPENCL_MAX_PROGRAMS; k++)
         if(cl->dev[i].program_used[k]) (cl->dlocl->symbols->dt_clReleaseProgram)(cl->dev[i].program[k]);
       (cl->dlocl->symbols->dt_clReleaseCommandQueue)(cl->dev[i].cmd_queue);
       (cl->dlocl->symbols->dt_clReleaseContext)(cl->dev[i].context);
+      if(cl->dev[i].gpu_cost) g_hash_table_destroy(cl->dev[i].gpu_cost);
 
       if(cl->print_statistics && (darktable.unmuted & DT_DEBUG_MEMORY))
       {
@@ -924,7 +936,24 @@ void dt_opencl_cleanup(dt_opencl_t *cl)
     free(cl->dlocl);
   }
 
+  if(cl->print_statistics)
+  {
+    for(int k = 0; k < 5; k++)
+    {
+      const dt_opencl_wait_stats_t *w = &cl->dev_wait[k];
+      if(!w->requests) continue;
+      dt_print(DT_DEBUG_OPENCL, "[opencl_summary_statistics] %s pipe: %d device requests, %d waited "
+                                "(%.3f ms average, %.3f ms max), %d fell back to cpu\n",
+               _opencl_pipe_names[k], w->requests, w->waited, w->waited ? 1000.0 * w->total / w->waited : 0.0,
+               1000.0 * w->max, w->timeouts);
+    }
+  }
+
   free(cl->dev);
+  g_list_free(cl->dev_waiters);
+  g_hash_table_destroy(cl->cpu_cost);
+  dt_pthread_mutex_destroy(&cl->cost_lock);
+  dt_pthread_mutex_destroy(&cl->dev_lock);
   dt_pthread_mutex_destroy(&cl->lock);
 }
 
@@ -1387,6 +1416,55 @@ static void dt_opencl_update_priorities(const char *configstr)
              cl->mandatory[1], cl->mandatory[2], cl->mandatory[3], cl->mandatory[4]);
 }
 
+/** a pipe waiting for a device, queued in dt_opencl_t.dev_waiters */
+typedef struct _opencl_waiter_t
+{
+  const int *priority; // devices acceptable for this pipe, -1 terminated
+  int rank;            // pipes of lower rank are served first
+  uint64_t ticket;     // then in order of arrival
+  int devid;           // handed over by dt_opencl_unlock_device()
+  pthread_cond_t cond;
+} _opencl_waiter_t;
+
+static gint _opencl_waiter_cmp(gconstpointer a, gconstpointer b)
+{
+  const _opencl_waiter_t *wa = (const _opencl_waiter_t *)a;
+  const _opencl_waiter_t *wb = (const _opencl_waiter_t *)b;
+  if(wa->rank != wb->rank) return wa->rank - wb->rank;
+  return (wa->ticket > wb->ticket) - (wa->ticket < wb->ticket);
+}
+
+// interactive pipes come first, then exports, thumbnails last
+static int _opencl_pipe_rank(const int pipetype)
+{
+  switch(pipetype)
+  {
+    case DT_DEV_PIXELPIPE_FULL:
+      return 0;
+    case DT_DEV_PIXELPIPE_PREVIEW:
+    case DT_DEV_PIXELPIPE_PREVIEW2:
+      return 1;
+    case DT_DEV_PIXELPIPE_EXPORT:
+      return 2;
+    default:
+      return 3;
+  }
+}
+
+// first free device of the priority list, marked in use. dev_lock has to be held.
+static int _opencl_grab_free_device(dt_opencl_t *cl, const int *prio)
+{
+  for(; *prio != -1; prio++)
+  {
+    if(!cl->dev[*prio].in_use)
+    {
+      cl->dev[*prio].in_use = 1;
+      return *prio;
+    }
+  }
+  return -1;
+}
+
 int dt_opencl_lock_device(const int pipetype)
 {
   dt_opencl_t *cl = darktable.opencl;
@@ -1398,82 +1476,101 @@ int dt_opencl_lock_device(const int pipetype)
   size_t prio_size = sizeof(int) * (cl->num_devs + 1);
   int *priority = (int *)malloc(prio_size);
   int mandatory;
+  int stats;
 
   switch(pipetype)
   {
     case DT_DEV_PIXELPIPE_FULL:
       memcpy(priority, cl->dev_priority_image, prio_size);
       mandatory = cl->mandatory[0];
+      stats = 0;
       break;
     case DT_DEV_PIXELPIPE_PREVIEW:
       memcpy(priority, cl->dev_priority_preview, prio_size);
       mandatory = cl->mandatory[1];
+      stats = 1;
       break;
     case DT_DEV_PIXELPIPE_EXPORT:
       memcpy(priority, cl->dev_priority_export, prio_size);
       mandatory = cl->mandatory[2];
+      stats = 2;
       break;
     case DT_DEV_PIXELPIPE_THUMBNAIL:
       memcpy(priority, cl->dev_priority_thumbnail, prio_size);
       mandatory = cl->mandatory[3];
+      stats = 3;
       break;
     case DT_DEV_PIXELPIPE_PREVIEW2:
       memcpy(priority, cl->dev_priority_preview2, prio_size);
       mandatory = cl->mandatory[4];
+      stats = 4;
       break;
     default:
-      free(priority);
-      priority = NULL;
+      // only a fallback if a new pipe type would be added and we forget to take care of it in opencl.c:
+      // any device, no waiting.
+      for(int k = 0; k < cl->num_devs; k++) priority[k] = k;
+      priority[cl->num_devs] = -1;
       mandatory = 0;
+      stats = -1;
   }
 
   dt_pthread_mutex_unlock(&cl->lock);
 
-  if(priority)
+  dt_pthread_mutex_lock(&cl->dev_lock);
+  if(stats >= 0) cl->dev_wait[stats].requests++;
+
+  int devid = _opencl_grab_free_device(cl, priority);
+
+  // all devices of this pipe are busy and it has to run on one of them: queue up. the device is
+  // handed over by whoever unlocks it first, so there's no polling and no window in which
+  // another pipe could snatch it. the old opencl_mandatory_timeout (rounds of 5ms) is kept as
+  // upper bound for the wait.
+  if(devid < 0 && mandatory && priority[0] != -1)
   {
-    const int usec = 5000;
     const int nloop = MAX(0, dt_conf_get_int("opencl_mandatory_timeout"));
-
-    // check for free opencl device repeatedly if mandatory is TRUE, else give up after first try
-    for(int n = 0; n < nloop; n++)
+    const double start = dt_get_wtime();
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    const int64_t nsec = deadline.tv_nsec + (int64_t)nloop * 5000000;
+    deadline.tv_sec += nsec / 1000000000;
+    deadline.tv_nsec = nsec % 1000000000;
+
+    _opencl_waiter_t waiter = { .priority = priority,
+                                .rank = _opencl_pipe_rank(pipetype),
+                                .ticket = cl->dev_ticket++,
+                                .devid = -1 };
+    pthread_cond_init(&waiter.cond, NULL);
+    cl->dev_waiters = g_list_insert_sorted(cl->dev_waiters, &waiter, _opencl_waiter_cmp);
+
+    while(waiter.devid < 0)
     {
-      const int *prio = priority;
-
-      while(*prio != -1)
-      {
-        if(!dt_pthread_mutex_BAD_trylock(&cl->dev[*prio].lock))
-        {
-          int devid = *prio;
-          free(priority);
-          return devid;
-        }
-        prio++;
-      }
+      if(dt_pthread_cond_timedwait(&waiter.cond, &cl->dev_lock, &deadline) == ETIMEDOUT) break;
+    }
 
-      if(!mandatory)
-      {
-        free(priority);
-        return -1;
-      }
+    // still queued if we timed out, already removed if a device has been handed over
+    cl->dev_waiters = g_list_remove(cl->dev_waiters, &waiter);
+    pthread_cond_destroy(&waiter.cond);
+    devid = waiter.devid;
 
-      dt_iop_nap(usec);
-    }
-  }
-  else
-  {
-    // only a fallback if a new pipe type would be added and we forget to take care of it in opencl.c
-    for(int try_dev = 0; try_dev < cl->num_devs; try_dev++)
+    const double waited = dt_get_wtime() - start;
+    if(stats >= 0)
     {
-      // get first currently unused processor
-      if(!dt_pthread_mutex_BAD_trylock(&cl->dev[try_dev].lock)) return try_dev;
+      dt_opencl_wait_stats_t *w = &cl->dev_wait[stats];
+      w->waited++;
+      w->total += waited;
+      w->max = MAX(w->max, waited);
+      if(devid < 0) w->timeouts++;
     }
+    dt_print(DT_DEBUG_OPENCL, "[opencl_lock_device] %s pipe waited %.3f ms for device %d\n",
+             stats >= 0 ? _opencl_pipe_names[stats] : "unknown", 1000.0 * waited, devid);
   }
 
+  dt_pthread_mutex_unlock(&cl->dev_lock);
   free(priority);
 
   // no free GPU :(
   // use CPU processing, if no free device:
-  return -1;
+  return devid;
 }
 
 void dt_opencl_unlock_device(const int dev)
@@ -1481,7 +1578,139 @@ void dt_opencl_unlock_device(const int dev)
   dt_opencl_t *cl = darktable.opencl;
   if(!cl->inited) return;
   if(dev < 0 || dev >= cl->num_devs) return;
-  dt_pthread_mutex_BAD_unlock(&cl->dev[dev].lock);
+
+  dt_pthread_mutex_lock(&cl->dev_lock);
+  // hand the device over to the first queued pipe which may use it. it stays in use.
+  for(GList *l = cl->dev_waiters; l; l = g_list_next(l))
+  {
+    _opencl_waiter_t *waiter = (_opencl_waiter_t *)l->data;
+    for(const int *prio = waiter->priority; *prio != -1; prio++)
+    {
+      if(*prio == dev)
+      {
+        waiter->devid = dev;
+        cl->dev_waiters = g_list_delete_link(cl->dev_waiters, l);
+        pthread_cond_signal(&waiter->cond);
+        dt_pthread_mutex_unlock(&cl->dev_lock);
+        return;
+      }
+    }
+  }
+  cl->dev[dev].in_use = 0;
+  dt_pthread_mutex_unlock(&cl->dev_lock);
+}
+
+// weight of a new sample in the moving averages of the cost model
+#define DT_OPENCL_COST_ALPHA 0.25f
+// gpu timings needed before the average is trusted, and the sampling interval afterwards
+#define DT_OPENCL_COST_WARMUP 4
+#define DT_OPENCL_COST_INTERVAL 32
+// a new sample counts as at most this factor off the average, so one stall doesn't decide the placement
+#define DT_OPENCL_COST_OUTLIER 4.0f
+// round trips timed for the transfer cost, the fastest one counts, and the most it may come out at in
+// seconds per megapixel (about 100MB/s, way below any bus a gpu sits on)
+#define DT_OPENCL_COST_TRANSFER_RUNS 3
+#define DT_OPENCL_COST_TRANSFER_MAX 0.3f
+
+void dt_opencl_cost_record(const int devid, const char *op, const gboolean on_gpu, const double seconds,
+                           const size_t pixels)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || pixels == 0) return;
+  if(on_gpu && (devid < 0 || devid >= cl->num_devs)) return;
+
+  const float time = seconds * 1e6 / pixels;
+  GHashTable *table = on_gpu ? cl->dev[devid].gpu_cost : cl->cpu_cost;
+
+  dt_pthread_mutex_lock(&cl->cost_lock);
+  dt_opencl_cost_t *cost = (dt_opencl_cost_t *)g_hash_table_lookup(table, op);
+  if(!cost)
+  {
+    cost = (dt_opencl_cost_t *)calloc(1, sizeof(dt_opencl_cost_t));
+    cost->time = time;
+    g_hash_table_insert(table, g_strdup(op), cost);
+  }
+  else
+  {
+    const float clamped = cost->time > 0.0f
+                              ? CLAMP(time, cost->time / DT_OPENCL_COST_OUTLIER, cost->time * DT_OPENCL_COST_OUTLIER)
+                              : time;
+    cost->time += DT_OPENCL_COST_ALPHA * (clamped - cost->time);
+  }
+  cost->samples++;
+  dt_pthread_mutex_unlock(&cl->cost_lock);
+}
+
+void dt_opencl_cost_get(const int devid, const char *op, float *cpu, float *gpu)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  *cpu = *gpu = NAN;
+  if(!cl->inited) return;
+
+  dt_pthread_mutex_lock(&cl->cost_lock);
+  const dt_opencl_cost_t *c = (dt_opencl_cost_t *)g_hash_table_lookup(cl->cpu_cost, op);
+  if(c) *cpu = c->time;
+  if(devid >= 0 && devid < cl->num_devs)
+  {
+    const dt_opencl_cost_t *g = (dt_opencl_cost_t *)g_hash_table_lookup(cl->dev[devid].gpu_cost, op);
+    if(g && g->samples >= DT_OPENCL_COST_WARMUP) *gpu = g->time;
+  }
+  dt_pthread_mutex_unlock(&cl->cost_lock);
+}
+
+gboolean dt_opencl_cost_want_gpu_sample(const int devid, const char *op)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0 || devid >= cl->num_devs) return FALSE;
+
+  dt_pthread_mutex_lock(&cl->cost_lock);
+  dt_opencl_cost_t *g = (dt_opencl_cost_t *)g_hash_table_lookup(cl->dev[devid].gpu_cost, op);
+  const gboolean want = !g || g->samples < DT_OPENCL_COST_WARMUP || (++g->runs % DT_OPENCL_COST_INTERVAL) == 0;
+  dt_pthread_mutex_unlock(&cl->cost_lock);
+  return want;
+}
+
+float dt_opencl_cost_transfer(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0 || devid >= cl->num_devs) return 0.0f;
+
+  dt_pthread_mutex_lock(&cl->cost_lock);
+  float transfer_cost = cl->dev[devid].transfer_cost;
+  dt_pthread_mutex_unlock(&cl->cost_lock);
+  if(transfer_cost > 0.0f) return transfer_cost;
+
+  // one megapixel float4 round trip, with the queue drained first so we only time the copies. the first
+  // transfers on a device can include driver setup, so the fastest of a few counts.
+  const int width = 1024, height = 1024, bpp = 4 * sizeof(float);
+  float *buf = dt_alloc_align(64, (size_t)width * height * bpp);
+  cl_mem dev_mem = buf ? dt_opencl_alloc_device(devid, width, height, bpp) : NULL;
+  if(dev_mem)
+  {
+    memset(buf, 0, (size_t)width * height * bpp);
+    dt_opencl_finish(devid);
+    double best = INFINITY;
+    for(int k = 0; k < DT_OPENCL_COST_TRANSFER_RUNS; k++)
+    {
+      const double start = dt_get_wtime();
+      if(dt_opencl_write_host_to_device(devid, buf, dev_mem, width, height, bpp) != CL_SUCCESS
+         || dt_opencl_read_host_from_device(devid, buf, dev_mem, width, height, bpp) != CL_SUCCESS)
+        break;
+      best = MIN(best, dt_get_wtime() - start);
+    }
+    if(isfinite(best))
+    {
+      transfer_cost = CLAMP(best * 1e6 / ((double)width * height), 1e-6, DT_OPENCL_COST_TRANSFER_MAX);
+      dt_print(DT_DEBUG_OPENCL, "[opencl_cost] device %d: %.3f ms per megapixel round trip\n", devid,
+               1000.0 * transfer_cost);
+      dt_pthread_mutex_lock(&cl->cost_lock);
+      cl->dev[devid].transfer_cost = transfer_cost;
+      dt_pthread_mutex_unlock(&cl->cost_lock);
+    }
+  }
+  dt_opencl_release_mem_object(dev_mem);
+  dt_free_align(buf);
+  return transfer_cost;
 }
 
 static FILE *fopen_stat(const char *filename, struct stat *st)
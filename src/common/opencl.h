@@ -86,7 +86,7 @@ typedef struct dt_opencl_eventtag_t
  */
 typedef struct dt_opencl_device_t
 {
-  dt_pthread_mutex_t lock;
+  int in_use; // locked by a pipe, protected by dt_opencl_t.dev_lock
   cl_device_id devid;
   cl_context context;
   cl_command_queue cmd_queue;
@@ -117,8 +117,29 @@ typedef struct dt_opencl_device_t
   float benchmark;
   size_t memory_in_use;
   size_t peak_memory;
+  GHashTable *gpu_cost; // module op -> dt_opencl_cost_t, protected by dt_opencl_t.cost_lock
+  float transfer_cost;  // seconds per megapixel of a float4 buffer to the device and back, 0 if not measured,
+                        // protected by dt_opencl_t.cost_lock
 } dt_opencl_device_t;
 
+/** measured processing time of a module, exponential moving average in seconds per megapixel */
+typedef struct dt_opencl_cost_t
+{
+  float time;
+  int samples; // timed runs
+  int runs;    // all runs, only counted for gpu sampling
+} dt_opencl_cost_t;
+
+/** wait statistics of one pipe type for device arbitration */
+typedef struct dt_opencl_wait_stats_t
+{
+  int requests;  // calls to dt_opencl_lock_device()
+  int waited;    // of those which had to queue for a device
+  int timeouts;  // of those which gave up and fell back to the cpu
+  double total;  // seconds spent queueing
+  double max;
+} dt_opencl_wait_stats_t;
+
 struct dt_bilateral_cl_global_t;
 struct dt_local_laplacian_cl_global_t;
 struct dt_dwt_cl_global_t; // wavelet decompose
@@ -155,6 +176,17 @@ typedef struct dt_opencl_t
   int *dev_priority_export;
   int *dev_priority_thumbnail;
   dt_opencl_device_t *dev;
+
+  // device arbitration: pipes waiting for a device queue up here and are handed
+  // a device directly by dt_opencl_unlock_device(), see dt_opencl_lock_device().
+  dt_pthread_mutex_t dev_lock;
+  GList *dev_waiters;
+  uint64_t dev_ticket;
+  dt_opencl_wait_stats_t dev_wait[5]; // same order as mandatory[]
+
+  // cost model for placing modules on cpu or gpu, see dt_opencl_cost_record()
+  dt_pthread_mutex_t cost_lock;
+  GHashTable *cpu_cost; // module op -> dt_opencl_cost_t
   dt_dlopencl_t *dlocl;
 
   // global kernels for blending operations.
@@ -224,6 +256,18 @@ int dt_opencl_lock_device(const int pipetype);
 /** done with your command queue. */
 void dt_opencl_unlock_device(const int dev);
 
+/** cost model: feed in the time op took on the cpu (devid ignored) or on the gpu for a buffer of pixels. */
+void dt_opencl_cost_record(const int devid, const char *op, const gboolean on_gpu, const double seconds,
+                           const size_t pixels);
+/** measured seconds per megapixel of op on the cpu and on device devid, NAN where unknown. */
+void dt_opencl_cost_get(const int devid, const char *op, float *cpu, float *gpu);
+/** seconds per megapixel to move a float4 buffer to devid and back. measured on first call, the device
+ * has to be locked by the caller. */
+float dt_opencl_cost_transfer(const int devid);
+/** TRUE if the next gpu run of op should be timed. that needs the queue drained around the module,
+ * so this is only asked for a few times and then once in a while. */
+gboolean dt_opencl_cost_want_gpu_sample(const int devid, const char *op);
+
 /** calculates md5sums for a list of CL include files. */
 void dt_opencl_md5sum(const char **files, char **md5sums);
 
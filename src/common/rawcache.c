@@ -0,0 +1,282 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/rawcache.h"
+#include "common/darktable.h"
+#include "common/file_location.h"
+#include "control/conf.h"
+#include "develop/format.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DT_RAWCACHE_MAGIC 0xD7CAC4E
+#define DT_RAWCACHE_VERSION 2
+
+// flags which are set by the raw loader and have to be restored on a hit
+#define DT_RAWCACHE_IMAGE_FLAGS                                                                                    \
+  (DT_IMAGE_LDR | DT_IMAGE_RAW | DT_IMAGE_HDR | DT_IMAGE_S_RAW | DT_IMAGE_4BAYER | DT_IMAGE_MONOCHROME)
+
+typedef struct dt_rawcache_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t image_size; // sizeof(dt_image_t), guards against struct changes between builds
+  char decoder[41];    // sha1 of what decoded the raw: darktable version, with rawspeed, and its cameras.xml
+  int64_t mtime;       // of the source file
+  int64_t filesize;    // of the source file
+  size_t data_size;    // bytes of sensor data following the header
+  dt_image_t img;      // image struct as left by the raw loader
+} dt_rawcache_header_t;
+
+static gboolean _rawcache_enabled()
+{
+  return dt_conf_get_bool("cache_raw_decode");
+}
+
+static void _rawcache_dir(char *dir, size_t size)
+{
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  snprintf(dir, size, "%s/rawcache", cachedir);
+}
+
+static void _rawcache_filename(const char *filename, char *path, size_t size)
+{
+  char dir[PATH_MAX] = { 0 };
+  _rawcache_dir(dir, sizeof(dir));
+  gchar *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, filename, -1);
+  snprintf(path, size, "%s/%s.dtraw", dir, hash);
+  g_free(hash);
+}
+
+// identifies the decoder. rawspeed is built from the submodule pinned by darktable, so the darktable
+// version covers its code. cameras.xml is data and can change on its own, take its size and mtime as well.
+static const char *_rawcache_decoder()
+{
+  static char decoder[41] = { 0 };
+  static gsize done = 0;
+  if(!g_once_init_enter(&done)) return decoder;
+
+  char datadir[PATH_MAX] = { 0 }, camfile[PATH_MAX] = { 0 };
+  dt_loc_get_datadir(datadir, sizeof(datadir));
+  snprintf(camfile, sizeof(camfile), "%s/rawspeed/cameras.xml", datadir);
+  GStatBuf st;
+  if(g_stat(camfile, &st)) memset(&st, 0, sizeof(st));
+
+  gchar *id = g_strdup_printf("%s|%" PRId64 "|%" PRId64, darktable_package_version, (int64_t)st.st_size,
+                              (int64_t)st.st_mtime);
+  gchar *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, id, -1);
+  g_strlcpy(decoder, hash, sizeof(decoder));
+  g_free(hash);
+  g_free(id);
+  g_once_init_leave(&done, 1);
+  return decoder;
+}
+
+static gboolean _rawcache_source_stat(const char *filename, int64_t *mtime, int64_t *filesize)
+{
+  GStatBuf st;
+  if(g_stat(filename, &st)) return FALSE;
+  *mtime = (int64_t)st.st_mtime;
+  *filesize = (int64_t)st.st_size;
+  return TRUE;
+}
+
+static gint _rawcache_sort_oldest(gconstpointer a, gconstpointer b)
+{
+  const int64_t ta = *(const int64_t *)a, tb = *(const int64_t *)b;
+  return (ta > tb) - (ta < tb);
+}
+
+// delete least recently used entries until `needed' more bytes fit into the quota
+static void _rawcache_make_room(const char *dir, const size_t needed)
+{
+  const size_t quota = (size_t)MAX(dt_conf_get_int("cache_raw_decode_size"), 0) << 20;
+
+  GDir *d = g_dir_open(dir, 0, NULL);
+  if(!d) return;
+
+  // entries: atime (or mtime), size, path. kept as a flat array of records.
+  typedef struct _entry_t
+  {
+    int64_t time;
+    size_t size;
+    gchar *path;
+  } _entry_t;
+  GArray *entries = g_array_new(FALSE, FALSE, sizeof(_entry_t));
+  size_t total = 0;
+  const gchar *name;
+  while((name = g_dir_read_name(d)))
+  {
+    if(!g_str_has_suffix(name, ".dtraw")) continue;
+    _entry_t e;
+    e.path = g_build_filename(dir, name, NULL);
+    GStatBuf st;
+    if(g_stat(e.path, &st))
+    {
+      g_free(e.path);
+      continue;
+    }
+    e.time = MAX((int64_t)st.st_atime, (int64_t)st.st_mtime);
+    e.size = st.st_size;
+    total += e.size;
+    g_array_append_val(entries, e);
+  }
+  g_dir_close(d);
+
+  g_array_sort(entries, _rawcache_sort_oldest);
+  for(guint k = 0; k < entries->len; k++)
+  {
+    _entry_t *e = &g_array_index(entries, _entry_t, k);
+    if(total + needed > quota && !g_unlink(e->path))
+    {
+      dt_print(DT_DEBUG_CACHE, "[rawcache] evicting `%s'\n", e->path);
+      total -= e->size;
+    }
+    g_free(e->path);
+  }
+  g_array_free(entries, TRUE);
+}
+
+dt_imageio_retval_t dt_rawcache_load(dt_image_t *img, const char *filename, dt_mipmap_buffer_t *mbuf)
+{
+  if(!mbuf || !_rawcache_enabled()) return DT_IMAGEIO_FILE_NOT_FOUND;
+
+  int64_t mtime, filesize;
+  if(!_rawcache_source_stat(filename, &mtime, &filesize)) return DT_IMAGEIO_FILE_NOT_FOUND;
+
+  char path[PATH_MAX] = { 0 };
+  _rawcache_filename(filename, path, sizeof(path));
+  FILE *f = g_fopen(path, "rb");
+  if(!f) return DT_IMAGEIO_FILE_NOT_FOUND;
+
+  dt_rawcache_header_t *header = (dt_rawcache_header_t *)malloc(sizeof(dt_rawcache_header_t));
+  dt_imageio_retval_t ret = DT_IMAGEIO_FILE_NOT_FOUND;
+  if(!header || fread(header, sizeof(*header), 1, f) != 1 || header->magic != DT_RAWCACHE_MAGIC
+     || header->version != DT_RAWCACHE_VERSION || header->image_size != sizeof(dt_image_t)
+     || strncmp(header->decoder, _rawcache_decoder(), sizeof(header->decoder))
+     || header->mtime != mtime || header->filesize != filesize)
+    goto stale;
+
+  const dt_image_t *cached = &header->img;
+  if(header->data_size != (size_t)cached->width * cached->height * dt_iop_buffer_dsc_to_bpp(&cached->buf_dsc))
+    goto stale;
+
+  // restore what the raw loader would have set
+  g_strlcpy(img->camera_maker, cached->camera_maker, sizeof(img->camera_maker));
+  g_strlcpy(img->camera_model, cached->camera_model, sizeof(img->camera_model));
+  g_strlcpy(img->camera_alias, cached->camera_alias, sizeof(img->camera_alias));
+  g_strlcpy(img->camera_legacy_makermodel, cached->camera_legacy_makermodel,
+            sizeof(img->camera_legacy_makermodel));
+  dt_image_refresh_makermodel(img);
+  img->raw_black_level = cached->raw_black_level;
+  img->raw_white_point = cached->raw_white_point;
+  memcpy(img->raw_black_level_separate, cached->raw_black_level_separate, sizeof(img->raw_black_level_separate));
+  memcpy(img->wb_coeffs, cached->wb_coeffs, sizeof(img->wb_coeffs));
+  memcpy(img->usercrop, cached->usercrop, sizeof(img->usercrop));
+  img->flags = (img->flags & ~DT_RAWCACHE_IMAGE_FLAGS) | (cached->flags & DT_RAWCACHE_IMAGE_FLAGS);
+  img->buf_dsc = cached->buf_dsc;
+  img->width = cached->width;
+  img->height = cached->height;
+  img->crop_x = cached->crop_x;
+  img->crop_y = cached->crop_y;
+  img->crop_width = cached->crop_width;
+  img->crop_height = cached->crop_height;
+  img->fuji_rotation_pos = cached->fuji_rotation_pos;
+  img->pixel_aspect_ratio = cached->pixel_aspect_ratio;
+
+  void *buf = dt_mipmap_cache_alloc(mbuf, img);
+  if(!buf)
+  {
+    ret = DT_IMAGEIO_CACHE_FULL;
+    goto done;
+  }
+  if(fread(buf, 1, header->data_size, f) != header->data_size)
+  {
+    // the image struct has been filled already, let the caller decode the raw for real
+    ret = DT_IMAGEIO_FILE_NOT_FOUND;
+    goto stale;
+  }
+
+  dt_print(DT_DEBUG_CACHE, "[rawcache] loaded `%s' from `%s'\n", filename, path);
+  ret = DT_IMAGEIO_OK;
+  goto done;
+
+stale:
+  g_unlink(path);
+done:
+  free(header);
+  fclose(f);
+  return ret;
+}
+
+void dt_rawcache_store(const dt_image_t *img, const char *filename, const void *buf, const double decode_time)
+{
+  if(!buf || !_rawcache_enabled()) return;
+
+  const size_t data_size = (size_t)img->width * img->height * dt_iop_buffer_dsc_to_bpp(&img->buf_dsc);
+  // plain formats decode about as fast as we could read them back, don't waste disk on them.
+  // assume reading back runs at roughly 1 GB/s.
+  if(decode_time < data_size / 1.0e9) return;
+
+  int64_t mtime, filesize;
+  if(!_rawcache_source_stat(filename, &mtime, &filesize)) return;
+
+  char dir[PATH_MAX] = { 0 }, path[PATH_MAX] = { 0 }, tmppath[PATH_MAX] = { 0 };
+  _rawcache_dir(dir, sizeof(dir));
+  if(g_mkdir_with_parents(dir, 0750)) return;
+  _rawcache_make_room(dir, data_size + sizeof(dt_rawcache_header_t));
+
+  _rawcache_filename(filename, path, sizeof(path));
+  // several exports can decode the same image at once, never write to the final name directly
+  snprintf(tmppath, sizeof(tmppath), "%s.%p.tmp", path, (void *)g_thread_self());
+
+  dt_rawcache_header_t *header = (dt_rawcache_header_t *)calloc(1, sizeof(dt_rawcache_header_t));
+  if(!header) return;
+  header->magic = DT_RAWCACHE_MAGIC;
+  header->version = DT_RAWCACHE_VERSION;
+  header->image_size = sizeof(dt_image_t);
+  g_strlcpy(header->decoder, _rawcache_decoder(), sizeof(header->decoder));
+  header->mtime = mtime;
+  header->filesize = filesize;
+  header->data_size = data_size;
+  header->img = *img;
+
+  FILE *f = g_fopen(tmppath, "wb");
+  int ok = 0;
+  if(f)
+  {
+    ok = fwrite(header, sizeof(*header), 1, f) == 1 && fwrite(buf, 1, data_size, f) == data_size;
+    ok = !fclose(f) && ok;
+  }
+  free(header);
+
+  if(ok && !g_rename(tmppath, path))
+    dt_print(DT_DEBUG_CACHE, "[rawcache] stored `%s' (%.1f MB, decoding took %.3fs)\n", filename,
+             data_size / (1024.0 * 1024.0), decode_time);
+  else
+    g_unlink(tmppath);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
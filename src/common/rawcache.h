@@ -0,0 +1,50 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/image.h"
+#include "common/imageio.h"
+#include "common/mipmap_cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * on-disk cache of decoded sensor data, for raw formats where decompression
+ * costs more than reading the plain buffer back (cr3, compressed arw, lossless dng, ...).
+ * entries are keyed by source file path, and validated against its mtime and size.
+ * disabled unless the cache_raw_decode preference is set.
+ */
+
+// fill img (rawspeed provided fields only) and the full mipmap buffer from the cache.
+// returns DT_IMAGEIO_OK on a hit, DT_IMAGEIO_FILE_NOT_FOUND if there is no valid entry.
+dt_imageio_retval_t dt_rawcache_load(dt_image_t *img, const char *filename, dt_mipmap_buffer_t *mbuf);
+
+// store a freshly decoded buffer of img->width x img->height pixels. decode_time is the wall time
+// the decoder needed, entries are only written if reading them back is expected to be faster.
+void dt_rawcache_store(const dt_image_t *img, const char *filename, const void *buf, const double decode_time);
+
+#ifdef __cplusplus
+}
+#endif
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
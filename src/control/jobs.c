@@ -17,7 +17,10 @@
 */
 
 #include "control/jobs.h"
+#include "common/numa.h"
+#include "control/conf.h"
 #include "control/control.h"
+#include "develop/pixelpipe_pool.h"
 
 #define DT_CONTROL_FG_PRIORITY 4
 #define DT_CONTROL_MAX_JOBS 30
@@ -307,6 +310,16 @@ static void dt_control_job_execute(_dt_job_t *job)
   dt_print(DT_DEBUG_CONTROL, "\n");
 }
 
+// no job waiting and none running on the other workers. only called with queue_mutex held.
+static gboolean _control_jobs_idle(const dt_control_t *control)
+{
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+    if(control->queues[i]) return FALSE;
+  for(int k = 0; k < control->num_threads; k++)
+    if(control->job[k]) return FALSE;
+  return TRUE;
+}
+
 static int32_t dt_control_run_job(dt_control_t *control)
 {
   _dt_job_t *job = dt_control_schedule_job(control);
@@ -324,11 +337,16 @@ static int32_t dt_control_run_job(dt_control_t *control)
   dt_pthread_mutex_lock(&control->queue_mutex);
   control->job[dt_control_get_threadid()] = NULL;
   if(job->queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = FALSE;
+  const gboolean idle = _control_jobs_idle(control);
   dt_pthread_mutex_unlock(&control->queue_mutex);
 
   // and free it
   dt_control_job_dispose(job);
 
+  // the last background job (thumbnails, exports, ...) is done: the buffers the shared pool kept for the
+  // next image are not needed anymore
+  if(idle) dt_dev_pixelpipe_pool_trim(darktable.pixelpipe_pool);
+
   return 0;
 }
 
@@ -557,6 +575,19 @@ static void *dt_control_work(void *ptr)
   snprintf(name, sizeof(name), "worker %d", threadid);
   dt_pthread_setname(name);
   free(params);
+  // spread the background workers over the numa nodes. this happens before their first parallel loop, so the
+  // openmp threads they start stay on the same node and so does the memory those touch first.
+  if(dt_conf_get_bool("numa_pin_workers"))
+  {
+    const int node = threadid % dt_numa_num_nodes();
+    if(dt_numa_bind_thread(node))
+    {
+#ifdef _OPENMP
+      omp_set_num_threads(MIN(darktable.num_openmp_threads, dt_numa_node_num_cpus(node)));
+#endif
+      dt_print(DT_DEBUG_CONTROL, "[control_work] worker %d bound to numa node %d\n", threadid, node);
+    }
+  }
   // int32_t threadid = dt_control_get_threadid();
   while(dt_control_running())
   {
@@ -29,10 +29,13 @@
 #include "common/imageio_dng.h"
 #include "common/imageio_module.h"
 #include "common/mipmap_cache.h"
+#include "common/numa.h"
 #include "common/tags.h"
 #include "common/undo.h"
 #include "control/conf.h"
 #include "develop/imageop_math.h"
+#include "develop/pixelpipe_pool.h"
+#include "develop/tiling.h"
 
 #include "gui/gtk.h"
 
@@ -1191,6 +1194,166 @@ static int32_t dt_control_refresh_exif_run(dt_job_t *job)
 }
 
 
+static int _export_prefetch_depth(const int consumers)
+{
+  const int depth = dt_conf_get_int("plugins/lighttable/export/prefetch_images");
+  // keep one full buffer for each image currently being exported
+  const int capacity = (int)darktable.mipmap_cache->mip_full.cache.cost_quota - consumers;
+  return CLAMP(depth, 0, MAX(capacity, 0));
+}
+
+static void _export_prefetch_image(const int imgid)
+{
+  // only raw decode is worth overlapping, and only if the file is actually reachable
+  const dt_image_t *image = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  if(!image) return;
+  char imgfilename[PATH_MAX] = { 0 };
+  gboolean from_cache = TRUE;
+  dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
+  dt_image_cache_read_release(darktable.image_cache, image);
+  if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR)) return;
+
+  dt_print(DT_DEBUG_PERF, "[export] prefetching full buffer for image %d\n", imgid);
+  dt_mipmap_cache_get(darktable.mipmap_cache, NULL, imgid, DT_MIPMAP_FULL, DT_MIPMAP_PREFETCH, 'r');
+}
+
+// state shared by the threads exporting the images of one job
+typedef struct _export_queue_t
+{
+  dt_pthread_mutex_t lock;
+  dt_job_t *job;
+  dt_control_export_t *settings;
+  dt_imageio_module_format_t *mformat;
+  dt_imageio_module_storage_t *mstorage;
+  dt_imageio_module_data_t *sdata;
+  dt_export_metadata_t *metadata;
+  guint tagid, etagid;
+  GList *next;     // next image to export
+  GList *prefetch; // next image to prefetch
+  int prefetched;
+  int prefetch_depth;
+  guint total;
+  guint started;
+  double fraction;
+} _export_queue_t;
+
+typedef struct _export_node_t
+{
+  _export_queue_t *queue;
+  dt_imageio_module_data_t *fdata; // one per thread, formats keep their encoder state in there
+  int node;
+  int nodes; // pipes running at the same time, they share the host memory limit
+} _export_node_t;
+
+// hands out the next image and keeps the decode-ahead queue filled behind it. -1 once done or cancelled.
+static int _export_next_image(_export_queue_t *q, guint *num)
+{
+  int imgid = -1;
+  dt_pthread_mutex_lock(&q->lock);
+  if(q->next && dt_control_job_get_state(q->job) != DT_JOB_STATE_CANCELLED)
+  {
+    imgid = GPOINTER_TO_INT(q->next->data);
+    q->next = g_list_next(q->next);
+    *num = ++q->started;
+
+    // the current image is being consumed now, keep the queue filled behind it
+    if(q->prefetched > 0)
+      q->prefetched--;
+    else
+      q->prefetch = q->next;
+    while(q->prefetch && q->prefetched < q->prefetch_depth)
+    {
+      _export_prefetch_image(GPOINTER_TO_INT(q->prefetch->data));
+      q->prefetch = g_list_next(q->prefetch);
+      q->prefetched++;
+    }
+  }
+  dt_pthread_mutex_unlock(&q->lock);
+  return imgid;
+}
+
+static void _export_images(_export_node_t *n)
+{
+  _export_queue_t *q = n->queue;
+  dt_control_export_t *settings = q->settings;
+  guint num = 0;
+  int imgid;
+
+  while((imgid = _export_next_image(q, &num)) >= 0)
+  {
+    // progress message
+    char message[512] = { 0 };
+    snprintf(message, sizeof(message), _("exporting %d / %d to %s"), num, q->total, q->mstorage->name(q->mstorage));
+    // update the message. initialize_store() might have changed the number of images
+    dt_control_job_set_progress_message(q->job, message);
+
+    // remove 'changed' tag from image
+    dt_tag_detach(q->tagid, imgid, FALSE, FALSE);
+    // make sure the 'exported' tag is set on the image
+    dt_tag_attach_from_gui(q->etagid, imgid, FALSE, FALSE);
+
+    /* register export timestamp in cache */
+    dt_image_cache_set_export_timestamp(darktable.image_cache, imgid);
+
+    // check if image still exists:
+    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, (int32_t)imgid, 'r');
+    if(image)
+    {
+      char imgfilename[PATH_MAX] = { 0 };
+      gboolean from_cache = TRUE;
+      dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
+      if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
+      {
+        dt_control_log(_("image `%s' is currently unavailable"), image->filename);
+        fprintf(stderr, "image `%s' is currently unavailable\n", imgfilename);
+        // dt_image_remove(imgid);
+        dt_image_cache_read_release(darktable.image_cache, image);
+      }
+      else
+      {
+        dt_image_cache_read_release(darktable.image_cache, image);
+        if(q->mstorage->store(q->mstorage, q->sdata, imgid, q->mformat, n->fdata, num, q->total,
+                              settings->high_quality, settings->upscale, settings->export_masks,
+                              settings->icc_type, settings->icc_filename, settings->icc_intent, q->metadata)
+           != 0)
+          dt_control_job_cancel(q->job);
+      }
+    }
+
+    dt_pthread_mutex_lock(&q->lock);
+    q->fraction += 1.0 / q->total;
+    if(q->fraction > 1.0) q->fraction = 1.0;
+    dt_control_job_set_progress(q->job, q->fraction);
+    dt_pthread_mutex_unlock(&q->lock);
+  }
+}
+
+static void *_export_node_thread(void *data)
+{
+  _export_node_t *n = (_export_node_t *)data;
+  char name[16] = { 0 };
+  snprintf(name, sizeof(name), "export node %d", n->node);
+  dt_pthread_setname(name);
+  // bind before the first parallel loop, the openmp threads of this thread are created on the node then
+  dt_numa_bind_thread(n->node);
+#ifdef _OPENMP
+  omp_set_num_threads(MIN(darktable.num_openmp_threads, dt_numa_node_num_cpus(n->node)));
+#endif
+  // every node tiles its pipe against its own share of the memory limit
+  dt_tiling_set_host_memory_share(n->nodes);
+  _export_images(n);
+  return NULL;
+}
+
+static void _export_setup_fdata(dt_imageio_module_data_t *fdata, const dt_control_export_t *settings,
+                                const uint32_t w, const uint32_t h)
+{
+  fdata->max_width = (settings->max_width != 0 && w != 0) ? MIN(w, settings->max_width) : MAX(w, settings->max_width);
+  fdata->max_height = (settings->max_height != 0 && h != 0) ? MIN(h, settings->max_height) : MAX(h, settings->max_height);
+  g_strlcpy(fdata->style, settings->style, sizeof(fdata->style));
+  fdata->style_append = settings->style_append;
+}
+
 static int32_t dt_control_export_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
@@ -1235,13 +1398,8 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   const guint total = g_list_length(t);
   dt_control_log(ngettext("exporting %d image..", "exporting %d images..", total), total);
 
-  double fraction = 0;
-
   // set up the fdata struct
-  fdata->max_width = (settings->max_width != 0 && w != 0) ? MIN(w, settings->max_width) : MAX(w, settings->max_width);
-  fdata->max_height = (settings->max_height != 0 && h != 0) ? MIN(h, settings->max_height) : MAX(h, settings->max_height);
-  g_strlcpy(fdata->style, settings->style, sizeof(fdata->style));
-  fdata->style_append = settings->style_append;
+  _export_setup_fdata(fdata, settings, w, h);
   // Invariant: the tagid for 'darktable|changed' will not change while this function runs. Is this a
   // sensible assumption?
   guint tagid = 0, etagid = 0;
@@ -1257,54 +1415,70 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
     metadata.list = g_list_remove(metadata.list, metadata.list->data);
   }
 
-  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
+  _export_queue_t queue = { 0 };
+  dt_pthread_mutex_init(&queue.lock, NULL);
+  queue.job = job;
+  queue.settings = settings;
+  queue.mformat = mformat;
+  queue.mstorage = mstorage;
+  queue.sdata = sdata;
+  queue.metadata = &metadata;
+  queue.tagid = tagid;
+  queue.etagid = etagid;
+  queue.next = t;
+  queue.total = total;
+
+  // on numa hosts every node exports images of its own, with its threads and memory kept local, so memory
+  // bandwidth scales with the sockets. only for storages writing each image on its own, the ones with
+  // initialize_store() or finalize_store() collect the images for a common result.
+  const int nodes = (dt_numa_num_nodes() > 1 && total > 1 && !mstorage->initialize_store
+                     && !mstorage->finalize_store && dt_conf_get_bool("numa_parallel_export"))
+                        ? MIN(dt_numa_num_nodes(), (int)total)
+                        : 1;
+
+  // decode-ahead: while image N goes through pixelpipe, encode and storage, the raw
+  // decode of the next images is queued as background mipmap loads. the lookahead is
+  // bounded by the number of full buffers the mipmap cache keeps, so prefetched
+  // buffers are not evicted again before the export loop reaches them.
+  queue.prefetch_depth = _export_prefetch_depth(nodes);
+  queue.prefetch = t;
+
+  if(nodes == 1)
   {
-    const int imgid = GPOINTER_TO_INT(t->data);
-    t = g_list_next(t);
-    const guint num = total - g_list_length(t);
-
-    // progress message
-    char message[512] = { 0 };
-    snprintf(message, sizeof(message), _("exporting %d / %d to %s"), num, total, mstorage->name(mstorage));
-    // update the message. initialize_store() might have changed the number of images
-    dt_control_job_set_progress_message(job, message);
-
-    // remove 'changed' tag from image
-    dt_tag_detach(tagid, imgid, FALSE, FALSE);
-    // make sure the 'exported' tag is set on the image
-    dt_tag_attach_from_gui(etagid, imgid, FALSE, FALSE);
-
-    /* register export timestamp in cache */
-    dt_image_cache_set_export_timestamp(darktable.image_cache, imgid);
-
-    // check if image still exists:
-    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, (int32_t)imgid, 'r');
-    if(image)
+    _export_node_t node = { .queue = &queue, .fdata = fdata, .node = 0 };
+    _export_images(&node);
+  }
+  else
+  {
+    dt_print(DT_DEBUG_PERF, "[export] exporting on %d numa nodes\n", nodes);
+    _export_node_t node[DT_NUMA_MAX_NODES] = { { 0 } };
+    pthread_t thread[DT_NUMA_MAX_NODES];
+    gboolean running[DT_NUMA_MAX_NODES] = { FALSE };
+    for(int k = 0; k < nodes; k++)
     {
-      char imgfilename[PATH_MAX] = { 0 };
-      gboolean from_cache = TRUE;
-      dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
-      if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
-      {
-        dt_control_log(_("image `%s' is currently unavailable"), image->filename);
-        fprintf(stderr, "image `%s' is currently unavailable\n", imgfilename);
-        // dt_image_remove(imgid);
-        dt_image_cache_read_release(darktable.image_cache, image);
-      }
-      else
-      {
-        dt_image_cache_read_release(darktable.image_cache, image);
-        if(mstorage->store(mstorage, sdata, imgid, mformat, fdata, num, total, settings->high_quality, settings->upscale,
-                           settings->export_masks, settings->icc_type, settings->icc_filename, settings->icc_intent,
-                           &metadata) != 0)
-          dt_control_job_cancel(job);
-      }
+      node[k].queue = &queue;
+      node[k].node = k;
+      node[k].nodes = nodes;
+      node[k].fdata = k ? mformat->get_params(mformat) : fdata;
+      if(!node[k].fdata) continue;
+      if(k) _export_setup_fdata(node[k].fdata, settings, w, h);
+      running[k] = dt_pthread_create(&thread[k], _export_node_thread, &node[k]) == 0;
+    }
+    // whatever could not be started is exported right here
+    if(!running[0])
+    {
+      dt_tiling_set_host_memory_share(nodes);
+      _export_images(&node[0]);
+      dt_tiling_set_host_memory_share(1);
+    }
+    for(int k = 0; k < nodes; k++)
+    {
+      if(running[k]) pthread_join(thread[k], NULL);
+      if(k && node[k].fdata) mformat->free_params(mformat, node[k].fdata);
     }
-
-    fraction += 1.0 / total;
-    if(fraction > 1.0) fraction = 1.0;
-    dt_control_job_set_progress(job, fraction);
   }
+  dt_pthread_mutex_destroy(&queue.lock);
+
   g_list_free_full(metadata.list, g_free);
 
   if(mstorage->finalize_store) mstorage->finalize_store(mstorage, sdata);
@@ -1313,6 +1487,9 @@ end:
   // all threads free their fdata
   mformat->free_params(mformat, fdata);
 
+  // the buffers kept for the next image of this export are not needed anymore
+  dt_dev_pixelpipe_pool_trim(darktable.pixelpipe_pool);
+
   // notify the user via the window manager
   dt_ui_notify_user();
 
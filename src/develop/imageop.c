@@ -314,6 +314,10 @@ int dt_iop_load_module_so(void *m, const char *libname, const char *op)
 
   if(!g_module_symbol(module->module, "process_sse2", (gpointer) & (module->process_sse2)))
     module->process_sse2 = NULL;
+  if(!g_module_symbol(module->module, "process_pixels_setup", (gpointer) & (module->process_pixels_setup)))
+    module->process_pixels_setup = NULL;
+  if(!g_module_symbol(module->module, "process_pixels", (gpointer) & (module->process_pixels)))
+    module->process_pixels = NULL;
 
   if(!g_module_symbol(module->module, "process", (gpointer) & (module->process_plain))) goto error;
 
@@ -451,6 +455,8 @@ int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt
   module->process_tiling = so->process_tiling;
   module->process_plain = so->process_plain;
   module->process_sse2 = so->process_sse2;
+  module->process_pixels_setup = so->process_pixels_setup;
+  module->process_pixels = so->process_pixels;
   module->process_cl = so->process_cl;
   module->process_tiling_cl = so->process_tiling_cl;
   module->distort_transform = so->distort_transform;
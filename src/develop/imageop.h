@@ -100,7 +100,12 @@ typedef enum dt_iop_flags_t
   = 1 << 8, // Preview pixelpipe of this module must not run on GPU but always on CPU
   IOP_FLAGS_NO_HISTORY_STACK = 1 << 9, // This iop will never show up in the history stack
   IOP_FLAGS_NO_MASKS = 1 << 10,         // The module doesn't support masks (used with SUPPORT_BLENDING)
-  IOP_FLAGS_FENCE = 1 << 11              // No module can be moved pass this one
+  IOP_FLAGS_FENCE = 1 << 11,             // No module can be moved pass this one
+  IOP_FLAGS_SCALE_INVARIANT = 1 << 12,   // Output of a downscaled input matches the downscaled output (point-wise
+                                         // or resampling-only modules), export may downscale before this module
+  IOP_FLAGS_ANY_COLORSPACE = 1 << 13,    // Only moves or resamples pixels, may run in Lab as well as in rgb
+  IOP_FLAGS_POINTWISE = 1 << 14          // Each output pixel depends only on the input pixel at the same place,
+                                         // the module may be run on any crop of its roi
 } dt_iop_flags_t;
 
 /** status of a module*/
@@ -256,6 +261,9 @@ typedef struct dt_iop_module_so_t
   void (*process_sse2)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                        const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
                        const struct dt_iop_roi_t *const roi_out);
+  void (*process_pixels_setup)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
+  void (*process_pixels)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                         const float *const in, float *const out, const size_t npixels);
   int (*process_cl)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
                     void *const o, const struct dt_iop_roi_t *const roi_in,
                     const struct dt_iop_roi_t *const roi_out);
@@ -504,6 +512,11 @@ typedef struct dt_iop_module_t
   void (*process_sse2)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                        const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
                        const struct dt_iop_roi_t *const roi_out);
+  /** per-run setup and per-pixel kernel of a point-wise process(), used to fuse runs of such modules. */
+  void (*process_pixels_setup)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
+  /** in may equal out, called concurrently on chunks of npixels pixels. */
+  void (*process_pixels)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                         const float *const in, float *const out, const size_t npixels);
   /** the opencl equivalent of process(). */
   int (*process_cl)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
                     void *const o, const struct dt_iop_roi_t *const roi_in,
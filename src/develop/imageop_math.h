@@ -176,6 +176,23 @@ static inline float dt_iop_eval_exp(const float *const coeff, const float x)
   return coeff[1] * powf(x * coeff[0], coeff[2]);
 }
 
+typedef union floatint_t
+{
+  float f;
+  uint32_t i;
+} floatint_t;
+
+/** very fast approximation for 2^-x (returns 0 for x > 126) */
+static inline float fast_mexp2f(const float x)
+{
+  const float i1 = (float)0x3f800000u; // 2^0
+  const float i2 = (float)0x3f000000u; // 2^-1
+  const float k0 = i1 + x * (i2 - i1);
+  floatint_t k;
+  k.i = k0 >= (float)0x800000u ? k0 : 0;
+  return k.f;
+}
+
 /** Copy alpha channel 1:1 from input to output */
 static inline void dt_iop_alpha_copy(const void *const __restrict__ ivoid,
                                      void *const __restrict__ ovoid,
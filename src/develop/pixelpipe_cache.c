@@ -17,8 +17,10 @@
 */
 
 #include "develop/pixelpipe_cache.h"
+#include "common/half.h"
 #include "develop/format.h"
 #include "develop/pixelpipe_hb.h"
+#include "develop/pixelpipe_pool.h"
 #include "libs/lib.h"
 #include <stdlib.h>
 
@@ -32,9 +34,11 @@
 //   ping, pong, and priority buffer (focused plugin)
 // - drop read by the time another is requested (with priority, drop that, or alternating ping and pong?)
 
-int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size)
+int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size,
+                                dt_dev_pixelpipe_pool_t *pool)
 {
   cache->entries = entries;
+  cache->pool = pool;
   cache->data = (void **)calloc(entries, sizeof(void *));
   cache->size = (size_t *)calloc(entries, sizeof(size_t));
   cache->dsc = (dt_iop_buffer_dsc_t *)calloc(entries, sizeof(dt_iop_buffer_dsc_t));
@@ -43,12 +47,19 @@ int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, si
 #endif
   cache->hash = (uint64_t *)calloc(entries, sizeof(uint64_t));
   cache->used = (int32_t *)calloc(entries, sizeof(int32_t));
+  cache->filled = (size_t *)calloc(entries, sizeof(size_t));
+  cache->half_entries = 0;
+  cache->half = NULL;
+  cache->half_size = cache->half_filled = NULL;
+  cache->half_dsc = NULL;
+  cache->half_hash = NULL;
+  cache->half_used = NULL;
   for(int k = 0; k < entries; k++)
   {
     cache->size[k] = size;
     if(size)
     { // allow 0 initial buffer size (yet unknown dimensions)
-      cache->data[k] = (void *)dt_alloc_align(64, size);
+      cache->data[k] = dt_dev_pixelpipe_pool_alloc(pool, size);
       if(!cache->data[k]) goto alloc_memory_fail;
 #ifdef _DEBUG
       memset(cache->data[k], 0x5d, size);
@@ -59,7 +70,7 @@ int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, si
     cache->hash[k] = -1;
     cache->used[k] = 0;
   }
-  cache->queries = cache->misses = 0;
+  cache->queries = cache->misses = cache->half_hits = 0;
   return 1;
 
 alloc_memory_fail:
@@ -70,21 +81,94 @@ alloc_memory_fail:
   // but will only fail to generate thumbnails for example.
   for(int k = 0; k < cache->entries; k++)
   {
-    dt_free_align(cache->data[k]);
+    dt_dev_pixelpipe_pool_free(cache->data[k]);
     cache->size[k] = 0;
     cache->data[k] = NULL;
   }
   return 0;
 }
 
+void dt_dev_pixelpipe_cache_init_half(dt_dev_pixelpipe_cache_t *cache, int entries)
+{
+  cache->half_entries = entries;
+  cache->half = (uint16_t **)calloc(entries, sizeof(uint16_t *));
+  cache->half_size = (size_t *)calloc(entries, sizeof(size_t));
+  cache->half_filled = (size_t *)calloc(entries, sizeof(size_t));
+  cache->half_dsc = (dt_iop_buffer_dsc_t *)calloc(entries, sizeof(dt_iop_buffer_dsc_t));
+  cache->half_hash = (uint64_t *)calloc(entries, sizeof(uint64_t));
+  cache->half_used = (int32_t *)calloc(entries, sizeof(int32_t));
+  for(int k = 0; k < entries; k++) cache->half_hash[k] = -1;
+}
+
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
 {
-  for(int k = 0; k < cache->entries; k++) dt_free_align(cache->data[k]);
+  for(int k = 0; k < cache->entries; k++) dt_dev_pixelpipe_pool_free(cache->data[k]);
   free(cache->data);
   free(cache->dsc);
   free(cache->hash);
   free(cache->used);
   free(cache->size);
+  free(cache->filled);
+  for(int k = 0; k < cache->half_entries; k++) dt_dev_pixelpipe_pool_free(cache->half[k]);
+  free(cache->half);
+  free(cache->half_size);
+  free(cache->half_filled);
+  free(cache->half_dsc);
+  free(cache->half_hash);
+  free(cache->half_used);
+}
+
+static int _half_find(const dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
+{
+  for(int k = 0; k < cache->half_entries; k++)
+    if(cache->half_hash[k] == hash) return k;
+  return -1;
+}
+
+// keeps the content of float line k as half floats before it gets overwritten
+static void _half_pack(dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  if(!cache->half_entries || cache->hash[k] == (uint64_t)-1 || !cache->data[k]
+     || cache->dsc[k].datatype != TYPE_FLOAT || cache->filled[k] < sizeof(float))
+    return;
+
+  int slot = -1, max_used = -1;
+  for(int h = 0; h < cache->half_entries; h++)
+  {
+    cache->half_used[h]++;
+    if(cache->half_hash[h] == cache->hash[k]) slot = h;
+  }
+  if(slot >= 0)
+  {
+    // still there from an earlier eviction
+    cache->half_used[slot] = 0;
+    return;
+  }
+  for(int h = 0; h < cache->half_entries; h++)
+  {
+    if(cache->half_used[h] > max_used)
+    {
+      max_used = cache->half_used[h];
+      slot = h;
+    }
+  }
+
+  const size_t n = cache->filled[k] / sizeof(float);
+  if(cache->half_size[slot] < n)
+  {
+    dt_dev_pixelpipe_pool_free(cache->half[slot]);
+    cache->half[slot] = (uint16_t *)dt_dev_pixelpipe_pool_alloc(cache->pool, n * sizeof(uint16_t));
+    cache->half_size[slot] = cache->half[slot] ? n : 0;
+    cache->half_hash[slot] = -1;
+    if(!cache->half[slot]) return;
+  }
+
+  ASAN_UNPOISON_MEMORY_REGION(cache->data[k], cache->filled[k]);
+  dt_half_from_float((const float *)cache->data[k], cache->half[slot], n);
+  cache->half_filled[slot] = n;
+  cache->half_dsc[slot] = cache->dsc[k];
+  cache->half_hash[slot] = cache->hash[k];
+  cache->half_used[slot] = 0;
 }
 
 uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_pixelpipe_t *pipe, int module)
@@ -122,12 +206,14 @@ uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_
   return hash;
 }
 
-int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
+int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size)
 {
   // search for hash in cache
   for(int32_t k = 0; k < cache->entries; k++)
     if(cache->hash[k] == hash) return 1;
-  return 0;
+  // half floats can only be unpacked into a buffer of the size they were packed from
+  const int half = _half_find(cache, hash);
+  return half >= 0 && cache->half_filled[half] * sizeof(float) == size;
 }
 
 int dt_dev_pixelpipe_cache_get_important(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
@@ -175,10 +261,11 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
     // kill LRU entry
     // printf("[pixelpipe_cache_get] hash not found, returning slot %d/%d age %d\n", max, cache->entries,
     // weight);
+    if(cache->hash[max] != hash) _half_pack(cache, max);
     if(cache->size[max] < size)
     {
-      dt_free_align(cache->data[max]);
-      cache->data[max] = (void *)dt_alloc_align(64, size);
+      dt_dev_pixelpipe_pool_free(cache->data[max]);
+      cache->data[max] = dt_dev_pixelpipe_pool_alloc(cache->pool, size);
       cache->size[max] = size;
     }
     *data = cache->data[max];
@@ -193,6 +280,24 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
 
     cache->hash[max] = hash;
     cache->used[max] = weight;
+    cache->filled[max] = size;
+
+    // evicted before, unpack instead of having it computed again
+    const int half = _half_find(cache, hash);
+    if(half >= 0)
+    {
+      if(*data && cache->half_filled[half] * sizeof(float) == size)
+      {
+        dt_half_to_float(cache->half[half], (float *)*data, cache->half_filled[half]);
+        cache->dsc[max] = cache->half_dsc[half];
+        cache->half_used[half] = 0;
+        cache->half_hits++;
+        return 0;
+      }
+      // can't be unpacked here, don't report it as available any longer
+      cache->half_hash[half] = -1;
+    }
+
     cache->misses++;
     return 1;
   }
@@ -208,6 +313,7 @@ void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache)
     cache->used[k] = 0;
     ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
   }
+  for(int k = 0; k < cache->half_entries; k++) cache->half_hash[k] = -1;
 }
 
 void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data)
@@ -242,6 +348,8 @@ void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
     printf("\n");
   }
   printf("cache hit rate so far: %.3f\n", (cache->queries - cache->misses) / (float)cache->queries);
+  if(cache->half_entries)
+    printf("of these unpacked from half floats: %.3f\n", cache->half_hits / (float)cache->queries);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -21,6 +21,7 @@
 #include <inttypes.h>
 
 struct dt_dev_pixelpipe_t;
+struct dt_dev_pixelpipe_pool_t;
 struct dt_iop_buffer_dsc_t;
 struct dt_iop_roi_t;
 
@@ -28,6 +29,10 @@ struct dt_iop_roi_t;
  * implements a simple pixel cache suitable for caching float images
  * corresponding to history items and zoom/pan settings in the develop module.
  * it is optimized for very few entries (~5), so most operations are O(N).
+ *
+ * optionally float lines of interactive pipes are packed to half floats when they get evicted, in a second
+ * set of slots at half the size. asking for such a hash again unpacks it into a float line, which is cheaper
+ * than running the modules up to there again.
  */
 
 typedef struct dt_dev_pixelpipe_cache_t
@@ -38,19 +43,35 @@ typedef struct dt_dev_pixelpipe_cache_t
   struct dt_iop_buffer_dsc_t *dsc;
   uint64_t *hash;
   int32_t *used;
+  size_t *filled; // bytes of the content asked for
+  struct dt_dev_pixelpipe_pool_t *pool; // where the cache lines come from
+
+  // half float copies of evicted lines
+  int32_t half_entries;
+  uint16_t **half;
+  size_t *half_size;   // allocated values
+  size_t *half_filled; // packed values
+  struct dt_iop_buffer_dsc_t *half_dsc;
+  uint64_t *half_hash;
+  int32_t *half_used;
 #ifdef HAVE_OPENCL
   void **gpu_mem;
 #endif
   // profiling:
   uint64_t queries;
   uint64_t misses;
+  uint64_t half_hits;
 } dt_dev_pixelpipe_cache_t;
 
 /** constructs a new cache with given cache line count (entries) and float buffer entry size in bytes.
+  cache lines are taken from pool, which may be NULL.
   \param[out] returns 0 if fail to allocate mem cache.
 */
-int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size);
+int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size,
+                                struct dt_dev_pixelpipe_pool_t *pool);
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache);
+/** adds entries slots keeping evicted float lines as half floats. memory is taken when lines are packed. */
+void dt_dev_pixelpipe_cache_init_half(dt_dev_pixelpipe_cache_t *cache, int entries);
 
 /** creates a hopefully unique hash from the complete module stack up to the module-th. */
 uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const struct dt_iop_roi_t *roi,
@@ -66,8 +87,8 @@ int dt_dev_pixelpipe_cache_get_important(dt_dev_pixelpipe_cache_t *cache, const
 int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
                                         void **data, struct dt_iop_buffer_dsc_t **dsc, int weight);
 
-/** test availability of a cache line without destroying another, if it is not found. */
-int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash);
+/** test availability of a cache line of size bytes without destroying another, if it is not found. */
+int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size);
 
 /** invalidates all cachelines. */
 void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache);
@@ -27,6 +27,7 @@
 #include "develop/format.h"
 #include "develop/imageop_math.h"
 #include "develop/pixelpipe.h"
+#include "develop/pixelpipe_pool.h"
 #include "develop/tiling.h"
 #include "develop/masks.h"
 #include "gui/gtk.h"
@@ -151,7 +152,12 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->processed_height = pipe->backbuf_height = pipe->iheight = 0;
   pipe->nodes = NULL;
   pipe->backbuf_size = size;
-  if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size)) return 0;
+  // pipes made for one image at a known size (export, thumbnails) share a pool that outlives them
+  pipe->pool = size ? darktable.pixelpipe_pool : dt_dev_pixelpipe_pool_new(dt_dev_pixelpipe_pool_limit(4));
+  if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size, pipe->pool)) return 0;
+  // interactive pipes may keep evicted lines as half floats, to step through the history without recomputing
+  if(!size && dt_conf_get_bool("pixelpipe_half_float_cache"))
+    dt_dev_pixelpipe_cache_init_half(&(pipe->cache), entries);
   pipe->cache_obsolete = 0;
   pipe->backbuf = NULL;
   pipe->backbuf_scale = 0.0f;
@@ -180,6 +186,7 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->iop_order_list = NULL;
   pipe->forms = NULL;
   pipe->store_all_raster_masks = FALSE;
+  pipe->incremental_valid = 0;
 
   return 1;
 }
@@ -187,6 +194,8 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
 void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, float *input, int width, int height,
                                 float iscale)
 {
+  if(pipe->input != input || pipe->iwidth != width || pipe->iheight != height || pipe->iscale != iscale)
+    pipe->incremental_valid = 0;
   pipe->iwidth = width;
   pipe->iheight = height;
   pipe->iscale = iscale;
@@ -212,6 +221,13 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   dt_dev_pixelpipe_cleanup_nodes(pipe);
   // so now it's safe to clean up cache:
   dt_dev_pixelpipe_cache_cleanup(&(pipe->cache));
+  if(pipe->pool != darktable.pixelpipe_pool)
+  {
+    if(darktable.unmuted & DT_DEBUG_MEMORY)
+      dt_dev_pixelpipe_pool_print_stats(pipe->pool, _pipe_type_to_str(pipe->type));
+    dt_dev_pixelpipe_pool_destroy(pipe->pool);
+  }
+  pipe->pool = NULL;
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
   dt_pthread_mutex_destroy(&(pipe->backbuf_mutex));
   dt_pthread_mutex_destroy(&(pipe->busy_mutex));
@@ -302,6 +318,8 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
     piece->hash = 0;
     piece->process_cl_ready = 0;
     piece->process_tiling_ready = 0;
+    piece->planned_cst = iop_cs_NONE;
+    piece->planned_cpu = 0;
     piece->raster_masks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, dt_free_align_ptr);
     memset(&piece->processed_roi_in, 0, sizeof(piece->processed_roi_in));
     memset(&piece->processed_roi_out, 0, sizeof(piece->processed_roi_out));
@@ -1122,6 +1140,375 @@ static int _transform_for_blend(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *p
   return ret;
 }
 
+// colorspaces a module runs in, which for colorspace agnostic modules is decided by the plan
+static inline int _pixelpipe_input_cst(dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe,
+                                       dt_dev_pixelpipe_iop_t *piece)
+{
+  if(piece->planned_cst != iop_cs_NONE) return piece->planned_cst;
+  return module->input_colorspace(module, pipe, piece);
+}
+
+static inline int _pixelpipe_output_cst(dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe,
+                                        dt_dev_pixelpipe_iop_t *piece)
+{
+  if(piece->planned_cst != iop_cs_NONE) return piece->planned_cst;
+  return module->output_colorspace(module, pipe, piece);
+}
+
+// every colorspace conversion of the pipe goes through one of these two, so that they can be counted
+static void _pixelpipe_transform_colorspace(dt_dev_pixelpipe_t *pipe, dt_iop_module_t *module,
+                                            const float *const image_in, float *const image_out,
+                                            const int width, const int height, const int cst_from,
+                                            const int cst_to, int *converted_cst,
+                                            const dt_iop_order_iccprofile_info_t *const profile_info)
+{
+  dt_ioppr_transform_image_colorspace(module, image_in, image_out, width, height, cst_from, cst_to, converted_cst,
+                                      profile_info);
+  if(cst_from != cst_to && *converted_cst == cst_to) pipe->cst_conversions++;
+}
+
+#ifdef HAVE_OPENCL
+static int _pixelpipe_transform_colorspace_cl(dt_dev_pixelpipe_t *pipe, dt_iop_module_t *module, const int devid,
+                                              cl_mem dev_img_in, cl_mem dev_img_out, const int width,
+                                              const int height, const int cst_from, const int cst_to,
+                                              int *converted_cst,
+                                              const dt_iop_order_iccprofile_info_t *const profile_info)
+{
+  const int success = dt_ioppr_transform_image_colorspace_cl(module, devid, dev_img_in, dev_img_out, width, height,
+                                                             cst_from, cst_to, converted_cst, profile_info);
+  if(success && cst_from != cst_to && *converted_cst == cst_to) pipe->cst_conversions++;
+  return success;
+}
+#endif
+
+/*
+ * plan the colorspaces of the run ahead of time. modules which only move pixels around
+ * (IOP_FLAGS_ANY_COLORSPACE) normally force a conversion to their own colorspace and the next
+ * module converts back. when the next module wants the colorspace which was there before anyway,
+ * such a module just runs in that colorspace and both conversions are gone. when it doesn't, the
+ * conversion would only be moved, so the module keeps its own colorspace.
+ */
+static void _pixelpipe_plan_colorspaces(dt_dev_pixelpipe_t *pipe)
+{
+  int cst = iop_cs_NONE;   // colorspace leaving the last planned module
+  GList *pending = NULL;   // agnostic modules waiting for the next module to decide about them
+  int pending_cst = iop_cs_NONE;
+
+  pipe->cst_conversions = pipe->cst_conversions_avoided = 0;
+
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    dt_iop_module_t *module = piece->module;
+    piece->planned_cst = iop_cs_NONE;
+    if(!piece->enabled) continue;
+
+    if((module->flags() & IOP_FLAGS_ANY_COLORSPACE) && (cst == iop_cs_rgb || cst == iop_cs_Lab)
+       && cst != module->input_colorspace(module, pipe, piece)
+       && !_transform_for_blend(module, piece, cst, cst))
+    {
+      if(!pending) pending_cst = cst;
+      pending = g_list_prepend(pending, piece);
+      continue;
+    }
+
+    if(pending && module->input_colorspace(module, pipe, piece) == pending_cst)
+    {
+      for(GList *p = pending; p; p = g_list_next(p))
+        ((dt_dev_pixelpipe_iop_t *)p->data)->planned_cst = pending_cst;
+      pipe->cst_conversions_avoided += 2;
+    }
+    g_list_free(pending);
+    pending = NULL;
+
+    cst = module->output_colorspace(module, pipe, piece);
+  }
+  g_list_free(pending);
+}
+
+#ifdef HAVE_OPENCL
+static inline gboolean _pixelpipe_piece_gpu_capable(dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
+{
+  return piece->module->process_cl && piece->process_cl_ready
+         && !((pipe->type == DT_DEV_PIXELPIPE_PREVIEW || pipe->type == DT_DEV_PIXELPIPE_PREVIEW2)
+              && (piece->module->flags() & IOP_FLAGS_PREVIEW_NON_OPENCL));
+}
+
+static inline gboolean _pixelpipe_piece_skipped(dt_develop_t *dev, dt_dev_pixelpipe_iop_t *piece)
+{
+  return !piece->enabled
+         || (dev->gui_module && dev->gui_module->operation_tags_filter() & piece->module->operation_tags());
+}
+
+// output pixels of every piece for a run with this roi, the way the recursion will ask for them. 0 for
+// pieces the run skips.
+static void _pixelpipe_piece_pixels(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *roi,
+                                    size_t *pixels, const int num)
+{
+  dt_iop_roi_t roi_out = *roi;
+  int k = num - 1;
+  for(GList *nodes = g_list_last(pipe->nodes); nodes && k >= 0; nodes = g_list_previous(nodes), k--)
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    pixels[k] = 0;
+    if(_pixelpipe_piece_skipped(dev, piece)) continue;
+
+    pixels[k] = (size_t)MAX(roi_out.width, 0) * MAX(roi_out.height, 0);
+    dt_iop_roi_t roi_in = roi_out;
+    piece->module->modify_roi_in(piece->module, piece, &roi_out, &roi_in);
+    roi_out = roi_in;
+  }
+}
+
+/*
+ * place every module on the cpu or the gpu, from the times measured for both and for moving the
+ * buffer between host and device (see dt_opencl_cost_record()). a gpu capable module between
+ * modules which only run on the cpu can be cheaper to run on the cpu than to copy the image over
+ * and back. this is a shortest path over the two states "buffer on host" and "buffer on device",
+ * starting and ending on the host. modules without timings on both sides stay on the gpu as before.
+ * the sizes are those of the run about to start with roi, not of the last one.
+ */
+static void _pixelpipe_plan_devices(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *roi)
+{
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+    ((dt_dev_pixelpipe_iop_t *)nodes->data)->planned_cpu = 0;
+
+  if(pipe->devid < 0 || !dt_conf_get_bool("opencl_cost_placement")) return;
+
+  const int num = g_list_length(pipe->nodes);
+  dt_dev_pixelpipe_iop_t **pieces = malloc(sizeof(dt_dev_pixelpipe_iop_t *) * num);
+  // per module: which state the best path to "host" / "device" after it came from, 0 host, 1 device
+  uint8_t *from = malloc(sizeof(uint8_t) * 2 * num);
+  size_t *pixels = malloc(sizeof(size_t) * num);
+  if(!pieces || !from || !pixels)
+  {
+    free(pieces);
+    free(from);
+    free(pixels);
+    return;
+  }
+  _pixelpipe_piece_pixels(pipe, dev, roi, pixels, num);
+
+  const float transfer = dt_opencl_cost_transfer(pipe->devid) * 0.5f; // one way, per megapixel
+  double host = 0.0, device = INFINITY;
+  float last_transfer = 0.0f;
+  int n = 0;
+  int k = 0;
+
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes), k++)
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(_pixelpipe_piece_skipped(dev, piece)) continue;
+
+    const float mpix = pixels[k] / 1e6f;
+    const gboolean capable = _pixelpipe_piece_gpu_capable(pipe, piece);
+    float cpu, gpu;
+    dt_opencl_cost_get(pipe->devid, piece->module->op, &cpu, &gpu);
+
+    const double cost_cpu = isnan(cpu) ? (capable ? INFINITY : 0.0) : cpu * mpix;
+    const double cost_gpu = capable ? (isnan(gpu) ? 0.0 : gpu * mpix) : INFINITY;
+    const double copy = transfer * mpix;
+
+    from[2 * n] = !(host <= device + copy);
+    from[2 * n + 1] = device <= host + copy;
+    const double next_host = MIN(host, device + copy) + cost_cpu;
+    const double next_device = capable ? MIN(device, host + copy) + cost_gpu : INFINITY;
+    host = next_host;
+    device = next_device;
+    last_transfer = copy;
+    pieces[n++] = piece;
+  }
+
+  // walk back from the cheapest way of ending up on the host
+  int state = !(host <= device + last_transfer);
+  int moved = 0;
+  for(int k = n - 1; k >= 0; k--)
+  {
+    if(state == 0 && _pixelpipe_piece_gpu_capable(pipe, pieces[k]))
+    {
+      pieces[k]->planned_cpu = 1;
+      moved++;
+    }
+    state = from[2 * k + state];
+  }
+
+  if(moved)
+    dt_print(DT_DEBUG_OPENCL | DT_DEBUG_PERF, "[pixelpipe_process] [%s] cost model moved %d modules to the cpu\n",
+             _pipe_type_to_str(pipe->type), moved);
+
+  free(pieces);
+  free(from);
+  free(pixels);
+}
+
+// times the module on the gpu if the cost model asks for it. the queue has to be drained on both
+// sides, which is why this only happens every now and then.
+static int _pixelpipe_process_cl_timed(dt_dev_pixelpipe_t *pipe, dt_iop_module_t *module,
+                                       dt_dev_pixelpipe_iop_t *piece, cl_mem input, cl_mem output,
+                                       const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out)
+{
+  if(!dt_opencl_cost_want_gpu_sample(pipe->devid, module->op))
+    return module->process_cl(module, piece, input, output, roi_in, roi_out);
+
+  dt_opencl_finish(pipe->devid);
+  const double start = dt_get_wtime();
+  const int success = module->process_cl(module, piece, input, output, roi_in, roi_out);
+  if(success && dt_opencl_finish(pipe->devid))
+    dt_opencl_cost_record(pipe->devid, module->op, TRUE, dt_get_wtime() - start,
+                          (size_t)roi_out->width * roi_out->height);
+  return success;
+}
+#endif
+
+// blending a crop has to give the crop of the blended full roi: no feathering or blurring of the mask,
+// and no raster mask made for the full roi
+static gboolean _piece_blends_pointwise(const dt_dev_pixelpipe_iop_t *const piece)
+{
+  const dt_develop_blend_params_t *const bp = (const dt_develop_blend_params_t *)piece->blendop_data;
+  if(!bp || bp->mask_mode == DEVELOP_MASK_DISABLED) return TRUE;
+  return bp->feathering_radius <= 0.0f && bp->blur_radius <= 0.0f && !(bp->mask_mode & DEVELOP_MASK_RASTER);
+}
+
+// the same holds for the module itself: it has to declare that it works per pixel, and no histogram or raster
+// mask may be gathered over the roi
+static gboolean _piece_is_pointwise(const dt_dev_pixelpipe_iop_t *const piece)
+{
+  dt_iop_module_t *const module = piece->module;
+  return (module->flags() & IOP_FLAGS_POINTWISE) && !(module->operation_tags() & IOP_TAG_DISTORT)
+         && !(piece->request_histogram & DT_REQUEST_ON)
+         && (!module->raster_mask.source.users || g_hash_table_size(module->raster_mask.source.users) == 0)
+         && _piece_blends_pointwise(piece);
+}
+
+// longest run of point-wise modules fused into one pass, and pixels per chunk of that pass
+#define DT_DEV_PIXELPIPE_MAX_FUSED 16
+#define DT_DEV_PIXELPIPE_FUSED_CHUNK 1024
+
+static inline gboolean _pixelpipe_piece_on_cpu(dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
+{
+#ifdef HAVE_OPENCL
+  if(dt_opencl_is_inited() && pipe->opencl_enabled && pipe->devid >= 0)
+    return !_pixelpipe_piece_gpu_capable(pipe, piece) || piece->planned_cpu;
+#endif
+  return TRUE;
+}
+
+static gboolean _pixelpipe_piece_fusable(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
+                                         dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *const roi,
+                                         const int cst)
+{
+  dt_iop_module_t *const module = piece->module;
+  const dt_develop_blend_params_t *const bp = (const dt_develop_blend_params_t *)piece->blendop_data;
+  if(!module->process_pixels || !_piece_is_pointwise(piece) || !_pixelpipe_piece_on_cpu(pipe, piece))
+    return FALSE;
+  // blending and picking need the input of the module, which is never written in a fused pass
+  if(bp && bp->mask_mode != DEVELOP_MASK_DISABLED) return FALSE;
+  if(module == dev->gui_module && module->request_color_pick != DT_REQUEST_COLORPICK_OFF) return FALSE;
+  if(_pixelpipe_input_cst(module, pipe, piece) != cst || _pixelpipe_output_cst(module, pipe, piece) != cst)
+    return FALSE;
+
+  dt_iop_roi_t roi_in = *roi;
+  module->modify_roi_in(module, piece, roi, &roi_in);
+  return !memcmp(&roi_in, roi, sizeof(dt_iop_roi_t));
+}
+
+/*
+ * collect the run of point-wise modules ending in the module at pieces, to be processed in one pass
+ * straight from the input of the first one. the run stops at anything that needs its output written
+ * out: a cache line which is already there, or the input of the focused module, which the user is
+ * about to change. returns the number of fused modules (0 if there is nothing to fuse) and moves
+ * modules/pieces/pos to the module whose output is the input of the run.
+ */
+static int _pixelpipe_fuse_chain(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *const roi,
+                                 dt_dev_pixelpipe_iop_t **fused, GList **modules, GList **pieces, int *pos)
+{
+  dt_dev_pixelpipe_iop_t *last = (dt_dev_pixelpipe_iop_t *)(*pieces)->data;
+  if(pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE || pipe->bypass_blendif || last->module == dev->gui_module
+     || (darktable.unmuted & DT_DEBUG_NAN))
+    return 0;
+  const int cst = _pixelpipe_input_cst(last->module, pipe, last);
+  if((cst != iop_cs_rgb && cst != iop_cs_Lab) || !_pixelpipe_piece_fusable(pipe, dev, last, roi, cst)) return 0;
+
+  int num = 1;
+  GList *m = g_list_previous(*modules), *p = g_list_previous(*pieces);
+  int k = *pos - 1;
+  fused[DT_DEV_PIXELPIPE_MAX_FUSED - 1] = last;
+  for(; m && num < DT_DEV_PIXELPIPE_MAX_FUSED; m = g_list_previous(m), p = g_list_previous(p), k--)
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)p->data;
+    dt_iop_module_t *module = (dt_iop_module_t *)m->data;
+    if(!piece->enabled
+       || (dev->gui_module && dev->gui_module->operation_tags_filter() & module->operation_tags()))
+      continue;
+
+    // fused modules all write 4 floats per pixel
+    dt_pthread_mutex_lock(&pipe->busy_mutex);
+    const int cached = dt_dev_pixelpipe_cache_available(&(pipe->cache),
+                                                        dt_dev_pixelpipe_cache_hash(pipe->image.id, roi, pipe, k),
+                                                        (size_t)roi->width * roi->height * 4 * sizeof(float));
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    if(cached || !_pixelpipe_piece_fusable(pipe, dev, piece, roi, cst)) break;
+
+    fused[DT_DEV_PIXELPIPE_MAX_FUSED - 1 - num++] = piece;
+    if(module == dev->gui_module)
+    {
+      m = g_list_previous(m);
+      p = g_list_previous(p);
+      k--;
+      break;
+    }
+  }
+  if(num < 2) return 0;
+
+  memmove(fused, fused + DT_DEV_PIXELPIPE_MAX_FUSED - num, sizeof(dt_dev_pixelpipe_iop_t *) * num);
+  *modules = m;
+  *pieces = p;
+  *pos = k;
+  return num;
+}
+
+// runs the fused modules over the image in chunks small enough to stay in cache between them
+static void _pixelpipe_process_fused(dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t **fused, const int num_fused,
+                                     const float *const input, float *const output, const dt_iop_roi_t *const roi)
+{
+  for(int m = 0; m < num_fused; m++)
+  {
+    dt_dev_pixelpipe_iop_t *piece = fused[m];
+    piece->dsc_in = pipe->dsc;
+    if(piece->module->process_pixels_setup) piece->module->process_pixels_setup(piece->module, piece);
+    piece->dsc_out = pipe->dsc;
+  }
+
+  const size_t npixels = (size_t)roi->width * roi->height;
+  const size_t nchunks = (npixels + DT_DEV_PIXELPIPE_FUSED_CHUNK - 1) / DT_DEV_PIXELPIPE_FUSED_CHUNK;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(fused, num_fused, input, output, npixels, nchunks) \
+  schedule(static)
+#endif
+  for(size_t c = 0; c < nchunks; c++)
+  {
+    const size_t offset = c * DT_DEV_PIXELPIPE_FUSED_CHUNK;
+    const size_t n = MIN(DT_DEV_PIXELPIPE_FUSED_CHUNK, npixels - offset);
+    float *const out = output + 4 * offset;
+    fused[0]->module->process_pixels(fused[0]->module, fused[0], input + 4 * offset, out, n);
+    for(int m = 1; m < num_fused; m++) fused[m]->module->process_pixels(fused[m]->module, fused[m], out, out, n);
+  }
+}
+
+// whether a piece has to be tiled on the cpu. one that fits host_memory_limit, but not beside the buffers kept
+// by the pools, rather gets these given back than being tiled.
+static gboolean _pixelpipe_piece_needs_tiling(dt_dev_pixelpipe_t *pipe, const size_t width, const size_t height,
+                                              const unsigned bpp, const float factor, const size_t overhead)
+{
+  if(dt_tiling_piece_fits_beside_pools(width, height, bpp, factor, overhead)) return FALSE;
+  if(!dt_tiling_piece_fits_host_memory(width, height, bpp, factor, overhead)) return TRUE;
+
+  dt_dev_pixelpipe_pool_trim(darktable.pixelpipe_pool);
+  if(pipe->pool != darktable.pixelpipe_pool) dt_dev_pixelpipe_pool_trim(pipe->pool);
+  return FALSE;
+}
+
 // recursive helper for process:
 static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
                                         void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
@@ -1164,7 +1551,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   if(pipe->type != DT_DEV_PIXELPIPE_PREVIEW || module == NULL || strcmp(module->op, "gamma") != 0)
   {
     hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, roi_out, pipe, pos);
-    cache_available = dt_dev_pixelpipe_cache_available(&(pipe->cache), hash);
+    cache_available = dt_dev_pixelpipe_cache_available(&(pipe->cache), hash, bufsize);
   }
   if(cache_available)
   {
@@ -1265,6 +1652,24 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     module->modify_roi_in(module, piece, roi_out, &roi_in);
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
 
+    // point-wise modules right before this one can run in one pass with it, then we start from their input
+    dt_dev_pixelpipe_iop_t *fused[DT_DEV_PIXELPIPE_MAX_FUSED];
+    GList *in_modules = modules, *in_pieces = pieces;
+    int in_pos = pos;
+    const int num_fused = _pixelpipe_fuse_chain(pipe, dev, roi_out, fused, &in_modules, &in_pieces, &in_pos);
+    if(num_fused)
+    {
+      for(int k = 0; k < num_fused; k++) fused[k]->processed_roi_in = fused[k]->processed_roi_out = *roi_out;
+      dt_print(DT_DEBUG_PERF, "[dev_pixelpipe] fusing %d point-wise modules up to `%s' [%s]\n", num_fused,
+               module->op, _pipe_type_to_str(pipe->type));
+    }
+    else
+    {
+      in_modules = g_list_previous(modules);
+      in_pieces = g_list_previous(pieces);
+      in_pos = pos - 1;
+    }
+
     // recurse to get actual data of input buffer
 
     dt_iop_buffer_dsc_t _input_format = { 0 };
@@ -1275,8 +1680,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     piece->processed_roi_in = roi_in;
     piece->processed_roi_out = *roi_out;
 
-    if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, &roi_in,
-                                    g_list_previous(modules), g_list_previous(pieces), pos - 1))
+    if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, &roi_in, in_modules,
+                                    in_pieces, in_pos))
       return 1;
 
     const size_t in_bpp = dt_iop_buffer_dsc_to_bpp(input_format);
@@ -1419,9 +1824,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
          are treated in the same manner. */
 
       /* try to enter opencl path after checking some module specific pre-requisites */
-      if(module->process_cl && piece->process_cl_ready
-         && !((pipe->type == DT_DEV_PIXELPIPE_PREVIEW || pipe->type == DT_DEV_PIXELPIPE_PREVIEW2)
-              && (module->flags() & IOP_FLAGS_PREVIEW_NON_OPENCL))
+      if(_pixelpipe_piece_gpu_capable(pipe, piece) && !piece->planned_cpu
          && (fits_on_device || piece->process_tiling_ready))
       {
 
@@ -1492,9 +1895,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           // transform to input colorspace
           if(success_opencl)
           {
-            success_opencl = dt_ioppr_transform_image_colorspace_cl(
+            success_opencl = _pixelpipe_transform_colorspace_cl(pipe,
                 module, piece->pipe->devid, cl_mem_input, cl_mem_input, roi_in.width, roi_in.height, input_cst_cl,
-                module->input_colorspace(module, pipe, piece), &input_cst_cl,
+                _pixelpipe_input_cst(module, pipe, piece), &input_cst_cl,
                 dt_ioppr_get_pipe_work_profile_info(pipe));
           }
 
@@ -1538,12 +1941,12 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           if(success_opencl)
           {
             success_opencl
-                = module->process_cl(module, piece, cl_mem_input, *cl_mem_output, &roi_in, roi_out);
+                = _pixelpipe_process_cl_timed(pipe, module, piece, cl_mem_input, *cl_mem_output, &roi_in, roi_out);
             pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_GPU);
             pixelpipe_flow &= ~(PIXELPIPE_FLOW_PROCESSED_ON_CPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
 
             // and save the output colorspace
-            pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
+            pipe->dsc.cst = _pixelpipe_output_cst(module, pipe, piece);
           }
 
           if(pipe->shutdown)
@@ -1588,12 +1991,12 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           {
             if(_transform_for_blend(module, piece, input_cst_cl, pipe->dsc.cst))
             {
-              success_opencl = dt_ioppr_transform_image_colorspace_cl(
+              success_opencl = _pixelpipe_transform_colorspace_cl(pipe,
                   module, piece->pipe->devid, cl_mem_input, cl_mem_input, roi_in.width, roi_in.height,
                   input_cst_cl, module->blend_colorspace(module, pipe, piece), &input_cst_cl,
                   dt_ioppr_get_pipe_work_profile_info(pipe));
 
-              success_opencl = dt_ioppr_transform_image_colorspace_cl(
+              success_opencl = _pixelpipe_transform_colorspace_cl(pipe,
                   module, piece->pipe->devid, *cl_mem_output, *cl_mem_output, roi_out->width, roi_out->height,
                   pipe->dsc.cst, module->blend_colorspace(module, pipe, piece), &pipe->dsc.cst,
                   dt_ioppr_get_pipe_work_profile_info(pipe));
@@ -1666,9 +2069,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           // transform to module input colorspace
           if(success_opencl)
           {
-            dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height,
-                                                input_format->cst, module->input_colorspace(module, pipe, piece),
-                                                &input_format->cst, dt_ioppr_get_pipe_work_profile_info(pipe));
+            _pixelpipe_transform_colorspace(pipe, module, input, input, roi_in.width, roi_in.height,
+                                            input_format->cst, _pixelpipe_input_cst(module, pipe, piece),
+                                            &input_format->cst, dt_ioppr_get_pipe_work_profile_info(pipe));
           }
 
           // histogram collection for module
@@ -1711,7 +2114,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
             pixelpipe_flow &= ~(PIXELPIPE_FLOW_PROCESSED_ON_CPU);
 
             // and save the output colorspace
-            pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
+            pipe->dsc.cst = _pixelpipe_output_cst(module, pipe, piece);
           }
 
           if(pipe->shutdown)
@@ -1750,13 +2153,13 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           {
             if(_transform_for_blend(module, piece, input_format->cst, pipe->dsc.cst))
             {
-              dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height,
-                                                  input_format->cst, module->blend_colorspace(module, pipe, piece),
-                                                  &input_format->cst, dt_ioppr_get_pipe_work_profile_info(pipe));
+              _pixelpipe_transform_colorspace(pipe, module, input, input, roi_in.width, roi_in.height,
+                                              input_format->cst, module->blend_colorspace(module, pipe, piece),
+                                              &input_format->cst, dt_ioppr_get_pipe_work_profile_info(pipe));
 
-              dt_ioppr_transform_image_colorspace(module, *output, *output, roi_out->width, roi_out->height,
-                                                  pipe->dsc.cst, module->blend_colorspace(module, pipe, piece),
-                                                  &pipe->dsc.cst, dt_ioppr_get_pipe_work_profile_info(pipe));
+              _pixelpipe_transform_colorspace(pipe, module, *output, *output, roi_out->width, roi_out->height,
+                                              pipe->dsc.cst, module->blend_colorspace(module, pipe, piece),
+                                              &pipe->dsc.cst, dt_ioppr_get_pipe_work_profile_info(pipe));
             }
           }
 
@@ -1903,9 +2306,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           }
 
           // transform to module input colorspace
-          dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height, input_format->cst,
-                                              module->input_colorspace(module, pipe, piece), &input_format->cst,
-                                              dt_ioppr_get_pipe_work_profile_info(pipe));
+          _pixelpipe_transform_colorspace(pipe, module, input, input, roi_in.width, roi_in.height, input_format->cst,
+                                          _pixelpipe_input_cst(module, pipe, piece), &input_format->cst,
+                                          dt_ioppr_get_pipe_work_profile_info(pipe));
 
           // histogram collection for module
           if((dev->gui_attached || !(piece->request_histogram & DT_REQUEST_ONLY_IN_GUI))
@@ -1938,11 +2341,12 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
             return 1;
           }
 
+          const double cpu_start = dt_get_wtime();
           /* process module on cpu. use tiling if needed and possible. */
-          if(piece->process_tiling_ready
-             && !dt_tiling_piece_fits_host_memory(MAX(roi_in.width, roi_out->width),
-                                                  MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp),
-                                                  tiling.factor, tiling.overhead))
+          if(!num_fused && piece->process_tiling_ready
+             && _pixelpipe_piece_needs_tiling(pipe, MAX(roi_in.width, roi_out->width),
+                                              MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp),
+                                              tiling.factor, tiling.overhead))
           {
             module->process_tiling(module, piece, input, *output, &roi_in, roi_out, in_bpp);
             pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_CPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
@@ -1950,13 +2354,19 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           }
           else
           {
-            module->process(module, piece, input, *output, &roi_in, roi_out);
+            if(num_fused)
+              _pixelpipe_process_fused(pipe, fused, num_fused, input, *output, roi_out);
+            else
+              module->process(module, piece, input, *output, &roi_in, roi_out);
             pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_CPU);
             pixelpipe_flow &= ~(PIXELPIPE_FLOW_PROCESSED_ON_GPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
           }
+          if(!num_fused)
+            dt_opencl_cost_record(pipe->devid, module->op, FALSE, dt_get_wtime() - cpu_start,
+                                  (size_t)roi_out->width * roi_out->height);
 
           // and save the output colorspace
-          pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
+          pipe->dsc.cst = _pixelpipe_output_cst(module, pipe, piece);
 
           if(pipe->shutdown)
           {
@@ -1992,13 +2402,13 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           // blend needs input/output images with default colorspace
           if(_transform_for_blend(module, piece, input_format->cst, pipe->dsc.cst))
           {
-            dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height,
-                                                input_format->cst, module->blend_colorspace(module, pipe, piece),
-                                                &input_format->cst, dt_ioppr_get_pipe_work_profile_info(pipe));
+            _pixelpipe_transform_colorspace(pipe, module, input, input, roi_in.width, roi_in.height,
+                                            input_format->cst, module->blend_colorspace(module, pipe, piece),
+                                            &input_format->cst, dt_ioppr_get_pipe_work_profile_info(pipe));
 
-            dt_ioppr_transform_image_colorspace(module, *output, *output, roi_out->width, roi_out->height,
-                                                pipe->dsc.cst, module->blend_colorspace(module, pipe, piece),
-                                                &pipe->dsc.cst, dt_ioppr_get_pipe_work_profile_info(pipe));
+            _pixelpipe_transform_colorspace(pipe, module, *output, *output, roi_out->width, roi_out->height,
+                                            pipe->dsc.cst, module->blend_colorspace(module, pipe, piece),
+                                            &pipe->dsc.cst, dt_ioppr_get_pipe_work_profile_info(pipe));
           }
 
           /* process blending on cpu */
@@ -2058,9 +2468,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
         }
 
         // transform to module input colorspace
-        dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height, input_format->cst,
-                                            module->input_colorspace(module, pipe, piece), &input_format->cst,
-                                            dt_ioppr_get_pipe_work_profile_info(pipe));
+        _pixelpipe_transform_colorspace(pipe, module, input, input, roi_in.width, roi_in.height, input_format->cst,
+                                        _pixelpipe_input_cst(module, pipe, piece), &input_format->cst,
+                                        dt_ioppr_get_pipe_work_profile_info(pipe));
 
         // histogram collection for module
         if((dev->gui_attached || !(piece->request_histogram & DT_REQUEST_ONLY_IN_GUI))
@@ -2093,11 +2503,12 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           return 1;
         }
 
+        const double cpu_start = dt_get_wtime();
         /* process module on cpu. use tiling if needed and possible. */
-        if(piece->process_tiling_ready
-           && !dt_tiling_piece_fits_host_memory(MAX(roi_in.width, roi_out->width),
-                                                MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp),
-                                                tiling.factor, tiling.overhead))
+        if(!num_fused && piece->process_tiling_ready
+           && _pixelpipe_piece_needs_tiling(pipe, MAX(roi_in.width, roi_out->width),
+                                            MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp),
+                                            tiling.factor, tiling.overhead))
         {
           module->process_tiling(module, piece, input, *output, &roi_in, roi_out, in_bpp);
           pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_CPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
@@ -2105,13 +2516,19 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
         }
         else
         {
-          module->process(module, piece, input, *output, &roi_in, roi_out);
+          if(num_fused)
+            _pixelpipe_process_fused(pipe, fused, num_fused, input, *output, roi_out);
+          else
+            module->process(module, piece, input, *output, &roi_in, roi_out);
           pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_CPU);
           pixelpipe_flow &= ~(PIXELPIPE_FLOW_PROCESSED_ON_GPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
         }
+        if(!num_fused)
+          dt_opencl_cost_record(pipe->devid, module->op, FALSE, dt_get_wtime() - cpu_start,
+                                (size_t)roi_out->width * roi_out->height);
 
         // and save the output colorspace
-        pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
+        pipe->dsc.cst = _pixelpipe_output_cst(module, pipe, piece);
 
         if(pipe->shutdown)
         {
@@ -2147,13 +2564,13 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
         // blend needs input/output images with default colorspace
         if(_transform_for_blend(module, piece, input_format->cst, pipe->dsc.cst))
         {
-          dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height, input_format->cst,
-                                              module->blend_colorspace(module, pipe, piece), &input_format->cst,
-                                              dt_ioppr_get_pipe_work_profile_info(pipe));
+          _pixelpipe_transform_colorspace(pipe, module, input, input, roi_in.width, roi_in.height, input_format->cst,
+                                          module->blend_colorspace(module, pipe, piece), &input_format->cst,
+                                          dt_ioppr_get_pipe_work_profile_info(pipe));
 
-          dt_ioppr_transform_image_colorspace(module, *output, *output, roi_out->width, roi_out->height,
-                                              pipe->dsc.cst, module->blend_colorspace(module, pipe, piece),
-                                              &pipe->dsc.cst, dt_ioppr_get_pipe_work_profile_info(pipe));
+          _pixelpipe_transform_colorspace(pipe, module, *output, *output, roi_out->width, roi_out->height,
+                                          pipe->dsc.cst, module->blend_colorspace(module, pipe, piece),
+                                          &pipe->dsc.cst, dt_ioppr_get_pipe_work_profile_info(pipe));
         }
 
         /* process blending */
@@ -2176,9 +2593,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       /* opencl is not inited or not enabled or we got no resource/device -> everything runs on cpu */
 
       // transform to module input colorspace
-      dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height, input_format->cst,
-                                          module->input_colorspace(module, pipe, piece), &input_format->cst,
-                                          dt_ioppr_get_pipe_work_profile_info(pipe));
+      _pixelpipe_transform_colorspace(pipe, module, input, input, roi_in.width, roi_in.height, input_format->cst,
+                                      _pixelpipe_input_cst(module, pipe, piece), &input_format->cst,
+                                      dt_ioppr_get_pipe_work_profile_info(pipe));
 
       // histogram collection for module
       if((dev->gui_attached || !(piece->request_histogram & DT_REQUEST_ONLY_IN_GUI))
@@ -2211,11 +2628,12 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
         return 1;
       }
 
+      const double cpu_start = dt_get_wtime();
       /* process module on cpu. use tiling if needed and possible. */
-      if(piece->process_tiling_ready
-         && !dt_tiling_piece_fits_host_memory(MAX(roi_in.width, roi_out->width),
-                                              MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp),
-                                              tiling.factor, tiling.overhead))
+      if(!num_fused && piece->process_tiling_ready
+         && _pixelpipe_piece_needs_tiling(pipe, MAX(roi_in.width, roi_out->width),
+                                          MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp),
+                                          tiling.factor, tiling.overhead))
       {
         module->process_tiling(module, piece, input, *output, &roi_in, roi_out, in_bpp);
         pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_CPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
@@ -2223,14 +2641,20 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       }
       else
       {
-        module->process(module, piece, input, *output, &roi_in, roi_out);
+        if(num_fused)
+          _pixelpipe_process_fused(pipe, fused, num_fused, input, *output, roi_out);
+        else
+          module->process(module, piece, input, *output, &roi_in, roi_out);
         pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_CPU);
         pixelpipe_flow &= ~(PIXELPIPE_FLOW_PROCESSED_ON_GPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
       }
+      if(!num_fused)
+        dt_opencl_cost_record(pipe->devid, module->op, FALSE, dt_get_wtime() - cpu_start,
+                              (size_t)roi_out->width * roi_out->height);
 
       // and save the output colorspace
       //(*out_format)->cst = module->output_colorspace(module, pipe, piece);
-      pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
+      pipe->dsc.cst = _pixelpipe_output_cst(module, pipe, piece);
 
       if(pipe->shutdown)
       {
@@ -2266,13 +2690,13 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       // blend needs input/output images with default colorspace
       if(_transform_for_blend(module, piece, input_format->cst, pipe->dsc.cst))
       {
-        dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height, input_format->cst,
-                                            module->blend_colorspace(module, pipe, piece), &input_format->cst,
-                                            dt_ioppr_get_pipe_work_profile_info(pipe));
+        _pixelpipe_transform_colorspace(pipe, module, input, input, roi_in.width, roi_in.height, input_format->cst,
+                                        module->blend_colorspace(module, pipe, piece), &input_format->cst,
+                                        dt_ioppr_get_pipe_work_profile_info(pipe));
 
-        dt_ioppr_transform_image_colorspace(module, *output, *output, roi_out->width, roi_out->height,
-                                            pipe->dsc.cst, module->blend_colorspace(module, pipe, piece),
-                                            &pipe->dsc.cst, dt_ioppr_get_pipe_work_profile_info(pipe));
+        _pixelpipe_transform_colorspace(pipe, module, *output, *output, roi_out->width, roi_out->height,
+                                        pipe->dsc.cst, module->blend_colorspace(module, pipe, piece),
+                                        &pipe->dsc.cst, dt_ioppr_get_pipe_work_profile_info(pipe));
       }
 
       /* process blending */
@@ -2282,9 +2706,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     }
 #else // HAVE_OPENCL
     // transform to module input colorspace
-    dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height, input_format->cst,
-                                        module->input_colorspace(module, pipe, piece), &input_format->cst,
-                                        dt_ioppr_get_pipe_work_profile_info(pipe));
+    _pixelpipe_transform_colorspace(pipe, module, input, input, roi_in.width, roi_in.height, input_format->cst,
+                                    _pixelpipe_input_cst(module, pipe, piece), &input_format->cst,
+                                    dt_ioppr_get_pipe_work_profile_info(pipe));
 
     // histogram collection for module
     if((dev->gui_attached || !(piece->request_histogram & DT_REQUEST_ONLY_IN_GUI))
@@ -2318,10 +2742,10 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     }
 
     /* process module on cpu. use tiling if needed and possible. */
-    if(piece->process_tiling_ready
-       && !dt_tiling_piece_fits_host_memory(MAX(roi_in.width, roi_out->width),
-                                            MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp),
-                                            tiling.factor, tiling.overhead))
+    if(!num_fused && piece->process_tiling_ready
+       && _pixelpipe_piece_needs_tiling(pipe, MAX(roi_in.width, roi_out->width),
+                                        MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp),
+                                        tiling.factor, tiling.overhead))
     {
       module->process_tiling(module, piece, input, *output, &roi_in, roi_out, in_bpp);
       pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_CPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
@@ -2329,13 +2753,16 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     }
     else
     {
-      module->process(module, piece, input, *output, &roi_in, roi_out);
+      if(num_fused)
+        _pixelpipe_process_fused(pipe, fused, num_fused, input, *output, roi_out);
+      else
+        module->process(module, piece, input, *output, &roi_in, roi_out);
       pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_CPU);
       pixelpipe_flow &= ~(PIXELPIPE_FLOW_PROCESSED_ON_GPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
     }
 
     // and save the output colorspace
-    pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
+    pipe->dsc.cst = _pixelpipe_output_cst(module, pipe, piece);
 
     if(pipe->shutdown)
     {
@@ -2370,13 +2797,13 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     // blend needs input/output images with default colorspace
     if(_transform_for_blend(module, piece, input_format->cst, pipe->dsc.cst))
     {
-      dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height, input_format->cst,
-                                          module->blend_colorspace(module, pipe, piece), &input_format->cst,
-                                          dt_ioppr_get_pipe_work_profile_info(pipe));
+      _pixelpipe_transform_colorspace(pipe, module, input, input, roi_in.width, roi_in.height, input_format->cst,
+                                      module->blend_colorspace(module, pipe, piece), &input_format->cst,
+                                      dt_ioppr_get_pipe_work_profile_info(pipe));
 
-      dt_ioppr_transform_image_colorspace(module, *output, *output, roi_out->width, roi_out->height, pipe->dsc.cst,
-                                          module->blend_colorspace(module, pipe, piece), &pipe->dsc.cst,
-                                          dt_ioppr_get_pipe_work_profile_info(pipe));
+      _pixelpipe_transform_colorspace(pipe, module, *output, *output, roi_out->width, roi_out->height, pipe->dsc.cst,
+                                      module->blend_colorspace(module, pipe, piece), &pipe->dsc.cst,
+                                      dt_ioppr_get_pipe_work_profile_info(pipe));
     }
 
     /* process blending */
@@ -2415,7 +2842,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     **out_format = piece->dsc_out = pipe->dsc;
 
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
-    if(module == darktable.develop->gui_module)
+    if(module == darktable.develop->gui_module || (num_fused && fused[0]->module == darktable.develop->gui_module))
     {
       // give the input buffer to the currently focused plugin more weight.
       // the user is likely to change that one soon, so keep it in cache.
@@ -2684,10 +3111,232 @@ static int dt_dev_pixelpipe_process_rec_and_backcopy(dt_dev_pixelpipe_t *pipe, d
 }
 
 
+void dt_dev_pixelpipe_piece_set_changed_area(dt_dev_pixelpipe_iop_t *piece, const uint64_t since,
+                                             const dt_iop_roi_t *const area)
+{
+  // a tile only sees part of the picture
+  if(piece->pipe->tiling)
+  {
+    piece->changed_since = 0;
+    return;
+  }
+  piece->changed_since = since;
+  piece->changed_area = *area;
+}
+
+// remember what the output of this run was made from, so the next run can patch it up
+static void _pixelpipe_keep_output_state(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *roi)
+{
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    piece->output_hash = piece->hash;
+    piece->output_enabled = piece->enabled;
+  }
+  pipe->incremental_roi = *roi;
+  pipe->incremental_filter = dev->gui_module ? dev->gui_module->operation_tags_filter() : 0;
+  pipe->incremental_valid = pipe->type == DT_DEV_PIXELPIPE_FULL && pipe->output_backbuf
+                            && pipe->mask_display == DT_DEV_PIXELPIPE_DISPLAY_NONE && !pipe->bypass_blendif;
+}
+
+// the part of the roi a piece reported as changed, clipped to the roi. x and y are relative to the roi.
+static dt_iop_roi_t _pixelpipe_changed_rect(const dt_iop_roi_t *const area, const dt_iop_roi_t *const roi)
+{
+  const int x0 = CLAMP(area->x, 0, roi->width), y0 = CLAMP(area->y, 0, roi->height);
+  const int x1 = CLAMP(area->x + area->width, x0, roi->width), y1 = CLAMP(area->y + area->height, y0, roi->height);
+  return (dt_iop_roi_t){ x0, y0, x1 - x0, y1 - y0, roi->scale };
+}
+
+// copies a width x height block of pixels from src to dst, strides and offsets are given in pixels
+static void _pixelpipe_copy_rect(void *const dst, const int dst_stride, const int dst_x, const int dst_y,
+                                 const void *const src, const int src_stride, const int src_x, const int src_y,
+                                 const int width, const int height, const size_t bpp)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(bpp, dst, dst_stride, dst_x, dst_y, height, src, src_stride, src_x, src_y, width) \
+  schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
+    memcpy((char *)dst + bpp * ((size_t)(dst_y + j) * dst_stride + dst_x),
+           (const char *)src + bpp * ((size_t)(src_y + j) * src_stride + src_x), bpp * width);
+}
+
+// if a single module changed since the last output, reported which part of its output differs, and all
+// modules after it are point-wise, only that part is run through the rest of the pipe and pasted into the
+// last output. returns FALSE if the pipe has to be processed the usual way, TRUE with *err set otherwise.
+static gboolean _pixelpipe_process_incremental(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
+                                               const dt_iop_roi_t *const roi, void **output, int *err)
+{
+  if(pipe->type != DT_DEV_PIXELPIPE_FULL || !pipe->incremental_valid
+     || memcmp(&pipe->incremental_roi, roi, sizeof(dt_iop_roi_t)) || pipe->output_imgid != pipe->image.id
+     || pipe->output_backbuf_width != roi->width || pipe->output_backbuf_height != roi->height)
+    return FALSE;
+
+  const int filter = dev->gui_module ? dev->gui_module->operation_tags_filter() : 0;
+  if(filter != pipe->incremental_filter) return FALSE;
+
+  // find the one changed piece, the ones after it have to work point-wise on the same roi
+  int changed = -1;
+  GList *changed_modules = NULL, *changed_pieces = NULL;
+  dt_dev_pixelpipe_iop_t *last = NULL;
+  GList *modules = pipe->iop;
+  int pos = 0;
+  for(GList *pieces = pipe->nodes; pieces && modules;
+      pieces = g_list_next(pieces), modules = g_list_next(modules), pos++)
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    dt_iop_module_t *module = piece->module;
+
+    if(piece->enabled != piece->output_enabled) return FALSE;
+    if(!piece->enabled || (filter & module->operation_tags())) continue;
+    if(module->request_color_pick != DT_REQUEST_COLORPICK_OFF
+       || module->request_mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE)
+      return FALSE;
+
+    if(piece->hash != piece->output_hash)
+    {
+      if(changed >= 0 || !_piece_blends_pointwise(piece)) return FALSE;
+      changed = pos;
+      changed_modules = modules;
+      changed_pieces = pieces;
+    }
+    else if(changed >= 0
+            && (!_piece_is_pointwise(piece) || memcmp(&piece->processed_roi_in, roi, sizeof(dt_iop_roi_t))
+                || memcmp(&piece->processed_roi_out, roi, sizeof(dt_iop_roi_t))))
+      return FALSE;
+
+    last = piece;
+  }
+  if(changed < 0 || dt_iop_buffer_dsc_to_bpp(&last->dsc_out) != 4 * sizeof(uint8_t)) return FALSE;
+
+  // run the changed module on the full roi, it tells which part of its output is new
+  dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)changed_pieces->data;
+  piece->changed_since = 0;
+
+  void *input = NULL;
+  void *cl_mem_input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+  *err = dt_dev_pixelpipe_process_rec_and_backcopy(pipe, dev, &input, &cl_mem_input, &input_format, roi,
+                                                   changed_modules, changed_pieces, changed + 1);
+  if(*err) return TRUE;
+  if(piece->changed_since != piece->output_hash || pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE)
+    return FALSE;
+
+  const dt_iop_roi_t rect = _pixelpipe_changed_rect(&piece->changed_area, roi);
+  const int x0 = rect.x, y0 = rect.y;
+  const dt_iop_roi_t roi_patch = { roi->x + x0, roi->y + y0, rect.width, rect.height, roi->scale };
+  const size_t out_bpp = 4 * sizeof(uint8_t);
+
+  dt_print(DT_DEBUG_DEV, "[pixelpipe_process] [%s] %s changed %dx%d of %dx%d\n", _pipe_type_to_str(pipe->type),
+           piece->module->op, roi_patch.width, roi_patch.height, roi->width, roi->height);
+
+  void *patch = NULL;
+  if(roi_patch.width > 0 && roi_patch.height > 0)
+  {
+    // hand the changed part over to the rest of the pipe through the cache
+    const size_t bpp = dt_iop_buffer_dsc_to_bpp(input_format);
+    const uint64_t hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, &roi_patch, pipe, changed + 1);
+    dt_iop_buffer_dsc_t crop_format = *input_format;
+    dt_iop_buffer_dsc_t *crop_format_p = &crop_format;
+    void *crop = NULL;
+
+    dt_pthread_mutex_lock(&pipe->busy_mutex);
+    if(pipe->shutdown)
+    {
+      dt_pthread_mutex_unlock(&pipe->busy_mutex);
+      *err = 1;
+      return TRUE;
+    }
+    (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bpp * roi_patch.width * roi_patch.height, &crop,
+                                     &crop_format_p);
+    if(crop == input)
+    {
+      // too few cache lines to hold both
+      dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), crop);
+      dt_pthread_mutex_unlock(&pipe->busy_mutex);
+      return FALSE;
+    }
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+
+    _pixelpipe_copy_rect(crop, roi_patch.width, 0, 0, input, roi->width, x0, y0, roi_patch.width, roi_patch.height,
+                         bpp);
+
+    // the pieces keep the rois of the full run, the next check and the raster masks rely on them
+    const int num_pieces = g_list_length(pipe->nodes);
+    dt_iop_roi_t *rois = malloc(sizeof(dt_iop_roi_t) * 2 * num_pieces);
+    // the crop in the cache is complete, the full run just won't find a use for it
+    if(!rois) return FALSE;
+    int k = 0;
+    for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes), k += 2)
+    {
+      dt_dev_pixelpipe_iop_t *p = (dt_dev_pixelpipe_iop_t *)nodes->data;
+      rois[k] = p->processed_roi_in;
+      rois[k + 1] = p->processed_roi_out;
+    }
+
+    void *cl_mem_patch = NULL;
+    dt_iop_buffer_dsc_t _patch_format = { 0 };
+    dt_iop_buffer_dsc_t *patch_format = &_patch_format;
+    *err = dt_dev_pixelpipe_process_rec_and_backcopy(pipe, dev, &patch, &cl_mem_patch, &patch_format, &roi_patch,
+                                                     g_list_last(pipe->iop), g_list_last(pipe->nodes),
+                                                     num_pieces);
+
+    k = 0;
+    for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes), k += 2)
+    {
+      dt_dev_pixelpipe_iop_t *p = (dt_dev_pixelpipe_iop_t *)nodes->data;
+      p->processed_roi_in = rois[k];
+      p->processed_roi_out = rois[k + 1];
+    }
+    free(rois);
+
+    if(*err) return TRUE;
+  }
+
+  // the last output with the patch on top goes where the usual run would have put it
+  const uint64_t hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, roi, pipe, g_list_length(pipe->iop));
+  dt_iop_buffer_dsc_t out_format = last->dsc_out;
+  dt_iop_buffer_dsc_t *out_format_p = &out_format;
+  void *out = NULL;
+
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  if(pipe->shutdown)
+  {
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    *err = 1;
+    return TRUE;
+  }
+  (void)dt_dev_pixelpipe_cache_get_important(&(pipe->cache), hash, out_bpp * roi->width * roi->height, &out,
+                                             &out_format_p);
+  if(out == patch)
+  {
+    dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), out);
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    return FALSE;
+  }
+  pipe->dsc = out_format;
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  memcpy(out, pipe->output_backbuf, out_bpp * roi->width * roi->height);
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+
+  if(patch)
+    _pixelpipe_copy_rect(out, roi->width, x0, y0, patch, roi_patch.width, 0, 0, roi_patch.width, roi_patch.height,
+                         out_bpp);
+
+  *output = out;
+  return TRUE;
+}
+
 int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height,
                              float scale)
 {
   pipe->processing = 1;
+  // modules on this thread take their scratch memory from the pool of this pipe
+  dt_dev_pixelpipe_pool_t *const caller_pool = dt_dev_pixelpipe_pool_set_current(pipe->pool);
   pipe->opencl_enabled = dt_opencl_update_settings(); // update enabled flag and profile from preferences
   pipe->devid = (pipe->opencl_enabled) ? dt_opencl_lock_device(pipe->type)
                                        : -1; // try to get/lock opencl resource
@@ -2720,9 +3369,16 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x,
 restart:
 
   // check if we should obsolete caches
-  if(pipe->cache_obsolete) dt_dev_pixelpipe_cache_flush(&(pipe->cache));
+  if(pipe->cache_obsolete) dt_dev_pixelpipe_flush_caches(pipe);
   pipe->cache_obsolete = 0;
 
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  _pixelpipe_plan_colorspaces(pipe);
+#ifdef HAVE_OPENCL
+  _pixelpipe_plan_devices(pipe, dev, &roi);
+#endif
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+
   // mask display off as a starting point
   pipe->mask_display = DT_DEV_PIXELPIPE_DISPLAY_NONE;
   // and blendif active
@@ -2734,9 +3390,11 @@ restart:
   dt_iop_buffer_dsc_t _out_format = { 0 };
   dt_iop_buffer_dsc_t *out_format = &_out_format;
 
-  // run pixelpipe recursively and get error status
-  int err = dt_dev_pixelpipe_process_rec_and_backcopy(pipe, dev, &buf, &cl_mem_out, &out_format, &roi, modules,
-                                                      pieces, pos);
+  // run pixelpipe recursively and get error status, unless a local change can be patched into the last output
+  int err = 0;
+  if(!_pixelpipe_process_incremental(pipe, dev, &roi, &buf, &err))
+    err = dt_dev_pixelpipe_process_rec_and_backcopy(pipe, dev, &buf, &cl_mem_out, &out_format, &roi, modules,
+                                                    pieces, pos);
 
   // get status summary of opencl queue by checking the eventlist
   int oclerr = (pipe->devid >= 0) ? (dt_opencl_events_flush(pipe->devid, 1) != 0) : 0;
@@ -2787,6 +3445,8 @@ restart:
     dt_opencl_unlock_device(pipe->devid);
     pipe->devid = -1;
   }
+  dt_dev_pixelpipe_pool_set_current(caller_pool);
+  if(darktable.unmuted & DT_DEBUG_MEMORY) dt_dev_pixelpipe_pool_print_stats(pipe->pool, _pipe_type_to_str(pipe->type));
   // ... and in case of other errors ...
   if(err)
   {
@@ -2794,6 +3454,9 @@ restart:
     return 1;
   }
 
+  dt_print(DT_DEBUG_PERF, "[dev_pixelpipe] %d colorspace conversions, %d avoided by planning [%s]\n",
+           pipe->cst_conversions, pipe->cst_conversions_avoided, _pipe_type_to_str(pipe->type));
+
   // terminate
   dt_pthread_mutex_lock(&pipe->backbuf_mutex);
   pipe->backbuf_hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, &roi, pipe, 0);
@@ -2819,6 +3482,8 @@ restart:
   }
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
 
+  _pixelpipe_keep_output_state(pipe, dev, &roi);
+
   // printf("pixelpipe homebrew process end\n");
   pipe->processing = 0;
   return 0;
@@ -2827,6 +3492,7 @@ restart:
 void dt_dev_pixelpipe_flush_caches(dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_flush(&pipe->cache);
+  pipe->incremental_valid = 0;
 }
 
 void dt_dev_pixelpipe_get_dimensions(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int width_in,
@@ -66,9 +66,22 @@ typedef struct dt_dev_pixelpipe_iop_t
   int process_cl_ready;       // set this to 0 in commit_params to temporarily disable the use of process_cl
   int process_tiling_ready;   // set this to 0 in commit_params to temporarily disable tiling
 
+  // colorspace an IOP_FLAGS_ANY_COLORSPACE module runs in during this run, iop_cs_NONE for its own
+  dt_iop_colorspace_type_t planned_cst;
+  // the cost model found running this module on the cpu cheaper than on the gpu plus copies
+  int planned_cpu;
+
   // the following are used internally for caching:
   dt_iop_buffer_dsc_t dsc_in, dsc_out;
 
+  // hash and enabled state of the piece when the pipe delivered its last output
+  uint64_t output_hash;
+  int output_enabled;
+  // part of the roi_out of the last process() that differs from the run with piece hash changed_since,
+  // reported by modules acting locally through dt_dev_pixelpipe_piece_set_changed_area()
+  uint64_t changed_since;
+  dt_iop_roi_t changed_area;
+
   GHashTable *raster_masks; // GList* of dt_dev_pixelpipe_raster_mask_t
 } dt_dev_pixelpipe_iop_t;
 
@@ -92,6 +105,8 @@ typedef struct dt_dev_pixelpipe_t
 {
   // store history/zoom caches
   dt_dev_pixelpipe_cache_t cache;
+  // buffers for the cache lines and module scratch, owned unless it is darktable.pixelpipe_pool
+  struct dt_dev_pixelpipe_pool_t *pool;
   // set to non-zero in order to obsolete old cache entries on next pixelpipe run
   int cache_obsolete;
   // input buffer
@@ -158,6 +173,13 @@ typedef struct dt_dev_pixelpipe_t
   GList *forms;
   // the masks generated in the pipe for later reusal are inside dt_dev_pixelpipe_iop_t
   gboolean store_all_raster_masks;
+  // colorspace conversions done during the last run, and those the plan avoided
+  int cst_conversions, cst_conversions_avoided;
+  // output_backbuf may be patched up by the next run, it was made from the
+  // piece states in output_hash with this roi and gui module tag filter
+  int incremental_valid;
+  dt_iop_roi_t incremental_roi;
+  int incremental_filter;
 } dt_dev_pixelpipe_t;
 
 struct dt_develop_t;
@@ -224,6 +246,11 @@ void dt_dev_pixelpipe_disable_before(dt_dev_pixelpipe_t *pipe, const char *op);
 void dt_dev_pixelpipe_add_node(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int n);
 void dt_dev_pixelpipe_remove_node(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int n);
 
+// called from process() by modules whose parameter changes act locally: area (relative to roi_out) holds all
+// pixels that may differ from the output of their run with piece hash since. width 0 means nothing changed.
+void dt_dev_pixelpipe_piece_set_changed_area(dt_dev_pixelpipe_iop_t *piece, const uint64_t since,
+                                             const dt_iop_roi_t *const area);
+
 // helper function to pass a raster mask through a (so far) processed pipe
 float *dt_dev_get_raster_mask(const dt_dev_pixelpipe_t *pipe, const struct dt_iop_module_t *raster_mask_source,
                               const int raster_mask_id, const struct dt_iop_module_t *target_module,
@@ -0,0 +1,255 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_pool.h"
+#include "common/darktable.h"
+#include "control/conf.h"
+
+#include <stdlib.h>
+
+#define DT_POOL_HEADER 64
+#define DT_POOL_MAGIC 0x706f6f6cu
+#define DT_POOL_PAGE 4096
+
+// sits in the 64 bytes in front of every buffer
+typedef struct dt_pool_block_t
+{
+  dt_dev_pixelpipe_pool_t *pool;
+  struct dt_pool_block_t *next; // in the free list
+  size_t size;                  // usable bytes
+  int cls;                      // size class, -1 if the block is not kept
+  int node;                     // numa node of the threads which touched it first
+  uint32_t magic;
+} dt_pool_block_t;
+
+static __thread dt_dev_pixelpipe_pool_t *_current_pool = NULL;
+
+static inline dt_pool_block_t *_block(void *mem)
+{
+  return (dt_pool_block_t *)((char *)mem - DT_POOL_HEADER);
+}
+
+// class of the smallest quarter step of a power of two holding size, and its size in bytes
+static int _size_class(const size_t size, size_t *class_size)
+{
+  if(size <= ((size_t)1 << DT_DEV_PIXELPIPE_POOL_MIN_SHIFT))
+  {
+    *class_size = size;
+    return size == ((size_t)1 << DT_DEV_PIXELPIPE_POOL_MIN_SHIFT) ? 0 : -1;
+  }
+  int e = g_bit_storage(size) - 1;
+  const size_t step = (size_t)1 << (e - 2);
+  size_t q = (size - ((size_t)1 << e) + step - 1) / step;
+  if(q == 4)
+  {
+    e++;
+    q = 0;
+  }
+  if(e >= 64)
+  {
+    *class_size = size;
+    return -1;
+  }
+  *class_size = ((size_t)1 << e) + q * ((size_t)1 << (e - 2));
+  return 4 * (e - DT_DEV_PIXELPIPE_POOL_MIN_SHIFT) + (int)q;
+}
+
+// fault the pages in from all threads, in the static split the modules use for their loops
+static void _first_touch(char *const mem, const size_t size)
+{
+  const size_t pages = (size + DT_POOL_PAGE - 1) / DT_POOL_PAGE;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(mem, pages) \
+  schedule(static)
+#endif
+  for(size_t k = 0; k < pages; k++) mem[k * DT_POOL_PAGE] = 0;
+}
+
+size_t dt_dev_pixelpipe_pool_limit(const int share)
+{
+  // host_memory_limit 0 means unrestricted, keep as much as with the default then
+  const int mb = dt_conf_get_int("host_memory_limit");
+  return ((size_t)(mb > 0 ? mb : 1500) << 20) / MAX(share, 1);
+}
+
+dt_dev_pixelpipe_pool_t *dt_dev_pixelpipe_pool_new(const size_t limit)
+{
+  dt_dev_pixelpipe_pool_t *pool = (dt_dev_pixelpipe_pool_t *)calloc(1, sizeof(dt_dev_pixelpipe_pool_t));
+  if(!pool) return NULL;
+  dt_pthread_mutex_init(&pool->lock, NULL);
+  pool->limit = limit;
+  return pool;
+}
+
+void dt_dev_pixelpipe_pool_destroy(dt_dev_pixelpipe_pool_t *pool)
+{
+  if(!pool) return;
+  dt_dev_pixelpipe_pool_trim(pool);
+  if(_current_pool == pool) _current_pool = NULL;
+  dt_pthread_mutex_destroy(&pool->lock);
+  free(pool);
+}
+
+void *dt_dev_pixelpipe_pool_alloc(dt_dev_pixelpipe_pool_t *pool, const size_t size)
+{
+  size_t class_size = 0;
+  const int cls = _size_class(MAX(size, 1), &class_size);
+  const int node = dt_numa_current_node();
+  dt_pool_block_t *block = NULL;
+
+  if(pool)
+  {
+    dt_pthread_mutex_lock(&pool->lock);
+    pool->requests++;
+    if(cls >= 0 && pool->free[node][cls])
+    {
+      block = (dt_pool_block_t *)pool->free[node][cls];
+      pool->free[node][cls] = block->next;
+      pool->kept -= block->size;
+      pool->reused++;
+    }
+    dt_pthread_mutex_unlock(&pool->lock);
+  }
+
+  if(!block)
+  {
+    block = (dt_pool_block_t *)dt_alloc_align(64, DT_POOL_HEADER + class_size);
+    if(!block && pool)
+    {
+      // give what we keep back to the system and try once more
+      dt_dev_pixelpipe_pool_trim(pool);
+      block = (dt_pool_block_t *)dt_alloc_align(64, DT_POOL_HEADER + class_size);
+    }
+    if(!block) return NULL;
+    _first_touch((char *)block + DT_POOL_HEADER, class_size);
+    block->pool = pool;
+    block->size = class_size;
+    block->cls = cls;
+    block->node = node;
+    block->magic = DT_POOL_MAGIC;
+    if(pool)
+    {
+      dt_pthread_mutex_lock(&pool->lock);
+      pool->fresh++;
+      dt_pthread_mutex_unlock(&pool->lock);
+    }
+  }
+  block->next = NULL;
+
+  if(pool)
+  {
+    dt_pthread_mutex_lock(&pool->lock);
+    pool->in_use += block->size;
+    pool->peak = MAX(pool->peak, pool->in_use);
+    dt_pthread_mutex_unlock(&pool->lock);
+  }
+  return (char *)block + DT_POOL_HEADER;
+}
+
+void dt_dev_pixelpipe_pool_free(void *mem)
+{
+  if(!mem) return;
+  dt_pool_block_t *block = _block(mem);
+  assert(block->magic == DT_POOL_MAGIC);
+  dt_dev_pixelpipe_pool_t *pool = block->pool;
+  if(!pool)
+  {
+    dt_free_align(block);
+    return;
+  }
+
+  dt_pthread_mutex_lock(&pool->lock);
+  pool->in_use -= block->size;
+  if(block->cls >= 0 && pool->kept + block->size <= pool->limit)
+  {
+    block->next = (dt_pool_block_t *)pool->free[block->node][block->cls];
+    pool->free[block->node][block->cls] = block;
+    pool->kept += block->size;
+    block = NULL;
+  }
+  else
+    pool->released++;
+  dt_pthread_mutex_unlock(&pool->lock);
+
+  if(block) dt_free_align(block);
+}
+
+void dt_dev_pixelpipe_pool_trim(dt_dev_pixelpipe_pool_t *pool)
+{
+  if(!pool) return;
+  dt_pthread_mutex_lock(&pool->lock);
+  for(int n = 0; n < DT_NUMA_MAX_NODES; n++)
+    for(int k = 0; k < DT_DEV_PIXELPIPE_POOL_CLASSES; k++)
+    {
+      dt_pool_block_t *block = (dt_pool_block_t *)pool->free[n][k];
+      while(block)
+      {
+        dt_pool_block_t *next = block->next;
+        dt_free_align(block);
+        pool->released++;
+        block = next;
+      }
+      pool->free[n][k] = NULL;
+    }
+  pool->kept = 0;
+  dt_pthread_mutex_unlock(&pool->lock);
+}
+
+size_t dt_dev_pixelpipe_pool_kept(dt_dev_pixelpipe_pool_t *pool)
+{
+  if(!pool) return 0;
+  dt_pthread_mutex_lock(&pool->lock);
+  const size_t kept = pool->kept;
+  dt_pthread_mutex_unlock(&pool->lock);
+  return kept;
+}
+
+void dt_dev_pixelpipe_pool_print_stats(dt_dev_pixelpipe_pool_t *pool, const char *name)
+{
+  if(!pool) return;
+  dt_pthread_mutex_lock(&pool->lock);
+  fprintf(stderr,
+          "[pixelpipe_pool] [%s] %" PRIu64 " requests, %" PRIu64 " reused (%.1f%%), %" PRIu64 " fresh, %" PRIu64
+          " released, in use %.1f MB, peak %.1f MB, kept %.1f/%.1f MB\n",
+          name, pool->requests, pool->reused, pool->requests ? 100.0 * pool->reused / pool->requests : 0.0,
+          pool->fresh, pool->released, pool->in_use / (1024.0 * 1024.0), pool->peak / (1024.0 * 1024.0),
+          pool->kept / (1024.0 * 1024.0), pool->limit / (1024.0 * 1024.0));
+  dt_pthread_mutex_unlock(&pool->lock);
+}
+
+dt_dev_pixelpipe_pool_t *dt_dev_pixelpipe_pool_set_current(dt_dev_pixelpipe_pool_t *pool)
+{
+  dt_dev_pixelpipe_pool_t *previous = _current_pool;
+  _current_pool = pool;
+  return previous;
+}
+
+dt_dev_pixelpipe_pool_t *dt_dev_pixelpipe_pool_get_current(void)
+{
+  return _current_pool;
+}
+
+void *dt_dev_pixelpipe_scratch_alloc(const size_t size)
+{
+  return dt_dev_pixelpipe_pool_alloc(_current_pool, size);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
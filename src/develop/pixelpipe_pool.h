@@ -0,0 +1,90 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/dtpthread.h"
+#include "common/numa.h"
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/**
+ * pool of large aligned buffers for the pixelpipe, handed out by size class. a buffer given back is
+ * kept for the next request of its class instead of being returned to the system, which saves the
+ * mmap/munmap and the page faults of a fresh buffer of many megabytes on every run. fresh buffers are
+ * first touched by all threads in the same static split as the loops working on them, so that their
+ * pages end up on the numa node of those threads. buffers given back are only handed out again to threads
+ * on the node they were first touched on.
+ *
+ * interactive pipes own a pool, pipes for one image (export, thumbnails) share a global one so their
+ * buffers survive to the next image. modules get scratch memory from the pool of the pipe running on
+ * the calling thread through dt_dev_pixelpipe_scratch_alloc().
+ */
+
+// size classes are powers of two split into quarters, starting at 256 KiB. smaller requests are not kept.
+#define DT_DEV_PIXELPIPE_POOL_MIN_SHIFT 18
+#define DT_DEV_PIXELPIPE_POOL_CLASSES (4 * (64 - DT_DEV_PIXELPIPE_POOL_MIN_SHIFT))
+
+typedef struct dt_dev_pixelpipe_pool_t
+{
+  dt_pthread_mutex_t lock;
+  // blocks waiting for reuse per numa node, linked through their headers
+  void *free[DT_NUMA_MAX_NODES][DT_DEV_PIXELPIPE_POOL_CLASSES];
+  size_t kept;  // bytes in the free lists
+  size_t limit; // never keep more than this many bytes
+
+  // statistics
+  uint64_t requests; // all allocations
+  uint64_t reused;   // served from the free lists
+  uint64_t fresh;    // taken from the system
+  uint64_t released; // given back to the system
+  size_t in_use;     // bytes handed out right now
+  size_t peak;       // maximum of in_use
+} dt_dev_pixelpipe_pool_t;
+
+/** bytes of unused buffers a pool may keep, 1/share of the host memory limit. */
+size_t dt_dev_pixelpipe_pool_limit(const int share);
+/** creates a pool keeping at most limit bytes of unused buffers. */
+dt_dev_pixelpipe_pool_t *dt_dev_pixelpipe_pool_new(const size_t limit);
+/** frees all kept buffers and the pool. buffers still handed out must not be freed afterwards. */
+void dt_dev_pixelpipe_pool_destroy(dt_dev_pixelpipe_pool_t *pool);
+
+/** 64 byte aligned buffer of at least size bytes, NULL if out of memory. pool may be NULL. */
+void *dt_dev_pixelpipe_pool_alloc(dt_dev_pixelpipe_pool_t *pool, const size_t size);
+/** gives a buffer back to the pool it came from. NULL is fine. */
+void dt_dev_pixelpipe_pool_free(void *mem);
+/** returns all kept buffers to the system. */
+void dt_dev_pixelpipe_pool_trim(dt_dev_pixelpipe_pool_t *pool);
+/** bytes of unused buffers the pool keeps right now. */
+size_t dt_dev_pixelpipe_pool_kept(dt_dev_pixelpipe_pool_t *pool);
+void dt_dev_pixelpipe_pool_print_stats(dt_dev_pixelpipe_pool_t *pool, const char *name);
+
+/** sets the pool serving scratch memory on the calling thread, returns the one set before. */
+dt_dev_pixelpipe_pool_t *dt_dev_pixelpipe_pool_set_current(dt_dev_pixelpipe_pool_t *pool);
+/** the pool serving scratch memory on the calling thread, NULL if none. */
+dt_dev_pixelpipe_pool_t *dt_dev_pixelpipe_pool_get_current(void);
+
+/** scratch memory for modules, a drop in replacement for dt_alloc_align(64, size). the buffer has to be
+  * given back with dt_dev_pixelpipe_scratch_free(), not dt_free_align(). */
+void *dt_dev_pixelpipe_scratch_alloc(const size_t size);
+#define dt_dev_pixelpipe_scratch_free dt_dev_pixelpipe_pool_free
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
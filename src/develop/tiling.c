@@ -22,6 +22,7 @@
 #include "control/control.h"
 #include "develop/blend.h"
 #include "develop/pixelpipe.h"
+#include "develop/pixelpipe_pool.h"
 
 #include <assert.h>
 #include <math.h>
@@ -43,6 +44,31 @@
    Needs to be increased if tiling fails due to insufficient buffer sizes. */
 #define RESERVE 5
 
+/* jobs running several pipes at once (the per numa node export) give each of them this share of
+   host_memory_limit, set on the thread running the pipe. */
+static __thread int _host_memory_share = 1;
+
+void dt_tiling_set_host_memory_share(const int share)
+{
+  _host_memory_share = MAX(share, 1);
+}
+
+/* unused buffers kept for reuse by the shared pool and the pool of the pipe on this thread. they are
+   not returned to the system, so they count against the memory limit. */
+static size_t _pools_kept(void)
+{
+  dt_dev_pixelpipe_pool_t *const current = dt_dev_pixelpipe_pool_get_current();
+  size_t kept = dt_dev_pixelpipe_pool_kept(darktable.pixelpipe_pool);
+  if(current != darktable.pixelpipe_pool) kept += dt_dev_pixelpipe_pool_kept(current);
+  return kept;
+}
+
+/* bytes of host memory a pipe on the calling thread may use, without what the pools keep */
+static float _host_memory_available(void)
+{
+  const float limit = dt_conf_get_float("host_memory_limit") * 1024.0f * 1024.0f / _host_memory_share;
+  return fmax(limit - _pools_kept(), 0.0f);
+}
 
 /* greatest common divisor */
 static unsigned _gcd(unsigned a, unsigned b)
@@ -610,8 +636,8 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
   }
 
   /* calculate optimal size of tiles */
-  float available = dt_conf_get_float("host_memory_limit") * 1024.0f * 1024.0f;
-  assert(available >= 500.0f * 1024.0f * 1024.0f);
+  assert(dt_conf_get_float("host_memory_limit") >= 500.0f);
+  float available = _host_memory_available();
   /* correct for size of ivoid and ovoid which are needed on top of tiling */
   available = fmax(available - ((float)roi_out->width * roi_out->height * out_bpp)
                    - ((float)roi_in->width * roi_in->height * in_bpp) - tiling.overhead,
@@ -701,14 +727,14 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
            tiles_x, tiles_y, width, height, overlap);
 
   /* reserve input and output buffers for tiles */
-  input = dt_alloc_align(64, (size_t)width * height * in_bpp);
+  input = dt_dev_pixelpipe_scratch_alloc((size_t)width * height * in_bpp);
   if(input == NULL)
   {
     dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] could not alloc input buffer for module '%s'\n",
              self->op);
     goto error;
   }
-  output = dt_alloc_align(64, (size_t)width * height * out_bpp);
+  output = dt_dev_pixelpipe_scratch_alloc((size_t)width * height * out_bpp);
   if(output == NULL)
   {
     dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] could not alloc output buffer for module '%s'\n",
@@ -811,8 +837,8 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
   /* copy back final processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
 
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
+  if(input != NULL) dt_dev_pixelpipe_scratch_free(input);
+  if(output != NULL) dt_dev_pixelpipe_scratch_free(output);
   piece->pipe->tiling = 0;
   return;
 
@@ -821,8 +847,8 @@ error:
 // fall through
 
 fallback:
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
+  if(input != NULL) dt_dev_pixelpipe_scratch_free(input);
+  if(output != NULL) dt_dev_pixelpipe_scratch_free(output);
   piece->pipe->tiling = 0;
   dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] fall back to standard processing for module '%s'\n",
            self->op);
@@ -877,8 +903,8 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
   }
 
   /* calculate optimal size of tiles */
-  float available = dt_conf_get_float("host_memory_limit") * 1024.0f * 1024.0f;
-  assert(available >= 500.0f * 1024.0f * 1024.0f);
+  assert(dt_conf_get_float("host_memory_limit") >= 500.0f);
+  float available = _host_memory_available();
   /* correct for size of ivoid and ovoid which are needed on top of tiling */
   available = fmax(available - ((float)roi_out->width * roi_out->height * out_bpp)
                    - ((float)roi_in->width * roi_in->height * in_bpp) - tiling.overhead,
@@ -1086,14 +1112,14 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
 
 
       /* prepare input tile buffer */
-      input = dt_alloc_align(64, (size_t)iroi_full.width * iroi_full.height * in_bpp);
+      input = dt_dev_pixelpipe_scratch_alloc((size_t)iroi_full.width * iroi_full.height * in_bpp);
       if(input == NULL)
       {
         dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] could not alloc input buffer for module '%s'\n",
                  self->op);
         goto error;
       }
-      output = dt_alloc_align(64, (size_t)oroi_full.width * oroi_full.height * out_bpp);
+      output = dt_dev_pixelpipe_scratch_alloc((size_t)oroi_full.width * oroi_full.height * out_bpp);
       if(output == NULL)
       {
         dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] could not alloc output buffer for module '%s'\n",
@@ -1144,16 +1170,16 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
                (char *)output + ((j + origin_y) * oroi_full.width + origin_x) * out_bpp,
                (size_t)oroi_good.width * out_bpp);
 
-      dt_free_align(input);
-      dt_free_align(output);
+      dt_dev_pixelpipe_scratch_free(input);
+      dt_dev_pixelpipe_scratch_free(output);
       input = output = NULL;
     }
 
   /* copy back final processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
 
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
+  if(input != NULL) dt_dev_pixelpipe_scratch_free(input);
+  if(output != NULL) dt_dev_pixelpipe_scratch_free(output);
   piece->pipe->tiling = 0;
   return;
 
@@ -1162,8 +1188,8 @@ error:
 // fall through
 
 fallback:
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
+  if(input != NULL) dt_dev_pixelpipe_scratch_free(input);
+  if(output != NULL) dt_dev_pixelpipe_scratch_free(output);
   piece->pipe->tiling = 0;
   dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] fall back to standard processing for module '%s'\n",
            self->op);
@@ -2053,8 +2079,8 @@ void default_tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpi
   return;
 }
 
-int dt_tiling_piece_fits_host_memory(const size_t width, const size_t height, const unsigned bpp,
-                                     const float factor, const size_t overhead)
+/* host_memory_limit in bytes for a pipe on the calling thread, 0 if there is no limit */
+static float _piece_host_memory_limit(void)
 {
   static int host_memory_limit = -1;
 
@@ -2068,11 +2094,27 @@ int dt_tiling_piece_fits_host_memory(const size_t width, const size_t height, co
     dt_conf_set_int("host_memory_limit", host_memory_limit);
   }
 
-  float requirement = factor * width * height * bpp + overhead;
+  return host_memory_limit * 1024.0f * 1024.0f / _host_memory_share;
+}
+
+int dt_tiling_piece_fits_host_memory(const size_t width, const size_t height, const unsigned bpp,
+                                     const float factor, const size_t overhead)
+{
+  const float limit = _piece_host_memory_limit();
+  if(limit == 0.0f) return TRUE;
+
+  const float requirement = factor * width * height * bpp + overhead;
+  return requirement <= limit;
+}
 
-  if(host_memory_limit == 0 || requirement <= host_memory_limit * 1024.0f * 1024.0f) return TRUE;
+int dt_tiling_piece_fits_beside_pools(const size_t width, const size_t height, const unsigned bpp,
+                                      const float factor, const size_t overhead)
+{
+  const float limit = _piece_host_memory_limit();
+  if(limit == 0.0f) return TRUE;
 
-  return FALSE;
+  const float requirement = factor * width * height * bpp + overhead;
+  return requirement <= limit - _pools_kept();
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -70,6 +70,14 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
 int dt_tiling_piece_fits_host_memory(const size_t width, const size_t height, const unsigned bpp,
                                      const float factor, const size_t overhead);
 
+/** like dt_tiling_piece_fits_host_memory(), with the buffers kept by the pools of the calling thread counted as
+    used. a piece that fits the limit but not beside the pools runs untiled once the pools are trimmed. */
+int dt_tiling_piece_fits_beside_pools(const size_t width, const size_t height, const unsigned bpp,
+                                      const float factor, const size_t overhead);
+
+/** pipes run on the calling thread get 1/share of host_memory_limit, for jobs running share pipes at once. */
+void dt_tiling_set_host_memory_share(const int share);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
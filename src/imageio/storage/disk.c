@@ -35,6 +35,8 @@
 #ifdef GDK_WINDOWING_QUARTZ
 #include "osx/osx.h"
 #endif
+#include <errno.h>
+#include <fcntl.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <stdio.h>
@@ -237,12 +239,14 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   g_strlcpy(pattern, d->filename, sizeof(pattern));
   gboolean from_cache = FALSE;
   dt_image_full_path(imgid, input_dir, sizeof(input_dir), &from_cache);
-  // set max_width and max_height values to expand them afterwards in darktable variables
-  dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
   int fail = 0;
+  gboolean reserved = FALSE;
   // we're potentially called in parallel. have sequence number synchronized:
   dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
   {
+    // set max_width and max_height values to expand them afterwards in darktable variables. d->vp is shared
+    // by the parallel exports, so only under the lock
+    dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
 try_again:
     // avoid braindead export which is bound to overwrite at random:
     if(total > 1 && !g_strrstr(pattern, "$"))
@@ -300,19 +304,33 @@ try_again:
   failed:
     g_free(output_dir);
 
+    // the file is only written after the lock is released, and other export jobs (one per numa node) may pick
+    // a name meanwhile: reserve the name by creating the file while still holding the lock
     if(!fail && d->onsave_action == DT_EXPORT_ONCONFLICT_UNIQUEFILENAME)
     {
       int seq = 1;
-      while(g_file_test(filename, G_FILE_TEST_EXISTS))
+      int fd;
+      while((fd = g_open(filename, O_WRONLY | O_CREAT | O_EXCL, 0644)) == -1 && errno == EEXIST)
       {
         snprintf(c, filename_free_space, "_%.2d.%s", seq, ext);
         seq++;
       }
+      if(fd != -1)
+      {
+        g_close(fd, NULL);
+        reserved = TRUE;
+      }
     }
 
     if(!fail && d->onsave_action == DT_EXPORT_ONCONFLICT_SKIP)
     {
-      if(g_file_test(filename, G_FILE_TEST_EXISTS))
+      const int fd = g_open(filename, O_WRONLY | O_CREAT | O_EXCL, 0644);
+      if(fd != -1)
+      {
+        g_close(fd, NULL);
+        reserved = TRUE;
+      }
+      else if(errno == EEXIST)
       {
         dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
         fprintf(stderr, "[export_job] skipping `%s'\n", filename);
@@ -331,6 +349,8 @@ try_again:
   {
     fprintf(stderr, "[imageio_storage_disk] could not export to file: `%s'!\n", filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
+    // don't leave the empty placeholder behind
+    if(reserved) g_unlink(filename);
     return 1;
   }
 
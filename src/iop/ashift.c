@@ -67,6 +67,7 @@
 #define LSD_DENSITY_TH 0.7                  // LSD: minimal density of region points in rectangle
 #define LSD_N_BINS 1024                     // LSD: number of bins in pseudo-ordering of gradient modulus
 #define LSD_GAMMA 0.45                      // gamma correction to apply on raw images prior to line detection
+#define LSD_MAX_SIZE 1500                   // larger images get box-downsampled to at most this size prior to line detection
 #define RANSAC_RUNS 400                     // how many iterations to run in ransac
 #define RANSAC_EPSILON 2                    // starting value for ransac epsilon (in -log10 units)
 #define RANSAC_EPSILON_STEP 1               // step size of epsilon optimization (log10 units)
@@ -84,6 +85,8 @@
 #define NMS_ALPHA 1.0                       // reflection coefficient for Nelder-Mead simplex
 #define NMS_BETA 0.5                        // contraction coefficient for Nelder-Mead simplex
 #define NMS_GAMMA 2.0                       // expansion coefficient for Nelder-Mead simplex
+#define NMS_STARTS_MAX 10                   // maximum number of starting points for the (parallel) Nelder-Mead simplex runs
+#define NMS_START_OFFSET 1.0                // offset of the additional starting points from the current parameters (logit units)
 #define DEFAULT_F_LENGTH 28.0               // focal length we assume if no exif data are available
 
 // define to get debugging output
@@ -114,7 +117,7 @@ const char *name()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_TILING_FULL_ROI | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_TILING_FULL_ROI | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_SCALE_INVARIANT;
 }
 
 int default_group()
@@ -410,6 +413,14 @@ typedef struct dt_iop_ashift_gui_data_t
   uint64_t lines_hash;
   uint64_t grid_hash;
   uint64_t buf_hash;
+  // lines of the last detection, as they came out of line_detect()
+  dt_iop_ashift_line_t *detected_lines;
+  int detected_count;
+  int detected_vertical_count;
+  int detected_horizontal_count;
+  float detected_vertical_weight;
+  float detected_horizontal_weight;
+  uint64_t detected_hash;
   dt_iop_ashift_fitaxis_t lastfit;
   float lastx;
   float lasty;
@@ -1144,7 +1155,7 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
 
 // simple conversion of rgb image into greyscale variant suitable for line segment detection
 // the lsd routines expect input as *double, roughly in the range [0.0; 256.0]
-static void rgb2grey256(const float *in, double *out, const int width, const int height)
+static void rgb2grey256(const float *in, float *out, const int width, const int height)
 {
   const int ch = 4;
 
@@ -1157,118 +1168,90 @@ static void rgb2grey256(const float *in, double *out, const int width, const int
   for(int j = 0; j < height; j++)
   {
     const float *inp = in + (size_t)ch * j * width;
-    double *outp = out + (size_t)j * width;
-    for(int i = 0; i < width; i++, inp += ch, outp++)
+    float *outp = out + (size_t)j * width;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int i = 0; i < width; i++)
     {
-      *outp = (0.3f * inp[0] + 0.59f * inp[1] + 0.11f * inp[2]) * 256.0;
+      outp[i] = (0.3f * inp[ch * i] + 0.59f * inp[ch * i + 1] + 0.11f * inp[ch * i + 2]) * 256.0f;
     }
   }
 }
 
-// sobel edge enhancement in one direction
-static void edge_enhance_1d(const double *in, double *out, const int width, const int height,
-                            dt_iop_ashift_enhance_t dir)
+// box-downsample an RGBA buffer by an integer factor, out has (width / factor) x (height / factor) pixels
+static void downsample_box(const float *in, float *out, const int width, const int height, const int factor)
 {
-  // Sobel kernels for both directions
-  const double hkernel[3][3] = { { 1.0, 0.0, -1.0 }, { 2.0, 0.0, -2.0 }, { 1.0, 0.0, -1.0 } };
-  const double vkernel[3][3] = { { 1.0, 2.0, 1.0 }, { 0.0, 0.0, 0.0 }, { -1.0, -2.0, -1.0 } };
-  const int kwidth = 3;
-  const int khwidth = kwidth / 2;
-
-  // select kernel
-  const double *kernel = (dir == ASHIFT_ENHANCE_HORIZONTAL) ? (const double *)hkernel : (const double *)vkernel;
+  const int ch = 4;
+  const int owidth = width / factor;
+  const int oheight = height / factor;
+  const float norm = 1.0f / (factor * factor);
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, khwidth, kwidth) \
-  shared(in, out, kernel) \
+  dt_omp_firstprivate(ch, factor, in, norm, oheight, owidth, out, width) \
   schedule(static)
 #endif
-  // loop over image pixels and perform sobel convolution
-  for(int j = khwidth; j < height - khwidth; j++)
+  for(int j = 0; j < oheight; j++)
   {
-    const double *inp = in + (size_t)j * width + khwidth;
-    double *outp = out + (size_t)j * width + khwidth;
-    for(int i = khwidth; i < width - khwidth; i++, inp++, outp++)
+    float *outp = out + (size_t)ch * j * owidth;
+    for(int i = 0; i < owidth; i++, outp += ch)
     {
-      double sum = 0.0f;
-      for(int jj = 0; jj < kwidth; jj++)
+      float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+      for(int jj = 0; jj < factor; jj++)
       {
-        const int k = jj * kwidth;
-        const int l = (jj - khwidth) * width;
-        for(int ii = 0; ii < kwidth; ii++)
+        const float *inp = in + (size_t)ch * ((size_t)(j * factor + jj) * width + (size_t)i * factor);
+        for(int ii = 0; ii < factor * ch; ii += ch)
         {
-          sum += inp[l + ii - khwidth] * kernel[k + ii];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+          for(int c = 0; c < 4; c++) sum[c] += inp[ii + c];
         }
       }
-      *outp = sum;
+      for(int c = 0; c < 4; c++) outp[c] = sum[c] * norm;
     }
   }
-
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, khwidth) \
-  shared(out) \
-  schedule(static)
-#endif
-  // border fill in output buffer, so we don't get pseudo lines at image frame
-  for(int j = 0; j < height; j++)
-    for(int i = 0; i < width; i++)
-    {
-      double val = out[j * width + i];
-
-      if(j < khwidth)
-        val = out[(khwidth - j) * width + i];
-      else if(j >= height - khwidth)
-        val = out[(j - khwidth) * width + i];
-      else if(i < khwidth)
-        val = out[j * width + (khwidth - i)];
-      else if(i >= width - khwidth)
-        val = out[j * width + (i - khwidth)];
-
-      out[j * width + i] = val;
-
-      // jump over center of image
-      if(i == khwidth && j >= khwidth && j < height - khwidth) i = width - khwidth;
-    }
 }
 
-// edge enhancement in both directions
-static int edge_enhance(const double *in, double *out, const int width, const int height)
+// sobel edge enhancement in both directions, returns the gradient magnitude. in and out must not overlap
+static void edge_enhance(const float *in, float *out, const int width, const int height)
 {
-  double *Gx = NULL;
-  double *Gy = NULL;
-
-  Gx = malloc((size_t)width * height * sizeof(double));
-  if(Gx == NULL) goto error;
-
-  Gy = malloc((size_t)width * height * sizeof(double));
-  if(Gy == NULL) goto error;
-
-  // perform edge enhancement in both directions
-  edge_enhance_1d(in, Gx, width, height, ASHIFT_ENHANCE_HORIZONTAL);
-  edge_enhance_1d(in, Gy, width, height, ASHIFT_ENHANCE_VERTICAL);
+  if(width < 3 || height < 3)
+  {
+    memset(out, 0, (size_t)width * height * sizeof(float));
+    return;
+  }
 
-// calculate absolute values
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width) \
-  shared(Gx, Gy, out) \
+  dt_omp_firstprivate(height, in, out, width) \
   schedule(static)
 #endif
-  for(size_t k = 0; k < (size_t)width * height; k++)
+  for(int j = 1; j < height - 1; j++)
   {
-    out[k] = sqrt(Gx[k] * Gx[k] + Gy[k] * Gy[k]);
-  }
+    const float *rm = in + (size_t)(j - 1) * width;
+    const float *r0 = in + (size_t)j * width;
+    const float *rp = in + (size_t)(j + 1) * width;
+    float *outp = out + (size_t)j * width;
 
-  free(Gx);
-  free(Gy);
-  return TRUE;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int i = 1; i < width - 1; i++)
+    {
+      const float gx = (rm[i - 1] - rm[i + 1]) + 2.0f * (r0[i - 1] - r0[i + 1]) + (rp[i - 1] - rp[i + 1]);
+      const float gy = (rm[i - 1] + 2.0f * rm[i] + rm[i + 1]) - (rp[i - 1] + 2.0f * rp[i] + rp[i + 1]);
+      outp[i] = sqrtf(gx * gx + gy * gy);
+    }
 
-error:
-  if(Gx) free(Gx);
-  if(Gy) free(Gy);
-  return FALSE;
+    // border fill, so we don't get pseudo lines at image frame
+    outp[0] = outp[1];
+    outp[width - 1] = outp[width - 2];
+  }
+
+  memcpy(out, out + width, sizeof(float) * width);
+  memcpy(out + (size_t)(height - 1) * width, out + (size_t)(height - 2) * width, sizeof(float) * width);
 }
 
 // XYZ -> sRGB matrix
@@ -1375,11 +1358,13 @@ static void gamma_correct(const float *in, float *out, const int width, const in
 
 // do actual line_detection based on LSD algorithm and return results according
 // to this module's conventions
-static int line_detect(float *in, const int width, const int height, const int x_off, const int y_off,
+static int line_detect(float *in, int width, int height, const int x_off, const int y_off,
                        const float scale, dt_iop_ashift_line_t **alines, int *lcount, int *vcount, int *hcount,
                        float *vweight, float *hweight, dt_iop_ashift_enhance_t enhance, const int is_raw)
 {
-  double *greyscale = NULL;
+  float *small = NULL;
+  float *greyscale = NULL;
+  double *lsd_in = NULL;
   double *lsd_lines = NULL;
   dt_iop_ashift_line_t *ashift_lines = NULL;
 
@@ -1388,6 +1373,20 @@ static int line_detect(float *in, const int width, const int height, const int x
   float vertical_weight = 0.0f;
   float horizontal_weight = 0.0f;
 
+  // line detection does not gain from more than LSD_MAX_SIZE pixels, larger images
+  // get downsampled first. line coordinates are scaled back by factor below
+  const int factor = (MAX(width, height) + LSD_MAX_SIZE - 1) / LSD_MAX_SIZE;
+  if(factor > 1)
+  {
+    small = dt_alloc_align(64, sizeof(float) * 4 * (width / factor) * (height / factor));
+    if(small == NULL) goto error;
+
+    downsample_box(in, small, width, height, factor);
+    in = small;
+    width /= factor;
+    height /= factor;
+  }
+
   // apply gamma correction if image is raw
   if(is_raw)
   {
@@ -1401,23 +1400,34 @@ static int line_detect(float *in, const int width, const int height, const int x
   }
 
   // allocate intermediate buffers
-  greyscale = malloc((size_t)width * height * sizeof(double));
-  if(greyscale == NULL) goto error;
+  greyscale = dt_alloc_align(64, sizeof(float) * 2 * width * height);
+  lsd_in = malloc((size_t)width * height * sizeof(double));
+  if(greyscale == NULL || lsd_in == NULL) goto error;
 
   // convert to greyscale image
   rgb2grey256(in, greyscale, width, height);
 
   // if requested perform an additional edge enhancement step
+  float *grey = greyscale;
   if(enhance & ASHIFT_ENHANCE_EDGES)
   {
-    (void)edge_enhance(greyscale, greyscale, width, height);
+    grey = greyscale + (size_t)width * height;
+    edge_enhance(greyscale, grey, width, height);
   }
 
+  // LSD works on doubles
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(grey, height, lsd_in, width) \
+  schedule(static)
+#endif
+  for(size_t k = 0; k < (size_t)width * height; k++) lsd_in[k] = grey[k];
+
   // call the line segment detector LSD;
   // LSD stores the number of found lines in lines_count.
   // it returns structural details as vector 'double lines[7 * lines_count]'
   int lines_count;
-  lsd_lines = LineSegmentDetection(&lines_count, greyscale, width, height,
+  lsd_lines = LineSegmentDetection(&lines_count, lsd_in, width, height,
                                    LSD_SCALE, LSD_SIGMA_SCALE, LSD_QUANT,
                                    LSD_ANG_TH, LSD_LOG_EPS, LSD_DENSITY_TH,
                                    LSD_N_BINS, NULL, NULL, NULL);
@@ -1447,11 +1457,13 @@ static int line_detect(float *in, const int width, const int height, const int x
          (fabs(y1 - y2) < 1 && fmin(y1, y2) > height - 3))
         continue;
 
-      // line position in absolute coordinates
-      float px1 = x_off + x1;
-      float py1 = y_off + y1;
-      float px2 = x_off + x2;
-      float py2 = y_off + y2;
+      // line position in absolute coordinates. a downsampled pixel is the mean of factor x factor
+      // pixels, its centre lies (factor - 1) / 2 pixels into that box
+      const float centre = 0.5f * (factor - 1);
+      float px1 = x_off + x1 * factor + centre;
+      float py1 = y_off + y1 * factor + centre;
+      float px2 = x_off + x2 * factor + centre;
+      float py2 = y_off + y2 * factor + centre;
 
       // scale back to input buffer
       px1 /= scale;
@@ -1476,7 +1488,7 @@ static int line_detect(float *in, const int width, const int height, const int x
 
       // length and width of rectangle (see LSD)
       ashift_lines[lct].length = sqrt((px2 - px1) * (px2 - px1) + (py2 - py1) * (py2 - py1));
-      ashift_lines[lct].width = lsd_lines[n * 7 + 4] / scale;
+      ashift_lines[lct].width = lsd_lines[n * 7 + 4] * factor / scale;
 
       // ...  and weight (= length * width * angle precision)
       const float weight = ashift_lines[lct].length * ashift_lines[lct].width * lsd_lines[n * 7 + 5];
@@ -1539,15 +1551,39 @@ static int line_detect(float *in, const int width, const int height, const int x
 
   // free intermediate buffers
   free(lsd_lines);
-  free(greyscale);
+  free(lsd_in);
+  dt_free_align(greyscale);
+  dt_free_align(small);
   return lct > 0 ? TRUE : FALSE;
 
 error:
   free(lsd_lines);
-  free(greyscale);
+  free(lsd_in);
+  dt_free_align(greyscale);
+  dt_free_align(small);
   return FALSE;
 }
 
+// hash identifying the input of a line detection: image, state of the preview pipe up to
+// this module, roi of the buffer and detection options
+static uint64_t get_detection_hash(const int imgid, const uint64_t buf_hash, const int width, const int height,
+                                   const int x_off, const int y_off, const float scale,
+                                   const dt_iop_ashift_enhance_t enhance, const int is_raw)
+{
+  union {
+      float f;
+      uint32_t u;
+  } x;
+  x.f = scale;
+
+  const uint64_t v[9] = { imgid, buf_hash & 0xffffffffu, buf_hash >> 32, width, height, x_off, y_off, x.u,
+                          (uint64_t)enhance << 1 | (is_raw ? 1 : 0) };
+
+  uint64_t hash = 5381;
+  for(size_t i = 0; i < 9; i++) hash = ((hash << 5) + hash) ^ v[i];
+  return hash;
+}
+
 // get image from buffer, analyze for structure and save results
 static int get_structure(dt_iop_module_t *module, dt_iop_ashift_enhance_t enhance)
 {
@@ -1559,6 +1595,16 @@ static int get_structure(dt_iop_module_t *module, dt_iop_ashift_enhance_t enhanc
   int x_off = 0;
   int y_off = 0;
   float scale = 0.0f;
+  uint64_t hash = 0;
+
+  const int is_raw = dt_image_is_raw(&module->dev->image_storage);
+
+  dt_iop_ashift_line_t *lines = NULL;
+  int lines_count = 0;
+  int vertical_count = 0;
+  int horizontal_count = 0;
+  float vertical_weight = 0.0f;
+  float horizontal_weight = 0.0f;
 
   dt_pthread_mutex_lock(&g->lock);
   // read buffer data if they are available
@@ -1569,15 +1615,35 @@ static int get_structure(dt_iop_module_t *module, dt_iop_ashift_enhance_t enhanc
     x_off = g->buf_x_off;
     y_off = g->buf_y_off;
     scale = g->buf_scale;
+    hash = get_detection_hash(module->dev->image_storage.id, g->buf_hash, width, height, x_off, y_off, scale,
+                              enhance, is_raw);
 
-    // create a temporary buffer to hold image data
-    buffer = malloc((size_t)width * height * 4 * sizeof(float));
-    if(buffer != NULL)
-      memcpy(buffer, g->buf, (size_t)width * height * 4 * sizeof(float));
+    if(g->detected_lines != NULL && g->detected_hash == hash)
+    {
+      // same image, roi and options as last time: reuse the detected lines. we hand out a copy as
+      // outlier removal and user selections change them
+      lines = malloc(sizeof(dt_iop_ashift_line_t) * g->detected_count);
+      if(lines != NULL)
+      {
+        memcpy(lines, g->detected_lines, sizeof(dt_iop_ashift_line_t) * g->detected_count);
+        lines_count = g->detected_count;
+        vertical_count = g->detected_vertical_count;
+        horizontal_count = g->detected_horizontal_count;
+        vertical_weight = g->detected_vertical_weight;
+        horizontal_weight = g->detected_horizontal_weight;
+      }
+    }
+    else
+    {
+      // create a temporary buffer to hold image data
+      buffer = malloc((size_t)width * height * 4 * sizeof(float));
+      if(buffer != NULL)
+        memcpy(buffer, g->buf, (size_t)width * height * 4 * sizeof(float));
+    }
   }
   dt_pthread_mutex_unlock(&g->lock);
 
-  if(buffer == NULL) goto error;
+  if(hash == 0 || (buffer == NULL && lines == NULL)) goto error;
 
   // get rid of old structural data
   g->lines_count = 0;
@@ -1586,18 +1652,29 @@ static int get_structure(dt_iop_module_t *module, dt_iop_ashift_enhance_t enhanc
   free(g->lines);
   g->lines = NULL;
 
-  dt_iop_ashift_line_t *lines;
-  int lines_count;
-  int vertical_count;
-  int horizontal_count;
-  float vertical_weight;
-  float horizontal_weight;
+  if(buffer != NULL)
+  {
+    // get new structural data
+    if(!line_detect(buffer, width, height, x_off, y_off, scale, &lines, &lines_count,
+                    &vertical_count, &horizontal_count, &vertical_weight, &horizontal_weight,
+                    enhance, is_raw))
+      goto error;
 
-  // get new structural data
-  if(!line_detect(buffer, width, height, x_off, y_off, scale, &lines, &lines_count,
-                  &vertical_count, &horizontal_count, &vertical_weight, &horizontal_weight,
-                  enhance, dt_image_is_raw(&module->dev->image_storage)))
-    goto error;
+    // and keep them for the next time
+    dt_iop_ashift_line_t *detected = malloc(sizeof(dt_iop_ashift_line_t) * lines_count);
+    if(detected != NULL) memcpy(detected, lines, sizeof(dt_iop_ashift_line_t) * lines_count);
+
+    dt_pthread_mutex_lock(&g->lock);
+    free(g->detected_lines);
+    g->detected_lines = detected;
+    g->detected_count = detected ? lines_count : 0;
+    g->detected_vertical_count = vertical_count;
+    g->detected_horizontal_count = horizontal_count;
+    g->detected_vertical_weight = vertical_weight;
+    g->detected_horizontal_weight = horizontal_weight;
+    g->detected_hash = detected ? hash : 0;
+    dt_pthread_mutex_unlock(&g->lock);
+  }
 
   // save new structural data
   g->lines_in_width = width;
@@ -2100,6 +2177,43 @@ static double model_fitness(double *params, void *data)
   return sum;
 }
 
+// sanity check of fit results: in case of extreme values the image gets distorted so strongly that it spans
+// an insanely huge area. we check that case and assume values that increase the image area by more than a
+// factor of 4 as being insane.
+static dt_iop_ashift_nmsresult_t nms_check_result(const dt_iop_ashift_fit_params_t *fit, const double *params)
+{
+  // consolidate the parameters (order matters!!!)
+  int pcount = 0;
+  const float rotation = isnan(fit->rotation) ? ilogit(params[pcount++], -fit->rotation_range, fit->rotation_range) : fit->rotation;
+  const float lensshift_v = isnan(fit->lensshift_v) ? ilogit(params[pcount++], -fit->lensshift_v_range, fit->lensshift_v_range) : fit->lensshift_v;
+  const float lensshift_h = isnan(fit->lensshift_h) ? ilogit(params[pcount++], -fit->lensshift_h_range, fit->lensshift_h_range) : fit->lensshift_h;
+  const float shear = isnan(fit->shear) ? ilogit(params[pcount++], -fit->shear_range, fit->shear_range) : fit->shear;
+
+  float homograph[3][3];
+  homography((float *)homograph, rotation, lensshift_v, lensshift_h, shear, fit->f_length_kb,
+             fit->orthocorr, fit->aspect, fit->width, fit->height, ASHIFT_HOMOGRAPH_FORWARD);
+
+  // visit all four corners and find maximum span
+  float xm = FLT_MAX, xM = -FLT_MAX, ym = FLT_MAX, yM = -FLT_MAX;
+  for(int y = 0; y < fit->height; y += fit->height - 1)
+    for(int x = 0; x < fit->width; x += fit->width - 1)
+    {
+      float pi[3], po[3];
+      pi[0] = x;
+      pi[1] = y;
+      pi[2] = 1.0f;
+      mat3mulv(po, (float *)homograph, pi);
+      po[0] /= po[2];
+      po[1] /= po[2];
+      xm = fmin(xm, po[0]);
+      ym = fmin(ym, po[1]);
+      xM = fmax(xM, po[0]);
+      yM = fmax(yM, po[1]);
+    }
+
+  return ((xM - xm) * (yM - ym) > 4.0f * fit->width * fit->height) ? NMS_INSANE : NMS_SUCCESS;
+}
+
 // setup all data structures for fitting and call NM simplex
 static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_params_t *p, dt_iop_ashift_fitaxis_t dir)
 {
@@ -2222,58 +2336,81 @@ static dt_iop_ashift_nmsresult_t nmsfit(dt_iop_module_t *module, dt_iop_ashift_p
     return NMS_NOT_ENOUGH_LINES;
   }
 
-  // start the simplex fit
-  int iter = simplex(model_fitness, params, fit.params_count, NMS_EPSILON, NMS_SCALE, NMS_ITERATIONS, NULL, (void*)&fit);
+  // model_fitness() is evaluated many times per run: only hand over the lines it uses
+  dt_iop_ashift_line_t *fit_lines = malloc(sizeof(dt_iop_ashift_line_t) * g->lines_count);
+  if(fit_lines == NULL) return NMS_NOT_ENOUGH_LINES;
+  int fit_lines_count = 0;
+  for(int n = 0; n < g->lines_count; n++)
+    if((g->lines[n].type & fit.linemask) == fit.linetype) fit_lines[fit_lines_count++] = g->lines[n];
+  fit.lines = fit_lines;
+  fit.lines_count = fit_lines_count;
+
+  // the simplex may get stuck in a local minimum, so besides the current parameters we start it
+  // from the neutral ones and from points around the current ones and keep the best result
+  double starts[NMS_STARTS_MAX][4];
+  int nstarts = 0;
+  memcpy(starts[nstarts++], params, sizeof(params));
+  for(int k = 0; k < fit.params_count; k++) starts[nstarts][k] = 0.0;
+  nstarts++;
+  for(int k = 0; k < fit.params_count && nstarts + 2 <= NMS_STARTS_MAX; k++)
+    for(int sign = -1; sign <= 1; sign += 2)
+    {
+      memcpy(starts[nstarts], params, sizeof(params));
+      starts[nstarts][k] += sign * NMS_START_OFFSET;
+      nstarts++;
+    }
+
+  int iters[NMS_STARTS_MAX];
+  double quality[NMS_STARTS_MAX];
+  dt_iop_ashift_nmsresult_t results[NMS_STARTS_MAX];
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(nstarts) \
+  shared(fit, iters, quality, results, starts) \
+  schedule(dynamic)
+#endif
+  for(int k = 0; k < nstarts; k++)
+  {
+    iters[k] = simplex(model_fitness, starts[k], fit.params_count, NMS_EPSILON, NMS_SCALE, NMS_ITERATIONS, NULL,
+                       (void *)&fit);
+    quality[k] = model_fitness(starts[k], (void *)&fit);
+    results[k] = iters[k] >= NMS_ITERATIONS ? NMS_DID_NOT_CONVERGE : nms_check_result(&fit, starts[k]);
+  }
+
+  free(fit_lines);
+  fit.lines = NULL;
+
+  // the best successful run wins, if there is none we report about the one from the current parameters
+  int best = 0;
+  for(int k = 1; k < nstarts; k++)
+    if(results[k] == NMS_SUCCESS && (results[best] != NMS_SUCCESS || quality[k] < quality[best])) best = k;
 
   // error case: the fit did not converge
-  if(iter >= NMS_ITERATIONS)
+  if(results[best] == NMS_DID_NOT_CONVERGE)
   {
 #ifdef ASHIFT_DEBUG
-    printf("optimization not successful: maximum number of iterations reached (%d)\n", iter);
+    printf("optimization not successful: maximum number of iterations reached (%d)\n", iters[best]);
 #endif
     return NMS_DID_NOT_CONVERGE;
   }
 
   // fit was successful: now consolidate the results (order matters!!!)
   pcount = 0;
-  fit.rotation = isnan(fit.rotation) ? ilogit(params[pcount++], -fit.rotation_range, fit.rotation_range) : fit.rotation;
-  fit.lensshift_v = isnan(fit.lensshift_v) ? ilogit(params[pcount++], -fit.lensshift_v_range, fit.lensshift_v_range) : fit.lensshift_v;
-  fit.lensshift_h = isnan(fit.lensshift_h) ? ilogit(params[pcount++], -fit.lensshift_h_range, fit.lensshift_h_range) : fit.lensshift_h;
-  fit.shear = isnan(fit.shear) ? ilogit(params[pcount++], -fit.shear_range, fit.shear_range) : fit.shear;
+  fit.rotation = isnan(fit.rotation) ? ilogit(starts[best][pcount++], -fit.rotation_range, fit.rotation_range) : fit.rotation;
+  fit.lensshift_v = isnan(fit.lensshift_v) ? ilogit(starts[best][pcount++], -fit.lensshift_v_range, fit.lensshift_v_range) : fit.lensshift_v;
+  fit.lensshift_h = isnan(fit.lensshift_h) ? ilogit(starts[best][pcount++], -fit.lensshift_h_range, fit.lensshift_h_range) : fit.lensshift_h;
+  fit.shear = isnan(fit.shear) ? ilogit(starts[best][pcount++], -fit.shear_range, fit.shear_range) : fit.shear;
 #ifdef ASHIFT_DEBUG
-  printf("params after optimization (%d iterations): rotation %f, lensshift_v %f, lensshift_h %f, shear %f\n",
-         iter, fit.rotation, fit.lensshift_v, fit.lensshift_h, fit.shear);
+  printf("params after optimization (%d iterations, start %d of %d): rotation %f, lensshift_v %f, lensshift_h %f, shear %f\n",
+         iters[best], best, nstarts, fit.rotation, fit.lensshift_v, fit.lensshift_h, fit.shear);
 #endif
 
-  // sanity check: in case of extreme values the image gets distorted so strongly that it spans an insanely huge area. we check that
-  // case and assume values that increase the image area by more than a factor of 4 as being insane.
-  float homograph[3][3];
-  homography((float *)homograph, fit.rotation, fit.lensshift_v, fit.lensshift_h, fit.shear, fit.f_length_kb,
-             fit.orthocorr, fit.aspect, fit.width, fit.height, ASHIFT_HOMOGRAPH_FORWARD);
-
-  // visit all four corners and find maximum span
-  float xm = FLT_MAX, xM = -FLT_MAX, ym = FLT_MAX, yM = -FLT_MAX;
-  for(int y = 0; y < fit.height; y += fit.height - 1)
-    for(int x = 0; x < fit.width; x += fit.width - 1)
-    {
-      float pi[3], po[3];
-      pi[0] = x;
-      pi[1] = y;
-      pi[2] = 1.0f;
-      mat3mulv(po, (float *)homograph, pi);
-      po[0] /= po[2];
-      po[1] /= po[2];
-      xm = fmin(xm, po[0]);
-      ym = fmin(ym, po[1]);
-      xM = fmax(xM, po[0]);
-      yM = fmax(yM, po[1]);
-    }
-
-  if((xM - xm) * (yM - ym) > 4.0f * fit.width * fit.height)
+  // error case: degenerate result
+  if(results[best] == NMS_INSANE)
   {
 #ifdef ASHIFT_DEBUG
-    printf("optimization not successful: degenerate case with area growth factor (%f) exceeding limits\n",
-           (xM - xm) * (yM - ym) / (fit.width * fit.height));
+    printf("optimization not successful: degenerate case with area growth factor exceeding limits\n");
 #endif
     return NMS_INSANE;
   }
@@ -4648,6 +4785,10 @@ void reload_defaults(dt_iop_module_t *module)
     g->buf_hash = 0;
     g->isflipped = -1;
     g->lastfit = ASHIFT_FIT_NONE;
+    free(g->detected_lines);
+    g->detected_lines = NULL;
+    g->detected_count = 0;
+    g->detected_hash = 0;
     dt_pthread_mutex_unlock(&g->lock);
 
     g->fitting = 0;
@@ -4808,6 +4949,9 @@ void gui_init(struct dt_iop_module_t *self)
   g->fitting = 0;
   g->lines = NULL;
   g->lines_count = 0;
+  g->detected_lines = NULL;
+  g->detected_count = 0;
+  g->detected_hash = 0;
   g->vertical_count = 0;
   g->horizontal_count = 0;
   g->lines_version = 0;
@@ -5041,6 +5185,7 @@ void gui_cleanup(struct dt_iop_module_t *self)
   dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)self->gui_data;
   dt_pthread_mutex_destroy(&g->lock);
   free(g->lines);
+  free(g->detected_lines);
   free(g->buf);
   free(g->points);
   free(g->points_idx);
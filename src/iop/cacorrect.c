@@ -19,6 +19,7 @@
 #include "config.h"
 #endif
 #include "common/darktable.h"
+#include "develop/develop.h"
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
 #include "gui/gtk.h"
@@ -48,6 +49,28 @@ typedef struct dt_iop_cacorrect_gui_data_t
 
 dt_iop_cacorrect_gui_data_t dummy;
 
+// the fit of the ca shifts only depends on the raw data and the region of interest, it is
+// kept for a few pipes so that only the correction itself needs to be redone, e.g. when
+// exporting the same image again or when modules after this one change.
+#define CACORRECT_FITS 8
+
+typedef struct dt_iop_cacorrect_fit_t
+{
+  int imgid;
+  uint64_t hash; // of the pipe up to (excluding) this module, 0 for an unused entry
+  dt_iop_roi_t roi;
+  gboolean valid; // FALSE if the estimation failed and no correction is to be applied
+  int polyord, numpar;
+  double fitparams[2][2][16];
+} dt_iop_cacorrect_fit_t;
+
+typedef struct dt_iop_cacorrect_global_data_t
+{
+  dt_iop_cacorrect_fit_t fits[CACORRECT_FITS];
+  int fits_next;
+  dt_pthread_mutex_t lock;
+} dt_iop_cacorrect_global_data_t;
+
 // this returns a translatable name
 const char *name()
 {
@@ -366,6 +389,37 @@ static void CA_correct(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
   // order of 2d polynomial fit (polyord), and numpar=polyord^2
   int polyord = 4, numpar = 16;
 
+  // reuse the fit if this input has been seen before
+  dt_iop_cacorrect_global_data_t *gd = (dt_iop_cacorrect_global_data_t *)self->global_data;
+  const uint64_t hash = dt_dev_hash_plus(self->dev, piece->pipe, self->iop_order, DT_DEV_TRANSFORM_DIR_BACK_EXCL);
+  gboolean fitted = FALSE;
+  if(autoCA && hash != 0)
+  {
+    dt_pthread_mutex_lock(&gd->lock);
+    for(int k = 0; k < CACORRECT_FITS; k++)
+    {
+      const dt_iop_cacorrect_fit_t *fit = gd->fits + k;
+      if(fit->hash == hash && fit->imgid == piece->pipe->image.id && !memcmp(&fit->roi, roi_in, sizeof(dt_iop_roi_t)))
+      {
+        processpasstwo = fit->valid;
+        polyord = fit->polyord;
+        numpar = fit->numpar;
+        memcpy(fitparams, fit->fitparams, sizeof(fitparams));
+        fitted = TRUE;
+        break;
+      }
+    }
+    dt_pthread_mutex_unlock(&gd->lock);
+  }
+  if(fitted && !processpasstwo)
+  {
+    // estimation failed on this input before, out already holds a copy of the input
+    free(Gtmp);
+    free(buffer1);
+    free(RawDataTmp);
+    return;
+  }
+
   const float eps = 1e-5f, eps2 = 1e-10f; // tolerance to avoid dividing by zero
 
 #ifdef _OPENMP
@@ -612,6 +666,9 @@ static void CA_correct(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
               }
             }
           }
+
+          // the interpolated green is needed for the correction, the shifts are known already
+          if(fitted) continue;
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 #ifdef __SSE2__
           vfloat zd25v = F2V(0.25f);
@@ -885,6 +942,7 @@ static void CA_correct(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
 #ifdef _OPENMP
 #pragma omp single
 #endif
+      if(!fitted)
       {
         for(int dir = 0; dir < 2; dir++)
           for(int c = 0; c < 2; c++)
@@ -1065,6 +1123,21 @@ static void CA_correct(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
         }
 
         // fitparams[polyord*i+j] gives the coefficients of (vblock^i hblock^j) in a polynomial fit for i,j<=4
+
+        if(hash != 0)
+        {
+          dt_pthread_mutex_lock(&gd->lock);
+          dt_iop_cacorrect_fit_t *fit = gd->fits + gd->fits_next;
+          gd->fits_next = (gd->fits_next + 1) % CACORRECT_FITS;
+          fit->imgid = piece->pipe->image.id;
+          fit->hash = hash;
+          fit->roi = *roi_in;
+          fit->valid = processpasstwo;
+          fit->polyord = polyord;
+          fit->numpar = numpar;
+          memcpy(fit->fitparams, fitparams, sizeof(fitparams));
+          dt_pthread_mutex_unlock(&gd->lock);
+        }
       }
       // end of initialization for CA correction pass
       // only executed if cared and cablue are zero
@@ -1515,10 +1588,23 @@ end:
 }
 
 /** init, cleanup, commit to pipeline */
+void init_global(dt_iop_module_so_t *module)
+{
+  dt_iop_cacorrect_global_data_t *gd = (dt_iop_cacorrect_global_data_t *)calloc(1, sizeof(dt_iop_cacorrect_global_data_t));
+  dt_pthread_mutex_init(&gd->lock, NULL);
+  module->data = gd;
+}
+
+void cleanup_global(dt_iop_module_so_t *module)
+{
+  dt_iop_cacorrect_global_data_t *gd = (dt_iop_cacorrect_global_data_t *)module->data;
+  dt_pthread_mutex_destroy(&gd->lock);
+  free(module->data);
+  module->data = NULL;
+}
+
 void init(dt_iop_module_t *module)
 {
-  // we don't need global data:
-  module->global_data = NULL; // malloc(sizeof(dt_iop_cacorrect_global_data_t));
   module->params = calloc(1, sizeof(dt_iop_cacorrect_params_t));
   module->default_params = calloc(1, sizeof(dt_iop_cacorrect_params_t));
   // our module is disabled by default
@@ -1536,8 +1622,6 @@ void cleanup(dt_iop_module_t *module)
   module->params = NULL;
   free(module->default_params);
   module->default_params = NULL;
-  free(module->global_data); // just to be sure
-  module->global_data = NULL;
 }
 
 /** commit is the synch point between core and gui, so it copies params to pipe data. */
@@ -39,25 +39,40 @@
 
 #define ROUND_POSISTIVE(f) ((unsigned int)((f)+0.5))
 
-DT_MODULE(1)
+DT_MODULE(2)
+
+typedef enum dt_iop_rlce_method_t
+{
+  DT_IOP_RLCE_SLIDING = 0, // one histogram centred on every pixel, as in version 1
+  DT_IOP_RLCE_TILED = 1    // one histogram per tile, interpolated between the four closest tiles
+} dt_iop_rlce_method_t;
+
+typedef struct dt_iop_rlce_params1_t
+{
+  double radius;
+  double slope;
+} dt_iop_rlce_params1_t;
 
 typedef struct dt_iop_rlce_params_t
 {
   double radius;
   double slope;
+  dt_iop_rlce_method_t method;
 } dt_iop_rlce_params_t;
 
 typedef struct dt_iop_rlce_gui_data_t
 {
   GtkBox *vbox1, *vbox2;
-  GtkWidget *label1, *label2;
+  GtkWidget *label1, *label2, *label3;
   GtkWidget *scale1, *scale2; // radie pixels, slope
+  GtkWidget *method;
 } dt_iop_rlce_gui_data_t;
 
 typedef struct dt_iop_rlce_data_t
 {
   double radius;
   double slope;
+  dt_iop_rlce_method_t method;
 } dt_iop_rlce_data_t;
 
 
@@ -81,86 +96,94 @@ int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_p
   return iop_cs_rgb;
 }
 
-void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
-             void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+#define BINS (256)
+#define TILE_MIN (32)  // pixels on a side of the smallest tile in process_tiled()
+#define TILES_MAX (64) // tiles along the longer side at most
+
+// clip the histogram at limit and redistribute the clipped entries, until nothing is clipped anymore
+static void clip_histogram(int *const hist, const int limit)
 {
-  dt_iop_rlce_data_t *data = (dt_iop_rlce_data_t *)piece->data;
-  const int ch = piece->colors;
+  int ce = 0, ceb = 0;
+  do
+  {
+    ceb = ce;
+    ce = 0;
+    for(int b = 0; b <= BINS; b++)
+    {
+      int d = hist[b] - limit;
+      if(d > 0)
+      {
+        ce += d;
+        hist[b] = limit;
+      }
+    }
 
-  // PASS1: Get a luminance map of image...
-  float *luminance = (float *)malloc(((size_t)roi_out->width * roi_out->height) * sizeof(float));
-// double lsmax=0.0,lsmin=1.0;
+    int d = (ce / (float)(BINS + 1));
+    int m = ce % (BINS + 1);
+    for(int b = 0; b <= BINS; b++) hist[b] += d;
+
+    if(m != 0)
+    {
+      int s = BINS / (float)m;
+      for(int b = 0; b <= BINS; b += s) ++hist[b];
+    }
+  } while(ce != ceb);
+}
+
+// luminance of every pixel, as histogram bin
+static void luminance_bins(const float *const in, uint16_t *const bins, const int width, const int height,
+                           const int ch)
+{
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ch, ivoid, roi_out) \
-  shared(luminance) \
+  dt_omp_firstprivate(bins, ch, height, in, width) \
   schedule(static)
 #endif
-  for(int j = 0; j < roi_out->height; j++)
+  for(size_t k = 0; k < (size_t)width * height; k++)
   {
-    float *in = (float *)ivoid + (size_t)j * roi_out->width * ch;
-    float *lm = luminance + (size_t)j * roi_out->width;
-    for(int i = 0; i < roi_out->width; i++)
-    {
-      double pmax = CLIP(fmax(in[0], fmax(in[1], in[2]))); // Max value in RGB set
-      double pmin = CLIP(fmin(in[0], fmin(in[1], in[2]))); // Min value in RGB set
-      *lm = (pmax + pmin) / 2.0;                           // Pixel luminocity
-      in += ch;
-      lm++;
-    }
+    const float *pixel = in + k * ch;
+    const double pmax = CLIP(fmax(pixel[0], fmax(pixel[1], pixel[2]))); // Max value in RGB set
+    const double pmin = CLIP(fmin(pixel[0], fmin(pixel[1], pixel[2]))); // Min value in RGB set
+    bins[k] = ROUND_POSISTIVE((float)((pmax + pmin) / 2.0) * (float)BINS);
   }
+}
 
-
-  // Params
-  const int rad = data->radius * roi_in->scale / piece->iscale;
-
-#define BINS (256)
-
-  const float slope = data->slope;
-
-  const size_t destbuf_size = roi_out->width;
-  float *const dest_buf = malloc(destbuf_size * sizeof(float) * dt_get_num_threads());
-
-// CLAHE
+// the original implementation: a histogram of a window of (2*rad+1)^2 pixels around every pixel,
+// clipped and integrated per pixel. kept to compare against, see process().
+static void process_sliding(const uint16_t *const luminance, float *const dest, const int width,
+                            const int height, const int rad, const float slope)
+{
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ch, dest_buf, destbuf_size, ivoid, ovoid, rad, roi_in, \
-                      roi_out, slope) \
-  shared(luminance) \
+  dt_omp_firstprivate(dest, height, luminance, rad, slope, width) \
   schedule(static)
 #endif
-  for(int j = 0; j < roi_out->height; j++)
+  for(int j = 0; j < height; j++)
   {
     int yMin = fmax(0, j - rad);
-    int yMax = fmin(roi_in->height, j + rad + 1);
+    int yMax = fmin(height, j + rad + 1);
     int h = yMax - yMin;
 
     int xMin0 = fmax(0, 0 - rad);
-    int xMax0 = fmin(roi_in->width - 1, rad);
+    int xMax0 = fmin(width - 1, rad);
 
     int hist[BINS + 1];
     int clippedhist[BINS + 1];
 
-    float *dest = dest_buf + destbuf_size * dt_get_thread_num();
-
     /* initially fill histogram */
     memset(hist, 0, (BINS + 1) * sizeof(int));
     for(int yi = yMin; yi < yMax; ++yi)
-      for(int xi = xMin0; xi < xMax0; ++xi)
-        ++hist[ROUND_POSISTIVE(luminance[(size_t)yi * roi_in->width + xi] * (float)BINS)];
+      for(int xi = xMin0; xi < xMax0; ++xi) ++hist[luminance[(size_t)yi * width + xi]];
 
-    // Destination row
-    memset(dest, 0, roi_out->width * sizeof(float));
-    float *ld = dest;
+    float *ld = dest + (size_t)j * width;
 
-    for(int i = 0; i < roi_out->width; i++)
+    for(int i = 0; i < width; i++)
     {
-
-      int v = ROUND_POSISTIVE(luminance[(size_t)j * roi_in->width + i] * (float)BINS);
+      int v = luminance[(size_t)j * width + i];
 
       int xMin = fmax(0, i - rad);
       int xMax = i + rad + 1;
-      int w = fmin(roi_in->width, xMax) - xMin;
+      int w = fmin(width, xMax) - xMin;
       int n = h * w;
 
       int limit = (int)(slope * n / BINS + 0.5f);
@@ -169,45 +192,19 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       if(xMin > 0)
       {
         int xMin1 = xMin - 1;
-        for(int yi = yMin; yi < yMax; ++yi)
-          --hist[ROUND_POSISTIVE(luminance[(size_t)yi * roi_in->width + xMin1] * (float)BINS)];
+        for(int yi = yMin; yi < yMax; ++yi) --hist[luminance[(size_t)yi * width + xMin1]];
       }
 
       /* add newly included values to histogram */
-      if(xMax <= roi_in->width)
+      if(xMax <= width)
       {
         int xMax1 = xMax - 1;
-        for(int yi = yMin; yi < yMax; ++yi)
-          ++hist[ROUND_POSISTIVE(luminance[(size_t)yi * roi_in->width + xMax1] * (float)BINS)];
+        for(int yi = yMin; yi < yMax; ++yi) ++hist[luminance[(size_t)yi * width + xMax1]];
       }
 
       /* clip histogram and redistribute clipped entries */
       memcpy(clippedhist, hist, (BINS + 1) * sizeof(int));
-      int ce = 0, ceb = 0;
-      do
-      {
-        ceb = ce;
-        ce = 0;
-        for(int b = 0; b <= BINS; b++)
-        {
-          int d = clippedhist[b] - limit;
-          if(d > 0)
-          {
-            ce += d;
-            clippedhist[b] = limit;
-          }
-        }
-
-        int d = (ce / (float)(BINS + 1));
-        int m = ce % (BINS + 1);
-        for(int b = 0; b <= BINS; b++) clippedhist[b] += d;
-
-        if(m != 0)
-        {
-          int s = BINS / (float)m;
-          for(int b = 0; b <= BINS; b += s) ++clippedhist[b];
-        }
-      } while(ce != ceb);
+      clip_histogram(clippedhist, limit);
 
       /* build cdf of clipped histogram */
       unsigned int hMin = BINS;
@@ -226,30 +223,174 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
       ld++;
     }
+  }
+}
+
+// tiled clahe: the image is cut into tiles of the window size, every tile gets one clipped histogram
+// and its mapping from input to output luminance, and every pixel interpolates bilinearly between the
+// mappings of the four closest tiles. this costs the same per pixel for any radius.
+// tiles are kept large enough for a meaningful histogram, and few enough that the luts stay small
+// on small radii and downscaled previews. returns FALSE if the luts can't be allocated.
+static int process_tiled(const uint16_t *const luminance, float *const dest, const int width, const int height,
+                         const int rad, const float slope)
+{
+  const int size = MAX(MAX(2 * rad + 1, TILE_MIN),
+                       (MAX(width, height) + TILES_MAX - 1) / TILES_MAX);
+  const int tx = (width + size - 1) / size;
+  const int ty = (height + size - 1) / size;
+  float *const lut = dt_alloc_align(64, sizeof(float) * (BINS + 1) * tx * ty);
+  if(!lut) return FALSE;
 
-    // Apply row
-    float *in = ((float *)ivoid) + (size_t)j * roi_out->width * ch;
-    float *out = ((float *)ovoid) + (size_t)j * roi_out->width * ch;
-    for(int r = 0; r < roi_out->width; r++)
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(height, lut, luminance, size, slope, tx, ty, width) \
+  schedule(dynamic) collapse(2)
+#endif
+  for(int tj = 0; tj < ty; tj++)
+    for(int ti = 0; ti < tx; ti++)
     {
-      float H, S, L;
-      rgb2hsl(in, &H, &S, &L);
-      // hsl2rgb(out,H,S,( L / dest[r] ) * (L-lsmin) + lsmin );
-      hsl2rgb(out, H, S, dest[r]);
-      out += ch;
-      in += ch;
-      ld++;
+      const int x0 = ti * size, x1 = MIN(x0 + size, width);
+      const int y0 = tj * size, y1 = MIN(y0 + size, height);
+
+      // four interleaved histograms, so that runs of equal bins do not wait on each other's increments
+      int hists[4][BINS + 1];
+      memset(hists, 0, sizeof(hists));
+      for(int y = y0; y < y1; y++)
+      {
+        const uint16_t *const row = luminance + (size_t)y * width;
+        int x = x0;
+        for(; x + 4 <= x1; x += 4)
+        {
+          hists[0][row[x]]++;
+          hists[1][row[x + 1]]++;
+          hists[2][row[x + 2]]++;
+          hists[3][row[x + 3]]++;
+        }
+        for(; x < x1; x++) hists[0][row[x]]++;
+      }
+      int hist[BINS + 1];
+      for(int b = 0; b <= BINS; b++) hist[b] = hists[0][b] + hists[1][b] + hists[2][b] + hists[3][b];
+
+      const int n = (x1 - x0) * (y1 - y0);
+      clip_histogram(hist, (int)(slope * n / BINS + 0.5f));
+
+      // same normalisation of the cdf as in process_sliding()
+      int hMin = 0;
+      while(hMin < BINS && hist[hMin] == 0) hMin++;
+      int cdfMax = 0;
+      for(int b = hMin; b <= BINS; b++) cdfMax += hist[b];
+      const int cdfMin = hist[hMin];
+      const float norm = cdfMax > cdfMin ? 1.0f / (cdfMax - cdfMin) : 0.0f;
+
+      float *const map = lut + (size_t)(BINS + 1) * (tj * tx + ti);
+      int cdf = 0;
+      for(int b = 0; b <= BINS; b++)
+      {
+        if(b >= hMin) cdf += hist[b];
+        map[b] = (cdf - cdfMin) * norm;
+      }
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(dest, height, lut, luminance, size, tx, ty, width) \
+  schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
+  {
+    // tiles above and below the pixel centre, and the weight of the lower one
+    const float fy = (j + 0.5f) / size - 0.5f;
+    const int j0 = CLAMP((int)floorf(fy), 0, ty - 1), j1 = MIN(j0 + 1, ty - 1);
+    const float wy = CLAMP(fy - j0, 0.0f, 1.0f);
+    for(int i = 0; i < width; i++)
+    {
+      const float fx = (i + 0.5f) / size - 0.5f;
+      const int i0 = CLAMP((int)floorf(fx), 0, tx - 1), i1 = MIN(i0 + 1, tx - 1);
+      const float wx = CLAMP(fx - i0, 0.0f, 1.0f);
+      const int v = luminance[(size_t)j * width + i];
+      const float m00 = lut[(size_t)(BINS + 1) * (j0 * tx + i0) + v];
+      const float m01 = lut[(size_t)(BINS + 1) * (j0 * tx + i1) + v];
+      const float m10 = lut[(size_t)(BINS + 1) * (j1 * tx + i0) + v];
+      const float m11 = lut[(size_t)(BINS + 1) * (j1 * tx + i1) + v];
+      const float top = m00 + wx * (m01 - m00);
+      const float bottom = m10 + wx * (m11 - m10);
+      dest[(size_t)j * width + i] = top + wy * (bottom - top);
     }
   }
 
-  free(dest_buf);
+  dt_free_align(lut);
+  return TRUE;
+}
 
-  // Cleanup
-  free(luminance);
+int legacy_params(dt_iop_module_t *self, const void *const old_params, const int old_version,
+                  void *new_params, const int new_version)
+{
+  if(old_version == 1 && new_version == 2)
+  {
+    const dt_iop_rlce_params1_t *old = old_params;
+    dt_iop_rlce_params_t *new = new_params;
+    new->radius = old->radius;
+    new->slope = old->slope;
+    // existing edits keep the look they were made with
+    new->method = DT_IOP_RLCE_SLIDING;
+    return 0;
+  }
+  return 1;
+}
 
-#undef BINS
+void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+             void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_rlce_data_t *data = (dt_iop_rlce_data_t *)piece->data;
+  const int ch = piece->colors;
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+
+  // Params
+  const int rad = data->radius * roi_in->scale / piece->iscale;
+  const float slope = data->slope;
+
+  // PASS1: Get a luminance map of image...
+  uint16_t *const luminance = dt_alloc_align(64, sizeof(uint16_t) * width * height);
+  float *const dest = dt_alloc_align(64, sizeof(float) * width * height);
+  if(!luminance || !dest)
+  {
+    fprintf(stderr, "[clahe] failed to allocate buffers, skipping\n");
+    dt_free_align(luminance);
+    dt_free_align(dest);
+    memcpy(ovoid, ivoid, sizeof(float) * ch * width * height);
+    return;
+  }
+  luminance_bins((const float *)ivoid, luminance, width, height, ch);
+
+  // PASS2: CLAHE, the new luminance of every pixel. the sliding window needs no extra memory,
+  // so it also stands in if the tiles can't get their luts.
+  if(data->method == DT_IOP_RLCE_SLIDING || !process_tiled(luminance, dest, width, height, rad, slope))
+    process_sliding(luminance, dest, width, height, rad, slope);
+  dt_free_align(luminance);
+
+  // Apply
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ch, dest, ivoid, ovoid, width, height) \
+  schedule(static)
+#endif
+  for(size_t k = 0; k < (size_t)width * height; k++)
+  {
+    const float *in = (const float *)ivoid + k * ch;
+    float *out = (float *)ovoid + k * ch;
+    float H, S, L;
+    rgb2hsl(in, &H, &S, &L);
+    hsl2rgb(out, H, S, dest[k]);
+  }
+
+  dt_free_align(dest);
 }
 
+#undef BINS
+#undef TILE_MIN
+#undef TILES_MAX
+
 static void radius_callback(GtkWidget *slider, gpointer user_data)
 {
   dt_iop_module_t *self = (dt_iop_module_t *)user_data;
@@ -268,6 +409,15 @@ static void slope_callback(GtkWidget *slider, gpointer user_data)
   dt_dev_add_history_item(darktable.develop, self, TRUE);
 }
 
+static void method_callback(GtkWidget *combo, gpointer user_data)
+{
+  dt_iop_module_t *self = (dt_iop_module_t *)user_data;
+  if(self->dt->gui->reset) return;
+  dt_iop_rlce_params_t *p = (dt_iop_rlce_params_t *)self->params;
+  p->method = dt_bauhaus_combobox_get(combo);
+  dt_dev_add_history_item(darktable.develop, self, TRUE);
+}
+
 
 
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
@@ -278,6 +428,7 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   d->radius = p->radius;
   d->slope = p->slope;
+  d->method = p->method;
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -299,6 +450,7 @@ void gui_update(struct dt_iop_module_t *self)
   dt_iop_rlce_params_t *p = (dt_iop_rlce_params_t *)module->params;
   dt_bauhaus_slider_set(g->scale1, p->radius);
   dt_bauhaus_slider_set(g->scale2, p->slope);
+  dt_bauhaus_combobox_set(g->method, p->method);
 }
 
 void init(dt_iop_module_t *module)
@@ -308,7 +460,7 @@ void init(dt_iop_module_t *module)
   module->default_enabled = 0;
   module->params_size = sizeof(dt_iop_rlce_params_t);
   module->gui_data = NULL;
-  dt_iop_rlce_params_t tmp = (dt_iop_rlce_params_t){ 64, 1.25 };
+  dt_iop_rlce_params_t tmp = (dt_iop_rlce_params_t){ 64, 1.25, DT_IOP_RLCE_TILED };
   memcpy(module->params, &tmp, sizeof(dt_iop_rlce_params_t));
   memcpy(module->default_params, &tmp, sizeof(dt_iop_rlce_params_t));
 }
@@ -338,6 +490,8 @@ void gui_init(struct dt_iop_module_t *self)
   gtk_box_pack_start(GTK_BOX(g->vbox1), g->label1, TRUE, TRUE, 0);
   g->label2 = dtgtk_reset_label_new(_("amount"), self, &p->slope, sizeof(float));
   gtk_box_pack_start(GTK_BOX(g->vbox1), g->label2, TRUE, TRUE, 0);
+  g->label3 = dtgtk_reset_label_new(_("method"), self, &p->method, sizeof(p->method));
+  gtk_box_pack_start(GTK_BOX(g->vbox1), g->label3, TRUE, TRUE, 0);
 
   g->scale1 = dt_bauhaus_slider_new_with_range(NULL, 0.0, 256.0, 1.0,
                                                p->radius, 0);
@@ -347,11 +501,21 @@ void gui_init(struct dt_iop_module_t *self)
 
   gtk_box_pack_start(GTK_BOX(g->vbox2), GTK_WIDGET(g->scale1), TRUE, TRUE, 0);
   gtk_box_pack_start(GTK_BOX(g->vbox2), GTK_WIDGET(g->scale2), TRUE, TRUE, 0);
+
+  g->method = dt_bauhaus_combobox_new(self);
+  dt_bauhaus_combobox_add(g->method, _("sliding window"));
+  dt_bauhaus_combobox_add(g->method, _("tiles"));
+  dt_bauhaus_combobox_set(g->method, p->method);
+  gtk_box_pack_start(GTK_BOX(g->vbox2), GTK_WIDGET(g->method), TRUE, TRUE, 0);
   gtk_widget_set_tooltip_text(GTK_WIDGET(g->scale1), _("size of features to preserve"));
   gtk_widget_set_tooltip_text(GTK_WIDGET(g->scale2), _("strength of the effect"));
+  gtk_widget_set_tooltip_text(g->method, _("sliding window computes a histogram around every pixel, as before.\n"
+                                           "tiles interpolates between the histograms of a grid, much faster\n"
+                                           "on large radii but slightly different"));
 
   g_signal_connect(G_OBJECT(g->scale1), "value-changed", G_CALLBACK(radius_callback), self);
   g_signal_connect(G_OBJECT(g->scale2), "value-changed", G_CALLBACK(slope_callback), self);
+  g_signal_connect(G_OBJECT(g->method), "value-changed", G_CALLBACK(method_callback), self);
 }
 
 void gui_cleanup(struct dt_iop_module_t *self)
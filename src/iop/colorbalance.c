@@ -150,7 +150,7 @@ const char *description()
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_SCALE_INVARIANT | IOP_FLAGS_POINTWISE;
 }
 
 int default_group()
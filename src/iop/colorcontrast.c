@@ -32,9 +32,6 @@
 #include <gtk/gtk.h>
 #include <stdlib.h>
 
-#if defined(__SSE__)
-#include <xmmintrin.h>
-#endif
 
 DT_MODULE_INTROSPECTION(2, dt_iop_colorcontrast_params_t)
 
@@ -89,7 +86,8 @@ const char *name()
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_SCALE_INVARIANT
+         | IOP_FLAGS_POINTWISE;
 }
 
 int default_group()
@@ -140,106 +138,35 @@ void connect_key_accels(dt_iop_module_t *self)
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
-  // this is called for preview and full pipe separately, each with its own pixelpipe piece.
-
-  // get our data struct:
-  const dt_iop_colorcontrast_params_t *const d = (dt_iop_colorcontrast_params_t *)piece->data;
-
-  // how many colors in our buffer?
-  const int ch = piece->colors;
+  const int width = roi_out->width;
 
-  const float *const in = (const float *const)ivoid;
-  float *const out = (float *const)ovoid;
-
-  if(d->unbound)
-  {
 #ifdef _OPENMP
-#pragma omp parallel for SIMD() default(none) \
-    dt_omp_firstprivate(ch, d, in, out, roi_out) \
-    schedule(static)
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ivoid, ovoid, piece, roi_out, self, width) \
+  schedule(static)
 #endif
-    for(size_t k = 0; k < (size_t)ch * roi_out->width * roi_out->height; k += ch)
-    {
-      out[k] = in[k];
-      out[k + 1] = (in[k + 1] * d->a_steepness) + d->a_offset;
-      out[k + 2] = (in[k + 2] * d->b_steepness) + d->b_offset;
-      out[k + 4] = in[k + 4];
-    }
-  }
-  else
+  for(int j = 0; j < roi_out->height; j++)
   {
-#ifdef _OPENMP
-#pragma omp parallel for SIMD() default(none) \
-    dt_omp_firstprivate(ch, d, in, out, roi_out) \
-    schedule(static)
-#endif
-    for(size_t k = 0; k < (size_t)ch * roi_out->width * roi_out->height; k += ch)
-    {
-      out[k] = in[k];
-      out[k + 1] = CLAMP((in[k + 1] * d->a_steepness) + d->a_offset, -128.0f, 128.0f);
-      out[k + 2] = CLAMP((in[k + 2] * d->b_steepness) + d->b_offset, -128.0f, 128.0f);
-      out[k + 4] = in[k + 4];
-    }
+    const size_t offset = (size_t)4 * width * j;
+    process_pixels(self, piece, (const float *)ivoid + offset, (float *)ovoid + offset, width);
   }
 }
 
-#if defined(__SSE__)
-void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
-                  void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+void process_pixels(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
+                    float *const out, const size_t npixels)
 {
-  // this is called for preview and full pipe separately, each with its own pixelpipe piece.
-
-  // get our data struct:
-  dt_iop_colorcontrast_params_t *d = (dt_iop_colorcontrast_params_t *)piece->data;
-
-  // how many colors in our buffer?
-  const int ch = piece->colors;
-
-  const int unbound = d->unbound;
-
-  const __m128 scale = _mm_set_ps(1.0f, d->b_steepness, d->a_steepness, 1.0f);
-  const __m128 offset = _mm_set_ps(0.0f, d->b_offset, d->a_offset, 0.0f);
-  const __m128 min = _mm_set_ps(-INFINITY, -128.0f, -128.0f, -INFINITY);
-  const __m128 max = _mm_set_ps(INFINITY, 128.0f, 128.0f, INFINITY);
+  const dt_iop_colorcontrast_params_t *const d = (dt_iop_colorcontrast_params_t *)piece->data;
+  const float lo = d->unbound ? -INFINITY : -128.0f;
+  const float hi = d->unbound ? INFINITY : 128.0f;
 
-// iterate over all output pixels (same coordinates as input)
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ch, ivoid, max, min, offset, ovoid, roi_in, roi_out, \
-                      scale, unbound) \
-  shared(d) \
-  schedule(static)
-#endif
-  for(int j = 0; j < roi_out->height; j++)
+  for(size_t k = 0; k < (size_t)4 * npixels; k += 4)
   {
-
-    float *in = ((float *)ivoid) + (size_t)ch * roi_in->width * j;
-    float *out = ((float *)ovoid) + (size_t)ch * roi_out->width * j;
-
-    if(unbound)
-    {
-      for(int i = 0; i < roi_out->width; i++)
-      {
-        _mm_stream_ps(out, _mm_add_ps(offset, _mm_mul_ps(scale, _mm_load_ps(in))));
-        in += ch;
-        out += ch;
-      }
-    }
-    else
-    {
-      for(int i = 0; i < roi_out->width; i++)
-      {
-        _mm_stream_ps(
-            out, _mm_min_ps(max, _mm_max_ps(min, _mm_add_ps(offset, _mm_mul_ps(scale, _mm_load_ps(in))))));
-        in += ch;
-        out += ch;
-      }
-    }
+    out[k] = in[k];
+    out[k + 1] = CLAMP((in[k + 1] * d->a_steepness) + d->a_offset, lo, hi);
+    out[k + 2] = CLAMP((in[k + 2] * d->b_steepness) + d->b_offset, lo, hi);
+    out[k + 3] = in[k + 3];
   }
-  _mm_sfence();
 }
-#endif
-
 
 #ifdef HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
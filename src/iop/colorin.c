@@ -25,6 +25,7 @@
 #include "common/colorspaces_inline_conversions.h"
 #include "common/file_location.h"
 #include "common/image_cache.h"
+#include "common/lcms_lut.h"
 #include "common/opencl.h"
 #include "control/control.h"
 #include "develop/develop.h"
@@ -106,6 +107,7 @@ typedef struct dt_iop_colorin_data_t
   cmsHTRANSFORM *xform_cam_Lab;
   cmsHTRANSFORM *xform_cam_nrgb;
   cmsHTRANSFORM *xform_nrgb_Lab;
+  dt_lcms_lut_t *lcms_lut; // baked version of the lcms2 transforms above, if any
   float lut[3][LUT_SAMPLES];
   float cmatrix[9];
   float nmatrix[9];
@@ -131,7 +133,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_SCALE_INVARIANT | IOP_FLAGS_POINTWISE;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -1018,12 +1020,71 @@ static void process_lcms2_proper(struct dt_iop_module_t *self, dt_dev_pixelpipe_
   }
 }
 
+// the complete lcms2 chain of the functions above, for baking the 3d lut and for
+// the pixels which fall outside of it
+static void _lcms2_exact(const void *data, const float *in, float *out, const size_t n)
+{
+  const dt_iop_colorin_data_t *const d = (const dt_iop_colorin_data_t *)data;
+  if(!d->nrgb)
+  {
+    cmsDoTransform(d->xform_cam_Lab, in, out, n);
+  }
+  else
+  {
+    cmsDoTransform(d->xform_cam_nrgb, in, out, n);
+
+    for(size_t j = 0; j < 4 * n; j += 4)
+    {
+      for(int c = 0; c < 3; c++)
+      {
+        out[j + c] = CLAMP(out[j + c], 0.0f, 1.0f);
+      }
+    }
+
+    cmsDoTransform(d->xform_nrgb_Lab, out, out, n);
+  }
+}
+
+static void process_lcms2_lut(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                              const void *const ivoid, void *const ovoid, const dt_iop_roi_t *const roi_in,
+                              const dt_iop_roi_t *const roi_out, const int blue_mapping)
+{
+  const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
+  const int ch = piece->colors;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ch, d, ivoid, ovoid, roi_out, blue_mapping) \
+  schedule(static)
+#endif
+  for(int k = 0; k < roi_out->height; k++)
+  {
+    const float *in = (const float *)ivoid + (size_t)ch * k * roi_out->width;
+    float *out = (float *)ovoid + (size_t)ch * k * roi_out->width;
+
+    if(blue_mapping)
+    {
+      float *camptr = out;
+      for(int j = 0; j < roi_out->width; j++, camptr += 4) apply_blue_mapping(in + 4 * j, camptr);
+      in = out;
+    }
+
+    dt_lcms_lut_apply(d->lcms_lut, in, out, roi_out->width, _lcms2_exact, d);
+  }
+}
+
 static void process_lcms2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
                           void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
   const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
   const int blue_mapping = d->blue_mapping && dt_image_is_matrix_correction_supported(&piece->pipe->image);
 
+  if(d->lcms_lut)
+  {
+    process_lcms2_lut(self, piece, ivoid, ovoid, roi_in, roi_out, blue_mapping);
+    return;
+  }
+
   // use general lcms2 fallback
   if(blue_mapping)
   {
@@ -1422,6 +1483,12 @@ static void process_sse2_lcms2(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
   const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
   const int blue_mapping = d->blue_mapping && dt_image_is_matrix_correction_supported(&piece->pipe->image);
 
+  if(d->lcms_lut)
+  {
+    process_lcms2_lut(self, piece, ivoid, ovoid, roi_in, roi_out, blue_mapping);
+    return;
+  }
+
   // use general lcms2 fallback
   if(blue_mapping)
   {
@@ -1523,6 +1590,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     cmsDeleteTransform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
+  dt_lcms_lut_release(d->lcms_lut);
+  d->lcms_lut = NULL;
 
   d->cmatrix[0] = d->nmatrix[0] = d->lmatrix[0] = NAN;
   d->lut[0][0] = -1.0f;
@@ -1731,6 +1800,17 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     }
   }
 
+  // lut based camera profiles are slow to evaluate through lcms2, bake the transform chain.
+  // only for rgb input, the lut domain doesn't cover xyz.
+  if(isnan(d->cmatrix[0]) && d->xform_cam_Lab && input_format == TYPE_RGBA_FLT
+     && (!d->nrgb || (d->xform_cam_nrgb && d->xform_nrgb_Lab)))
+  {
+    const cmsHPROFILE profiles[3] = { d->input, d->nrgb ? d->nrgb : Lab, Lab };
+    gchar *key = dt_lcms_lut_key(profiles, d->nrgb ? 3 : 2, p->intent, d->nrgb ? "colorin clip" : "colorin");
+    d->lcms_lut = dt_lcms_lut_get(key, DT_LCMS_LUT_RGB, _lcms2_exact, d);
+    g_free(key);
+  }
+
   d->nonlinearlut = 0;
 
   // now try to initialize unbounded mode:
@@ -1763,6 +1843,7 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
   d->xform_cam_Lab = NULL;
   d->xform_cam_nrgb = NULL;
   d->xform_nrgb_Lab = NULL;
+  d->lcms_lut = NULL;
   self->commit_params(self, self->default_params, pipe, piece);
 }
 
@@ -1785,6 +1866,8 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     cmsDeleteTransform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
+  dt_lcms_lut_release(d->lcms_lut);
+  d->lcms_lut = NULL;
 
   free(piece->data);
   piece->data = NULL;
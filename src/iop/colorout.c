@@ -22,6 +22,7 @@
 #include "common/colorspaces.h"
 #include "common/colorspaces_inline_conversions.h"
 #include "common/file_location.h"
+#include "common/lcms_lut.h"
 #include "common/opencl.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -54,6 +55,7 @@ typedef struct dt_iop_colorout_data_t
   float lut[3][LUT_SAMPLES];
   float cmatrix[9];
   cmsHTRANSFORM *xform;
+  dt_lcms_lut_t *lcms_lut; // baked xform, not used for softproofing
   float unbounded_coeffs[3][3]; // for extrapolation of shaper curves
 } dt_iop_colorout_data_t;
 
@@ -87,7 +89,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_SCALE_INVARIANT | IOP_FLAGS_POINTWISE;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -396,6 +398,12 @@ static void process_fastpath_apply_tonecurves(struct dt_iop_module_t *self, dt_d
   }
 }
 
+static void _xform_exact(const void *data, const float *in, float *out, const size_t n)
+{
+  const dt_iop_colorout_data_t *const d = (const dt_iop_colorout_data_t *)data;
+  cmsDoTransform(d->xform, in, out, n);
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -449,7 +457,10 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       const float *in = ((float *)ivoid) + (size_t)ch * k * roi_out->width;
       float *out = ((float *)ovoid) + (size_t)ch * k * roi_out->width;
 
-      cmsDoTransform(d->xform, in, out, roi_out->width);
+      if(d->lcms_lut)
+        dt_lcms_lut_apply(d->lcms_lut, in, out, roi_out->width, _xform_exact, d);
+      else
+        cmsDoTransform(d->xform, in, out, roi_out->width);
 
       if(gamutcheck)
       {
@@ -531,7 +542,10 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
       const float *in = ((float *)ivoid) + (size_t)ch * k * roi_out->width;
       float *out = ((float *)ovoid) + (size_t)ch * k * roi_out->width;
 
-      cmsDoTransform(d->xform, in, out, roi_out->width);
+      if(d->lcms_lut)
+        dt_lcms_lut_apply(d->lcms_lut, in, out, roi_out->width, _xform_exact, d);
+      else
+        cmsDoTransform(d->xform, in, out, roi_out->width);
 
       if(gamutcheck)
       {
@@ -605,6 +619,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     cmsDeleteTransform(d->xform);
     d->xform = NULL;
   }
+  dt_lcms_lut_release(d->lcms_lut);
+  d->lcms_lut = NULL;
   d->cmatrix[0] = NAN;
   d->lut[0][0] = -1.0f;
   d->lut[1][0] = -1.0f;
@@ -752,6 +768,18 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     }
   }
 
+  // lut based output profiles are slow to evaluate through lcms2, bake the transform. not when the user asked
+  // for exact lcms2 output
+  if(d->xform && !softproof && !force_lcms2)
+  {
+    const cmsHPROFILE profiles[2] = { Lab, output };
+    gchar *tag = g_strdup_printf("colorout %u", (unsigned int)output_format);
+    gchar *key = dt_lcms_lut_key(profiles, 2, out_intent, tag);
+    d->lcms_lut = dt_lcms_lut_get(key, DT_LCMS_LUT_LAB, _xform_exact, d);
+    g_free(key);
+    g_free(tag);
+  }
+
   if(out_type == DT_COLORSPACE_DISPLAY || out_type == DT_COLORSPACE_DISPLAY2)
     pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
 
@@ -783,6 +811,7 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
   piece->data = calloc(1, sizeof(dt_iop_colorout_data_t));
   dt_iop_colorout_data_t *d = (dt_iop_colorout_data_t *)piece->data;
   d->xform = NULL;
+  d->lcms_lut = NULL;
   self->commit_params(self, self->default_params, pipe, piece);
 }
 
@@ -794,6 +823,8 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     cmsDeleteTransform(d->xform);
     d->xform = NULL;
   }
+  dt_lcms_lut_release(d->lcms_lut);
+  d->lcms_lut = NULL;
 
   free(piece->data);
   piece->data = NULL;
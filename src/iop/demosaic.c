@@ -26,6 +26,7 @@
 #include "develop/develop.h"
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
+#include "develop/pixelpipe_pool.h"
 #include "develop/tiling.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
@@ -382,39 +383,58 @@ static void pre_median(float *out, const float *const in, const dt_iop_roi_t *co
   pre_median_b(out, in, roi, filters, num_passes, threshold);
 }
 
+// branch-free compare and exchange, so the median network below vectorizes
 #define SWAPmed(I, J)                                                                                        \
-  if(med[I] > med[J]) SWAP(med[I], med[J])
+  {                                                                                                          \
+    const float lo = fminf(med[I], med[J]);                                                                  \
+    med[J] = fmaxf(med[I], med[J]);                                                                          \
+    med[I] = lo;                                                                                             \
+  }
 
 static void color_smoothing(float *out, const dt_iop_roi_t *const roi_out, const int num_passes)
 {
-  const int width4 = 4 * roi_out->width;
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+  const size_t npixels = (size_t)width * height;
+
+  // red-green and blue-green planes of the previous pass. the two colours don't depend on each other,
+  // so both are smoothed in the same sweep.
+  float *const diff = (float *)dt_dev_pixelpipe_scratch_alloc(2 * npixels * sizeof(float));
+  if(!diff) return;
 
   for(int pass = 0; pass < num_passes; pass++)
   {
-    for(int c = 0; c < 3; c += 2)
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+    dt_omp_firstprivate(diff, npixels, out) \
+    schedule(static)
+#endif
+    for(size_t k = 0; k < npixels; k++)
     {
-      {
-        float *outp = out;
-        for(int j = 0; j < roi_out->height; j++)
-          for(int i = 0; i < roi_out->width; i++, outp += 4) outp[3] = outp[c];
-      }
+      diff[k] = out[4 * k + 0] - out[4 * k + 1];
+      diff[npixels + k] = out[4 * k + 2] - out[4 * k + 1];
+    }
+
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(roi_out, width4) \
-      shared(out, c) \
-      schedule(static)
+    dt_omp_firstprivate(diff, height, npixels, out, width) \
+    schedule(static)
 #endif
-      for(int j = 1; j < roi_out->height - 1; j++)
+    for(int j = 1; j < height - 1; j++)
+    {
+      for(int c = 0; c < 2; c++)
       {
-        float *outp = out + (size_t)4 * j * roi_out->width + 4;
-        for(int i = 1; i < roi_out->width - 1; i++, outp += 4)
+        const float *const d = diff + c * npixels + (size_t)j * width;
+        float *const outp = out + (size_t)4 * j * width;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int i = 1; i < width - 1; i++)
         {
           float med[9] = {
-            outp[-width4 - 4 + 3] - outp[-width4 - 4 + 1], outp[-width4 + 0 + 3] - outp[-width4 + 0 + 1],
-            outp[-width4 + 4 + 3] - outp[-width4 + 4 + 1], outp[-4 + 3] - outp[-4 + 1],
-            outp[+0 + 3] - outp[+0 + 1], outp[+4 + 3] - outp[+4 + 1],
-            outp[+width4 - 4 + 3] - outp[+width4 - 4 + 1], outp[+width4 + 0 + 3] - outp[+width4 + 0 + 1],
-            outp[+width4 + 4 + 3] - outp[+width4 + 4 + 1],
+            d[i - width - 1], d[i - width], d[i - width + 1],
+            d[i - 1],         d[i],         d[i + 1],
+            d[i + width - 1], d[i + width], d[i + width + 1],
           };
           /* optimal 9-element median search */
           SWAPmed(1, 2);
@@ -436,11 +456,12 @@ static void color_smoothing(float *out, const dt_iop_roi_t *const roi_out, const
           SWAPmed(4, 2);
           SWAPmed(6, 4);
           SWAPmed(4, 2);
-          outp[c] = fmaxf(med[4] + outp[1], 0.0f);
+          outp[4 * i + 2 * c] = fmaxf(med[4] + outp[4 * i + 1], 0.0f);
         }
       }
     }
   }
+  dt_dev_pixelpipe_scratch_free(diff);
 }
 #undef SWAP
 
@@ -588,7 +609,7 @@ static void xtrans_markesteijn_interpolate(float *out, const float *const in,
   const int ndir = 4 << (passes > 1);
 
   const size_t buffer_size = (size_t)TS * TS * (ndir * 4 + 3) * sizeof(float);
-  char *const all_buffers = (char *)dt_alloc_align(64, dt_get_num_threads() * buffer_size);
+  char *const all_buffers = (char *)dt_dev_pixelpipe_scratch_alloc(dt_get_num_threads() * buffer_size);
   if(!all_buffers)
   {
     printf("[demosaic] not able to allocate Markesteijn buffers\n");
@@ -624,16 +645,25 @@ static void xtrans_markesteijn_interpolate(float *out, const float *const in,
 
   // extra passes propagates out errors at edges, hence need more padding
   const int pad_tile = (passes == 1) ? 12 : 17;
+
+  // step through TSxTS cells of image, each tile overlapping the
+  // prior as interpolation needs a substantial border. all tiles go
+  // into a single parallel loop, rows of tiles alone are too few to
+  // keep many cores busy.
+  const int tile_step = TS - (pad_tile * 2);
+  const int tiles_x = (width + tile_step - 1) / tile_step;
+  const int tiles_y = (height + tile_step - 1) / tile_step;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(all_buffers, buffer_size, dir, height, in, ndir, pad_tile, passes, roi_in, width, xtrans) \
+  dt_omp_firstprivate(all_buffers, buffer_size, dir, height, in, ndir, pad_tile, passes, roi_in, tile_step, \
+                      tiles_x, tiles_y, width, xtrans) \
   shared(sgrow, sgcol, allhex, out) \
   schedule(dynamic)
 #endif
-  // step through TSxTS cells of image, each tile overlapping the
-  // prior as interpolation needs a substantial border
-  for(int top = -pad_tile; top < height - pad_tile; top += TS - (pad_tile*2))
+  for(int tile = 0; tile < tiles_x * tiles_y; tile++)
   {
+    const int top = (tile / tiles_x) * tile_step - pad_tile;
+    const int left = (tile % tiles_x) * tile_step - pad_tile;
     char *const buffer = all_buffers + dt_get_thread_num() * buffer_size;
     // rgb points to ndir TSxTS tiles of 3 channels (R, G, and B)
     float(*rgb)[TS][TS][3] = (float(*)[TS][TS][3])buffer;
@@ -653,385 +683,382 @@ static void xtrans_markesteijn_interpolate(float *out, const float *const in,
     uint8_t (*const homosum)[TS][TS] = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float)
                                                             + TS * TS * ndir * sizeof(uint8_t));
 
-    for(int left = -pad_tile; left < width - pad_tile; left += TS - (pad_tile*2))
-    {
-      int mrow = MIN(top + TS, height + pad_tile);
-      int mcol = MIN(left + TS, width + pad_tile);
+    int mrow = MIN(top + TS, height + pad_tile);
+    int mcol = MIN(left + TS, width + pad_tile);
 
-      // Copy current tile from in to image buffer. If border goes
-      // beyond edges of image, fill with mirrored/interpolated edges.
-      // The extra border avoids discontinuities at image edges.
-      for(int row = top; row < mrow; row++)
-        for(int col = left; col < mcol; col++)
+    // Copy current tile from in to image buffer. If border goes
+    // beyond edges of image, fill with mirrored/interpolated edges.
+    // The extra border avoids discontinuities at image edges.
+    for(int row = top; row < mrow; row++)
+      for(int col = left; col < mcol; col++)
+      {
+        float(*const pix) = rgb[0][row - top][col - left];
+        if((col >= 0) && (row >= 0) && (col < width) && (row < height))
         {
-          float(*const pix) = rgb[0][row - top][col - left];
-          if((col >= 0) && (row >= 0) && (col < width) && (row < height))
-          {
-            const int f = FCxtrans(row, col, roi_in, xtrans);
-            for(int c = 0; c < 3; c++) pix[c] = (c == f) ? in[roi_in->width * row + col] : 0.f;
-          }
-          else
-          {
-            // mirror a border pixel if beyond image edge
-            const int c = FCxtrans(row, col, roi_in, xtrans);
-            for(int cc = 0; cc < 3; cc++)
-              if(cc != c)
-                pix[cc] = 0.0f;
+          const int f = FCxtrans(row, col, roi_in, xtrans);
+          for(int c = 0; c < 3; c++) pix[c] = (c == f) ? in[roi_in->width * row + col] : 0.f;
+        }
+        else
+        {
+          // mirror a border pixel if beyond image edge
+          const int c = FCxtrans(row, col, roi_in, xtrans);
+          for(int cc = 0; cc < 3; cc++)
+            if(cc != c)
+              pix[cc] = 0.0f;
+            else
+            {
+#define TRANSLATE(n, size) ((n >= size) ? (2 * size - n - 2) : abs(n))
+              const int cy = TRANSLATE(row, height), cx = TRANSLATE(col, width);
+              if(c == FCxtrans(cy, cx, roi_in, xtrans))
+                pix[c] = in[roi_in->width * cy + cx];
               else
               {
-#define TRANSLATE(n, size) ((n >= size) ? (2 * size - n - 2) : abs(n))
-                const int cy = TRANSLATE(row, height), cx = TRANSLATE(col, width);
-                if(c == FCxtrans(cy, cx, roi_in, xtrans))
-                  pix[c] = in[roi_in->width * cy + cx];
-                else
-                {
-                  // interpolate if mirror pixel is a different color
-                  float sum = 0.0f;
-                  uint8_t count = 0;
-                  for(int y = row - 1; y <= row + 1; y++)
-                    for(int x = col - 1; x <= col + 1; x++)
+                // interpolate if mirror pixel is a different color
+                float sum = 0.0f;
+                uint8_t count = 0;
+                for(int y = row - 1; y <= row + 1; y++)
+                  for(int x = col - 1; x <= col + 1; x++)
+                  {
+                    const int yy = TRANSLATE(y, height), xx = TRANSLATE(x, width);
+                    const int ff = FCxtrans(yy, xx, roi_in, xtrans);
+                    if(ff == c)
                     {
-                      const int yy = TRANSLATE(y, height), xx = TRANSLATE(x, width);
-                      const int ff = FCxtrans(yy, xx, roi_in, xtrans);
-                      if(ff == c)
-                      {
-                        sum += in[roi_in->width * yy + xx];
-                        count++;
-                      }
+                      sum += in[roi_in->width * yy + xx];
+                      count++;
                     }
-                  pix[c] = sum / count;
-                }
+                  }
+                pix[c] = sum / count;
               }
-          }
+            }
         }
+      }
 
-      // duplicate rgb[0] to rgb[1], rgb[2], and rgb[3]
-      for(int c = 1; c <= 3; c++) memcpy(rgb[c], rgb[0], sizeof(*rgb));
+    // duplicate rgb[0] to rgb[1], rgb[2], and rgb[3]
+    for(int c = 1; c <= 3; c++) memcpy(rgb[c], rgb[0], sizeof(*rgb));
 
-      // note that successive calculations are inset within the tile
-      // so as to give enough border data, and there needs to be a 6
-      // pixel border initially to allow allhex to find neighboring
-      // pixels
+    // note that successive calculations are inset within the tile
+    // so as to give enough border data, and there needs to be a 6
+    // pixel border initially to allow allhex to find neighboring
+    // pixels
 
-      /* Set green1 and green3 to the minimum and maximum allowed values:   */
-      // Run through each red/blue or blue/red pair, setting their g1
-      // and g3 values to the min/max of green pixels surrounding the
-      // pair. Use a 3 pixel border as gmin/gmax is used by
-      // interpolate green which has a 3 pixel border.
-      const int pad_g1_g3 = 3;
-      for(int row = top + pad_g1_g3; row < mrow - pad_g1_g3; row++)
+    /* Set green1 and green3 to the minimum and maximum allowed values:   */
+    // Run through each red/blue or blue/red pair, setting their g1
+    // and g3 values to the min/max of green pixels surrounding the
+    // pair. Use a 3 pixel border as gmin/gmax is used by
+    // interpolate green which has a 3 pixel border.
+    const int pad_g1_g3 = 3;
+    for(int row = top + pad_g1_g3; row < mrow - pad_g1_g3; row++)
+    {
+      // setting max to 0.0f signifies that this is a new pair, which
+      // requires a new min/max calculation of its neighboring greens
+      float min = FLT_MAX, max = 0.0f;
+      for(int col = left + pad_g1_g3; col < mcol - pad_g1_g3; col++)
       {
-        // setting max to 0.0f signifies that this is a new pair, which
-        // requires a new min/max calculation of its neighboring greens
-        float min = FLT_MAX, max = 0.0f;
-        for(int col = left + pad_g1_g3; col < mcol - pad_g1_g3; col++)
+        // if in row of horizontal red & blue pairs (or processing
+        // vertical red & blue pairs near image bottom), reset min/max
+        // between each pair
+        if(FCxtrans(row, col, roi_in, xtrans) == 1)
         {
-          // if in row of horizontal red & blue pairs (or processing
-          // vertical red & blue pairs near image bottom), reset min/max
-          // between each pair
-          if(FCxtrans(row, col, roi_in, xtrans) == 1)
-          {
-            min = FLT_MAX, max = 0.0f;
-            continue;
-          }
-          // if at start of red & blue pair, calculate min/max of green
-          // pixels surrounding it; note that while normally using == to
-          // compare floats is suspect, here the check is if 0.0f has
-          // explicitly been assigned to max (which signifies a new
-          // red/blue pair)
-          if(max == 0.0f)
-          {
-            float (*const pix)[3] = &rgb[0][row - top][col - left];
-            const short *const hex = hexmap(row,col,allhex);
-            for(int c = 0; c < 6; c++)
-            {
-              const float val = pix[hex[c]][1];
-              if(min > val) min = val;
-              if(max < val) max = val;
-            }
-          }
-          gmin[row - top][col - left] = min;
-          gmax[row - top][col - left] = max;
-          // handle vertical red/blue pairs
-          switch((row - sgrow) % 3)
-          {
-            // hop down a row to second pixel in vertical pair
-            case 1:
-              if(row < mrow - 4) row++, col--;
-              break;
-            // then if not done with the row hop up and right to next
-            // vertical red/blue pair, resetting min/max
-            case 2:
-              min = FLT_MAX, max = 0.0f;
-              if((col += 2) < mcol - 4 && row > top + 3) row--;
-          }
+          min = FLT_MAX, max = 0.0f;
+          continue;
         }
-      }
-
-      /* Interpolate green horizontally, vertically, and along both diagonals: */
-      // need a 3 pixel border here as 3*hex[] can have a 3 unit offset
-      const int pad_g_interp = 3;
-      for(int row = top + pad_g_interp; row < mrow - pad_g_interp; row++)
-        for(int col = left + pad_g_interp; col < mcol - pad_g_interp; col++)
+        // if at start of red & blue pair, calculate min/max of green
+        // pixels surrounding it; note that while normally using == to
+        // compare floats is suspect, here the check is if 0.0f has
+        // explicitly been assigned to max (which signifies a new
+        // red/blue pair)
+        if(max == 0.0f)
         {
-          float color[8];
-          int f = FCxtrans(row, col, roi_in, xtrans);
-          if(f == 1) continue;
           float (*const pix)[3] = &rgb[0][row - top][col - left];
           const short *const hex = hexmap(row,col,allhex);
-          // TODO: these constants come from integer math constants in
-          // dcraw -- calculate them instead from interpolation math
-          color[0] = 0.6796875f * (pix[hex[1]][1] + pix[hex[0]][1])
-                     - 0.1796875f * (pix[2 * hex[1]][1] + pix[2 * hex[0]][1]);
-          color[1] = 0.87109375f * pix[hex[3]][1] + pix[hex[2]][1] * 0.13f
-                     + 0.359375f * (pix[0][f] - pix[-hex[2]][f]);
-          for(int c = 0; c < 2; c++)
-            color[2 + c] = 0.640625f * pix[hex[4 + c]][1] + 0.359375f * pix[-2 * hex[4 + c]][1]
-                           + 0.12890625f * (2 * pix[0][f] - pix[3 * hex[4 + c]][f] - pix[-3 * hex[4 + c]][f]);
-          for(int c = 0; c < 4; c++)
-            rgb[c ^ !((row - sgrow) % 3)][row - top][col - left][1]
-                = CLAMPS(color[c], gmin[row - top][col - left], gmax[row - top][col - left]);
+          for(int c = 0; c < 6; c++)
+          {
+            const float val = pix[hex[c]][1];
+            if(min > val) min = val;
+            if(max < val) max = val;
+          }
         }
-
-      for(int pass = 0; pass < passes; pass++)
-      {
-        if(pass == 1)
+        gmin[row - top][col - left] = min;
+        gmax[row - top][col - left] = max;
+        // handle vertical red/blue pairs
+        switch((row - sgrow) % 3)
         {
-          // if on second pass, copy rgb[0] to [3] into rgb[4] to [7],
-          // and process that second set of buffers
-          memcpy(rgb + 4, rgb, (size_t)4 * sizeof(*rgb));
-          rgb += 4;
+          // hop down a row to second pixel in vertical pair
+          case 1:
+            if(row < mrow - 4) row++, col--;
+            break;
+          // then if not done with the row hop up and right to next
+          // vertical red/blue pair, resetting min/max
+          case 2:
+            min = FLT_MAX, max = 0.0f;
+            if((col += 2) < mcol - 4 && row > top + 3) row--;
         }
+      }
+    }
 
-        /* Recalculate green from interpolated values of closer pixels: */
-        if(pass)
-        {
-          const int pad_g_recalc = 6;
-          for(int row = top + pad_g_recalc; row < mrow - pad_g_recalc; row++)
-            for(int col = left + pad_g_recalc; col < mcol - pad_g_recalc; col++)
-            {
-              int f = FCxtrans(row, col, roi_in, xtrans);
-              if(f == 1) continue;
-              const short *const hex = hexmap(row,col,allhex);
-              for(int d = 3; d < 6; d++)
-              {
-                float(*rfx)[3] = &rgb[(d - 2) ^ !((row - sgrow) % 3)][row - top][col - left];
-                float val = rfx[-2 * hex[d]][1] + 2 * rfx[hex[d]][1] - rfx[-2 * hex[d]][f]
-                            - 2 * rfx[hex[d]][f] + 3 * rfx[0][f];
-                rfx[0][1] = CLAMPS(val / 3.0f, gmin[row - top][col - left], gmax[row - top][col - left]);
-              }
-            }
-        }
+    /* Interpolate green horizontally, vertically, and along both diagonals: */
+    // need a 3 pixel border here as 3*hex[] can have a 3 unit offset
+    const int pad_g_interp = 3;
+    for(int row = top + pad_g_interp; row < mrow - pad_g_interp; row++)
+      for(int col = left + pad_g_interp; col < mcol - pad_g_interp; col++)
+      {
+        float color[8];
+        int f = FCxtrans(row, col, roi_in, xtrans);
+        if(f == 1) continue;
+        float (*const pix)[3] = &rgb[0][row - top][col - left];
+        const short *const hex = hexmap(row,col,allhex);
+        // TODO: these constants come from integer math constants in
+        // dcraw -- calculate them instead from interpolation math
+        color[0] = 0.6796875f * (pix[hex[1]][1] + pix[hex[0]][1])
+                   - 0.1796875f * (pix[2 * hex[1]][1] + pix[2 * hex[0]][1]);
+        color[1] = 0.87109375f * pix[hex[3]][1] + pix[hex[2]][1] * 0.13f
+                   + 0.359375f * (pix[0][f] - pix[-hex[2]][f]);
+        for(int c = 0; c < 2; c++)
+          color[2 + c] = 0.640625f * pix[hex[4 + c]][1] + 0.359375f * pix[-2 * hex[4 + c]][1]
+                         + 0.12890625f * (2 * pix[0][f] - pix[3 * hex[4 + c]][f] - pix[-3 * hex[4 + c]][f]);
+        for(int c = 0; c < 4; c++)
+          rgb[c ^ !((row - sgrow) % 3)][row - top][col - left][1]
+              = CLAMPS(color[c], gmin[row - top][col - left], gmax[row - top][col - left]);
+      }
 
-        /* Interpolate red and blue values for solitary green pixels:   */
-        const int pad_rb_g = (passes == 1) ? 6 : 5;
-        for(int row = (top - sgrow + pad_rb_g + 2) / 3 * 3 + sgrow; row < mrow - pad_rb_g; row += 3)
-          for(int col = (left - sgcol + pad_rb_g + 2) / 3 * 3 + sgcol; col < mcol - pad_rb_g; col += 3)
+    for(int pass = 0; pass < passes; pass++)
+    {
+      if(pass == 1)
+      {
+        // if on second pass, copy rgb[0] to [3] into rgb[4] to [7],
+        // and process that second set of buffers
+        memcpy(rgb + 4, rgb, (size_t)4 * sizeof(*rgb));
+        rgb += 4;
+      }
+
+      /* Recalculate green from interpolated values of closer pixels: */
+      if(pass)
+      {
+        const int pad_g_recalc = 6;
+        for(int row = top + pad_g_recalc; row < mrow - pad_g_recalc; row++)
+          for(int col = left + pad_g_recalc; col < mcol - pad_g_recalc; col++)
           {
-            float(*rfx)[3] = &rgb[0][row - top][col - left];
-            int h = FCxtrans(row, col + 1, roi_in, xtrans);
-            float diff[6] = { 0.0f };
-            // interplated color: first index is red/blue, second is
-            // pass, is double actual result
-            float color[2][6];
-            // Six passes, alternating hori/vert interp (i),
-            // starting with R or B (h) depending on which is closest.
-            // Passes 0,1 to rgb[0], rgb[1] of hori/vert interp. Pass
-            // 3,5 to rgb[2], rgb[3] of best of interp hori/vert
-            // results. Each pass which outputs moves on to the next
-            // rgb[] for input of interp greens.
-            for(int i = 1, d = 0; d < 6; d++, i ^= TS ^ 1, h ^= 2)
+            int f = FCxtrans(row, col, roi_in, xtrans);
+            if(f == 1) continue;
+            const short *const hex = hexmap(row,col,allhex);
+            for(int d = 3; d < 6; d++)
             {
-              // look 1 and 2 pixels distance from solitary green to
-              // red then blue or blue then red
-              for(int c = 0; c < 2; c++, h ^= 2)
-              {
-                // rate of change in greens between current pixel and
-                // interpolated pixels 1 or 2 distant: a quick
-                // derivative which will be divided by two later to be
-                // rate of luminance change for red/blue between known
-                // red/blue neighbors and the current unknown pixel
-                float g = 2 * rfx[0][1] - rfx[i << c][1] - rfx[-(i << c)][1];
-                // color is halved before being stored in rgb, hence
-                // this becomes green rate of change plus the average
-                // of the near red or blue pixels on current axis
-                color[h != 0][d] = g + rfx[i << c][h] + rfx[-(i << c)][h];
-                // Note that diff will become the slope for both red
-                // and blue differentials in the current direction.
-                // For 2nd and 3rd hori+vert passes, create a sum of
-                // steepness for both cardinal directions.
-                if(d > 1)
-                  diff[d] += SQR(rfx[i << c][1] - rfx[-(i << c)][1] - rfx[i << c][h] + rfx[-(i << c)][h])
-                             + SQR(g);
-              }
-              if((d < 2) || (d & 1))
-              { // output for passes 0, 1, 3, 5
-                // for 0, 1 just use hori/vert, for 3, 5 use best of x/y dir
-                const int d_out = d - ((d > 1) && (diff[d-1] < diff[d]));
-                rfx[0][0] = color[0][d_out] / 2.f;
-                rfx[0][2] = color[1][d_out] / 2.f;
-                rfx += TS * TS;
-              }
+              float(*rfx)[3] = &rgb[(d - 2) ^ !((row - sgrow) % 3)][row - top][col - left];
+              float val = rfx[-2 * hex[d]][1] + 2 * rfx[hex[d]][1] - rfx[-2 * hex[d]][f]
+                          - 2 * rfx[hex[d]][f] + 3 * rfx[0][f];
+              rfx[0][1] = CLAMPS(val / 3.0f, gmin[row - top][col - left], gmax[row - top][col - left]);
             }
           }
+      }
 
-        /* Interpolate red for blue pixels and vice versa:              */
-        const int pad_rb_br = (passes == 1) ? 6 : 5;
-        for(int row = top + pad_rb_br; row < mrow - pad_rb_br; row++)
-          for(int col = left + pad_rb_br; col < mcol - pad_rb_br; col++)
+      /* Interpolate red and blue values for solitary green pixels:   */
+      const int pad_rb_g = (passes == 1) ? 6 : 5;
+      for(int row = (top - sgrow + pad_rb_g + 2) / 3 * 3 + sgrow; row < mrow - pad_rb_g; row += 3)
+        for(int col = (left - sgcol + pad_rb_g + 2) / 3 * 3 + sgcol; col < mcol - pad_rb_g; col += 3)
+        {
+          float(*rfx)[3] = &rgb[0][row - top][col - left];
+          int h = FCxtrans(row, col + 1, roi_in, xtrans);
+          float diff[6] = { 0.0f };
+          // interplated color: first index is red/blue, second is
+          // pass, is double actual result
+          float color[2][6];
+          // Six passes, alternating hori/vert interp (i),
+          // starting with R or B (h) depending on which is closest.
+          // Passes 0,1 to rgb[0], rgb[1] of hori/vert interp. Pass
+          // 3,5 to rgb[2], rgb[3] of best of interp hori/vert
+          // results. Each pass which outputs moves on to the next
+          // rgb[] for input of interp greens.
+          for(int i = 1, d = 0; d < 6; d++, i ^= TS ^ 1, h ^= 2)
           {
-            int f = 2 - FCxtrans(row, col, roi_in, xtrans);
-            if(f == 1) continue;
-            float(*rfx)[3] = &rgb[0][row - top][col - left];
-            int c = (row - sgrow) % 3 ? TS : 1;
-            int h = 3 * (c ^ TS ^ 1);
-            for(int d = 0; d < 4; d++, rfx += TS * TS)
+            // look 1 and 2 pixels distance from solitary green to
+            // red then blue or blue then red
+            for(int c = 0; c < 2; c++, h ^= 2)
             {
-              int i = d > 1 || ((d ^ c) & 1) ||
-                ((fabsf(rfx[0][1]-rfx[c][1]) + fabsf(rfx[0][1]-rfx[-c][1])) <
-                 2.f*(fabsf(rfx[0][1]-rfx[h][1]) + fabsf(rfx[0][1]-rfx[-h][1]))) ? c:h;
-              rfx[0][f] = (rfx[i][f] + rfx[-i][f] + 2.f * rfx[0][1] - rfx[i][1] - rfx[-i][1]) / 2.f;
+              // rate of change in greens between current pixel and
+              // interpolated pixels 1 or 2 distant: a quick
+              // derivative which will be divided by two later to be
+              // rate of luminance change for red/blue between known
+              // red/blue neighbors and the current unknown pixel
+              float g = 2 * rfx[0][1] - rfx[i << c][1] - rfx[-(i << c)][1];
+              // color is halved before being stored in rgb, hence
+              // this becomes green rate of change plus the average
+              // of the near red or blue pixels on current axis
+              color[h != 0][d] = g + rfx[i << c][h] + rfx[-(i << c)][h];
+              // Note that diff will become the slope for both red
+              // and blue differentials in the current direction.
+              // For 2nd and 3rd hori+vert passes, create a sum of
+              // steepness for both cardinal directions.
+              if(d > 1)
+                diff[d] += SQR(rfx[i << c][1] - rfx[-(i << c)][1] - rfx[i << c][h] + rfx[-(i << c)][h])
+                           + SQR(g);
+            }
+            if((d < 2) || (d & 1))
+            { // output for passes 0, 1, 3, 5
+              // for 0, 1 just use hori/vert, for 3, 5 use best of x/y dir
+              const int d_out = d - ((d > 1) && (diff[d-1] < diff[d]));
+              rfx[0][0] = color[0][d_out] / 2.f;
+              rfx[0][2] = color[1][d_out] / 2.f;
+              rfx += TS * TS;
             }
           }
+        }
 
-        /* Fill in red and blue for 2x2 blocks of green:                */
-        const int pad_g22 = (passes == 1) ? 8 : 4;
-        for(int row = top + pad_g22; row < mrow - pad_g22; row++)
-          if((row - sgrow) % 3)
-            for(int col = left + pad_g22; col < mcol - pad_g22; col++)
-              if((col - sgcol) % 3)
-              {
-                float(*rfx)[3] = &rgb[0][row - top][col - left];
-                const short *const hex = hexmap(row,col,allhex);
-                for(int d = 0; d < ndir; d += 2, rfx += TS * TS)
-                  if(hex[d] + hex[d + 1])
-                  {
-                    float g = 3.f * rfx[0][1] - 2.f * rfx[hex[d]][1] - rfx[hex[d + 1]][1];
-                    for(int c = 0; c < 4; c += 2)
-                      rfx[0][c] = (g + 2.f * rfx[hex[d]][c] + rfx[hex[d + 1]][c]) / 3.f;
-                  }
-                  else
-                  {
-                    float g = 2.f * rfx[0][1] - rfx[hex[d]][1] - rfx[hex[d + 1]][1];
-                    for(int c = 0; c < 4; c += 2)
-                      rfx[0][c] = (g + rfx[hex[d]][c] + rfx[hex[d + 1]][c]) / 2.f;
-                  }
-              }
-      } // end of multipass loop
-
-      // jump back to the first set of rgb buffers (this is a nop
-      // unless on the second pass)
-      rgb = (float(*)[TS][TS][3])buffer;
-      // from here on out, mainly are working within the current tile
-      // rather than in reference to the image, so don't offset
-      // mrow/mcol by top/left of tile
-      mrow -= top;
-      mcol -= left;
-
-      /* Convert to perceptual colorspace and differentiate in all directions:  */
-      // Original dcraw algorithm uses CIELab as perceptual space
-      // (presumably coming from original AHD) and converts taking
-      // camera matrix into account. Now use YPbPr which requires much
-      // less code and is nearly indistinguishable. It assumes the
-      // camera RGB is roughly linear.
-      for(int d = 0; d < ndir; d++)
-      {
-        const int pad_yuv = (passes == 1) ? 8 : 13;
-        for(int row = pad_yuv; row < mrow - pad_yuv; row++)
-          for(int col = pad_yuv; col < mcol - pad_yuv; col++)
-          {
-            float *rx = rgb[d][row][col];
-            // use ITU-R BT.2020 YPbPr, which is great, but could use
-            // a better/simpler choice? note that imageop.h provides
-            // dt_iop_RGB_to_YCbCr which uses Rec. 601 conversion,
-            // which appears less good with specular highlights
-            float y = 0.2627f * rx[0] + 0.6780f * rx[1] + 0.0593f * rx[2];
-            yuv[0][row][col] = y;
-            yuv[1][row][col] = (rx[2] - y) * 0.56433f;
-            yuv[2][row][col] = (rx[0] - y) * 0.67815f;
-          }
-        // Note that f can offset by a column (-1 or +1) and by a row
-        // (-TS or TS). The row-wise offsets cause the undefined
-        // behavior sanitizer to warn of an out of bounds index, but
-        // as yfx is multi-dimensional and there is sufficient
-        // padding, that is not actually so.
-        const int f = dir[d & 3];
-        const int pad_drv = (passes == 1) ? 9 : 14;
-        for(int row = pad_drv; row < mrow - pad_drv; row++)
-          for(int col = pad_drv; col < mcol - pad_drv; col++)
+      /* Interpolate red for blue pixels and vice versa:              */
+      const int pad_rb_br = (passes == 1) ? 6 : 5;
+      for(int row = top + pad_rb_br; row < mrow - pad_rb_br; row++)
+        for(int col = left + pad_rb_br; col < mcol - pad_rb_br; col++)
+        {
+          int f = 2 - FCxtrans(row, col, roi_in, xtrans);
+          if(f == 1) continue;
+          float(*rfx)[3] = &rgb[0][row - top][col - left];
+          int c = (row - sgrow) % 3 ? TS : 1;
+          int h = 3 * (c ^ TS ^ 1);
+          for(int d = 0; d < 4; d++, rfx += TS * TS)
           {
-            float(*yfx)[TS][TS] = (float(*)[TS][TS]) & yuv[0][row][col];
-            drv[d][row][col] = SQR(2 * yfx[0][0][0] - yfx[0][0][f] - yfx[0][0][-f])
-                               + SQR(2 * yfx[1][0][0] - yfx[1][0][f] - yfx[1][0][-f])
-                               + SQR(2 * yfx[2][0][0] - yfx[2][0][f] - yfx[2][0][-f]);
+            int i = d > 1 || ((d ^ c) & 1) ||
+              ((fabsf(rfx[0][1]-rfx[c][1]) + fabsf(rfx[0][1]-rfx[-c][1])) <
+               2.f*(fabsf(rfx[0][1]-rfx[h][1]) + fabsf(rfx[0][1]-rfx[-h][1]))) ? c:h;
+            rfx[0][f] = (rfx[i][f] + rfx[-i][f] + 2.f * rfx[0][1] - rfx[i][1] - rfx[-i][1]) / 2.f;
           }
-      }
+        }
 
-      /* Build homogeneity maps from the derivatives:                   */
-      memset(homo, 0, (size_t)ndir * TS * TS * sizeof(uint8_t));
-      const int pad_homo = (passes == 1) ? 10 : 15;
-      for(int row = pad_homo; row < mrow - pad_homo; row++)
-        for(int col = pad_homo; col < mcol - pad_homo; col++)
+      /* Fill in red and blue for 2x2 blocks of green:                */
+      const int pad_g22 = (passes == 1) ? 8 : 4;
+      for(int row = top + pad_g22; row < mrow - pad_g22; row++)
+        if((row - sgrow) % 3)
+          for(int col = left + pad_g22; col < mcol - pad_g22; col++)
+            if((col - sgcol) % 3)
+            {
+              float(*rfx)[3] = &rgb[0][row - top][col - left];
+              const short *const hex = hexmap(row,col,allhex);
+              for(int d = 0; d < ndir; d += 2, rfx += TS * TS)
+                if(hex[d] + hex[d + 1])
+                {
+                  float g = 3.f * rfx[0][1] - 2.f * rfx[hex[d]][1] - rfx[hex[d + 1]][1];
+                  for(int c = 0; c < 4; c += 2)
+                    rfx[0][c] = (g + 2.f * rfx[hex[d]][c] + rfx[hex[d + 1]][c]) / 3.f;
+                }
+                else
+                {
+                  float g = 2.f * rfx[0][1] - rfx[hex[d]][1] - rfx[hex[d + 1]][1];
+                  for(int c = 0; c < 4; c += 2)
+                    rfx[0][c] = (g + rfx[hex[d]][c] + rfx[hex[d + 1]][c]) / 2.f;
+                }
+            }
+    } // end of multipass loop
+
+    // jump back to the first set of rgb buffers (this is a nop
+    // unless on the second pass)
+    rgb = (float(*)[TS][TS][3])buffer;
+    // from here on out, mainly are working within the current tile
+    // rather than in reference to the image, so don't offset
+    // mrow/mcol by top/left of tile
+    mrow -= top;
+    mcol -= left;
+
+    /* Convert to perceptual colorspace and differentiate in all directions:  */
+    // Original dcraw algorithm uses CIELab as perceptual space
+    // (presumably coming from original AHD) and converts taking
+    // camera matrix into account. Now use YPbPr which requires much
+    // less code and is nearly indistinguishable. It assumes the
+    // camera RGB is roughly linear.
+    for(int d = 0; d < ndir; d++)
+    {
+      const int pad_yuv = (passes == 1) ? 8 : 13;
+      for(int row = pad_yuv; row < mrow - pad_yuv; row++)
+        for(int col = pad_yuv; col < mcol - pad_yuv; col++)
         {
-          float tr = FLT_MAX;
-          for(int d = 0; d < ndir; d++)
-            if(tr > drv[d][row][col]) tr = drv[d][row][col];
-          tr *= 8;
-          for(int d = 0; d < ndir; d++)
-            for(int v = -1; v <= 1; v++)
-              for(int h = -1; h <= 1; h++) homo[d][row][col] += ((drv[d][row + v][col + h] <= tr) ? 1 : 0);
+          float *rx = rgb[d][row][col];
+          // use ITU-R BT.2020 YPbPr, which is great, but could use
+          // a better/simpler choice? note that imageop.h provides
+          // dt_iop_RGB_to_YCbCr which uses Rec. 601 conversion,
+          // which appears less good with specular highlights
+          float y = 0.2627f * rx[0] + 0.6780f * rx[1] + 0.0593f * rx[2];
+          yuv[0][row][col] = y;
+          yuv[1][row][col] = (rx[2] - y) * 0.56433f;
+          yuv[2][row][col] = (rx[0] - y) * 0.67815f;
         }
-
-      /* Build 5x5 sum of homogeneity maps for each pixel & direction */
-      for(int d = 0; d < ndir; d++)
-        for(int row = pad_tile; row < mrow - pad_tile; row++)
+      // Note that f can offset by a column (-1 or +1) and by a row
+      // (-TS or TS). The row-wise offsets cause the undefined
+      // behavior sanitizer to warn of an out of bounds index, but
+      // as yfx is multi-dimensional and there is sufficient
+      // padding, that is not actually so.
+      const int f = dir[d & 3];
+      const int pad_drv = (passes == 1) ? 9 : 14;
+      for(int row = pad_drv; row < mrow - pad_drv; row++)
+        for(int col = pad_drv; col < mcol - pad_drv; col++)
         {
-          // start before first column where homo[d][row][col+2] != 0,
-          // so can know v5sum and homosum[d][row][col] will be 0
-          int col = pad_tile-5;
-          uint8_t v5sum[5] = { 0 };
-          homosum[d][row][col] = 0;
-          // calculate by rolling through column sums
-          for(col++; col < mcol - pad_tile; col++)
-          {
-            uint8_t colsum = 0;
-            for(int v = -2; v <= 2; v++) colsum += homo[d][row + v][col + 2];
-            homosum[d][row][col] = homosum[d][row][col - 1] - v5sum[col % 5] + colsum;
-            v5sum[col % 5] = colsum;
-          }
+          float(*yfx)[TS][TS] = (float(*)[TS][TS]) & yuv[0][row][col];
+          drv[d][row][col] = SQR(2 * yfx[0][0][0] - yfx[0][0][f] - yfx[0][0][-f])
+                             + SQR(2 * yfx[1][0][0] - yfx[1][0][f] - yfx[1][0][-f])
+                             + SQR(2 * yfx[2][0][0] - yfx[2][0][f] - yfx[2][0][-f]);
         }
+    }
 
-      /* Average the most homogeneous pixels for the final result:       */
+    /* Build homogeneity maps from the derivatives:                   */
+    memset(homo, 0, (size_t)ndir * TS * TS * sizeof(uint8_t));
+    const int pad_homo = (passes == 1) ? 10 : 15;
+    for(int row = pad_homo; row < mrow - pad_homo; row++)
+      for(int col = pad_homo; col < mcol - pad_homo; col++)
+      {
+        float tr = FLT_MAX;
+        for(int d = 0; d < ndir; d++)
+          if(tr > drv[d][row][col]) tr = drv[d][row][col];
+        tr *= 8;
+        for(int d = 0; d < ndir; d++)
+          for(int v = -1; v <= 1; v++)
+            for(int h = -1; h <= 1; h++) homo[d][row][col] += ((drv[d][row + v][col + h] <= tr) ? 1 : 0);
+      }
+
+    /* Build 5x5 sum of homogeneity maps for each pixel & direction */
+    for(int d = 0; d < ndir; d++)
       for(int row = pad_tile; row < mrow - pad_tile; row++)
-        for(int col = pad_tile; col < mcol - pad_tile; col++)
+      {
+        // start before first column where homo[d][row][col+2] != 0,
+        // so can know v5sum and homosum[d][row][col] will be 0
+        int col = pad_tile-5;
+        uint8_t v5sum[5] = { 0 };
+        homosum[d][row][col] = 0;
+        // calculate by rolling through column sums
+        for(col++; col < mcol - pad_tile; col++)
         {
-          uint8_t hm[8] = { 0 };
-          uint8_t maxval = 0;
-          for(int d = 0; d < ndir; d++)
+          uint8_t colsum = 0;
+          for(int v = -2; v <= 2; v++) colsum += homo[d][row + v][col + 2];
+          homosum[d][row][col] = homosum[d][row][col - 1] - v5sum[col % 5] + colsum;
+          v5sum[col % 5] = colsum;
+        }
+      }
+
+    /* Average the most homogeneous pixels for the final result:       */
+    for(int row = pad_tile; row < mrow - pad_tile; row++)
+      for(int col = pad_tile; col < mcol - pad_tile; col++)
+      {
+        uint8_t hm[8] = { 0 };
+        uint8_t maxval = 0;
+        for(int d = 0; d < ndir; d++)
+        {
+          hm[d] = homosum[d][row][col];
+          maxval = (maxval < hm[d] ? hm[d] : maxval);
+        }
+        maxval -= maxval >> 3;
+        for(int d = 0; d < ndir - 4; d++)
+          if(hm[d] < hm[d + 4])
+            hm[d] = 0;
+          else if(hm[d] > hm[d + 4])
+            hm[d + 4] = 0;
+        float avg[4] = { 0.0f };
+        for(int d = 0; d < ndir; d++)
+          if(hm[d] >= maxval)
           {
-            hm[d] = homosum[d][row][col];
-            maxval = (maxval < hm[d] ? hm[d] : maxval);
+            for(int c = 0; c < 3; c++) avg[c] += rgb[d][row][col][c];
+            avg[3]++;
           }
-          maxval -= maxval >> 3;
-          for(int d = 0; d < ndir - 4; d++)
-            if(hm[d] < hm[d + 4])
-              hm[d] = 0;
-            else if(hm[d] > hm[d + 4])
-              hm[d + 4] = 0;
-          float avg[4] = { 0.0f };
-          for(int d = 0; d < ndir; d++)
-            if(hm[d] >= maxval)
-            {
-              for(int c = 0; c < 3; c++) avg[c] += rgb[d][row][col][c];
-              avg[3]++;
-            }
-          for(int c = 0; c < 3; c++)
-            out[4 * (width * (row + top) + col + left) + c] =
-              avg[c]/avg[3];
-        }
-    }
+        for(int c = 0; c < 3; c++)
+          out[4 * (width * (row + top) + col + left) + c] =
+            avg[c]/avg[3];
+      }
   }
-  dt_free_align(all_buffers);
+  dt_dev_pixelpipe_scratch_free(all_buffers);
 }
 
 #undef TS
@@ -1584,7 +1611,7 @@ static void xtrans_fdc_interpolate(struct dt_iop_module_t *self, float *out, con
               1.221201e-03f - 5.982162e-19f * _Complex_I } } };
 
   const size_t buffer_size = (size_t)TS * TS * (ndir * 4 + 7) * sizeof(float);
-  char *const all_buffers = (char *)dt_alloc_align(64, dt_get_num_threads() * buffer_size);
+  char *const all_buffers = (char *)dt_dev_pixelpipe_scratch_alloc(dt_get_num_threads() * buffer_size);
   if(!all_buffers)
   {
     fprintf(stderr, "[demosaic] not able to allocate FDC base buffers\n");
@@ -2144,7 +2171,7 @@ static void xtrans_fdc_interpolate(struct dt_iop_module_t *self, float *out, con
         }
     }
   }
-  dt_free_align(all_buffers);
+  dt_dev_pixelpipe_scratch_free(all_buffers);
 }
 
 #undef PIX_SWAP
@@ -2481,106 +2508,84 @@ static void passthrough_monochrome(float *out, const float *const in, dt_iop_roi
 }
 
 /** 1:1 demosaic from in to out, in is full buf, out is translated/cropped (scale == 1.0!) */
-static void demosaic_ppg(float *const out, const float *const in, const dt_iop_roi_t *const roi_out,
-                         const dt_iop_roi_t *const roi_in, const uint32_t filters, const float thrs)
-{
-  // offsets only where the buffer ends:
-  const int offx = 3; // MAX(0, 3 - roi_out->x);
-  const int offy = 3; // MAX(0, 3 - roi_out->y);
-  const int offX = 3; // MAX(0, 3 - (roi_in->width  - (roi_out->x + roi_out->width)));
-  const int offY = 3; // MAX(0, 3 - (roi_in->height - (roi_out->y + roi_out->height)));
+// rows per strip of the fused ppg pass, each strip recomputes two rows of green at its edges
+#define PPG_STRIP 64
 
-  // these may differ a little, if you're unlucky enough to split a bayer block with cropping or similar.
-  // we never want to access the input out of bounds though:
-  assert(roi_in->width >= roi_out->width);
-  assert(roi_in->height >= roi_out->height);
-  // border interpolate
-  float sum[8];
-  for(int j = 0; j < roi_out->height; j++)
-    for(int i = 0; i < roi_out->width; i++)
+// border interpolate: average the neighbours of each colour in the 3x3 window
+static inline void ppg_border_pixel(float *const pix, const float *const in, const dt_iop_roi_t *const roi_out,
+                                    const dt_iop_roi_t *const roi_in, const uint32_t filters, const int j,
+                                    const int i)
+{
+  float sum[8] = { 0.0f };
+  for(int y = j - 1; y != j + 2; y++)
+    for(int x = i - 1; x != i + 2; x++)
     {
-      if(i == offx && j >= offy && j < roi_out->height - offY) i = roi_out->width - offX;
-      if(i == roi_out->width) break;
-      memset(sum, 0, sizeof(float) * 8);
-      for(int y = j - 1; y != j + 2; y++)
-        for(int x = i - 1; x != i + 2; x++)
-        {
-          const int yy = y + roi_out->y, xx = x + roi_out->x;
-          if(yy >= 0 && xx >= 0 && yy < roi_in->height && xx < roi_in->width)
-          {
-            int f = FC(y, x, filters);
-            sum[f] += in[(size_t)yy * roi_in->width + xx];
-            sum[f + 4]++;
-          }
-        }
-      int f = FC(j, i, filters);
-      for(int c = 0; c < 3; c++)
+      const int yy = y + roi_out->y, xx = x + roi_out->x;
+      if(yy >= 0 && xx >= 0 && yy < roi_in->height && xx < roi_in->width)
       {
-        if(c != f && sum[c + 4] > 0.0f)
-          out[4 * ((size_t)j * roi_out->width + i) + c] = sum[c] / sum[c + 4];
-        else
-          out[4 * ((size_t)j * roi_out->width + i) + c]
-              = in[((size_t)j + roi_out->y) * roi_in->width + i + roi_out->x];
+        const int f = FC(y, x, filters);
+        sum[f] += in[(size_t)yy * roi_in->width + xx];
+        sum[f + 4]++;
       }
     }
-  const int median = thrs > 0.0f;
-  // if(median) fbdd_green(out, in, roi_out, roi_in, filters);
-  const float *input = in;
-  if(median)
+  const int f = FC(j, i, filters);
+  for(int c = 0; c < 3; c++)
   {
-    float *med_in = (float *)dt_alloc_align(64, (size_t)roi_in->height * roi_in->width * sizeof(float));
-    pre_median(med_in, in, roi_in, filters, 1, thrs);
-    input = med_in;
+    if(c != f && sum[c + 4] > 0.0f)
+      pix[c] = sum[c] / sum[c + 4];
+    else
+      pix[c] = in[((size_t)j + roi_out->y) * roi_in->width + i + roi_out->x];
   }
-// for all pixels: interpolate green into float array, or copy color.
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(filters, out, roi_in, roi_out, offx, offy, offX, offY) \
-  shared(input) \
-  schedule(static)
-#endif
-  for(int j = offy; j < roi_out->height - offY; j++)
+  pix[3] = 0.0f;
+}
+
+// first ppg step for one row: copy the sensor colour and interpolate green for red and blue pixels.
+// pixels closer than three to the border are filled by ppg_border_pixel().
+static void ppg_green_row(float *const buf, const float *const in, const float *const input,
+                          const dt_iop_roi_t *const roi_out, const dt_iop_roi_t *const roi_in,
+                          const uint32_t filters, const int j)
+{
+  const int width = roi_out->width;
+  const int border = 3;
+  if(j < border || j >= roi_out->height - border)
   {
-    float *buf = out + (size_t)4 * roi_out->width * j + 4 * offx;
-    const float *buf_in = input + (size_t)roi_in->width * (j + roi_out->y) + offx + roi_out->x;
-    for(int i = offx; i < roi_out->width - offX; i++)
-    {
-      const int c = FC(j, i, filters);
-#if defined(__SSE__)
-      // prefetch what we need soon (load to cpu caches)
-      _mm_prefetch((char *)buf_in + 256, _MM_HINT_NTA); // TODO: try HINT_T0-3
-      _mm_prefetch((char *)buf_in + roi_in->width + 256, _MM_HINT_NTA);
-      _mm_prefetch((char *)buf_in + 2 * roi_in->width + 256, _MM_HINT_NTA);
-      _mm_prefetch((char *)buf_in + 3 * roi_in->width + 256, _MM_HINT_NTA);
-      _mm_prefetch((char *)buf_in - roi_in->width + 256, _MM_HINT_NTA);
-      _mm_prefetch((char *)buf_in - 2 * roi_in->width + 256, _MM_HINT_NTA);
-      _mm_prefetch((char *)buf_in - 3 * roi_in->width + 256, _MM_HINT_NTA);
-#endif
+    for(int i = 0; i < width; i++) ppg_border_pixel(buf + 4 * i, in, roi_out, roi_in, filters, j, i);
+    return;
+  }
+  for(int i = 0; i < border; i++)
+  {
+    ppg_border_pixel(buf + 4 * i, in, roi_out, roi_in, filters, j, i);
+    ppg_border_pixel(buf + 4 * (width - 1 - i), in, roi_out, roi_in, filters, j, width - 1 - i);
+  }
 
-#if defined(__SSE__)
-      __m128 col = _mm_load_ps(buf);
-      float *color = (float *)&col;
-#else
-      float color[4] = { buf[0], buf[1], buf[2], buf[3] };
+  const int w = roi_in->width;
+  const float *const row_in = input + (size_t)w * (j + roi_out->y) + roi_out->x;
+  // the bayer pattern repeats every other column, so every parity has a single colour
+  for(int p = 0; p < 2; p++)
+  {
+    const int c = FC(j, border + p, filters);
+    const int i0 = border + p, i1 = width - border;
+    if(c == 0 || c == 2)
+    {
+#ifdef _OPENMP
+#pragma omp simd
 #endif
-      const float pc = buf_in[0];
-      // if(__builtin_expect(c == 0 || c == 2, 1))
-      if(c == 0 || c == 2)
+      for(int i = i0; i < i1; i += 2)
       {
-        color[c] = pc;
-        // get stuff (hopefully from cache)
-        const float pym = buf_in[-roi_in->width * 1];
-        const float pym2 = buf_in[-roi_in->width * 2];
-        const float pym3 = buf_in[-roi_in->width * 3];
-        const float pyM = buf_in[+roi_in->width * 1];
-        const float pyM2 = buf_in[+roi_in->width * 2];
-        const float pyM3 = buf_in[+roi_in->width * 3];
-        const float pxm = buf_in[-1];
-        const float pxm2 = buf_in[-2];
-        const float pxm3 = buf_in[-3];
-        const float pxM = buf_in[+1];
-        const float pxM2 = buf_in[+2];
-        const float pxM3 = buf_in[+3];
+        const float *const pin = row_in + i;
+        const float pc = pin[0];
+        const float pym = pin[-w * 1];
+        const float pym2 = pin[-w * 2];
+        const float pym3 = pin[-w * 3];
+        const float pyM = pin[+w * 1];
+        const float pyM2 = pin[+w * 2];
+        const float pyM3 = pin[+w * 3];
+        const float pxm = pin[-1];
+        const float pxm2 = pin[-2];
+        const float pxm3 = pin[-3];
+        const float pxM = pin[+1];
+        const float pxM2 = pin[+2];
+        const float pxM3 = pin[+3];
 
         const float guessx = (pxm + pc + pxM) * 2.0f - pxM2 - pxm2;
         const float diffx = (fabsf(pxm2 - pc) + fabsf(pxM2 - pc) + fabsf(pxm - pxM)) * 3.0f
@@ -2588,124 +2593,155 @@ static void demosaic_ppg(float *const out, const float *const in, const dt_iop_r
         const float guessy = (pym + pc + pyM) * 2.0f - pyM2 - pym2;
         const float diffy = (fabsf(pym2 - pc) + fabsf(pyM2 - pc) + fabsf(pym - pyM)) * 3.0f
                             + (fabsf(pyM3 - pyM) + fabsf(pym3 - pym)) * 2.0f;
-        if(diffx > diffy)
-        {
-          // use guessy
-          const float m = fminf(pym, pyM);
-          const float M = fmaxf(pym, pyM);
-          color[1] = fmaxf(fminf(guessy * .25f, M), m);
-        }
-        else
-        {
-          const float m = fminf(pxm, pxM);
-          const float M = fmaxf(pxm, pxM);
-          color[1] = fmaxf(fminf(guessx * .25f, M), m);
-        }
+        const float gy = fmaxf(fminf(guessy * .25f, fmaxf(pym, pyM)), fminf(pym, pyM));
+        const float gx = fmaxf(fminf(guessx * .25f, fmaxf(pxm, pxM)), fminf(pxm, pxM));
+
+        float *const pix = buf + 4 * i;
+        pix[0] = pix[2] = pix[3] = 0.0f;
+        pix[c] = pc;
+        pix[1] = diffx > diffy ? gy : gx;
       }
-      else
-        color[1] = pc;
+    }
+    else
+    {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int i = i0; i < i1; i += 2)
+      {
+        float *const pix = buf + 4 * i;
+        pix[0] = pix[2] = pix[3] = 0.0f;
+        pix[1] = row_in[i];
+      }
+    }
+  }
+}
 
-      // write using MOVNTPS (write combine omitting caches)
-      // _mm_stream_ps(buf, col);
-      memcpy(buf, color, 4 * sizeof(float));
-      buf += 4;
-      buf_in++;
+// second ppg step for one row: fill in red and blue from the three green-interpolated rows
+// above, at and below row j. the outermost columns keep their border values.
+static void ppg_color_row(float *const out, const float *const above, const float *const cur,
+                          const float *const below, const int width, const uint32_t filters, const int j)
+{
+  memcpy(out, cur, 4 * sizeof(float));
+  memcpy(out + 4 * (width - 1), cur + 4 * (width - 1), 4 * sizeof(float));
+  for(int p = 0; p < 2; p++)
+  {
+    const int c = FC(j, 1 + p, filters);
+    if(c & 1)
+    {
+      // green pixel: one of red and blue comes from the left/right, the other one from top/bottom
+      const int ch = FC(j, 2 + p, filters) == 0 ? 0 : 2;
+      const int cv = 2 - ch;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int i = 1 + p; i < width - 1; i += 2)
+      {
+        const float *const pix = cur + 4 * i;
+        const float *const nt = above + 4 * i;
+        const float *const nb = below + 4 * i;
+        const float *const nl = pix - 4;
+        const float *const nr = pix + 4;
+        float *const o = out + 4 * i;
+        o[1] = pix[1];
+        o[3] = pix[3];
+        o[cv] = (nt[cv] + nb[cv] + 2.0f * pix[1] - nt[1] - nb[1]) * .5f;
+        o[ch] = (nl[ch] + nr[ch] + 2.0f * pix[1] - nl[1] - nr[1]) * .5f;
+      }
     }
+    else
+    {
+      // red pixel: fill blue, blue pixel: fill red, from the diagonal neighbours
+      const int f = 2 - c;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int i = 1 + p; i < width - 1; i += 2)
+      {
+        const float *const pix = cur + 4 * i;
+        const float *const ntl = above + 4 * (i - 1);
+        const float *const ntr = above + 4 * (i + 1);
+        const float *const nbl = below + 4 * (i - 1);
+        const float *const nbr = below + 4 * (i + 1);
+        const float diff1 = fabsf(ntl[f] - nbr[f]) + fabsf(ntl[1] - pix[1]) + fabsf(nbr[1] - pix[1]);
+        const float guess1 = ntl[f] + nbr[f] + 2.0f * pix[1] - ntl[1] - nbr[1];
+        const float diff2 = fabsf(ntr[f] - nbl[f]) + fabsf(ntr[1] - pix[1]) + fabsf(nbl[1] - pix[1]);
+        const float guess2 = ntr[f] + nbl[f] + 2.0f * pix[1] - ntr[1] - nbl[1];
+        float *const o = out + 4 * i;
+        o[c] = pix[c];
+        o[1] = pix[1];
+        o[3] = pix[3];
+        o[f] = diff1 > diff2 ? guess2 * .5f : (diff1 < diff2 ? guess1 * .5f : (guess1 + guess2) * .25f);
+      }
+    }
+  }
+}
+
+static void demosaic_ppg(float *const out, const float *const in, const dt_iop_roi_t *const roi_out,
+                         const dt_iop_roi_t *const roi_in, const uint32_t filters, const float thrs)
+{
+  // these may differ a little, if you're unlucky enough to split a bayer block with cropping or similar.
+  // we never want to access the input out of bounds though:
+  assert(roi_in->width >= roi_out->width);
+  assert(roi_in->height >= roi_out->height);
+
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+  const int median = thrs > 0.0f;
+  // if(median) fbdd_green(out, in, roi_out, roi_in, filters);
+  const float *input = in;
+  if(median)
+  {
+    float *med_in = (float *)dt_alloc_align(64, (size_t)roi_in->height * roi_in->width * sizeof(float));
+    pre_median(med_in, in, roi_in, filters, 1, thrs);
+    input = med_in;
+  }
+
+  // both steps run in one pass over strips of rows. every thread keeps the green-interpolated
+  // rows around the current one in a private ring of three rows, so the intermediate result never
+  // leaves the cache and the output is written exactly once.
+  const size_t ring_size = (size_t)3 * 4 * width;
+  float *const all_rings = (float *)dt_alloc_align(64, dt_get_num_threads() * ring_size * sizeof(float));
+  if(!all_rings)
+  {
+    fprintf(stderr, "[demosaic] not able to allocate PPG buffers\n");
+    if(median) dt_free_align((float *)input);
+    return;
   }
-// SFENCE (make sure stuff is stored now)
-// _mm_sfence();
+  const int strips = (height + PPG_STRIP - 1) / PPG_STRIP;
 
-// for all pixels: interpolate colors into float array
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(filters, out, roi_out) \
+  dt_omp_firstprivate(all_rings, filters, height, in, input, out, ring_size, roi_in, roi_out, strips, width) \
   schedule(static)
 #endif
-  for(int j = 1; j < roi_out->height - 1; j++)
+  for(int s = 0; s < strips; s++)
   {
-    float *buf = out + (size_t)4 * roi_out->width * j + 4;
-    for(int i = 1; i < roi_out->width - 1; i++)
+    float *const ring = all_rings + dt_get_thread_num() * ring_size;
+    const int j0 = s * PPG_STRIP;
+    const int j1 = MIN(j0 + PPG_STRIP, height);
+#define RING(row) (ring + (size_t)4 * width * ((row) % 3))
+    if(j0 > 0) ppg_green_row(RING(j0 - 1), in, input, roi_out, roi_in, filters, j0 - 1);
+    ppg_green_row(RING(j0), in, input, roi_out, roi_in, filters, j0);
+    for(int j = j0; j < j1; j++)
     {
-      // also prefetch direct nbs top/bottom
-#if defined(__SSE__)
-      _mm_prefetch((char *)buf + 256, _MM_HINT_NTA);
-      _mm_prefetch((char *)buf - roi_out->width * 4 * sizeof(float) + 256, _MM_HINT_NTA);
-      _mm_prefetch((char *)buf + roi_out->width * 4 * sizeof(float) + 256, _MM_HINT_NTA);
-#endif
-
-      const int c = FC(j, i, filters);
-#if defined(__SSE__)
-      __m128 col = _mm_load_ps(buf);
-      float *color = (float *)&col;
-#else
-      float color[4] = { buf[0], buf[1], buf[2], buf[3] };
-#endif
-      // fill all four pixels with correctly interpolated stuff: r/b for green1/2
-      // b for r and r for b
-      if(__builtin_expect(c & 1, 1)) // c == 1 || c == 3)
-      {
-        // calculate red and blue for green pixels:
-        // need 4-nbhood:
-        const float *nt = buf - 4 * roi_out->width;
-        const float *nb = buf + 4 * roi_out->width;
-        const float *nl = buf - 4;
-        const float *nr = buf + 4;
-        if(FC(j, i + 1, filters) == 0) // red nb in same row
-        {
-          color[2] = (nt[2] + nb[2] + 2.0f * color[1] - nt[1] - nb[1]) * .5f;
-          color[0] = (nl[0] + nr[0] + 2.0f * color[1] - nl[1] - nr[1]) * .5f;
-        }
-        else
-        {
-          // blue nb
-          color[0] = (nt[0] + nb[0] + 2.0f * color[1] - nt[1] - nb[1]) * .5f;
-          color[2] = (nl[2] + nr[2] + 2.0f * color[1] - nl[1] - nr[1]) * .5f;
-        }
-      }
-      else
+      float *const outrow = out + (size_t)4 * width * j;
+      if(j == 0 || j == height - 1)
       {
-        // get 4-star-nbhood:
-        const float *ntl = buf - 4 - 4 * roi_out->width;
-        const float *ntr = buf + 4 - 4 * roi_out->width;
-        const float *nbl = buf - 4 + 4 * roi_out->width;
-        const float *nbr = buf + 4 + 4 * roi_out->width;
-
-        if(c == 0)
-        {
-          // red pixel, fill blue:
-          const float diff1 = fabsf(ntl[2] - nbr[2]) + fabsf(ntl[1] - color[1]) + fabsf(nbr[1] - color[1]);
-          const float guess1 = ntl[2] + nbr[2] + 2.0f * color[1] - ntl[1] - nbr[1];
-          const float diff2 = fabsf(ntr[2] - nbl[2]) + fabsf(ntr[1] - color[1]) + fabsf(nbl[1] - color[1]);
-          const float guess2 = ntr[2] + nbl[2] + 2.0f * color[1] - ntr[1] - nbl[1];
-          if(diff1 > diff2)
-            color[2] = guess2 * .5f;
-          else if(diff1 < diff2)
-            color[2] = guess1 * .5f;
-          else
-            color[2] = (guess1 + guess2) * .25f;
-        }
-        else // c == 2, blue pixel, fill red:
-        {
-          const float diff1 = fabsf(ntl[0] - nbr[0]) + fabsf(ntl[1] - color[1]) + fabsf(nbr[1] - color[1]);
-          const float guess1 = ntl[0] + nbr[0] + 2.0f * color[1] - ntl[1] - nbr[1];
-          const float diff2 = fabsf(ntr[0] - nbl[0]) + fabsf(ntr[1] - color[1]) + fabsf(nbl[1] - color[1]);
-          const float guess2 = ntr[0] + nbl[0] + 2.0f * color[1] - ntr[1] - nbl[1];
-          if(diff1 > diff2)
-            color[0] = guess2 * .5f;
-          else if(diff1 < diff2)
-            color[0] = guess1 * .5f;
-          else
-            color[0] = (guess1 + guess2) * .25f;
-        }
+        memcpy(outrow, RING(j), sizeof(float) * 4 * width);
+        if(j + 1 < height) ppg_green_row(RING(j + 1), in, input, roi_out, roi_in, filters, j + 1);
+        continue;
       }
-      // _mm_stream_ps(buf, col);
-      memcpy(buf, color, 4 * sizeof(float));
-      buf += 4;
+      ppg_green_row(RING(j + 1), in, input, roi_out, roi_in, filters, j + 1);
+      ppg_color_row(outrow, RING(j - 1), RING(j), RING(j + 1), width, filters, j);
     }
+#undef RING
   }
-  // _mm_sfence();
+
+  dt_free_align(all_rings);
   if(median) dt_free_align((float *)input);
 }
+#undef PPG_STRIP
 
 void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
                   float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
@@ -2894,7 +2930,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       roo.width = roi_in->width;
       roo.height = roi_in->height;
       roo.scale = 1.0f;
-      tmp = (float *)dt_alloc_align(64, (size_t)roo.width * roo.height * 4 * sizeof(float));
+      tmp = (float *)dt_dev_pixelpipe_scratch_alloc((size_t)roo.width * roo.height * 4 * sizeof(float));
     }
 
     if(demosaicing_method == DT_IOP_DEMOSAIC_PASSTHROUGH_MONOCHROME)
@@ -2918,7 +2954,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
       if(!(img->flags & DT_IMAGE_4BAYER) && data->green_eq != DT_IOP_GREEN_EQ_NO)
       {
-        in = (float *)dt_alloc_align(64, (size_t)roi_in->height * roi_in->width * sizeof(float));
+        in = (float *)dt_dev_pixelpipe_scratch_alloc((size_t)roi_in->height * roi_in->width * sizeof(float));
         switch(data->green_eq)
         {
           case DT_IOP_GREEN_EQ_FULL:
@@ -2930,12 +2966,12 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
                                      roi_in->x, roi_in->y, threshold);
             break;
           case DT_IOP_GREEN_EQ_BOTH:
-            aux = dt_alloc_align(64, (size_t)roi_in->height * roi_in->width * sizeof(float));
+            aux = dt_dev_pixelpipe_scratch_alloc((size_t)roi_in->height * roi_in->width * sizeof(float));
             green_equilibration_favg(aux, pixels, roi_in->width, roi_in->height, piece->pipe->dsc.filters,
                                      roi_in->x, roi_in->y);
             green_equilibration_lavg(in, aux, roi_in->width, roi_in->height, piece->pipe->dsc.filters, roi_in->x,
                                      roi_in->y, threshold);
-            dt_free_align(aux);
+            dt_dev_pixelpipe_scratch_free(aux);
             break;
         }
       }
@@ -2955,14 +2991,14 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       else
         amaze_demosaic_RT(self, piece, in, tmp, &roi, &roo, piece->pipe->dsc.filters);
 
-      if(!(img->flags & DT_IMAGE_4BAYER) && data->green_eq != DT_IOP_GREEN_EQ_NO) dt_free_align(in);
+      if(!(img->flags & DT_IMAGE_4BAYER) && data->green_eq != DT_IOP_GREEN_EQ_NO) dt_dev_pixelpipe_scratch_free(in);
     }
 
     if(scaled)
     {
       roi = *roi_out;
       dt_iop_clip_and_zoom_roi((float *)o, tmp, &roi, &roo, roi.width, roo.width);
-      dt_free_align(tmp);
+      dt_dev_pixelpipe_scratch_free(tmp);
     }
   }
   else
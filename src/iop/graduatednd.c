@@ -144,7 +144,8 @@ const char *name()
 int flags()
 {
   return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING
-         | IOP_FLAGS_TILING_FULL_ROI;
+         | IOP_FLAGS_TILING_FULL_ROI
+         | IOP_FLAGS_SCALE_INVARIANT | IOP_FLAGS_POINTWISE;
 }
 
 int default_group()
@@ -82,6 +82,19 @@ typedef struct dt_iop_hazeremoval_gui_data_t
   dt_pthread_mutex_t lock;
 } dt_iop_hazeremoval_gui_data_t;
 
+// ambient light and maximal depth depend on the image and the modules before this one only,
+// so they are kept for a couple of pipes and reused until the input changes
+#define HAZEREMOVAL_STATS 8
+
+typedef struct dt_iop_hazeremoval_stats_t
+{
+  int imgid;
+  uint64_t hash; // of the pipe up to (excluding) this module, 0 for an unused entry
+  int width, height;
+  rgb_pixel A0;
+  float distance_max;
+} dt_iop_hazeremoval_stats_t;
+
 typedef struct dt_iop_hazeremoval_global_data_t
 {
   int kernel_hazeremoval_transision_map;
@@ -90,6 +103,9 @@ typedef struct dt_iop_hazeremoval_global_data_t
   int kernel_hazeremoval_box_max_x;
   int kernel_hazeremoval_box_max_y;
   int kernel_hazeremoval_dehaze;
+  dt_iop_hazeremoval_stats_t stats[HAZEREMOVAL_STATS];
+  int stats_next;
+  dt_pthread_mutex_t stats_lock;
 } dt_iop_hazeremoval_global_data_t;
 
 
@@ -146,7 +162,8 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
 
 void init_global(dt_iop_module_so_t *self)
 {
-  dt_iop_hazeremoval_global_data_t *gd = malloc(sizeof(*gd));
+  dt_iop_hazeremoval_global_data_t *gd = calloc(1, sizeof(*gd));
+  dt_pthread_mutex_init(&gd->stats_lock, NULL);
   const int program = 27; // hazeremoval.cl, from programs.conf
   gd->kernel_hazeremoval_transision_map = dt_opencl_create_kernel(program, "hazeremoval_transision_map");
   gd->kernel_hazeremoval_box_min_x = dt_opencl_create_kernel(program, "hazeremoval_box_min_x");
@@ -167,6 +184,7 @@ void cleanup_global(dt_iop_module_so_t *self)
   dt_opencl_free_kernel(gd->kernel_hazeremoval_box_max_x);
   dt_opencl_free_kernel(gd->kernel_hazeremoval_box_max_y);
   dt_opencl_free_kernel(gd->kernel_hazeremoval_dehaze);
+  dt_pthread_mutex_destroy(&gd->stats_lock);
   free(self->data);
   self->data = NULL;
 }
@@ -327,13 +345,6 @@ static inline int min_i(int a, int b)
 }
 
 
-// maximum of two integers
-static inline int max_i(int a, int b)
-{
-  return a > b ? a : b;
-}
-
-
 // swap the two floats that the pointers point to
 static inline void pointer_swap_f(float *a, float *b)
 {
@@ -343,166 +354,148 @@ static inline void pointer_swap_f(float *a, float *b)
 }
 
 
-// calculate the one-dimensional moving maximum over a window of size 2*w+1
-// input array x has stride 1, output array y has stride stride_y
-static inline void box_max_1d(int N, const float *x, float *y, size_t stride_y, int w)
+// extremum of two floats, written as a comparison so that the loops below vectorize
+static inline float box_op(const float a, const float b, const int maximum)
+{
+  return maximum ? (a > b ? a : b) : (a < b ? a : b);
+}
+
+
+// number of padded samples needed for a moving window of size 2*w+1 over N samples,
+// rounded up to whole windows
+static inline int box_padded_length(const int N, const int w)
+{
+  const int W = 2 * w + 1;
+  return (N + 2 * w + W - 1) / W * W;
+}
+
+
+// calculate the one-dimensional moving minimum or maximum over a window of size 2*w+1
+// with the van Herk/Gil-Werman algorithm, i.e., with three comparisons per sample
+// independent of the window size.  the padded input is cut into blocks of the window
+// size, every window then consists of the tail of one block and the head of the next.
+// the algorithm runs on n interleaved signals at once, sample k of signal c is x[k * n + c],
+// which lets the inner loops vectorize when filtering along columns.
+// xp, g and h are scratch buffers of box_padded_length(N, w) * n floats each, xp has to be
+// filled with the input by the caller, starting at offset w * n, the padding is done here.
+static inline void box_extremum_1d(const int N, const int n, const int w, const int maximum, float *const xp,
+                                   float *const g, float *const h)
 {
-  float m = -(INFINITY);
-  for(int i = 0, i_end = min_i(w + 1, N); i < i_end; i++) m = fmaxf(x[i], m);
-  for(int i = 0; i < N; i++)
+  const int W = 2 * w + 1;
+  const int M = box_padded_length(N, w);
+  const float pad = maximum ? -INFINITY : INFINITY;
+  for(size_t k = 0; k < (size_t)w * n; k++) xp[k] = pad;
+  for(size_t k = (size_t)(N + w) * n; k < (size_t)M * n; k++) xp[k] = pad;
+
+  for(int b = 0; b < M; b += W)
   {
-    y[i * stride_y] = m;
-    if(i - w >= 0 && x[i - w] == m)
-    {
-      m = -(INFINITY);
-      for(int j = max_i(i - w + 1, 0), j_end = min_i(i + w + 2, N); j < j_end; j++) m = fmaxf(x[j], m);
-    }
-    if(i + w + 1 < N) m = fmaxf(x[i + w + 1], m);
+    // running extremum from the start of the block forwards
+    for(int c = 0; c < n; c++) g[(size_t)b * n + c] = xp[(size_t)b * n + c];
+    for(int k = b + 1; k < b + W; k++)
+      for(int c = 0; c < n; c++)
+        g[(size_t)k * n + c] = box_op(g[(size_t)(k - 1) * n + c], xp[(size_t)k * n + c], maximum);
+    // and from the end of the block backwards
+    const int e = b + W - 1;
+    for(int c = 0; c < n; c++) h[(size_t)e * n + c] = xp[(size_t)e * n + c];
+    for(int k = e - 1; k >= b; k--)
+      for(int c = 0; c < n; c++)
+        h[(size_t)k * n + c] = box_op(h[(size_t)(k + 1) * n + c], xp[(size_t)k * n + c], maximum);
   }
 }
 
 
-// calculate the two-dimensional moving maximum over a box of size (2*w+1) x (2*w+1)
+// calculate the two-dimensional moving minimum or maximum over a box of size (2*w+1) x (2*w+1)
 // does the calculation in-place if input and output images are identical
-static void box_max(const gray_image img1, const gray_image img2, const int w)
+// returns FALSE if the scratch buffers could not be allocated, img2 is left untouched then
+#define BOX_STRIP 16
+static int box_extremum(const gray_image img1, const gray_image img2, const int w, const int maximum)
 {
-  gray_image img2_bak;
-  if(img1.data == img2.data)
-  {
+  const int width = img1.width;
+  const int height = img1.height;
+  const int Mx = box_padded_length(width, w);
+  const int My = box_padded_length(height, w);
+  const int strips = (width + BOX_STRIP - 1) / BOX_STRIP;
+
+  // three scratch rows or column strips per thread, rounded up to whole cache lines
+  const size_t per_thread = ((size_t)3 * MAX(Mx, My * BOX_STRIP) + 15) & ~(size_t)15;
+  float *const scratch = dt_alloc_align(64, sizeof(float) * per_thread * dt_get_num_threads());
+  if(!scratch) return FALSE;
+
+  // rows, one at a time
 #ifdef _OPENMP
 #pragma omp parallel default(none) \
-    dt_omp_firstprivate(img1, img2, w) \
-    private(img2_bak)
-#endif
-    {
-      img2_bak = new_gray_image(img2.width, 1);
-#ifdef _OPENMP
-#pragma omp for
+  dt_omp_firstprivate(img1, img2, w, maximum, width, height, Mx, scratch, per_thread)
 #endif
-      for(int i1 = 0; i1 < img2.height; i1++)
-      {
-        memcpy(img2_bak.data, img2.data + (size_t)i1 * img2.width, sizeof(float) * img2.width);
-        box_max_1d(img2.width, img2_bak.data, img2.data + (size_t)i1 * img2.width, 1, w);
-      }
-      free_gray_image(&img2_bak);
-    }
-  }
-  else
   {
+    float *const xp = scratch + per_thread * dt_get_thread_num(), *const g = xp + Mx, *const h = xp + 2 * Mx;
 #ifdef _OPENMP
-#pragma omp parallel default(none) \
-    dt_omp_firstprivate(img1, img2, w) \
-    private(img2_bak)
+#pragma omp for schedule(static)
 #endif
+    for(int i1 = 0; i1 < height; i1++)
     {
-#ifdef _OPENMP
-#pragma omp for
-#endif
-      for(int i1 = 0; i1 < img1.height; i1++)
-        box_max_1d(img1.width, img1.data + (size_t)i1 * img1.width, img2.data + (size_t)i1 * img2.width, 1, w);
+      memcpy(xp + w, img1.data + (size_t)i1 * width, sizeof(float) * width);
+      box_extremum_1d(width, 1, w, maximum, xp, g, h);
+      float *const out = img2.data + (size_t)i1 * width;
+      for(int i = 0; i < width; i++) out[i] = box_op(h[i], g[i + 2 * w], maximum);
     }
   }
+
+  // columns, in strips of BOX_STRIP neighbouring columns which are filtered side by side
 #ifdef _OPENMP
 #pragma omp parallel default(none) \
-  dt_omp_firstprivate(img1, img2, w) \
-  private(img2_bak)
+  dt_omp_firstprivate(img2, w, maximum, width, height, My, strips, scratch, per_thread)
 #endif
   {
-    img2_bak = new_gray_image(1, img2.height);
+    float *const xp = scratch + per_thread * dt_get_thread_num(), *const g = xp + (size_t)My * BOX_STRIP,
+                *const h = xp + (size_t)2 * My * BOX_STRIP;
 #ifdef _OPENMP
-#pragma omp for
+#pragma omp for schedule(static)
 #endif
-    for(int i0 = 0; i0 < img1.width; i0++)
+    for(int s = 0; s < strips; s++)
     {
-      for(int i1 = 0; i1 < img1.height; i1++) img2_bak.data[i1] = img2.data[i0 + (size_t)i1 * img2.width];
-      box_max_1d(img1.height, img2_bak.data, img2.data + i0, img1.width, w);
+      const int x0 = s * BOX_STRIP;
+      const int n = min_i(BOX_STRIP, width - x0);
+      for(int i1 = 0; i1 < height; i1++)
+      {
+        float *const row = xp + (size_t)(i1 + w) * BOX_STRIP;
+        memcpy(row, img2.data + (size_t)i1 * width + x0, sizeof(float) * n);
+        for(int c = n; c < BOX_STRIP; c++) row[c] = 0.f;
+      }
+      box_extremum_1d(height, BOX_STRIP, w, maximum, xp, g, h);
+      for(int i1 = 0; i1 < height; i1++)
+      {
+        const float *const hi = h + (size_t)i1 * BOX_STRIP;
+        const float *const gi = g + (size_t)(i1 + 2 * w) * BOX_STRIP;
+        float *const out = img2.data + (size_t)i1 * width + x0;
+        for(int c = 0; c < n; c++) out[c] = box_op(hi[c], gi[c], maximum);
+      }
     }
-    free_gray_image(&img2_bak);
   }
+
+  dt_free_align(scratch);
+  return TRUE;
 }
+#undef BOX_STRIP
 
 
-// calculate the one-dimensional moving minimum over a window of size 2*w+1
-// input array x has stride 1, output array y has stride stride_y
-static inline void box_min_1d(int N, const float *x, float *y, size_t stride_y, int w)
+// calculate the two-dimensional moving maximum over a box of size (2*w+1) x (2*w+1)
+// does the calculation in-place if input and output images are identical
+static int box_max(const gray_image img1, const gray_image img2, const int w)
 {
-  float m = INFINITY;
-  for(int i = 0, i_end = min_i(w + 1, N); i < i_end; i++) m = fminf(x[i], m);
-  for(int i = 0; i < N; i++)
-  {
-    y[i * stride_y] = m;
-    if(i - w >= 0 && x[i - w] == m)
-    {
-      m = INFINITY;
-      for(int j = max_i(i - w + 1, 0), j_end = min_i(i + w + 2, N); j < j_end; j++) m = fminf(x[j], m);
-    }
-    if(i + w + 1 < N) m = fminf(x[i + w + 1], m);
-  }
+  return box_extremum(img1, img2, w, TRUE);
 }
 
 
 // calculate the two-dimensional moving minimum over a box of size (2*w+1) x (2*w+1)
 // does the calculation in-place if input and output images are identical
-static void box_min(const gray_image img1, const gray_image img2, const int w)
+static int box_min(const gray_image img1, const gray_image img2, const int w)
 {
-  gray_image img2_bak;
-  if(img1.data == img2.data)
-  {
-#ifdef _OPENMP
-#pragma omp parallel default(none) \
-    dt_omp_firstprivate(img1, img2, w) \
-    private(img2_bak)
-#endif
-    {
-      img2_bak = new_gray_image(img2.width, 1);
-#ifdef _OPENMP
-#pragma omp for
-#endif
-      for(int i1 = 0; i1 < img2.height; i1++)
-      {
-        memcpy(img2_bak.data, img2.data + (size_t)i1 * img2.width, sizeof(float) * img2.width);
-        box_min_1d(img2.width, img2_bak.data, img2.data + (size_t)i1 * img2.width, 1, w);
-      }
-      free_gray_image(&img2_bak);
-    }
-  }
-  else
-  {
-#ifdef _OPENMP
-#pragma omp parallel default(none) \
-    dt_omp_firstprivate(img1, img2, w) \
-    private(img2_bak)
-#endif
-    {
-#ifdef _OPENMP
-#pragma omp for
-#endif
-      for(int i1 = 0; i1 < img1.height; i1++)
-        box_min_1d(img1.width, img1.data + (size_t)i1 * img1.width, img2.data + (size_t)i1 * img2.width, 1, w);
-    }
-  }
-#ifdef _OPENMP
-#pragma omp parallel default(none) \
-  dt_omp_firstprivate(img1, img2, w) \
-  private(img2_bak)
-#endif
-  {
-    img2_bak = new_gray_image(1, img2.height);
-#ifdef _OPENMP
-#pragma omp for schedule(static)
-#endif
-    for(int i0 = 0; i0 < img1.width; i0++)
-    {
-      for(int i1 = 0; i1 < img1.height; i1++) img2_bak.data[i1] = img2.data[i0 + (size_t)i1 * img2.width];
-      box_min_1d(img1.height, img2_bak.data, img2.data + i0, img1.width, w);
-    }
-    free_gray_image(&img2_bak);
-  }
+  return box_extremum(img1, img2, w, FALSE);
 }
 
 
 // calculate the dark channel (minimal color component over a box of size (2*w+1) x (2*w+1) )
-static void dark_channel(const const_rgb_image img1, const gray_image img2, const int w)
+static int dark_channel(const const_rgb_image img1, const gray_image img2, const int w)
 {
   const size_t size = (size_t)img1.height * img1.width;
 #ifdef _OPENMP
@@ -518,12 +511,12 @@ static void dark_channel(const const_rgb_image img1, const gray_image img2, cons
     m = fminf(pixel[2], m);
     img2.data[i] = m;
   }
-  box_min(img2, img2, w);
+  return box_min(img2, img2, w);
 }
 
 
 // calculate the transition map
-static void transition_map(const const_rgb_image img1, const gray_image img2, const int w, const float *const A0,
+static int transition_map(const const_rgb_image img1, const gray_image img2, const int w, const float *const A0,
                            const float strength)
 {
   const size_t size = (size_t)img1.height * img1.width;
@@ -540,7 +533,7 @@ static void transition_map(const const_rgb_image img1, const gray_image img2, co
     m = fminf(pixel[2] / A0[2], m);
     img2.data[i] = 1.f - m * strength;
   }
-  box_max(img2, img2, w);
+  return box_max(img2, img2, w);
 }
 
 
@@ -610,7 +603,12 @@ static float ambient_light(const const_rgb_image img, int w1, rgb_pixel *pA0)
   const size_t size = (size_t)width * height;
   // calculate dark channel, which is an estimate for local amount of haze
   gray_image dark_ch = new_gray_image(width, height);
-  dark_channel(img, dark_ch, w1);
+  if(!dark_channel(img, dark_ch, w1))
+  {
+    free_gray_image(&dark_ch);
+    for(int c = 0; c < 3; c++) (*pA0)[c] = NAN;
+    return NAN;
+  }
   // determine the brightest pixels among the most hazy pixels
   gray_image bright_hazy = new_gray_image(width, height);
   // first determine the most hazy pixels
@@ -673,6 +671,95 @@ static float ambient_light(const const_rgb_image img, int w1, rgb_pixel *pA0)
 }
 
 
+// the statistics in ambient_light() are global and do not need the full resolution, larger
+// images are averaged down to about this size first.  this also is the size range the preview
+// pipe works at, which provides the values for the full pipe in darkroom.
+#define HAZEREMOVAL_STATS_SIZE 1024
+
+static float ambient_light_downscaled(const const_rgb_image img, int w1, rgb_pixel *pA0)
+{
+  const int f = (MAX(img.width, img.height) + HAZEREMOVAL_STATS_SIZE - 1) / HAZEREMOVAL_STATS_SIZE;
+  if(f <= 1) return ambient_light(img, w1, pA0);
+
+  const int width = img.width / f;
+  const int height = img.height / f;
+  float *const small = dt_alloc_align(64, sizeof(float) * 4 * width * height);
+  if(!small) return ambient_light(img, w1, pA0);
+
+  const float norm = 1.f / (f * f);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(img, small, width, height, f, norm) \
+  schedule(static)
+#endif
+  for(int i1 = 0; i1 < height; i1++)
+    for(int i0 = 0; i0 < width; i0++)
+    {
+      float sum[3] = { 0.f, 0.f, 0.f };
+      for(int j1 = i1 * f; j1 < (i1 + 1) * f; j1++)
+        for(int j0 = i0 * f; j0 < (i0 + 1) * f; j0++)
+        {
+          const float *pixel = img.data + ((size_t)j1 * img.width + j0) * img.stride;
+          for(int c = 0; c < 3; c++) sum[c] += pixel[c];
+        }
+      float *out = small + ((size_t)i1 * width + i0) * 4;
+      for(int c = 0; c < 3; c++) out[c] = sum[c] * norm;
+      out[3] = 0.f;
+    }
+
+  const float distance_max = ambient_light((const_rgb_image){ small, width, height, 4 }, w1, pA0);
+  dt_free_align(small);
+  return distance_max;
+}
+
+
+static uint64_t stats_hash(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece)
+{
+  return dt_dev_hash_plus(self->dev, piece->pipe, self->iop_order, DT_DEV_TRANSFORM_DIR_BACK_EXCL);
+}
+
+
+// look up ambient light and maximal depth for the input of this piece, NAN if not known yet
+static float stats_lookup(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const uint64_t hash,
+                          const int width, const int height, rgb_pixel *pA0)
+{
+  dt_iop_hazeremoval_global_data_t *gd = self->global_data;
+  float distance_max = NAN;
+  if(hash == 0) return distance_max;
+  dt_pthread_mutex_lock(&gd->stats_lock);
+  for(int k = 0; k < HAZEREMOVAL_STATS; k++)
+  {
+    const dt_iop_hazeremoval_stats_t *st = gd->stats + k;
+    if(st->hash == hash && st->imgid == piece->pipe->image.id && st->width == width && st->height == height)
+    {
+      for(int c = 0; c < 3; c++) (*pA0)[c] = st->A0[c];
+      distance_max = st->distance_max;
+      break;
+    }
+  }
+  dt_pthread_mutex_unlock(&gd->stats_lock);
+  return distance_max;
+}
+
+
+static void stats_store(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const uint64_t hash,
+                        const int width, const int height, const rgb_pixel A0, const float distance_max)
+{
+  dt_iop_hazeremoval_global_data_t *gd = self->global_data;
+  if(hash == 0 || isnan(A0[0])) return;
+  dt_pthread_mutex_lock(&gd->stats_lock);
+  dt_iop_hazeremoval_stats_t *st = gd->stats + gd->stats_next;
+  gd->stats_next = (gd->stats_next + 1) % HAZEREMOVAL_STATS;
+  st->imgid = piece->pipe->image.id;
+  st->hash = hash;
+  st->width = width;
+  st->height = height;
+  for(int c = 0; c < 3; c++) st->A0[c] = A0[c];
+  st->distance_max = distance_max;
+  dt_pthread_mutex_unlock(&gd->stats_lock);
+}
+
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -729,8 +816,18 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     distance_max = g->distance_max;
     dt_pthread_mutex_unlock(&g->lock);
   }
-  // In all other cases we calculate distance_max and A0 here.
-  if(isnan(distance_max)) distance_max = ambient_light(img_in, w1, &A0);
+  // In all other cases we calculate distance_max and A0 here, unless they are known
+  // already for the same input.
+  if(isnan(distance_max))
+  {
+    const uint64_t hash = stats_hash(self, piece);
+    distance_max = stats_lookup(self, piece, hash, width, height, &A0);
+    if(isnan(distance_max))
+    {
+      distance_max = ambient_light_downscaled(img_in, w1, &A0);
+      stats_store(self, piece, hash, width, height, A0, distance_max);
+    }
+  }
   // PREVIEW pixelpipe stores values.
   if(self->dev->gui_attached && g && piece->pipe->type == DT_DEV_PIXELPIPE_PREVIEW)
   {
@@ -746,10 +843,15 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
   // calculate the transition map
   gray_image trans_map = new_gray_image(width, height);
-  transition_map(img_in, trans_map, w1, A0, strength);
-
-  // refine the transition map
-  box_min(trans_map, trans_map, w1);
+  // and refine it. without the scratch memory for the box filters the image is passed through unchanged
+  if(isnan(distance_max) || !transition_map(img_in, trans_map, w1, A0, strength)
+     || !box_min(trans_map, trans_map, w1))
+  {
+    fprintf(stderr, "[hazeremoval] failed to allocate scratch buffers, skipping\n");
+    free_gray_image(&trans_map);
+    memcpy(ovoid, ivoid, sizeof(float) * ch * width * height);
+    return;
+  }
   gray_image trans_map_filtered = new_gray_image(width, height);
   // apply guided filter with no clipping
   guided_filter(img_in.data, trans_map.data, trans_map_filtered.data, width, height, ch, w2, eps, 1.f, -FLT_MAX,
@@ -799,7 +901,7 @@ static float ambient_light_cl(struct dt_iop_module_t *self, int devid, cl_mem im
   int err = dt_opencl_read_host_from_device(devid, in, img, width, height, element_size);
   if(err != CL_SUCCESS) goto error;
   const const_rgb_image img_in = (const_rgb_image){ in, width, height, element_size / sizeof(float) };
-  const float max_depth = ambient_light(img_in, w1, pA0);
+  const float max_depth = ambient_light_downscaled(img_in, w1, pA0);
   dt_free_align(in);
   return max_depth;
 error:
@@ -981,8 +1083,20 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     distance_max = g->distance_max;
     dt_pthread_mutex_unlock(&g->lock);
   }
-  // In all other cases we calculate distance_max and A0 here.
-  if(isnan(distance_max)) distance_max = ambient_light_cl(self, devid, img_in, w1, &A0);
+  // In all other cases we calculate distance_max and A0 here, unless they are known
+  // already for the same input.
+  if(isnan(distance_max))
+  {
+    const uint64_t hash = stats_hash(self, piece);
+    distance_max = stats_lookup(self, piece, hash, width, height, &A0);
+    if(isnan(distance_max))
+    {
+      distance_max = ambient_light_cl(self, devid, img_in, w1, &A0);
+      stats_store(self, piece, hash, width, height, A0, distance_max);
+    }
+  }
+  // no ambient light without host memory, leave it to the cpu path
+  if(isnan(distance_max)) return FALSE;
   // PREVIEW pixelpipe stores values.
   if(self->dev->gui_attached && g && piece->pipe->type == DT_DEV_PIXELPIPE_PREVIEW)
   {
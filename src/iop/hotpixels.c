@@ -117,48 +117,64 @@ static int process_bayer(const dt_iop_hotpixels_data_t *data,
   int fixed = 0;
 
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
+#pragma omp parallel default(none) \
   dt_omp_firstprivate(ivoid, markfixed, min_neighbours, multiplier, ovoid, \
                       roi_out, threshold, width, widthx2) \
-  reduction(+ : fixed) \
-  schedule(static)
+  reduction(+ : fixed)
 #endif
-  for(int row = 2; row < roi_out->height - 2; row++)
   {
-    const float *in = (float *)ivoid + (size_t)width * row + 2;
-    float *out = (float *)ovoid + (size_t)width * row + 2;
-    for(int col = 2; col < width - 2; col++, in++, out++)
+    // per row: replacement value and whether the pixel is hot
+    float *const maxins = dt_alloc_align(64, sizeof(float) * width);
+    int *const hot = dt_alloc_align(64, sizeof(int) * width);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for(int row = 2; row < roi_out->height - 2; row++)
     {
-      float mid = *in * multiplier;
-      if(*in > threshold)
+      const float *const in = (float *)ivoid + (size_t)width * row;
+      float *const out = (float *)ovoid + (size_t)width * row;
+
+      // test all pixels of the row without branching, the same coloured neighbours are
+      // two pixels apart in both directions
+#ifdef _OPENMP
+#pragma omp simd aligned(maxins, hot : 64)
+#endif
+      for(int col = 2; col < width - 2; col++)
       {
+        const float mid = in[col] * multiplier;
         int count = 0;
-        float maxin = 0.0;
-        float other;
+        float maxin = 0.0f;
 #define TESTONE(OFFSET)                                                                                      \
-  other = in[OFFSET];                                                                                        \
-  if(mid > other)                                                                                            \
   {                                                                                                          \
-    count++;                                                                                                 \
-    if(other > maxin) maxin = other;                                                                         \
+    const float other = in[col + (OFFSET)];                                                                  \
+    const int darker = mid > other;                                                                          \
+    count += darker;                                                                                         \
+    maxin = (darker && other > maxin) ? other : maxin;                                                       \
   }
         TESTONE(-2);
         TESTONE(-widthx2);
         TESTONE(+2);
         TESTONE(+widthx2);
 #undef TESTONE
-        if(count >= min_neighbours)
+        maxins[col] = maxin;
+        hot[col] = (in[col] > threshold) & (count >= min_neighbours);
+      }
+
+      // and only then replace the few hot ones
+      for(int col = 2; col < width - 2; col++)
+      {
+        if(!hot[col]) continue;
+        out[col] = maxins[col];
+        fixed++;
+        if(markfixed)
         {
-          *out = maxin;
-          fixed++;
-          if(markfixed)
-          {
-            for(int i = -2; i >= -10 && i >= -col; i -= 2) out[i] = *in;
-            for(int i = 2; i <= 10 && i < width - col; i += 2) out[i] = *in;
-          }
+          for(int i = -2; i >= -10 && i >= -col; i -= 2) out[col + i] = in[col];
+          for(int i = 2; i <= 10 && i < width - col; i += 2) out[col + i] = in[col];
         }
       }
     }
+    dt_free_align(maxins);
+    dt_free_align(hot);
   }
 
   return fixed;
@@ -217,62 +233,77 @@ static int process_xtrans(const dt_iop_hotpixels_data_t *data,
   const int width = roi_out->width;
   int fixed = 0;
 
+  // the same offsets as linear offsets into the buffer, per cell
+  ptrdiff_t loffsets[6][6][4];
+  for(int j = 0; j < 6; ++j)
+    for(int i = 0; i < 6; ++i)
+      for(int n = 0; n < 4; ++n) loffsets[j][i][n] = offsets[j][i][n][0] + (ptrdiff_t)offsets[j][i][n][1] * width;
+
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
+#pragma omp parallel default(none) \
   dt_omp_firstprivate(ivoid, markfixed, min_neighbours, multiplier, ovoid, \
                       roi_out, threshold, xtrans, width) \
-  shared(offsets) \
-  reduction(+ : fixed) \
-  schedule(static)
+  shared(loffsets) \
+  reduction(+ : fixed)
 #endif
-  for(int row = 2; row < roi_out->height - 2; row++)
   {
-    const float *in = (float *)ivoid + (size_t)width * row + 2;
-    float *out = (float *)ovoid + (size_t)width * row + 2;
-    for(int col = 2; col < width - 2; col++, in++, out++)
+    float *const maxins = dt_alloc_align(64, sizeof(float) * width);
+    int *const hot = dt_alloc_align(64, sizeof(int) * width);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for(int row = 2; row < roi_out->height - 2; row++)
     {
-      float mid = *in * multiplier;
-      if(*in > threshold)
+      const float *const in = (float *)ivoid + (size_t)width * row;
+      float *const out = (float *)ovoid + (size_t)width * row;
+      const ptrdiff_t(*const rowoffsets)[4] = loffsets[row % 6];
+
+      // test all pixels of the row without branching, see process_bayer()
+      for(int col = 2; col < width - 2; col++)
       {
+        const ptrdiff_t *const off = rowoffsets[col % 6];
+        const float mid = in[col] * multiplier;
         int count = 0;
-        float maxin = 0.0;
+        float maxin = 0.0f;
         for(int n = 0; n < 4; ++n)
         {
-          int xx = offsets[row % 6][col % 6][n][0];
-          int yy = offsets[row % 6][col % 6][n][1];
-          float other = *(in + xx + yy * (size_t)width);
-          if(mid > other)
-          {
-            count++;
-            if(other > maxin) maxin = other;
-          }
+          const float other = in[col + off[n]];
+          const int darker = mid > other;
+          count += darker;
+          maxin = (darker && other > maxin) ? other : maxin;
         }
+        maxins[col] = maxin;
         // NOTE: it seems that detecting by 2 neighbors would help for extreme cases
-        if(count >= min_neighbours)
+        hot[col] = (in[col] > threshold) & (count >= min_neighbours);
+      }
+
+      for(int col = 2; col < width - 2; col++)
+      {
+        if(!hot[col]) continue;
+        out[col] = maxins[col];
+        fixed++;
+        if(markfixed)
         {
-          *out = maxin;
-          fixed++;
-          if(markfixed)
+          const uint8_t c = FCxtrans(row, col, roi_out, xtrans);
+          for(int i = -2; i >= -10 && i >= -col; --i)
           {
-            const uint8_t c = FCxtrans(row, col, roi_out, xtrans);
-            for(int i = -2; i >= -10 && i >= -col; --i)
+            if(c == FCxtrans(row, col+i, roi_out, xtrans))
             {
-              if(c == FCxtrans(row, col+i, roi_out, xtrans))
-              {
-                out[i] = *in;
-              }
+              out[col + i] = in[col];
             }
-            for(int i = 2; i <= 10 && i < width - col; ++i)
+          }
+          for(int i = 2; i <= 10 && i < width - col; ++i)
+          {
+            if(c == FCxtrans(row, col+i, roi_out, xtrans))
             {
-              if(c == FCxtrans(row, col+i, roi_out, xtrans))
-              {
-                out[i] = *in;
-              }
+              out[col + i] = in[col];
             }
           }
         }
       }
     }
+    dt_free_align(maxins);
+    dt_free_align(hot);
   }
 
   return fixed;
@@ -183,6 +183,14 @@ void process_tiling(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
                     void *const o, const struct dt_iop_roi_t *const roi_in,
                     const struct dt_iop_roi_t *const roi_out, const int bpp);
 
+/** optional per-pixel kernel of a point-wise process(), lets the pipe fuse runs of such modules into a
+  * single pass without intermediate buffers. process_pixels_setup() is called once per run in place of
+  * process() and does everything besides touching pixels (e.g. updating piece->pipe->dsc).
+  * process_pixels() is then called concurrently on chunks of npixels 4-channel pixels, in may equal out. */
+void process_pixels_setup(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
+void process_pixels(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
+                    float *const out, const size_t npixels);
+
 #if defined(__SSE__)
 /** a variant process(), that can contain SSE2 intrinsics. */
 /** can be provided by each IOP. */
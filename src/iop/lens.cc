@@ -122,6 +122,8 @@ typedef struct dt_iop_lensfun_global_data_t
   int kernel_lens_distort_lanczos2;
   int kernel_lens_distort_lanczos3;
   int kernel_lens_vignette;
+  GList *grids;               // dt_iop_lensfun_grid_t, most recently used first
+  dt_pthread_mutex_t grid_lock;
 } dt_iop_lensfun_global_data_t;
 
 typedef struct dt_iop_lensfun_data_t
@@ -137,9 +139,32 @@ typedef struct dt_iop_lensfun_data_t
   lfLensType target_geom;
   gboolean do_nan_checks;
   gboolean tca_override;
+  float tca_r, tca_b;
   lfLensCalibTCA custom_tca;
 } dt_iop_lensfun_data_t;
 
+/*
+ * the corrections only depend on camera, lens, shooting settings and the size of the image,
+ * so they are sampled once on a coarse grid over the whole image and interpolated from there.
+ * grids are kept for a few settings and shared between pipes and images shot the same way.
+ */
+#define LENSFUN_GRID_STEP 16      // initial node spacing in pixels
+#define LENSFUN_GRID_MIN_STEP 4   // finer than this and we rather ask lensfun for every pixel
+#define LENSFUN_GRID_MAX_ERROR 0.05f  // in pixels, for the interpolated coordinates
+#define LENSFUN_GRID_MAX_VIGNETTE_ERROR 1e-3f  // relative, for the interpolated vignetting gain
+#define LENSFUN_GRIDS 6
+
+typedef struct dt_iop_lensfun_grid_t
+{
+  gchar *key;
+  int modflags;
+  int step;        // node spacing in pixels, 0 if no grid met the error bounds
+  int gw, gh;      // number of nodes per row and column
+  float *coords;   // gw * gh nodes of 3 (x,y) pairs, as returned by ApplySubpixelGeometryDistortion
+  float *vignette; // gw * gh gains of the vignetting correction
+  int refs;
+} dt_iop_lensfun_grid_t;
+
 
 const char *name()
 {
@@ -385,6 +410,253 @@ static lfModifier * get_modifier(int *mods_done, int w, int h, const dt_iop_lens
   return mod;
 }
 
+static gchar *_grid_key(const dt_iop_lensfun_data_t *d, const int w, const int h)
+{
+  return g_strdup_printf("%s|%s|%d|%d|%d|%d|%a|%a|%a|%a|%a|%d|%d|%a|%a", d->lens->Maker,
+                         d->lens->Model ? d->lens->Model : "", w, h, d->modify_flags & LF_MODIFY_ALL, d->inverse,
+                         d->crop, d->focal, d->aperture, d->distance, d->scale, (int)d->target_geom,
+                         d->tca_override, d->tca_r, d->tca_b);
+}
+
+static void _grid_free(dt_iop_lensfun_grid_t *grid)
+{
+  if(!grid) return;
+  g_free(grid->key);
+  dt_free_align(grid->coords);
+  dt_free_align(grid->vignette);
+  free(grid);
+}
+
+static inline void _grid_locate(const dt_iop_lensfun_grid_t *const grid, const float x, const int n, int *i,
+                                float *t)
+{
+  const float f = x / grid->step;
+  *i = CLAMP((int)f, 0, n - 2);
+  *t = f - *i;
+}
+
+// interpolated version of ApplySubpixelGeometryDistortion() for one row
+static void _grid_distort_row(const dt_iop_lensfun_grid_t *const grid, const int x0, const int y, const int width,
+                              float *const out)
+{
+  int j, i;
+  float ty, tx;
+  _grid_locate(grid, y, grid->gh, &j, &ty);
+  const float *const r0 = grid->coords + (size_t)6 * j * grid->gw;
+  const float *const r1 = r0 + (size_t)6 * grid->gw;
+  for(int x = 0; x < width; x++)
+  {
+    _grid_locate(grid, x0 + x, grid->gw, &i, &tx);
+    const float *const a = r0 + 6 * i, *const b = r1 + 6 * i;
+    for(int c = 0; c < 6; c++)
+    {
+      const float top = a[c] + tx * (a[c + 6] - a[c]);
+      const float bottom = b[c] + tx * (b[c + 6] - b[c]);
+      out[6 * x + c] = top + ty * (bottom - top);
+    }
+  }
+}
+
+static inline float _grid_vignette_at(const dt_iop_lensfun_grid_t *const grid, const float x, const float y)
+{
+  int j, i;
+  float ty, tx;
+  _grid_locate(grid, y, grid->gh, &j, &ty);
+  _grid_locate(grid, x, grid->gw, &i, &tx);
+  const float *const a = grid->vignette + (size_t)j * grid->gw + i;
+  const float *const b = a + grid->gw;
+  const float top = a[0] + tx * (a[1] - a[0]);
+  const float bottom = b[0] + tx * (b[1] - b[0]);
+  return top + ty * (bottom - top);
+}
+
+// interpolated version of ApplyColorModification() for one row of ch channel pixels
+static void _grid_vignette_row(const dt_iop_lensfun_grid_t *const grid, float *const buf, const int x0,
+                               const int y, const int width, const int ch)
+{
+  for(int x = 0; x < width; x++)
+  {
+    const float gain = _grid_vignette_at(grid, x0 + x, y);
+    for(int c = 0; c < 3; c++) buf[(size_t)ch * x + c] *= gain;
+  }
+}
+
+static float _vignette_gain(lfModifier *modifier, const float x, const float y)
+{
+  float v[4] = { 0.5f, 0.5f, 0.5f, 0.5f };
+  modifier->ApplyColorModification(v, x, y, 1, 1, LF_CR_4(RED, GREEN, BLUE, UNKNOWN), 4);
+  return v[1] / 0.5f;
+}
+
+// sample the corrections every step pixels, and check the interpolation against lensfun in the middle of
+// every cell. returns FALSE if the error is too large (or lensfun returned non-finite coordinates).
+static gboolean _grid_sample(dt_iop_lensfun_grid_t *grid, lfModifier *modifier, const int w, const int h,
+                             const int step, float *max_error)
+{
+  const int gw = (w + step - 1) / step + 1, gh = (h + step - 1) / step + 1;
+  const gboolean geometry = grid->modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE);
+  const gboolean vignette = grid->modflags & LF_MODIFY_VIGNETTING;
+
+  dt_free_align(grid->coords);
+  dt_free_align(grid->vignette);
+  grid->coords = geometry ? (float *)dt_alloc_align(64, sizeof(float) * 6 * gw * gh) : NULL;
+  grid->vignette = vignette ? (float *)dt_alloc_align(64, sizeof(float) * gw * gh) : NULL;
+  if((geometry && !grid->coords) || (vignette && !grid->vignette)) return FALSE;
+  grid->step = step;
+  grid->gw = gw;
+  grid->gh = gh;
+
+  int finite = TRUE;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(geometry, vignette, gw, gh, step, grid, modifier) \
+  reduction(&&:finite) \
+  schedule(static)
+#endif
+  for(int j = 0; j < gh; j++)
+    for(int i = 0; i < gw; i++)
+    {
+      if(geometry)
+      {
+        float *node = grid->coords + (size_t)6 * (j * gw + i);
+        modifier->ApplySubpixelGeometryDistortion(i * step, j * step, 1, 1, node);
+        for(int c = 0; c < 6; c++) finite = finite && isfinite(node[c]);
+      }
+      if(vignette) grid->vignette[(size_t)j * gw + i] = _vignette_gain(modifier, i * step, j * step);
+    }
+  if(!finite) return FALSE;
+
+  float error = 0.0f, vignette_error = 0.0f;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(geometry, vignette, gw, gh, step, grid, modifier) \
+  reduction(max:error, vignette_error) \
+  schedule(static)
+#endif
+  for(int j = 0; j < gh - 1; j++)
+    for(int i = 0; i < gw - 1; i++)
+    {
+      const int x = i * step + step / 2, y = j * step + step / 2;
+      if(geometry)
+      {
+        float exact[6], approx[6];
+        modifier->ApplySubpixelGeometryDistortion(x, y, 1, 1, exact);
+        _grid_distort_row(grid, x, y, 1, approx);
+        for(int c = 0; c < 6; c++) error = fmaxf(error, fabsf(exact[c] - approx[c]));
+      }
+      if(vignette)
+      {
+        const float exact = _vignette_gain(modifier, x, y);
+        vignette_error = fmaxf(vignette_error, fabsf(_grid_vignette_at(grid, x, y) - exact) / fmaxf(exact, 1e-6f));
+      }
+    }
+
+  *max_error = error;
+  return error <= LENSFUN_GRID_MAX_ERROR && vignette_error <= LENSFUN_GRID_MAX_VIGNETTE_ERROR;
+}
+
+static dt_iop_lensfun_grid_t *_grid_build(gchar *key, const dt_iop_lensfun_data_t *d, const int w, const int h)
+{
+  dt_iop_lensfun_grid_t *grid = (dt_iop_lensfun_grid_t *)calloc(1, sizeof(dt_iop_lensfun_grid_t));
+  grid->key = key;
+
+  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
+  lfModifier *modifier = get_modifier(&grid->modflags, w, h, d, LF_MODIFY_ALL);
+  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+
+  float error = 0.0f;
+  int step = LENSFUN_GRID_STEP;
+  while(step >= LENSFUN_GRID_MIN_STEP && !_grid_sample(grid, modifier, w, h, step, &error)) step /= 2;
+  delete modifier;
+
+  if(step < LENSFUN_GRID_MIN_STEP)
+  {
+    dt_free_align(grid->coords);
+    dt_free_align(grid->vignette);
+    grid->coords = grid->vignette = NULL;
+    grid->step = 0;
+    dt_print(DT_DEBUG_PERF, "[lens] no remap grid within error bounds for %dx%d, using lensfun per pixel\n", w, h);
+  }
+  else
+    dt_print(DT_DEBUG_PERF, "[lens] remap grid for %dx%d every %d pixels, max error %g px\n", w, h, step,
+             error);
+  return grid;
+}
+
+// returns the grid for the given pipe and image size, NULL if lensfun has to be asked for every pixel
+static dt_iop_lensfun_grid_t *_grid_acquire(dt_iop_module_t *self, const dt_iop_lensfun_data_t *d, const int w,
+                                            const int h)
+{
+  dt_iop_lensfun_global_data_t *gd = (dt_iop_lensfun_global_data_t *)self->global_data;
+  gchar *key = _grid_key(d, w, h);
+
+  dt_pthread_mutex_lock(&gd->grid_lock);
+  for(GList *l = gd->grids; l; l = g_list_next(l))
+  {
+    dt_iop_lensfun_grid_t *grid = (dt_iop_lensfun_grid_t *)l->data;
+    if(!strcmp(grid->key, key))
+    {
+      g_free(key);
+      gd->grids = g_list_remove_link(gd->grids, l);
+      gd->grids = g_list_concat(l, gd->grids);
+      if(!grid->step)
+      {
+        dt_pthread_mutex_unlock(&gd->grid_lock);
+        return NULL;
+      }
+      grid->refs++;
+      dt_pthread_mutex_unlock(&gd->grid_lock);
+      return grid;
+    }
+  }
+  dt_pthread_mutex_unlock(&gd->grid_lock);
+
+  // sample without holding the lock, another pipe might have done the same meanwhile
+  dt_iop_lensfun_grid_t *grid = _grid_build(key, d, w, h);
+
+  dt_pthread_mutex_lock(&gd->grid_lock);
+  for(GList *l = gd->grids; l; l = g_list_next(l))
+  {
+    dt_iop_lensfun_grid_t *other = (dt_iop_lensfun_grid_t *)l->data;
+    if(!strcmp(other->key, grid->key))
+    {
+      _grid_free(grid);
+      grid = other;
+      break;
+    }
+  }
+  if(!g_list_find(gd->grids, grid))
+  {
+    gd->grids = g_list_prepend(gd->grids, grid);
+    // forget the least recently used grids nobody holds on to
+    GList *l = g_list_nth(gd->grids, LENSFUN_GRIDS);
+    while(l)
+    {
+      GList *next = g_list_next(l);
+      dt_iop_lensfun_grid_t *old = (dt_iop_lensfun_grid_t *)l->data;
+      if(!old->refs)
+      {
+        gd->grids = g_list_delete_link(gd->grids, l);
+        _grid_free(old);
+      }
+      l = next;
+    }
+  }
+  if(!grid->step) grid = NULL;
+  else grid->refs++;
+  dt_pthread_mutex_unlock(&gd->grid_lock);
+  return grid;
+}
+
+static void _grid_release(dt_iop_module_t *self, dt_iop_lensfun_grid_t *grid)
+{
+  if(!grid) return;
+  dt_iop_lensfun_global_data_t *gd = (dt_iop_lensfun_global_data_t *)self->global_data;
+  dt_pthread_mutex_lock(&gd->grid_lock);
+  grid->refs--;
+  dt_pthread_mutex_unlock(&gd->grid_lock);
+}
+
 void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid, void *const ovoid,
              const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -405,12 +677,17 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
   const float orig_w = roi_in->scale * piece->buf_in.width, orig_h = roi_in->scale * piece->buf_in.height;
 
-  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
-
   int modflags;
-  lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
-
-  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+  lfModifier *modifier = NULL;
+  dt_iop_lensfun_grid_t *const grid = _grid_acquire(self, d, orig_w, orig_h);
+  if(grid)
+    modflags = grid->modflags;
+  else
+  {
+    dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
+    modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
+    dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+  }
 
   const struct dt_interpolation *const interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF);
 
@@ -425,7 +702,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(bufsize, ch, ch_width, d, interpolation, ivoid, \
+      dt_omp_firstprivate(bufsize, ch, ch_width, d, grid, interpolation, ivoid, \
                           mask_display, ovoid, roi_in, roi_out) \
       shared(buf, modifier) \
       schedule(static)
@@ -433,7 +710,10 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
       for(int y = 0; y < roi_out->height; y++)
       {
         float *bufptr = ((float *)buf) + (size_t)bufsize * dt_get_thread_num();
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, bufptr);
+        if(grid)
+          _grid_distort_row(grid, roi_out->x, roi_out->y + y, roi_out->width, bufptr);
+        else
+          modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, bufptr);
 
         // reverse transform the global coords from lf to our buffer
         float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
@@ -482,7 +762,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
     {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(ch, pixelformat, roi_out, ovoid) \
+      dt_omp_firstprivate(ch, grid, pixelformat, roi_out, ovoid) \
       shared(modifier) \
       schedule(static)
 #endif
@@ -491,8 +771,11 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
         /* Colour correction: vignetting */
         // actually this way row stride does not matter.
         float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
-        modifier->ApplyColorModification(out, roi_out->x, roi_out->y + y, roi_out->width, 1,
-                                         pixelformat, ch * roi_out->width);
+        if(grid)
+          _grid_vignette_row(grid, out, roi_out->x, roi_out->y + y, roi_out->width, ch);
+        else
+          modifier->ApplyColorModification(out, roi_out->x, roi_out->y + y, roi_out->width, 1,
+                                           pixelformat, ch * roi_out->width);
       }
     }
   }
@@ -507,7 +790,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
     {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(ch, pixelformat, roi_in) \
+      dt_omp_firstprivate(ch, grid, pixelformat, roi_in) \
       shared(buf, modifier) \
       schedule(static)
 #endif
@@ -516,8 +799,11 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
         /* Colour correction: vignetting */
         // actually this way row stride does not matter.
         float *bufptr = ((float *)buf) + (size_t)ch * roi_in->width * y;
-        modifier->ApplyColorModification(bufptr, roi_in->x, roi_in->y + y, roi_in->width, 1,
-                                         pixelformat, ch * roi_in->width);
+        if(grid)
+          _grid_vignette_row(grid, bufptr, roi_in->x, roi_in->y + y, roi_in->width, ch);
+        else
+          modifier->ApplyColorModification(bufptr, roi_in->x, roi_in->y + y, roi_in->width, 1,
+                                           pixelformat, ch * roi_in->width);
       }
     }
 
@@ -529,15 +815,18 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(buf2size, ch, ch_width, d, interpolation, mask_display, ovoid, roi_in, roi_out) \
+      dt_omp_firstprivate(buf2size, ch, ch_width, d, grid, interpolation, mask_display, ovoid, roi_in, roi_out) \
       shared(buf2, buf, modifier) \
       schedule(static)
 #endif
       for(int y = 0; y < roi_out->height; y++)
       {
         float *buf2ptr = ((float *)buf2) + (size_t)buf2size * dt_get_thread_num();
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width,
-                                                  1, buf2ptr);
+        if(grid)
+          _grid_distort_row(grid, roi_out->x, roi_out->y + y, roi_out->width, buf2ptr);
+        else
+          modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width,
+                                                    1, buf2ptr);
         // reverse transform the global coords from lf to our buffer
         float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
         for(int x = 0; x < roi_out->width; x++, buf2ptr += 6, out += ch)
@@ -583,6 +872,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
     dt_free_align(buf);
   }
   delete modifier;
+  _grid_release(self, grid);
 
   if(self->dev->gui_attached && g && piece->pipe->type == DT_DEV_PIXELPIPE_PREVIEW)
   {
@@ -606,6 +896,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
   float *tmpbuf = NULL;
   lfModifier *modifier = NULL;
+  dt_iop_lensfun_grid_t *grid = NULL;
 
   const int devid = piece->pipe->devid;
   const int iwidth = roi_in->width;
@@ -669,9 +960,15 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   dev_tmpbuf = (cl_mem)dt_opencl_alloc_device_buffer(devid, tmpbuflen);
   if(dev_tmpbuf == NULL) goto error;
 
-  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
-  modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
-  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+  grid = _grid_acquire(self, d, orig_w, orig_h);
+  if(grid)
+    modflags = grid->modflags;
+  else
+  {
+    dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
+    modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
+    dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+  }
 
   if(d->inverse)
   {
@@ -680,14 +977,17 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(tmpbufwidth, roi_out) \
+      dt_omp_firstprivate(grid, tmpbufwidth, roi_out) \
       shared(tmpbuf, d, modifier) \
       schedule(static)
 #endif
       for(int y = 0; y < roi_out->height; y++)
       {
         float *pi = tmpbuf + (size_t)y * tmpbufwidth;
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, pi);
+        if(grid)
+          _grid_distort_row(grid, roi_out->x, roi_out->y + y, roi_out->width, pi);
+        else
+          modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, pi);
       }
 
       /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
@@ -718,7 +1018,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(ch, pixelformat, roi_out) \
+      dt_omp_firstprivate(ch, grid, pixelformat, roi_out) \
       shared(tmpbuf, modifier, d) \
       schedule(static)
 #endif
@@ -728,8 +1028,11 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
         // actually this way row stride does not matter.
         float *buf = tmpbuf + (size_t)y * ch * roi_out->width;
         for(int k = 0; k < ch * roi_out->width; k++) buf[k] = 0.5f;
-        modifier->ApplyColorModification(buf, roi_out->x, roi_out->y + y, roi_out->width, 1,
-                                         pixelformat, ch * roi_out->width);
+        if(grid)
+          _grid_vignette_row(grid, buf, roi_out->x, roi_out->y + y, roi_out->width, ch);
+        else
+          modifier->ApplyColorModification(buf, roi_out->x, roi_out->y + y, roi_out->width, 1,
+                                           pixelformat, ch * roi_out->width);
       }
 
       /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
@@ -760,7 +1063,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(ch, pixelformat, roi_in) \
+      dt_omp_firstprivate(ch, grid, pixelformat, roi_in) \
       shared(tmpbuf, modifier, d) \
       schedule(static)
 #endif
@@ -770,8 +1073,11 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
         // actually this way row stride does not matter.
         float *buf = tmpbuf + (size_t)y * ch * roi_in->width;
         for(int k = 0; k < ch * roi_in->width; k++) buf[k] = 0.5f;
-        modifier->ApplyColorModification(buf, roi_in->x, roi_in->y + y, roi_in->width, 1,
-                                         pixelformat, ch * roi_in->width);
+        if(grid)
+          _grid_vignette_row(grid, buf, roi_in->x, roi_in->y + y, roi_in->width, ch);
+        else
+          modifier->ApplyColorModification(buf, roi_in->x, roi_in->y + y, roi_in->width, 1,
+                                           pixelformat, ch * roi_in->width);
       }
 
       /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
@@ -797,14 +1103,17 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(tmpbufwidth, roi_out) \
+      dt_omp_firstprivate(grid, tmpbufwidth, roi_out) \
       shared(tmpbuf, d, modifier) \
       schedule(static)
 #endif
       for(int y = 0; y < roi_out->height; y++)
       {
         float *pi = tmpbuf + (size_t)y * tmpbufwidth;
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, pi);
+        if(grid)
+          _grid_distort_row(grid, roi_out->x, roi_out->y + y, roi_out->width, pi);
+        else
+          modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, pi);
       }
 
       /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
@@ -843,6 +1152,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   dt_opencl_release_mem_object(dev_tmp);
   if(tmpbuf != NULL) dt_free_align(tmpbuf);
   if(modifier != NULL) delete modifier;
+  _grid_release(self, grid);
   return TRUE;
 
 error:
@@ -850,6 +1160,7 @@ error:
   dt_opencl_release_mem_object(dev_tmpbuf);
   if(tmpbuf != NULL) dt_free_align(tmpbuf);
   if(modifier != NULL) delete modifier;
+  _grid_release(self, grid);
   dt_print(DT_DEBUG_OPENCL, "[opencl_lens] couldn't enqueue kernel! %d\n", err);
   return FALSE;
 }
@@ -1200,6 +1511,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   d->target_geom = p->target_geom;
   d->do_nan_checks = TRUE;
   d->tca_override = p->tca_override;
+  d->tca_r = p->tca_r;
+  d->tca_b = p->tca_b;
 
   /*
    * there are certain situations when LensFun can return NAN coordinated.
@@ -1245,6 +1558,7 @@ void init_global(dt_iop_module_so_t *module)
   gd->kernel_lens_distort_lanczos2 = dt_opencl_create_kernel(program, "lens_distort_lanczos2");
   gd->kernel_lens_distort_lanczos3 = dt_opencl_create_kernel(program, "lens_distort_lanczos3");
   gd->kernel_lens_vignette = dt_opencl_create_kernel(program, "lens_vignette");
+  dt_pthread_mutex_init(&gd->grid_lock, NULL);
 
   lfDatabase *dt_iop_lensfun_db = new lfDatabase;
   gd->db = (lfDatabase *)dt_iop_lensfun_db;
@@ -1455,6 +1769,8 @@ void cleanup_global(dt_iop_module_so_t *module)
   dt_opencl_free_kernel(gd->kernel_lens_distort_lanczos2);
   dt_opencl_free_kernel(gd->kernel_lens_distort_lanczos3);
   dt_opencl_free_kernel(gd->kernel_lens_vignette);
+  g_list_free_full(gd->grids, (GDestroyNotify)_grid_free);
+  dt_pthread_mutex_destroy(&gd->grid_lock);
   free(module->data);
   module->data = NULL;
 }
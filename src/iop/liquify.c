@@ -259,6 +259,49 @@ typedef struct
   int warp_kernel;
 } dt_iop_liquify_global_data_t;
 
+#define LIQUIFY_PATHS 2
+#define LIQUIFY_MAPS 4
+// displacements below this many pixels left over in a map after taking warps back out are rounding residue
+#define LIQUIFY_MAP_RESIDUE (1.0f / 256.0f)
+
+// the interpolated warps of the params, as seen by the piece at one scale
+
+typedef struct
+{
+  uint64_t hash;            ///< hash of the distorted params the warps were interpolated from
+  dt_liquify_warp_t *warps;
+  int num_warps;
+  uint64_t used;
+} dt_iop_liquify_paths_t;
+
+// a distortion map: the stamps of all warps, clipped to extent
+
+typedef struct
+{
+  uint64_t hash;            ///< hash of the warps, 0 while unused or being updated
+  gboolean inverted;
+  gboolean orphan;          ///< not in the cache, freed on release
+  cairo_rectangle_int_t extent;
+  dt_liquify_warp_t *warps; ///< the warps of a forward map, to find out what changed
+  int num_warps;
+  float complex *map;
+  int refs;
+  uint64_t used;
+} dt_iop_liquify_map_t;
+
+// piece data: the params plus the warps and maps built from them. modify_roi_in, process,
+// distort_mask and the point transforms all need the same warps, and the maps only change
+// where a warp was edited.
+
+typedef struct
+{
+  dt_iop_liquify_params_t params;
+  dt_pthread_mutex_t lock;  ///< protects the caches below
+  dt_iop_liquify_paths_t paths[LIQUIFY_PATHS];
+  dt_iop_liquify_map_t maps[LIQUIFY_MAPS];
+  uint64_t clock;
+} dt_iop_liquify_data_t;
+
 typedef struct
 {
   dt_pthread_mutex_t lock;
@@ -1029,7 +1072,9 @@ static void build_round_stamp (float complex **pstamp,
   Applies a stamp at a specified position.
 
   Applies a stamp at the position specified by @a point and adds the
-  resulting vector field to the global distortion map @a global_map.
+  resulting vector field, times @a weight, to the global distortion
+  map @a global_map. A weight of -1 applies the warp, +1 takes it
+  back out again.
 
   The global distortion map is a map of relative pixel displacements
   encompassing all our paths.
@@ -1039,7 +1084,8 @@ static void add_to_global_distortion_map (float complex *global_map,
                                           const cairo_rectangle_int_t *global_map_extent,
                                           const dt_liquify_warp_t *warp,
                                           const float complex *stamp,
-                                          const cairo_rectangle_int_t *stamp_extent)
+                                          const cairo_rectangle_int_t *stamp_extent,
+                                          const float weight)
 {
   cairo_rectangle_int_t mmext = *stamp_extent;
   mmext.x += (int) round (creal (warp->point));
@@ -1063,7 +1109,7 @@ static void add_to_global_distortion_map (float complex *global_map,
 
     for (int x = cmmext.x; x < cmmext.x + cmmext.width; x++)
     {
-      destrow[x - global_map_extent->x] -= srcrow[x - mmext.x];
+      destrow[x - global_map_extent->x] += weight * srcrow[x - mmext.x];
     }
   }
 }
@@ -1140,18 +1186,18 @@ static void apply_global_distortion_map (struct dt_iop_module_t *module,
 // calculate the map extent.
 
 static void _get_map_extent (const dt_iop_roi_t *roi_out,
-                             GList *interpolated,
+                             const dt_liquify_warp_t *warps,
+                             const int num_warps,
                              cairo_rectangle_int_t *map_extent)
 {
   const cairo_rectangle_int_t roi_out_rect = { roi_out->x, roi_out->y, roi_out->width, roi_out->height };
   cairo_region_t *roi_out_region = cairo_region_create_rectangle (&roi_out_rect);
   cairo_region_t *map_region = cairo_region_create ();
 
-  for (GList *i = interpolated; i != NULL; i = i->next)
+  for (int i = 0; i < num_warps; i++)
   {
-    const dt_liquify_warp_t *warp = ((dt_liquify_warp_t *) i->data);
     cairo_rectangle_int_t r;
-    compute_round_stamp_extent (&r, warp);
+    compute_round_stamp_extent (&r, &warps[i]);
     // add extent if not entirely outside the roi
     if (cairo_region_contains_rectangle (roi_out_region, &r) != CAIRO_REGION_OVERLAP_OUT)
     {
@@ -1165,107 +1211,436 @@ static void _get_map_extent (const dt_iop_roi_t *roi_out,
   cairo_region_destroy (roi_out_region);
 }
 
-static float complex *create_global_distortion_map (const cairo_rectangle_int_t *map_extent,
-                                                    GList *interpolated,
-                                                    gboolean inverted)
+static void _stamp_warps (float complex *map,
+                          const cairo_rectangle_int_t *map_extent,
+                          const dt_liquify_warp_t *warps,
+                          const int num_warps,
+                          const float weight)
 {
-  // allocate distortion map big enough to contain all paths
-  const int mapsize = map_extent->width * map_extent->height;
-  float complex * map = dt_alloc_align(64, mapsize * sizeof (float complex));
-  memset (map, 0, mapsize * sizeof (float complex));
-
-  // build map
-  for (GList *i = interpolated; i != NULL; i = i->next)
+  for (int i = 0; i < num_warps; i++)
   {
-    const dt_liquify_warp_t *warp = ((dt_liquify_warp_t *) i->data);
     float complex *stamp = NULL;
     cairo_rectangle_int_t r;
-    build_round_stamp (&stamp, &r, warp);
-    add_to_global_distortion_map (map, map_extent, warp, stamp, &r);
+    build_round_stamp (&stamp, &r, &warps[i]);
+    add_to_global_distortion_map (map, map_extent, &warps[i], stamp, &r, weight);
     free ((void *) stamp);
   }
+}
 
-  if (inverted)
-  {
-    float complex * const imap = dt_alloc_align (64, mapsize * sizeof (float complex));
-    memset (imap, 0, mapsize * sizeof (float complex));
+/*
+  Taking warps back out of a map leaves float residue where they were
+  stamped, which would send unwarped pixels through the interpolation.
+  Snap what is left below LIQUIFY_MAP_RESIDUE under these warps to an
+  exact zero, as a map built from scratch has there.
+*/
 
-    // copy map into imap (inverted map).
-    // imap [ n + dx(map[n]) , n + dy(map[n]) ] = -map[n]
+static void _snap_map_residue (float complex *map,
+                               const cairo_rectangle_int_t *map_extent,
+                               const dt_liquify_warp_t *warps,
+                               const int num_warps)
+{
+  for (int i = 0; i < num_warps; i++)
+  {
+    cairo_rectangle_int_t r;
+    compute_round_stamp_extent (&r, &warps[i]);
+    // the stamp is placed at the rounded point, the extent at the truncated one
+    const int x0 = MAX (r.x - 1, map_extent->x);
+    const int y0 = MAX (r.y - 1, map_extent->y);
+    const int x1 = MIN (r.x + r.width + 1, map_extent->x + map_extent->width);
+    const int y1 = MIN (r.y + r.height + 1, map_extent->y + map_extent->height);
 
     #ifdef _OPENMP
     #pragma omp parallel for schedule (static) default (shared)
     #endif
 
-    for (int y = 0; y <  map_extent->height; y++)
+    for (int y = y0; y < y1; y++)
     {
-      const float complex *row = map + y * map_extent->width;
-      for (int x = 0; x < map_extent->width; x++)
-      {
-        const float complex d = *(row + x);
-        // compute new position (nx,ny) given the displacement d
-        const int nx = x + (int)creal(d);
-        const int ny = y + (int)cimag(d);
-
-        // if the point falls into the extent, set it
-        if (nx>0 && nx<map_extent->width && ny>0 && ny<map_extent->height)
-          imap[nx + ny * map_extent->width] = -d;
-      }
+      float complex *row = map + (size_t)(y - map_extent->y) * map_extent->width - map_extent->x;
+      for (int x = x0; x < x1; x++)
+        if (fabsf (crealf (row[x])) < LIQUIFY_MAP_RESIDUE && fabsf (cimagf (row[x])) < LIQUIFY_MAP_RESIDUE)
+          row[x] = 0;
     }
+  }
+}
+
+static float complex *create_global_distortion_map (const cairo_rectangle_int_t *map_extent,
+                                                    const dt_liquify_warp_t *warps,
+                                                    const int num_warps)
+{
+  // allocate distortion map big enough to contain all paths
+  const int mapsize = map_extent->width * map_extent->height;
+  float complex * map = dt_alloc_align(64, mapsize * sizeof (float complex));
+  if (map == NULL) return NULL;
+  memset (map, 0, mapsize * sizeof (float complex));
+
+  // build map
+  _stamp_warps (map, map_extent, warps, num_warps, -1.0f);
 
-    dt_free_align ((void *) map);
+  return map;
+}
 
-    // now just do a pass to avoid gap with a displacement of zero, note that we do not need high
-    // precision here as the inverted distortion mask is only used to compute a final displacement
-    // of points.
+// invert the part of the distortion map that covers extent
 
-    #ifdef _OPENMP
-    #pragma omp parallel for schedule (dynamic) default (shared)
-    #endif
+static float complex *invert_global_distortion_map (const float complex *map,
+                                                    const cairo_rectangle_int_t *map_extent,
+                                                    const cairo_rectangle_int_t *extent)
+{
+  const int mapsize = extent->width * extent->height;
+  float complex * const imap = dt_alloc_align (64, mapsize * sizeof (float complex));
+  if (imap == NULL) return NULL;
+  memset (imap, 0, mapsize * sizeof (float complex));
 
-    for (int y = 0; y <  map_extent->height; y++)
+  // copy map into imap (inverted map).
+  // imap [ n + dx(map[n]) , n + dy(map[n]) ] = -map[n]
+
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule (static) default (shared)
+  #endif
+
+  for (int y = 0; y <  extent->height; y++)
+  {
+    const float complex *row = map + (y + extent->y - map_extent->y) * map_extent->width
+                               + extent->x - map_extent->x;
+    for (int x = 0; x < extent->width; x++)
+    {
+      const float complex d = *(row + x);
+      // compute new position (nx,ny) given the displacement d
+      const int nx = x + (int)creal(d);
+      const int ny = y + (int)cimag(d);
+
+      // if the point falls into the extent, set it
+      if (nx>0 && nx<extent->width && ny>0 && ny<extent->height)
+        imap[nx + ny * extent->width] = -d;
+    }
+  }
+
+  // now just do a pass to avoid gap with a displacement of zero, note that we do not need high
+  // precision here as the inverted distortion mask is only used to compute a final displacement
+  // of points.
+
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule (dynamic) default (shared)
+  #endif
+
+  for (int y = 0; y <  extent->height; y++)
+  {
+    float complex *row = imap + y * extent->width;
+    float complex last[2] = { 0, 0 };
+    for (int x = 0; x < extent->width / 2 + 1; x++)
     {
-      float complex *row = imap + y * map_extent->width;
-      float complex last[2] = { 0, 0 };
-      for (int x = 0; x < map_extent->width / 2 + 1; x++)
+      float complex *cl = row + x;
+      float complex *cr = row + extent->width - x;
+      if (x!=0)
       {
-        float complex *cl = row + x;
-        float complex *cr = row + map_extent->width - x;
-        if (x!=0)
-        {
-          if (*cl == 0) *cl = last[0];
-          if (*cr == 0) *cr = last[1];
-        }
-        last[0] = *cl; last[1] = *cr;
+        if (*cl == 0) *cl = last[0];
+        if (*cr == 0) *cr = last[1];
       }
+      last[0] = *cl; last[1] = *cr;
     }
+  }
+
+  return imap;
+}
+
+// piece caches
+
+static inline uint64_t _hash_bytes (uint64_t hash, const void *data, const size_t size)
+{
+  const unsigned char *c = (const unsigned char *) data;
+  for (size_t k = 0; k < size; k++)
+    hash = ((hash << 5) + hash) ^ c[k];
+  return hash;
+}
 
-    map = imap;
+static inline uint64_t _hash_warp (uint64_t hash, const dt_liquify_warp_t *warp)
+{
+  const int interpolated = (warp->status & DT_LIQUIFY_STATUS_INTERPOLATED) != 0;
+  hash = _hash_bytes (hash, &warp->point, sizeof (warp->point));
+  hash = _hash_bytes (hash, &warp->strength, sizeof (warp->strength));
+  hash = _hash_bytes (hash, &warp->radius, sizeof (warp->radius));
+  hash = _hash_bytes (hash, &warp->control1, sizeof (warp->control1));
+  hash = _hash_bytes (hash, &warp->control2, sizeof (warp->control2));
+  hash = _hash_bytes (hash, &warp->type, sizeof (warp->type));
+  return _hash_bytes (hash, &interpolated, sizeof (interpolated));
+}
+
+static inline gboolean _warp_equal (const dt_liquify_warp_t *a, const dt_liquify_warp_t *b)
+{
+  return a->point == b->point && a->strength == b->strength && a->radius == b->radius
+    && a->control1 == b->control1 && a->control2 == b->control2 && a->type == b->type
+    && (a->status & DT_LIQUIFY_STATUS_INTERPOLATED) == (b->status & DT_LIQUIFY_STATUS_INTERPOLATED);
+}
+
+// hash of everything interpolate_paths() looks at, leaving out the gui state (selection, hovering)
+
+static uint64_t _params_hash (const dt_iop_liquify_params_t *p)
+{
+  uint64_t hash = 5381;
+  for (int k=0; k<MAX_NODES; k++)
+  {
+    const dt_liquify_path_data_t *data = &p->nodes[k];
+    if (data->header.type == DT_LIQUIFY_PATH_INVALIDATED)
+      break;
+    hash = _hash_bytes (hash, &data->header.type, sizeof (data->header.type));
+    hash = _hash_bytes (hash, &data->header.prev, sizeof (data->header.prev));
+    hash = _hash_bytes (hash, &data->header.next, sizeof (data->header.next));
+    hash = _hash_warp (hash, &data->warp);
+    hash = _hash_bytes (hash, &data->node, sizeof (data->node));
   }
+  return hash;
+}
 
-  return map;
+static inline gboolean _rect_contains (const cairo_rectangle_int_t *outer, const cairo_rectangle_int_t *inner)
+{
+  return inner->x >= outer->x && inner->y >= outer->y
+    && inner->x + inner->width <= outer->x + outer->width
+    && inner->y + inner->height <= outer->y + outer->height;
+}
+
+static inline gboolean _rect_equal (const cairo_rectangle_int_t *a, const cairo_rectangle_int_t *b)
+{
+  return a->x == b->x && a->y == b->y && a->width == b->width && a->height == b->height;
 }
 
-static float complex *build_global_distortion_map (struct dt_iop_module_t *module,
-                                                   const dt_dev_pixelpipe_iop_t *piece,
-                                                   const dt_iop_roi_t *roi_in,
-                                                   const dt_iop_roi_t *roi_out,
-                                                   cairo_rectangle_int_t *map_extent)
+/*
+  Returns a copy of the interpolated warps of the piece's params,
+  distorted into the piece at the given scale. free() it.
+*/
+
+static dt_liquify_warp_t *_interpolated_warps (struct dt_iop_module_t *module,
+                                               const dt_dev_pixelpipe_iop_t *piece,
+                                               const float scale,
+                                               const gboolean from_distort_transform,
+                                               int *num_warps)
 {
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *) piece->data;
+
   // copy params
   dt_iop_liquify_params_t copy_params;
-  memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
+  memcpy(&copy_params, &d->params, sizeof(dt_iop_liquify_params_t));
+
+  distort_paths_raw_to_piece (module, piece->pipe, scale, &copy_params, from_distort_transform);
 
-  distort_paths_raw_to_piece (module, piece->pipe, roi_in->scale, &copy_params, FALSE);
+  const uint64_t hash = _params_hash (&copy_params);
+
+  dt_pthread_mutex_lock (&d->lock);
+  for (int k = 0; k < LIQUIFY_PATHS; k++)
+  {
+    dt_iop_liquify_paths_t *paths = &d->paths[k];
+    if (paths->warps && paths->hash == hash)
+    {
+      dt_liquify_warp_t *warps = malloc (sizeof (dt_liquify_warp_t) * MAX (paths->num_warps, 1));
+      memcpy (warps, paths->warps, sizeof (dt_liquify_warp_t) * paths->num_warps);
+      *num_warps = paths->num_warps;
+      paths->used = ++d->clock;
+      dt_pthread_mutex_unlock (&d->lock);
+      return warps;
+    }
+  }
+  dt_pthread_mutex_unlock (&d->lock);
 
   GList *interpolated = interpolate_paths (&copy_params);
+  const int n = g_list_length (interpolated);
+  dt_liquify_warp_t *warps = malloc (sizeof (dt_liquify_warp_t) * MAX (n, 1));
+  int i = 0;
+  for (GList *l = interpolated; l != NULL; l = l->next)
+    warps[i++] = *((dt_liquify_warp_t *) l->data);
+  g_list_free_full (interpolated, free);
 
-  _get_map_extent (roi_out, interpolated, map_extent);
+  // remember them in the least recently used slot
+  dt_pthread_mutex_lock (&d->lock);
+  dt_iop_liquify_paths_t *slot = &d->paths[0];
+  for (int k = 1; k < LIQUIFY_PATHS; k++)
+    if (d->paths[k].used < slot->used) slot = &d->paths[k];
+  free (slot->warps);
+  slot->warps = malloc (sizeof (dt_liquify_warp_t) * MAX (n, 1));
+  memcpy (slot->warps, warps, sizeof (dt_liquify_warp_t) * n);
+  slot->num_warps = n;
+  slot->hash = hash;
+  slot->used = ++d->clock;
+  dt_pthread_mutex_unlock (&d->lock);
 
-  float complex *map = create_global_distortion_map(map_extent, interpolated, FALSE);
+  *num_warps = n;
+  return warps;
+}
 
-  g_list_free_full (interpolated, free);
-  return map;
+static void _map_release (dt_iop_liquify_data_t *d, dt_iop_liquify_map_t *m)
+{
+  if (m == NULL) return;
+  dt_pthread_mutex_lock (&d->lock);
+  m->refs--;
+  dt_pthread_mutex_unlock (&d->lock);
+  if (m->orphan)
+  {
+    dt_free_align (m->map);
+    free (m->warps);
+    free (m);
+  }
+}
+
+/*
+  Returns the distortion map for the warps covering at least extent,
+  or exactly extent if inverted. Release it with _map_release().
+
+  A cached forward map whose extent still covers the new one is
+  updated in place: the warps that differ from the ones it was built
+  from are taken out and the new ones stamped in, so editing a single
+  warp does not rebuild the whole map.
+*/
+
+static dt_iop_liquify_map_t *_map_acquire (dt_iop_liquify_data_t *d,
+                                           const dt_liquify_warp_t *warps,
+                                           const int num_warps,
+                                           const cairo_rectangle_int_t *extent,
+                                           const gboolean inverted)
+{
+  uint64_t hash = 5381;
+  for (int i = 0; i < num_warps; i++)
+    hash = _hash_warp (hash, &warps[i]);
+  if (hash == 0) hash = 1;
+
+  dt_pthread_mutex_lock (&d->lock);
+
+  for (int k = 0; k < LIQUIFY_MAPS; k++)
+  {
+    dt_iop_liquify_map_t *m = &d->maps[k];
+    if (m->hash == hash && m->inverted == inverted
+        && (inverted ? _rect_equal (&m->extent, extent) : _rect_contains (&m->extent, extent)))
+    {
+      m->refs++;
+      m->used = ++d->clock;
+      dt_pthread_mutex_unlock (&d->lock);
+      return m;
+    }
+  }
+
+  if (!inverted)
+  {
+    for (int k = 0; k < LIQUIFY_MAPS; k++)
+    {
+      dt_iop_liquify_map_t *m = &d->maps[k];
+      if (m->hash == 0 || m->inverted || m->refs || !_rect_contains (&m->extent, extent))
+        continue;
+
+      // the warps of one edited path are contiguous, skip the common head and tail
+      int head = 0, tail = 0;
+      while (head < m->num_warps && head < num_warps && _warp_equal (&m->warps[head], &warps[head]))
+        head++;
+      while (tail < m->num_warps - head && tail < num_warps - head
+             && _warp_equal (&m->warps[m->num_warps - 1 - tail], &warps[num_warps - 1 - tail]))
+        tail++;
+      const int removed = m->num_warps - head - tail;
+      const int added = num_warps - head - tail;
+      if (removed + added >= num_warps)
+        continue;
+
+      m->hash = 0;
+      m->refs = 1;
+      dt_pthread_mutex_unlock (&d->lock);
+
+      _stamp_warps (m->map, &m->extent, m->warps + head, removed, 1.0f);
+      _snap_map_residue (m->map, &m->extent, m->warps + head, removed);
+      _stamp_warps (m->map, &m->extent, warps + head, added, -1.0f);
+
+      dt_liquify_warp_t *copy = malloc (sizeof (dt_liquify_warp_t) * MAX (num_warps, 1));
+      memcpy (copy, warps, sizeof (dt_liquify_warp_t) * num_warps);
+
+      dt_pthread_mutex_lock (&d->lock);
+      free (m->warps);
+      m->warps = copy;
+      m->num_warps = num_warps;
+      m->hash = hash;
+      m->used = ++d->clock;
+      dt_pthread_mutex_unlock (&d->lock);
+      return m;
+    }
+  }
+
+  dt_pthread_mutex_unlock (&d->lock);
+
+  // build it from scratch
+  float complex *map = NULL;
+  dt_liquify_warp_t *copy = NULL;
+  if (inverted)
+  {
+    dt_iop_liquify_map_t *forward = _map_acquire (d, warps, num_warps, extent, FALSE);
+    if (forward == NULL) return NULL;
+    map = invert_global_distortion_map (forward->map, &forward->extent, extent);
+    _map_release (d, forward);
+  }
+  else
+  {
+    map = create_global_distortion_map (extent, warps, num_warps);
+    copy = malloc (sizeof (dt_liquify_warp_t) * MAX (num_warps, 1));
+    memcpy (copy, warps, sizeof (dt_liquify_warp_t) * num_warps);
+  }
+  if (map == NULL)
+  {
+    free (copy);
+    return NULL;
+  }
+
+  // store it in the least recently used slot nobody is holding
+  dt_pthread_mutex_lock (&d->lock);
+  dt_iop_liquify_map_t *m = NULL;
+  for (int k = 0; k < LIQUIFY_MAPS; k++)
+    if (d->maps[k].refs == 0 && (m == NULL || d->maps[k].used < m->used))
+      m = &d->maps[k];
+  if (m)
+  {
+    dt_free_align (m->map);
+    free (m->warps);
+  }
+  else
+  {
+    m = calloc (1, sizeof (dt_iop_liquify_map_t));
+    m->orphan = TRUE;
+  }
+  m->hash = hash;
+  m->inverted = inverted;
+  m->extent = *extent;
+  m->warps = copy;
+  m->num_warps = copy ? num_warps : 0;
+  m->map = map;
+  m->refs = 1;
+  m->used = ++d->clock;
+  dt_pthread_mutex_unlock (&d->lock);
+  return m;
+}
+
+static void _cache_cleanup (dt_iop_liquify_data_t *d)
+{
+  for (int k = 0; k < LIQUIFY_PATHS; k++)
+    free (d->paths[k].warps);
+  for (int k = 0; k < LIQUIFY_MAPS; k++)
+  {
+    dt_free_align (d->maps[k].map);
+    free (d->maps[k].warps);
+  }
+}
+
+/*
+  Returns the distortion map for roi_out, NULL if no warp touches it.
+  The map may cover more than the extent of the warps in roi_out.
+*/
+
+static dt_iop_liquify_map_t *build_global_distortion_map (struct dt_iop_module_t *module,
+                                                          const dt_dev_pixelpipe_iop_t *piece,
+                                                          const dt_iop_roi_t *roi_in,
+                                                          const dt_iop_roi_t *roi_out)
+{
+  int num_warps = 0;
+  dt_liquify_warp_t *warps = _interpolated_warps (module, piece, roi_in->scale, FALSE, &num_warps);
+
+  cairo_rectangle_int_t map_extent;
+  _get_map_extent (roi_out, warps, num_warps, &map_extent);
+
+  dt_iop_liquify_map_t *m = NULL;
+  if (map_extent.width != 0 && map_extent.height != 0)
+    m = _map_acquire ((dt_iop_liquify_data_t *) piece->data, warps, num_warps, &map_extent, FALSE);
+
+  free (warps);
+  return m;
 }
 
 // 1st pass: how large would the output be, given this input roi?
@@ -1291,12 +1666,6 @@ void modify_roi_in (struct dt_iop_module_t *module,
 
   *roi_in = *roi_out;
 
-  // copy params
-  dt_iop_liquify_params_t copy_params;
-  memcpy(&copy_params, (dt_iop_liquify_params_t*)piece->data, sizeof(dt_iop_liquify_params_t));
-
-  distort_paths_raw_to_piece (module, piece->pipe, roi_in->scale, &copy_params, FALSE);
-
   cairo_rectangle_int_t pipe_rect =
     {
       0,
@@ -1315,9 +1684,10 @@ void modify_roi_in (struct dt_iop_module_t *module,
   cairo_region_t *roi_in_region = cairo_region_create_rectangle (&roi_in_rect);
 
   // get extent of all paths
-  GList *interpolated = interpolate_paths (&copy_params);
+  int num_warps = 0;
+  dt_liquify_warp_t *warps = _interpolated_warps (module, piece, roi_in->scale, FALSE, &num_warps);
   cairo_rectangle_int_t extent;
-  _get_map_extent (roi_out, interpolated, &extent);
+  _get_map_extent (roi_out, warps, num_warps, &extent);
 
   // (eventually) extend roi_in
   cairo_region_union_rectangle (roi_in_region, &extent);
@@ -1333,7 +1703,7 @@ void modify_roi_in (struct dt_iop_module_t *module,
 
   // cleanup
   cairo_region_destroy (roi_in_region);
-  g_list_free_full (interpolated, free);
+  free (warps);
 }
 
 static int _distort_xtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, float *points, size_t points_count, gboolean inverted)
@@ -1358,26 +1728,33 @@ static int _distort_xtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pi
 
   if (extent.width != 0 && extent.height != 0)
   {
-    // copy params
-    dt_iop_liquify_params_t copy_params;
-    memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
-
-    distort_paths_raw_to_piece (self, piece->pipe, scale, &copy_params, TRUE);
-
-    // create the distortion map for this extent
-
-    GList *interpolated = interpolate_paths (&copy_params);
+    int num_warps = 0;
+    dt_liquify_warp_t *warps = _interpolated_warps (self, piece, scale, TRUE, &num_warps);
 
     // we need to adjust the extent to be the union enclosing all the points (currently in extent) and
     // the warps that are in (possibly partly) in this same region.
 
     dt_iop_roi_t roi_in = { .x = extent.x, .y = extent.y, .width = extent.width, .height = extent.height };
-    _get_map_extent (&roi_in, interpolated, &extent);
+    _get_map_extent (&roi_in, warps, num_warps, &extent);
+
+    // no warp near any of the points
+    if (extent.width == 0 || extent.height == 0)
+    {
+      free (warps);
+      return 1;
+    }
+
+    // get the distortion map for this extent
+
+    dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *) piece->data;
+    dt_iop_liquify_map_t *m = _map_acquire (d, warps, num_warps, &extent, inverted);
+    free (warps);
 
-    float complex *map = create_global_distortion_map (&extent, interpolated, inverted);
-    g_list_free_full (interpolated, free);
+    if (m == NULL) return 0;
 
-    if (map == NULL) return 0;
+    // a forward map may cover more than asked for
+    extent = m->extent;
+    const float complex *map = m->map;
 
     const int map_size =  extent.width * extent.height;
     const int x_last = extent.x + extent.width;
@@ -1400,7 +1777,7 @@ static int _distort_xtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pi
       }
     }
 
-    dt_free_align ((void *) map);
+    _map_release (d, m);
   }
 
   return 1;
@@ -1436,22 +1813,18 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
 
   // 2. build the distortion map
 
-  cairo_rectangle_int_t map_extent;
-  float complex *map = build_global_distortion_map (self, piece, roi_in, roi_out, &map_extent);
-  if (map == NULL)
+  dt_iop_liquify_map_t *m = build_global_distortion_map (self, piece, roi_in, roi_out);
+  if (m == NULL)
     return;
 
   // 3. apply the map
 
-  if (map_extent.width != 0 && map_extent.height != 0)
-  {
-    int ch = piece->colors;
-    piece->colors = 1;
-    apply_global_distortion_map (self, piece, in, out, roi_in, roi_out, map, &map_extent);
-    piece->colors = ch;
-  }
+  int ch = piece->colors;
+  piece->colors = 1;
+  apply_global_distortion_map (self, piece, in, out, roi_in, roi_out, m->map, &m->extent);
+  piece->colors = ch;
 
-  dt_free_align ((void *) map);
+  _map_release ((dt_iop_liquify_data_t *) piece->data, m);
 
 }
 
@@ -1482,17 +1855,15 @@ void process(struct dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, cons
 
   // 2. build the distortion map
 
-  cairo_rectangle_int_t map_extent;
-  float complex *map = build_global_distortion_map (module, piece, roi_in, roi_out, &map_extent);
-  if (map == NULL)
+  dt_iop_liquify_map_t *m = build_global_distortion_map (module, piece, roi_in, roi_out);
+  if (m == NULL)
     return;
 
   // 3. apply the map
 
-  if (map_extent.width != 0 && map_extent.height != 0)
-    apply_global_distortion_map (module, piece, in, out, roi_in, roi_out, map, &map_extent);
+  apply_global_distortion_map (module, piece, in, out, roi_in, roi_out, m->map, &m->extent);
 
-  dt_free_align ((void *) map);
+  _map_release ((dt_iop_liquify_data_t *) piece->data, m);
 }
 
 #ifdef HAVE_OPENCL
@@ -1648,17 +2019,15 @@ int process_cl (struct dt_iop_module_t *module,
 
   // 2. build the distortion map
 
-  cairo_rectangle_int_t map_extent;
-  const float complex *map = build_global_distortion_map (module, piece, roi_in, roi_out, &map_extent);
-  if (map == NULL)
+  dt_iop_liquify_map_t *m = build_global_distortion_map (module, piece, roi_in, roi_out);
+  if (m == NULL)
     return TRUE;
 
   // 3. apply the map
 
-  if (map_extent.width != 0 && map_extent.height != 0)
-    err = apply_global_distortion_map_cl (module, piece, dev_in, dev_out, roi_in, roi_out, map, &map_extent);
+  err = apply_global_distortion_map_cl (module, piece, dev_in, dev_out, roi_in, roi_out, m->map, &m->extent);
 
-  dt_free_align ((void *) map);
+  _map_release ((dt_iop_liquify_data_t *) piece->data, m);
   if (err != CL_SUCCESS) goto error;
 
   return TRUE;
@@ -1710,24 +2079,31 @@ void cleanup(dt_iop_module_t *module)
 
 void init_pipe (struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = malloc (module->params_size);
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *) calloc (1, sizeof (dt_iop_liquify_data_t));
+  dt_pthread_mutex_init (&d->lock, NULL);
+  piece->data = d;
   module->commit_params (module, module->default_params, pipe, piece);
 }
 
 void cleanup_pipe (struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *) piece->data;
+  _cache_cleanup (d);
+  dt_pthread_mutex_destroy (&d->lock);
   free (piece->data);
   piece->data = NULL;
 }
 
-/* commit is the synch point between core and gui, so it copies params to pipe data. */
+/* commit is the synch point between core and gui, so it copies params to pipe data.
+   the cached warps and maps are keyed by content and survive the commit. */
 
 void commit_params (struct dt_iop_module_t *module,
                     dt_iop_params_t *params,
                     dt_dev_pixelpipe_t *pipe,
                     dt_dev_pixelpipe_iop_t *piece)
 {
-  memcpy (piece->data, params, module->params_size);
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *) piece->data;
+  memcpy (&d->params, params, module->params_size);
 }
 
 // calculate the dot product of 2 vectors.
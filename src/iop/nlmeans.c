@@ -131,22 +131,6 @@ void connect_key_accels(dt_iop_module_t *self)
 }
 
 
-typedef union floatint_t
-{
-  float f;
-  uint32_t i;
-} floatint_t;
-
-static inline float fast_mexp2f(const float x)
-{
-  const float i1 = (float)0x3f800000u; // 2^0
-  const float i2 = (float)0x3f000000u; // 2^-1
-  const float k0 = i1 + x * (i2 - i1);
-  floatint_t k;
-  k.i = k0 >= (float)0x800000u ? k0 : 0;
-  return k.f;
-}
-
 static float gh(const float f, const float sharpness)
 {
   const float f2 = f * sharpness;
@@ -150,30 +150,61 @@ void connect_key_accels(dt_iop_module_t *self)
   dt_accel_connect_slider_iop(self, "noise threshold", GTK_WIDGET(g->threshold));
 }
 
-// transposes image, it is faster to read columns than to write them.
-static void hat_transform(float *temp, const float *const base, int stride, int size, int scale)
+// mirror an index at the borders of [0, size), the border itself is not repeated
+static inline int hat_mirror(int i, const int size)
 {
-  int i;
-  const float *basep0;
-  const float *basep1;
-  const float *basep2;
-  const size_t stxsc = (size_t)stride * scale;
-
-  basep0 = base;
-  basep1 = base + stxsc;
-  basep2 = base + stxsc;
-
-  for(i = 0; i < scale; i++, basep0 += stride, basep1 -= stride, basep2 += stride)
-    temp[i] = (*basep0 + *basep0 + *basep1 + *basep2) * 0.25f;
-
-  for(; i < size - scale; i++, basep0 += stride)
-    temp[i] = ((*basep0) * 2 + *(basep0 - stxsc) + *(basep0 + stxsc)) * 0.25f;
+  if(i < 0) i = -i;
+  if(i >= size) i = 2 * (size - 1) - i;
+  return CLAMP(i, 0, size - 1);
+}
 
-  basep1 = basep0 - stxsc;
-  basep2 = base + stride * (size - 2);
+// a trous filter along the columns: every output row is a weighted sum of three input rows,
+// so whole rows are processed at a time and the inner loop runs over contiguous memory.
+static void hat_transform_cols(float *const out, const float *const in, const int width, const int height,
+                               const int scale)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(height, in, out, scale, width) \
+  schedule(static)
+#endif
+  for(int row = 0; row < height; row++)
+  {
+    const float *const r0 = in + (size_t)row * width;
+    const float *const r1 = in + (size_t)hat_mirror(row - scale, height) * width;
+    const float *const r2 = in + (size_t)hat_mirror(row + scale, height) * width;
+    float *const o = out + (size_t)row * width;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int col = 0; col < width; col++) o[col] = (r0[col] * 2 + r1[col] + r2[col]) * 0.25f;
+  }
+}
 
-  for(; i < size; i++, basep0 += stride, basep1 += stride, basep2 -= stride)
-    temp[i] = (*basep0 + *basep0 + *basep1 + *basep2) * 0.25f;
+// a trous filter along the rows
+static void hat_transform_rows(float *const out, const float *const in, const int width, const int height,
+                               const int scale)
+{
+  const int left = MIN(scale, width);
+  const int right = MAX(width - scale, left);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(height, in, left, out, right, scale, width) \
+  schedule(static)
+#endif
+  for(int row = 0; row < height; row++)
+  {
+    const float *const r = in + (size_t)row * width;
+    float *const o = out + (size_t)row * width;
+    for(int col = 0; col < left; col++)
+      o[col] = (r[col] * 2 + r[hat_mirror(col - scale, width)] + r[hat_mirror(col + scale, width)]) * 0.25f;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int col = left; col < right; col++) o[col] = (r[col] * 2 + r[col - scale] + r[col + scale]) * 0.25f;
+    for(int col = right; col < width; col++)
+      o[col] = (r[col] * 2 + r[hat_mirror(col - scale, width)] + r[hat_mirror(col + scale, width)]) * 0.25f;
+  }
 }
 
 #define BIT16 65536.0
@@ -260,30 +291,9 @@ static void wavelet_denoise(const float *const in, float *const out, const dt_io
       const size_t pass2 = 2 * size;
       const size_t pass3 = 4 * size - pass1;
 
-// filter horizontally and transpose
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(fimg, halfheight, halfwidth, pass1, pass2) \
-      shared(lev) \
-      schedule(static)
-#endif
-      for(int col = 0; col < halfwidth; col++)
-      {
-        hat_transform(fimg + pass2 + (size_t)col * halfheight, fimg + pass1 + col, halfwidth, halfheight,
-                      1 << lev);
-      }
-// filter vertically and transpose back
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(fimg, halfheight, halfwidth, pass2, pass3) \
-      shared(lev) \
-      schedule(static)
-#endif
-      for(int row = 0; row < halfheight; row++)
-      {
-        hat_transform(fimg + pass3 + (size_t)row * halfwidth, fimg + pass2 + row, halfheight, halfwidth,
-                      1 << lev);
-      }
+      // filter vertically, then horizontally
+      hat_transform_cols(fimg + pass2, fimg + pass1, halfwidth, halfheight, 1 << lev);
+      hat_transform_rows(fimg + pass3, fimg + pass2, halfwidth, halfheight, 1 << lev);
 
       const float thold = threshold * noise[lev];
 #ifdef _OPENMP
@@ -442,24 +452,9 @@ static void wavelet_denoise_xtrans(const float *const in, float *out, const dt_i
       const size_t pass2 = 2 * size;
       const size_t pass3 = 4 * size - pass1;
 
-// filter horizontally and transpose
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(fimg, height, pass1, pass2, width) \
-      shared(lev) \
-      schedule(static)
-#endif
-      for(int col = 0; col < width; col++)
-        hat_transform(fimg + pass2 + (size_t)col * height, fimg + pass1 + col, width, height, 1 << lev);
-// filter vertically and transpose back
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(fimg, height, pass2, pass3, width) \
-      shared(lev) \
-      schedule(static)
-#endif
-      for(int row = 0; row < height; row++)
-        hat_transform(fimg + pass3 + (size_t)row * width, fimg + pass2 + row, height, width, 1 << lev);
+      // filter vertically, then horizontally
+      hat_transform_cols(fimg + pass2, fimg + pass1, width, height, 1 << lev);
+      hat_transform_rows(fimg + pass3, fimg + pass2, width, height, 1 << lev);
 
       const float thold = threshold * noise[lev];
 #ifdef _OPENMP
@@ -86,6 +86,19 @@ typedef struct dt_iop_retouch_form_data_t
   float fill_brightness; // value to be added to the color
 } dt_iop_retouch_form_data_t;
 
+// a form applied in this run, with its mask already scaled to the layer roi
+typedef struct retouch_form_t
+{
+  dt_masks_form_t *form;
+  int index; // index in params->rt_forms
+  int scale;
+  float opacity;
+  int dx, dy;
+  float *mask_scaled;
+  dt_iop_roi_t roi_mask_scaled;
+  int wave; // forms of a scale in the same wave touch disjoint pixels
+} retouch_form_t;
+
 typedef struct retouch_user_data_t
 {
   dt_iop_module_t *self;
@@ -94,6 +107,9 @@ typedef struct retouch_user_data_t
   int display_scale;
   int mask_display;
   int suppress_mask;
+  retouch_form_t *forms; // forms hitting the roi, in group order
+  int num_forms;
+  int forms_collected;
 } retouch_user_data_t;
 
 typedef struct dt_iop_retouch_params_t
@@ -167,7 +183,24 @@ typedef struct dt_iop_retouch_gui_data_t
   GtkWidget *sl_mask_opacity; // draw mask opacity
 } dt_iop_retouch_gui_data_t;
 
-typedef struct dt_iop_retouch_params_t dt_iop_retouch_data_t;
+// what a form did on the last run of a pipe piece, to tell the pipe which area a change affects
+typedef struct retouch_footprint_t
+{
+  int formid;
+  uint64_t hash; // geometry, opacity and settings of the form
+  int area[4];   // destination x, y, width, height in full resolution, border included
+  int source[4]; // source area, the destination for blur and fill
+  int margin;    // how far around both areas the form reads
+} retouch_footprint_t;
+
+typedef struct dt_iop_retouch_data_t
+{
+  dt_iop_retouch_params_t params; // first, so piece->data can be used as the params
+  uint64_t last_hash;             // piece hash the footprints belong to, 0 if none
+  uint64_t last_global_hash;      // everything besides the forms the output depends on
+  int num_footprints;
+  retouch_footprint_t footprints[RETOUCH_NO_FORMS];
+} dt_iop_retouch_data_t;
 
 typedef struct dt_iop_retouch_global_data_t
 {
@@ -2504,7 +2537,7 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *params, dt_dev
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = malloc(sizeof(dt_iop_retouch_data_t));
+  piece->data = calloc(1, sizeof(dt_iop_retouch_data_t));
   self->commit_params(self, self->default_params, pipe, piece);
 }
 
@@ -4207,7 +4240,7 @@ static void retouch_heal(float *const in, dt_iop_roi_t *const roi_in, const int
   rt_copy_in_to_out(in, roi_in, img_dest, roi_mask_scaled, ch, 0, 0);
 
   // heal it
-  dt_heal(img_src, img_dest, mask_scaled, roi_mask_scaled->width, roi_mask_scaled->height, ch, use_sse);
+  dt_heal(img_src, img_dest, mask_scaled, roi_mask_scaled->width, roi_mask_scaled->height, ch);
 
   // copy healed (temp) image to destination image
   rt_copy_image_masked(img_dest, in, roi_in, ch, mask_scaled, roi_mask_scaled, opacity, use_sse);
@@ -4217,184 +4250,483 @@ cleanup:
   if(img_dest) dt_free_align(img_dest);
 }
 
-static void rt_process_forms(float *layer, dwt_params_t *const wt_p, const int scale1)
+// returns the scale of the forms processed on decomposition layer scale1, -1 if none
+static int rt_get_form_scale(const int scale1, const int scales, const int return_layer,
+                             const int merge_from_scale, const int num_scales)
 {
-  int scale = scale1;
-  retouch_user_data_t *usr_d = (retouch_user_data_t *)wt_p->user_data;
-  dt_iop_module_t *self = usr_d->self;
-  dt_dev_pixelpipe_iop_t *piece = usr_d->piece;
-
   // if preview a single scale, just process that scale and original image
   // unless merge is activated
-  if(wt_p->merge_from_scale == 0 && wt_p->return_layer > 0 && scale != wt_p->return_layer && scale != 0) return;
+  if(merge_from_scale == 0 && return_layer > 0 && scale1 != return_layer && scale1 != 0) return -1;
   // do not process the reconstructed image
-  if(scale > wt_p->scales + 1) return;
+  if(scale1 > scales + 1) return -1;
 
+  // when the requested scales is grather than max scales the residual image index will be different from the one
+  // defined by the user,
+  // so we need to adjust it here, otherwise we will be using the shapes from a scale on the residual image
+  if(scales < num_scales && return_layer == 0 && scale1 == scales + 1) return num_scales + 1;
+
+  return scale1;
+}
+
+static gboolean rt_rois_overlap(const dt_iop_roi_t *const roi_1, const int dx1, const int dy1,
+                                const dt_iop_roi_t *const roi_2, const int dx2, const int dy2)
+{
+  return roi_1->x - dx1 < roi_2->x - dx2 + roi_2->width && roi_2->x - dx2 < roi_1->x - dx1 + roi_1->width
+         && roi_1->y - dy1 < roi_2->y - dy2 + roi_2->height && roi_2->y - dy2 < roi_1->y - dy1 + roi_1->height;
+}
+
+// a form writes to its mask area and reads from it and from the source area (the mask area moved by -dx, -dy),
+// two forms can be applied in any order if none of them writes where the other one reads
+static gboolean rt_forms_overlap(const retouch_form_t *const form_1, const retouch_form_t *const form_2)
+{
+  const dt_iop_roi_t *const roi_1 = &form_1->roi_mask_scaled;
+  const dt_iop_roi_t *const roi_2 = &form_2->roi_mask_scaled;
+
+  return rt_rois_overlap(roi_1, 0, 0, roi_2, 0, 0) || rt_rois_overlap(roi_1, form_1->dx, form_1->dy, roi_2, 0, 0)
+         || rt_rois_overlap(roi_1, 0, 0, roi_2, form_2->dx, form_2->dy);
+}
+
+static void rt_free_forms(retouch_user_data_t *usr_d)
+{
+  for(int i = 0; i < usr_d->num_forms; i++)
+    if(usr_d->forms[i].mask_scaled) dt_free_align(usr_d->forms[i].mask_scaled);
+  free(usr_d->forms);
+  usr_d->forms = NULL;
+  usr_d->num_forms = 0;
+}
+
+// gathers the forms processed in this run and builds their masks, so it's done once and not on every scale.
+// forms outside of the roi are dropped here
+static void rt_collect_forms(retouch_user_data_t *usr_d, const int scales, const int return_layer,
+                             const int merge_from_scale)
+{
+  dt_iop_module_t *self = usr_d->self;
+  dt_dev_pixelpipe_iop_t *piece = usr_d->piece;
   dt_develop_blend_params_t *bp = (dt_develop_blend_params_t *)piece->blendop_data;
   dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
   dt_iop_roi_t *roi_layer = &usr_d->roi;
-  const int mask_display = usr_d->mask_display && (scale == usr_d->display_scale);
 
-  // when the requested scales is grather than max scales the residual image index will be different from the one
-  // defined by the user,
-  // so we need to adjust it here, otherwise we will be using the shapes from a scale on the residual image
-  if(wt_p->scales < p->num_scales && wt_p->return_layer == 0 && scale == wt_p->scales + 1)
+  usr_d->forms = NULL;
+  usr_d->num_forms = 0;
+
+  if(usr_d->suppress_mask) return;
+
+  const dt_masks_form_t *grp = dt_masks_get_from_id_ext(piece->pipe->forms, bp->mask_id);
+  if(grp == NULL || !(grp->type & DT_MASKS_GROUP) || grp->points == NULL) return;
+
+  retouch_form_t *forms = calloc(g_list_length(grp->points), sizeof(retouch_form_t));
+  if(forms == NULL)
   {
-    scale = p->num_scales + 1;
+    fprintf(stderr, "rt_collect_forms: error allocating memory\n");
+    return;
   }
 
-  // iterate through all forms
-  if(!usr_d->suppress_mask)
+  int num_forms = 0;
+  for(const GList *l = grp->points; l; l = g_list_next(l))
   {
-    const dt_masks_form_t *grp = dt_masks_get_from_id_ext(piece->pipe->forms, bp->mask_id);
-    if(grp && (grp->type & DT_MASKS_GROUP))
+    const dt_masks_point_group_t *grpt = (dt_masks_point_group_t *)l->data;
+    if(grpt == NULL)
     {
-      GList *forms = g_list_first(grp->points);
-      while(forms)
-      {
-        const dt_masks_point_group_t *grpt = (dt_masks_point_group_t *)forms->data;
-        if(grpt == NULL)
-        {
-          fprintf(stderr, "rt_process_forms: invalid form\n");
-          forms = g_list_next(forms);
-          continue;
-        }
-        const int formid = grpt->formid;
-        const float form_opacity = grpt->opacity;
-        if(formid == 0)
-        {
-          fprintf(stderr, "rt_process_forms: form is null\n");
-          forms = g_list_next(forms);
-          continue;
-        }
-        const int index = rt_get_index_from_formid(p, formid);
-        if(index == -1)
-        {
-          // FIXME: we get this error when user go back in history, so forms are the same but the array has changed
-          fprintf(stderr, "rt_process_forms: missing form=%i from array\n", formid);
-          forms = g_list_next(forms);
-          continue;
-        }
+      fprintf(stderr, "rt_collect_forms: invalid form\n");
+      continue;
+    }
+    const int formid = grpt->formid;
+    if(formid == 0)
+    {
+      fprintf(stderr, "rt_collect_forms: form is null\n");
+      continue;
+    }
+    const int index = rt_get_index_from_formid(p, formid);
+    if(index == -1)
+    {
+      // FIXME: we get this error when user go back in history, so forms are the same but the array has changed
+      fprintf(stderr, "rt_collect_forms: missing form=%i from array\n", formid);
+      continue;
+    }
 
-        // only process current scale
-        if(p->rt_forms[index].scale != scale)
-        {
-          forms = g_list_next(forms);
-          continue;
-        }
+    // skip the scales that won't be processed
+    gboolean processed = FALSE;
+    for(int scale1 = 0; scale1 <= scales + 1 && !processed; scale1++)
+      processed = (rt_get_form_scale(scale1, scales, return_layer, merge_from_scale, p->num_scales)
+                   == p->rt_forms[index].scale);
+    if(!processed) continue;
 
-        // get the spot
-        dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, formid);
-        if(form == NULL)
-        {
-          fprintf(stderr, "rt_process_forms: missing form=%i from masks\n", formid);
-          forms = g_list_next(forms);
-          continue;
-        }
+    // get the spot
+    dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, formid);
+    if(form == NULL)
+    {
+      fprintf(stderr, "rt_collect_forms: missing form=%i from masks\n", formid);
+      continue;
+    }
 
-        // if the form is outside the roi, we just skip it
-        if(!rt_masks_form_is_in_roi(self, piece, form, roi_layer, roi_layer))
-        {
-          forms = g_list_next(forms);
-          continue;
-        }
+    forms[num_forms].form = form;
+    forms[num_forms].index = index;
+    forms[num_forms].scale = p->rt_forms[index].scale;
+    forms[num_forms].opacity = grpt->opacity;
+    num_forms++;
+  }
 
-        // get the mask
-        float *mask = NULL;
-        dt_iop_roi_t roi_mask = { 0 };
+  // the masks don't depend on each other, build them all at once
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(forms, num_forms, p, piece, roi_layer, self) \
+  schedule(dynamic)
+#endif
+  for(int i = 0; i < num_forms; i++)
+  {
+    retouch_form_t *f = forms + i;
 
-        dt_masks_get_mask(self, piece, form, &mask, &roi_mask.width, &roi_mask.height, &roi_mask.x, &roi_mask.y);
-        if(mask == NULL)
-        {
-          fprintf(stderr, "rt_process_forms: error retrieving mask\n");
-          forms = g_list_next(forms);
-          continue;
-        }
+    // if the form is outside the roi, we just skip it
+    if(!rt_masks_form_is_in_roi(self, piece, f->form, roi_layer, roi_layer)) continue;
 
-        // search the delta with the source
-        const dt_iop_retouch_algo_type_t algo = p->rt_forms[index].algorithm;
-        int dx = 0, dy = 0;
+    // get the mask
+    float *mask = NULL;
+    dt_iop_roi_t roi_mask = { 0 };
 
-        if(algo != DT_IOP_RETOUCH_BLUR && algo != DT_IOP_RETOUCH_FILL)
-        {
-          if(!rt_masks_get_delta_to_destination(self, piece, roi_layer, form, &dx, &dy))
-          {
-            forms = g_list_next(forms);
-            if(mask) dt_free_align(mask);
-            continue;
-          }
-        }
+    dt_masks_get_mask(self, piece, f->form, &mask, &roi_mask.width, &roi_mask.height, &roi_mask.x, &roi_mask.y);
+    if(mask == NULL)
+    {
+      fprintf(stderr, "rt_collect_forms: error retrieving mask\n");
+      continue;
+    }
 
-        // scale the mask
-        float *mask_scaled = NULL;
-        dt_iop_roi_t roi_mask_scaled = { 0 };
+    // search the delta with the source
+    const dt_iop_retouch_algo_type_t algo = p->rt_forms[f->index].algorithm;
 
-        rt_build_scaled_mask(mask, &roi_mask, &mask_scaled, &roi_mask_scaled, roi_layer, dx, dy, algo);
+    if(algo != DT_IOP_RETOUCH_BLUR && algo != DT_IOP_RETOUCH_FILL
+       && !rt_masks_get_delta_to_destination(self, piece, roi_layer, f->form, &f->dx, &f->dy))
+    {
+      dt_free_align(mask);
+      continue;
+    }
 
-        // we don't need the original mask anymore
-        if(mask)
-        {
-          dt_free_align(mask);
-          mask = NULL;
-        }
+    // scale the mask, we don't need the original one anymore
+    rt_build_scaled_mask(mask, &roi_mask, &f->mask_scaled, &f->roi_mask_scaled, roi_layer, f->dx, f->dy, algo);
+    dt_free_align(mask);
 
-        if(mask_scaled == NULL)
-        {
-          forms = g_list_next(forms);
-          continue;
-        }
+    // nothing to do with this one
+    if(f->mask_scaled
+       && ((f->dx == 0 && f->dy == 0 && algo != DT_IOP_RETOUCH_BLUR && algo != DT_IOP_RETOUCH_FILL)
+           || f->roi_mask_scaled.width <= 2 || f->roi_mask_scaled.height <= 2))
+    {
+      dt_free_align(f->mask_scaled);
+      f->mask_scaled = NULL;
+    }
+  }
 
-        if((dx != 0 || dy != 0 || algo == DT_IOP_RETOUCH_BLUR || algo == DT_IOP_RETOUCH_FILL)
-           && ((roi_mask_scaled.width > 2) && (roi_mask_scaled.height > 2)))
-        {
-          if(algo == DT_IOP_RETOUCH_CLONE)
-          {
-            retouch_clone(layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, dx, dy, form_opacity,
-                          wt_p->use_sse);
-          }
-          else if(algo == DT_IOP_RETOUCH_HEAL)
-          {
-            retouch_heal(layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, dx, dy, form_opacity,
-                         wt_p->use_sse);
-          }
-          else if(algo == DT_IOP_RETOUCH_BLUR)
-          {
-            retouch_blur(self, layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, form_opacity,
-                         p->rt_forms[index].blur_type, p->rt_forms[index].blur_radius, piece, wt_p->use_sse);
-          }
-          else if(algo == DT_IOP_RETOUCH_FILL)
-          {
-            // add a brightness to the color so it can be fine-adjusted by the user
-            float fill_color[3];
+  // drop the empty ones and sort the others in waves: a form must wait for the earlier
+  // forms of its scale it overlaps with, the forms of a wave can be processed in parallel
+  int count = 0;
+  for(int i = 0; i < num_forms; i++)
+  {
+    if(forms[i].mask_scaled == NULL) continue;
 
-            if(p->rt_forms[index].fill_mode == DT_IOP_RETOUCH_FILL_ERASE)
-            {
-              fill_color[0] = fill_color[1] = fill_color[2] = p->rt_forms[index].fill_brightness;
-            }
-            else
-            {
-              fill_color[0] = p->rt_forms[index].fill_color[0] + p->rt_forms[index].fill_brightness;
-              fill_color[1] = p->rt_forms[index].fill_color[1] + p->rt_forms[index].fill_brightness;
-              fill_color[2] = p->rt_forms[index].fill_color[2] + p->rt_forms[index].fill_brightness;
-            }
+    retouch_form_t *f = forms + count;
+    if(count != i) *f = forms[i];
 
-            retouch_fill(layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, form_opacity, fill_color,
-                         wt_p->use_sse);
-          }
-          else
-            fprintf(stderr, "rt_process_forms: unknown algorithm %i\n", algo);
+    f->wave = 0;
+    for(int j = 0; j < count; j++)
+      if(forms[j].scale == f->scale && forms[j].wave >= f->wave && rt_forms_overlap(forms + j, f))
+        f->wave = forms[j].wave + 1;
 
-          if(mask_display)
-            rt_copy_mask_to_alpha(layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, form_opacity);
-        }
+    count++;
+  }
+
+  if(count == 0)
+  {
+    free(forms);
+    return;
+  }
+
+  usr_d->forms = forms;
+  usr_d->num_forms = count;
+}
+
+static void rt_process_form(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, float *layer,
+                            dt_iop_roi_t *roi_layer, const int ch, retouch_form_t *f, const int mask_display,
+                            const int use_sse)
+{
+  dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
+  const int index = f->index;
+  const dt_iop_retouch_algo_type_t algo = p->rt_forms[index].algorithm;
+
+  if(algo == DT_IOP_RETOUCH_CLONE)
+  {
+    retouch_clone(layer, roi_layer, ch, f->mask_scaled, &f->roi_mask_scaled, f->dx, f->dy, f->opacity, use_sse);
+  }
+  else if(algo == DT_IOP_RETOUCH_HEAL)
+  {
+    retouch_heal(layer, roi_layer, ch, f->mask_scaled, &f->roi_mask_scaled, f->dx, f->dy, f->opacity, use_sse);
+  }
+  else if(algo == DT_IOP_RETOUCH_BLUR)
+  {
+    retouch_blur(self, layer, roi_layer, ch, f->mask_scaled, &f->roi_mask_scaled, f->opacity,
+                 p->rt_forms[index].blur_type, p->rt_forms[index].blur_radius, piece, use_sse);
+  }
+  else if(algo == DT_IOP_RETOUCH_FILL)
+  {
+    // add a brightness to the color so it can be fine-adjusted by the user
+    float fill_color[3];
+
+    if(p->rt_forms[index].fill_mode == DT_IOP_RETOUCH_FILL_ERASE)
+    {
+      fill_color[0] = fill_color[1] = fill_color[2] = p->rt_forms[index].fill_brightness;
+    }
+    else
+    {
+      fill_color[0] = p->rt_forms[index].fill_color[0] + p->rt_forms[index].fill_brightness;
+      fill_color[1] = p->rt_forms[index].fill_color[1] + p->rt_forms[index].fill_brightness;
+      fill_color[2] = p->rt_forms[index].fill_color[2] + p->rt_forms[index].fill_brightness;
+    }
+
+    retouch_fill(layer, roi_layer, ch, f->mask_scaled, &f->roi_mask_scaled, f->opacity, fill_color, use_sse);
+  }
+  else
+    fprintf(stderr, "rt_process_forms: unknown algorithm %i\n", algo);
+
+  if(mask_display)
+    rt_copy_mask_to_alpha(layer, roi_layer, ch, f->mask_scaled, &f->roi_mask_scaled, f->opacity);
+}
+
+static void rt_process_forms(float *layer, dwt_params_t *const wt_p, const int scale1)
+{
+  retouch_user_data_t *usr_d = (retouch_user_data_t *)wt_p->user_data;
+  dt_iop_module_t *self = usr_d->self;
+  dt_dev_pixelpipe_iop_t *piece = usr_d->piece;
+  dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
+  dt_iop_roi_t *roi_layer = &usr_d->roi;
+  const int mask_display = usr_d->mask_display && (scale1 == usr_d->display_scale);
+
+  // the decompose routine may have reduced the scales, so the forms are gathered on the first layer
+  if(!usr_d->forms_collected)
+  {
+    rt_collect_forms(usr_d, wt_p->scales, wt_p->return_layer, wt_p->merge_from_scale);
+    usr_d->forms_collected = 1;
+  }
+
+  const int scale
+      = rt_get_form_scale(scale1, wt_p->scales, wt_p->return_layer, wt_p->merge_from_scale, p->num_scales);
+  if(scale < 0) return;
+
+  retouch_form_t *const forms = usr_d->forms;
+  const int num_forms = usr_d->num_forms;
+  const int ch = wt_p->ch;
+  const int use_sse = wt_p->use_sse;
+
+  int num_waves = 0;
+  for(int i = 0; i < num_forms; i++)
+    if(forms[i].scale == scale) num_waves = MAX(num_waves, forms[i].wave + 1);
+
+  // waves run in order, forms inside a wave run in parallel. a lone form keeps
+  // the threads for itself
+  for(int wave = 0; wave < num_waves; wave++)
+  {
+    int wave_size = 0;
+    for(int i = 0; i < num_forms; i++)
+      if(forms[i].scale == scale && forms[i].wave == wave) wave_size++;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ch, forms, layer, mask_display, num_forms, piece, roi_layer, scale, self, use_sse, wave) \
+  schedule(dynamic) if(wave_size > 1)
+#endif
+    for(int i = 0; i < num_forms; i++)
+    {
+      if(forms[i].scale != scale || forms[i].wave != wave) continue;
+
+      rt_process_form(self, piece, layer, roi_layer, ch, forms + i, mask_display, use_sse);
+    }
+  }
+}
+
+static inline uint64_t rt_hash_bytes(uint64_t hash, const void *const data, const size_t size)
+{
+  const char *str = (const char *)data;
+  for(size_t i = 0; i < size; i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+// gathers what every form of the group does, in full resolution coordinates so it doesn't depend on the roi
+static int rt_get_footprints(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                             retouch_footprint_t *const footprints)
+{
+  const dt_develop_blend_params_t *bp = (dt_develop_blend_params_t *)piece->blendop_data;
+  const dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
+
+  const dt_masks_form_t *grp = dt_masks_get_from_id_ext(piece->pipe->forms, bp->mask_id);
+  if(grp == NULL || !(grp->type & DT_MASKS_GROUP)) return 0;
+
+  // the wavelet layers spread a change over the support of their filters, a form working on a layer
+  // can see changes done to the image that far away
+  const int wavelet_margin
+      = (p->num_scales > 0) ? ceilf((float)(2 << MIN(p->num_scales, RETOUCH_MAX_SCALES)) / piece->iscale) : 0;
+
+  int num = 0;
+  for(const GList *l = grp->points; l && num < RETOUCH_NO_FORMS; l = g_list_next(l))
+  {
+    const dt_masks_point_group_t *grpt = (dt_masks_point_group_t *)l->data;
+    if(grpt == NULL || grpt->formid == 0) continue;
+    const int index = rt_get_index_from_formid((dt_iop_retouch_params_t *)p, grpt->formid);
+    dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, grpt->formid);
+    if(index == -1 || form == NULL) continue;
+
+    retouch_footprint_t *f = footprints + num;
+    const dt_iop_retouch_algo_type_t algo = p->rt_forms[index].algorithm;
+
+    if(!dt_masks_get_area(self, piece, form, &f->area[2], &f->area[3], &f->area[0], &f->area[1])) continue;
+    if(algo == DT_IOP_RETOUCH_BLUR || algo == DT_IOP_RETOUCH_FILL)
+      memcpy(f->source, f->area, sizeof(f->area));
+    else if(!dt_masks_get_source_area(self, piece, form, &f->source[2], &f->source[3], &f->source[0],
+                                      &f->source[1]))
+      continue;
+
+    // heal also reads the pixels around its areas
+    f->margin = wavelet_margin + 2;
+    if(algo == DT_IOP_RETOUCH_BLUR) f->margin += ceilf(p->rt_forms[index].blur_radius / piece->iscale);
+
+    const int len = dt_masks_group_get_hash_buffer_length(form);
+    char *str = malloc(len);
+    dt_masks_group_get_hash_buffer(form, str);
+    uint64_t hash = rt_hash_bytes(5381, str, len);
+    free(str);
+    hash = rt_hash_bytes(hash, &grpt->state, sizeof(grpt->state));
+    hash = rt_hash_bytes(hash, &grpt->opacity, sizeof(grpt->opacity));
+    hash = rt_hash_bytes(hash, &p->rt_forms[index], sizeof(dt_iop_retouch_form_data_t));
+
+    f->formid = grpt->formid;
+    f->hash = hash;
+    num++;
+  }
+
+  return num;
+}
+
+static inline void rt_box_add(int box[4], const int area[4])
+{
+  if(area[2] <= 0 || area[3] <= 0) return;
+  if(box[2] <= box[0] || box[3] <= box[1])
+  {
+    box[0] = area[0];
+    box[1] = area[1];
+    box[2] = area[0] + area[2];
+    box[3] = area[1] + area[3];
+    return;
+  }
+  box[0] = MIN(box[0], area[0]);
+  box[1] = MIN(box[1], area[1]);
+  box[2] = MAX(box[2], area[0] + area[2]);
+  box[3] = MAX(box[3], area[1] + area[3]);
+}
+
+static inline gboolean rt_box_touches(const int box[4], const int area[4], const int margin)
+{
+  return box[2] > box[0] && box[3] > box[1] && area[0] - margin < box[2] && box[0] < area[0] + area[2] + margin
+         && area[1] - margin < box[3] && box[1] < area[1] + area[3] + margin;
+}
+
+// a change of forms only changes the output where the forms were and are now, plus where other forms
+// read from there. this tells the pipe, so it only runs that area through the modules after this one
+static void rt_report_changed_area(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                                   const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_retouch_data_t *d = (dt_iop_retouch_data_t *)piece->data;
+  dt_iop_retouch_gui_data_t *g = (dt_iop_retouch_gui_data_t *)self->gui_data;
+
+  if(piece->pipe->type != DT_DEV_PIXELPIPE_FULL || d->last_hash == piece->hash) return;
+
+  // anything else changing may touch every pixel
+  const int gui_active = self->dev && self->dev->gui_attached && (self == self->dev->gui_module)
+                         && (piece->pipe == self->dev->pipe);
+  const int gui_state[3] = { (g && gui_active) ? g->display_wavelet_scale : 0,
+                             (g && gui_active) ? g->mask_display : 0, (g && gui_active) ? g->suppress_mask : 0 };
+  const float preview_scale = roi_in->scale / piece->iscale;
+  uint64_t global_hash = rt_hash_bytes(5381, &d->params.algorithm,
+                                       sizeof(dt_iop_retouch_params_t)
+                                           - offsetof(dt_iop_retouch_params_t, algorithm));
+  global_hash = rt_hash_bytes(global_hash, piece->blendop_data, sizeof(dt_develop_blend_params_t));
+  global_hash = rt_hash_bytes(global_hash, gui_state, sizeof(gui_state));
+  global_hash = rt_hash_bytes(global_hash, &preview_scale, sizeof(preview_scale));
+
+  retouch_footprint_t *footprints = malloc(sizeof(retouch_footprint_t) * RETOUCH_NO_FORMS);
+  if(footprints == NULL) return;
+  const int num_footprints = rt_get_footprints(self, piece, footprints);
+
+  if(d->last_hash != 0 && d->last_global_hash == global_hash)
+  {
+    // forms gone, added or changed. kept[i] is set for the new forms found unchanged among the old ones
+    int box[4] = { 0 };
+    gboolean *dirty = calloc(num_footprints + 1, sizeof(gboolean));
+    gboolean *kept = calloc(num_footprints + 1, sizeof(gboolean));
+    gboolean *kept_old = calloc(d->num_footprints + 1, sizeof(gboolean));
+    for(int i = 0; i < num_footprints; i++)
+    {
+      const retouch_footprint_t *f = footprints + i;
+      for(int j = 0; j < d->num_footprints; j++)
+      {
+        const retouch_footprint_t *o = d->footprints + j;
+        if(o->formid != f->formid) continue;
+        kept[i] = kept_old[j] = o->hash == f->hash && !memcmp(o->area, f->area, sizeof(f->area))
+                                && !memcmp(o->source, f->source, sizeof(f->source));
+        break;
+      }
+      if(!kept[i])
+      {
+        rt_box_add(box, f->area);
+        dirty[i] = TRUE;
+      }
+    }
+    for(int j = 0; j < d->num_footprints; j++)
+      if(!kept_old[j]) rt_box_add(box, d->footprints[j].area);
 
-        if(mask) dt_free_align(mask);
-        if(mask_scaled) dt_free_align(mask_scaled);
+    // the forms kept have to be applied in the same order, or they count as changed where it differs
+    for(int i = 0, j = 0; i < num_footprints; i++)
+    {
+      if(!kept[i]) continue;
+      while(j < d->num_footprints && !kept_old[j]) j++;
+      if(j >= d->num_footprints || d->footprints[j].formid != footprints[i].formid)
+      {
+        rt_box_add(box, footprints[i].area);
+        dirty[i] = TRUE;
+      }
+      j++;
+    }
 
-        forms = g_list_next(forms);
+    // forms reading from there write different pixels as well
+    gboolean grown = TRUE;
+    while(grown)
+    {
+      grown = FALSE;
+      for(int i = 0; i < num_footprints; i++)
+      {
+        const retouch_footprint_t *f = footprints + i;
+        if(dirty[i] || !(rt_box_touches(box, f->area, f->margin) || rt_box_touches(box, f->source, f->margin)))
+          continue;
+        rt_box_add(box, f->area);
+        dirty[i] = grown = TRUE;
       }
     }
+    free(dirty);
+    free(kept);
+    free(kept_old);
+
+    // to roi_out, with some slack for the rasterization of the masks
+    dt_iop_roi_t area = { 0 };
+    if(box[2] > box[0] && box[3] > box[1])
+    {
+      area.x = floorf(box[0] * roi_in->scale) - roi_out->x - 2;
+      area.y = floorf(box[1] * roi_in->scale) - roi_out->y - 2;
+      area.width = ceilf(box[2] * roi_in->scale) - roi_out->x + 2 - area.x;
+      area.height = ceilf(box[3] * roi_in->scale) - roi_out->y + 2 - area.y;
+      area.scale = roi_out->scale;
+    }
+    dt_dev_pixelpipe_piece_set_changed_area(piece, d->last_hash, &area);
   }
+
+  memcpy(d->footprints, footprints, sizeof(retouch_footprint_t) * num_footprints);
+  d->num_footprints = num_footprints;
+  d->last_hash = piece->hash;
+  d->last_global_hash = global_hash;
+  free(footprints);
 }
 
 static void process_internal(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
@@ -4416,6 +4748,8 @@ static void process_internal(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
   const int gui_active = (self->dev) ? (self == self->dev->gui_module) : 0;
   const int display_wavelet_scale = (g && gui_active) ? g->display_wavelet_scale : 0;
 
+  rt_report_changed_area(self, piece, roi_in, roi_out);
+
   // we will do all the clone, heal, etc on the input image,
   // this way the source for one algorithm can be the destination from a previous one
   in_retouch = dt_alloc_align(64, roi_rt->width * roi_rt->height * ch * sizeof(float));
@@ -4517,6 +4851,7 @@ static void process_internal(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
   rt_copy_in_to_out(in_retouch, roi_rt, ovoid, roi_out, ch, 0, 0);
 
 cleanup:
+  rt_free_forms(&usr_data);
   if(in_retouch) dt_free_align(in_retouch);
   if(dwt_p) dt_dwt_free(dwt_p);
 }
@@ -4665,40 +5000,33 @@ cleanup:
   return err;
 }
 
-static cl_int rt_build_scaled_mask_cl(const int devid, float *const mask, dt_iop_roi_t *const roi_mask,
-                                      float **mask_scaled, cl_mem *p_dev_mask_scaled,
-                                      dt_iop_roi_t *roi_mask_scaled, dt_iop_roi_t *const roi_in, const int dx,
-                                      const int dy, const int algo)
+static cl_int rt_copy_scaled_mask_to_device_cl(const int devid, float *const mask_scaled,
+                                               dt_iop_roi_t *const roi_mask_scaled, cl_mem *p_dev_mask_scaled)
 {
   cl_int err = CL_SUCCESS;
 
-  rt_build_scaled_mask(mask, roi_mask, mask_scaled, roi_mask_scaled, roi_in, dx, dy, algo);
-  if(*mask_scaled == NULL)
-  {
-    goto cleanup;
-  }
-
   const cl_mem dev_mask_scaled
       = dt_opencl_alloc_device_buffer(devid, roi_mask_scaled->width * roi_mask_scaled->height * sizeof(float));
   if(dev_mask_scaled == NULL)
   {
-    fprintf(stderr, "rt_build_scaled_mask_cl error 2\n");
+    fprintf(stderr, "rt_copy_scaled_mask_to_device_cl error 2\n");
     err = CL_MEM_OBJECT_ALLOCATION_FAILURE;
     goto cleanup;
   }
 
-  err = dt_opencl_write_buffer_to_device(devid, *mask_scaled, dev_mask_scaled, 0,
+  err = dt_opencl_write_buffer_to_device(devid, mask_scaled, dev_mask_scaled, 0,
                                          roi_mask_scaled->width * roi_mask_scaled->height * sizeof(float), TRUE);
   if(err != CL_SUCCESS)
   {
-    fprintf(stderr, "rt_build_scaled_mask_cl error 4\n");
+    fprintf(stderr, "rt_copy_scaled_mask_to_device_cl error 4\n");
+    dt_opencl_release_mem_object(dev_mask_scaled);
     goto cleanup;
   }
 
   *p_dev_mask_scaled = dev_mask_scaled;
 
 cleanup:
-  if(err != CL_SUCCESS) fprintf(stderr, "rt_build_scaled_mask_cl error\n");
+  if(err != CL_SUCCESS) fprintf(stderr, "rt_copy_scaled_mask_to_device_cl error\n");
 
   return err;
 }
@@ -5030,200 +5358,81 @@ static cl_int rt_process_forms_cl(cl_mem dev_layer, dwt_params_cl_t *const wt_p,
 {
   cl_int err = CL_SUCCESS;
 
-  int scale = scale1;
   retouch_user_data_t *usr_d = (retouch_user_data_t *)wt_p->user_data;
   dt_iop_module_t *self = usr_d->self;
   dt_dev_pixelpipe_iop_t *piece = usr_d->piece;
-
-  // if preview a single scale, just process that scale and original image
-  // unless merge is activated
-  if(wt_p->merge_from_scale == 0 && wt_p->return_layer > 0 && scale != wt_p->return_layer && scale != 0)
-    return err;
-  // do not process the reconstructed image
-  if(scale > wt_p->scales + 1) return err;
-
-  dt_develop_blend_params_t *bp = (dt_develop_blend_params_t *)piece->blendop_data;
   dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
   dt_iop_retouch_global_data_t *gd = (dt_iop_retouch_global_data_t *)self->global_data;
   const int devid = piece->pipe->devid;
   dt_iop_roi_t *roi_layer = &usr_d->roi;
-  const int mask_display = usr_d->mask_display && (scale == usr_d->display_scale);
+  const int mask_display = usr_d->mask_display && (scale1 == usr_d->display_scale);
 
-  // when the requested scales is grather than max scales the residual image index will be different from the one
-  // defined by the user,
-  // so we need to adjust it here, otherwise we will be using the shapes from a scale on the residual image
-  if(wt_p->scales < p->num_scales && wt_p->return_layer == 0 && scale == wt_p->scales + 1)
+  // the decompose routine may have reduced the scales, so the forms are gathered on the first layer
+  if(!usr_d->forms_collected)
   {
-    scale = p->num_scales + 1;
+    rt_collect_forms(usr_d, wt_p->scales, wt_p->return_layer, wt_p->merge_from_scale);
+    usr_d->forms_collected = 1;
   }
 
-  // iterate through all forms
-  if(!usr_d->suppress_mask)
-  {
-    dt_masks_form_t *grp = dt_masks_get_from_id_ext(piece->pipe->forms, bp->mask_id);
-    if(grp && (grp->type & DT_MASKS_GROUP))
-    {
-      GList *forms = g_list_first(grp->points);
-      while(forms && err == CL_SUCCESS)
-      {
-        dt_masks_point_group_t *grpt = (dt_masks_point_group_t *)forms->data;
-        if(grpt == NULL)
-        {
-          fprintf(stderr, "rt_process_forms: invalid form\n");
-          forms = g_list_next(forms);
-          continue;
-        }
-        const int formid = grpt->formid;
-        const float form_opacity = grpt->opacity;
-        if(formid == 0)
-        {
-          fprintf(stderr, "rt_process_forms: form is null\n");
-          forms = g_list_next(forms);
-          continue;
-        }
-        const int index = rt_get_index_from_formid(p, formid);
-        if(index == -1)
-        {
-          // FIXME: we get this error when user go back in history, so forms are the same but the array has changed
-          fprintf(stderr, "rt_process_forms: missing form=%i from array\n", formid);
-          forms = g_list_next(forms);
-          continue;
-        }
-
-        // only process current scale
-        if(p->rt_forms[index].scale != scale)
-        {
-          forms = g_list_next(forms);
-          continue;
-        }
-
-        // get the spot
-        dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, formid);
-        if(form == NULL)
-        {
-          fprintf(stderr, "rt_process_forms: missing form=%i from masks\n", formid);
-          forms = g_list_next(forms);
-          continue;
-        }
-
-        // if the form is outside the roi, we just skip it
-        if(!rt_masks_form_is_in_roi(self, piece, form, roi_layer, roi_layer))
-        {
-          forms = g_list_next(forms);
-          continue;
-        }
-
-        // get the mask
-        float *mask = NULL;
-        dt_iop_roi_t roi_mask = { 0 };
-
-        dt_masks_get_mask(self, piece, form, &mask, &roi_mask.width, &roi_mask.height, &roi_mask.x, &roi_mask.y);
-        if(mask == NULL)
-        {
-          fprintf(stderr, "rt_process_forms: error retrieving mask\n");
-          forms = g_list_next(forms);
-          continue;
-        }
-
-        int dx = 0, dy = 0;
-
-        // search the delta with the source
-        const dt_iop_retouch_algo_type_t algo = p->rt_forms[index].algorithm;
-        if(algo != DT_IOP_RETOUCH_BLUR && algo != DT_IOP_RETOUCH_FILL)
-        {
-          if(!rt_masks_get_delta_to_destination(self, piece, roi_layer, form, &dx, &dy))
-          {
-            forms = g_list_next(forms);
-            if(mask) dt_free_align(mask);
-            continue;
-          }
-        }
-
-        // scale the mask
-        cl_mem dev_mask_scaled = NULL;
-        float *mask_scaled = NULL;
-        dt_iop_roi_t roi_mask_scaled = { 0 };
-
-        err = rt_build_scaled_mask_cl(devid, mask, &roi_mask, &mask_scaled, &dev_mask_scaled, &roi_mask_scaled,
-                                      roi_layer, dx, dy, algo);
-
-        // only heal needs mask scaled
-        if(algo != DT_IOP_RETOUCH_HEAL && mask_scaled != NULL)
-        {
-          dt_free_align(mask_scaled);
-          mask_scaled = NULL;
-        }
+  const int scale
+      = rt_get_form_scale(scale1, wt_p->scales, wt_p->return_layer, wt_p->merge_from_scale, p->num_scales);
+  if(scale < 0) return err;
 
-        // we don't need the original mask anymore
-        if(mask)
-        {
-          dt_free_align(mask);
-          mask = NULL;
-        }
-
-        if(mask_scaled == NULL && algo == DT_IOP_RETOUCH_HEAL)
-        {
-          forms = g_list_next(forms);
+  // the device runs the forms in order, the masks are already built
+  for(int i = 0; i < usr_d->num_forms && err == CL_SUCCESS; i++)
+  {
+    retouch_form_t *f = usr_d->forms + i;
+    if(f->scale != scale) continue;
 
-          if(dev_mask_scaled) dt_opencl_release_mem_object(dev_mask_scaled);
-          dev_mask_scaled = NULL;
+    const int index = f->index;
+    const dt_iop_retouch_algo_type_t algo = p->rt_forms[index].algorithm;
 
-          continue;
-        }
-
-        if((err == CL_SUCCESS)
-           && (dx != 0 || dy != 0 || algo == DT_IOP_RETOUCH_BLUR || algo == DT_IOP_RETOUCH_FILL)
-           && ((roi_mask_scaled.width > 2) && (roi_mask_scaled.height > 2)))
-        {
-          if(algo == DT_IOP_RETOUCH_CLONE)
-          {
-            err = retouch_clone_cl(devid, dev_layer, roi_layer, dev_mask_scaled, &roi_mask_scaled, dx, dy,
-                                   form_opacity, gd);
-          }
-          else if(algo == DT_IOP_RETOUCH_HEAL)
-          {
-            err = retouch_heal_cl(devid, dev_layer, roi_layer, mask_scaled, dev_mask_scaled, &roi_mask_scaled, dx,
-                                  dy, form_opacity, gd);
-          }
-          else if(algo == DT_IOP_RETOUCH_BLUR)
-          {
-            err = retouch_blur_cl(devid, dev_layer, roi_layer, dev_mask_scaled, &roi_mask_scaled, form_opacity,
-                                  p->rt_forms[index].blur_type, p->rt_forms[index].blur_radius, piece, gd);
-          }
-          else if(algo == DT_IOP_RETOUCH_FILL)
-          {
-            // add a brightness to the color so it can be fine-adjusted by the user
-            float fill_color[3];
+    cl_mem dev_mask_scaled = NULL;
+    err = rt_copy_scaled_mask_to_device_cl(devid, f->mask_scaled, &f->roi_mask_scaled, &dev_mask_scaled);
+    if(err != CL_SUCCESS) break;
 
-            if(p->rt_forms[index].fill_mode == DT_IOP_RETOUCH_FILL_ERASE)
-            {
-              fill_color[0] = fill_color[1] = fill_color[2] = p->rt_forms[index].fill_brightness;
-            }
-            else
-            {
-              fill_color[0] = p->rt_forms[index].fill_color[0] + p->rt_forms[index].fill_brightness;
-              fill_color[1] = p->rt_forms[index].fill_color[1] + p->rt_forms[index].fill_brightness;
-              fill_color[2] = p->rt_forms[index].fill_color[2] + p->rt_forms[index].fill_brightness;
-            }
+    if(algo == DT_IOP_RETOUCH_CLONE)
+    {
+      err = retouch_clone_cl(devid, dev_layer, roi_layer, dev_mask_scaled, &f->roi_mask_scaled, f->dx, f->dy,
+                             f->opacity, gd);
+    }
+    else if(algo == DT_IOP_RETOUCH_HEAL)
+    {
+      err = retouch_heal_cl(devid, dev_layer, roi_layer, f->mask_scaled, dev_mask_scaled, &f->roi_mask_scaled,
+                            f->dx, f->dy, f->opacity, gd);
+    }
+    else if(algo == DT_IOP_RETOUCH_BLUR)
+    {
+      err = retouch_blur_cl(devid, dev_layer, roi_layer, dev_mask_scaled, &f->roi_mask_scaled, f->opacity,
+                            p->rt_forms[index].blur_type, p->rt_forms[index].blur_radius, piece, gd);
+    }
+    else if(algo == DT_IOP_RETOUCH_FILL)
+    {
+      // add a brightness to the color so it can be fine-adjusted by the user
+      float fill_color[3];
 
-            err = retouch_fill_cl(devid, dev_layer, roi_layer, dev_mask_scaled, &roi_mask_scaled, form_opacity,
-                                  fill_color, gd);
-          }
-          else
-            fprintf(stderr, "rt_process_forms: unknown algorithm %i\n", algo);
+      if(p->rt_forms[index].fill_mode == DT_IOP_RETOUCH_FILL_ERASE)
+      {
+        fill_color[0] = fill_color[1] = fill_color[2] = p->rt_forms[index].fill_brightness;
+      }
+      else
+      {
+        fill_color[0] = p->rt_forms[index].fill_color[0] + p->rt_forms[index].fill_brightness;
+        fill_color[1] = p->rt_forms[index].fill_color[1] + p->rt_forms[index].fill_brightness;
+        fill_color[2] = p->rt_forms[index].fill_color[2] + p->rt_forms[index].fill_brightness;
+      }
 
-          if(mask_display)
-            rt_copy_mask_to_alpha_cl(devid, dev_layer, roi_layer, dev_mask_scaled, &roi_mask_scaled, form_opacity,
-                                     gd);
-        }
+      err = retouch_fill_cl(devid, dev_layer, roi_layer, dev_mask_scaled, &f->roi_mask_scaled, f->opacity,
+                            fill_color, gd);
+    }
+    else
+      fprintf(stderr, "rt_process_forms: unknown algorithm %i\n", algo);
 
-        if(mask) dt_free_align(mask);
-        if(mask_scaled) dt_free_align(mask_scaled);
-        if(dev_mask_scaled) dt_opencl_release_mem_object(dev_mask_scaled);
+    if(mask_display && err == CL_SUCCESS)
+      rt_copy_mask_to_alpha_cl(devid, dev_layer, roi_layer, dev_mask_scaled, &f->roi_mask_scaled, f->opacity,
+                               gd);
 
-        forms = g_list_next(forms);
-      }
-    }
+    dt_opencl_release_mem_object(dev_mask_scaled);
   }
 
   return err;
@@ -5249,6 +5458,8 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   const int gui_active = (self->dev) ? (self == self->dev->gui_module) : 0;
   const int display_wavelet_scale = (g && gui_active) ? g->display_wavelet_scale : 0;
 
+  rt_report_changed_area(self, piece, roi_in, roi_out);
+
   // we will do all the clone, heal, etc on the input image,
   // this way the source for one algorithm can be the destination from a previous one
   const cl_mem in_retouch = dt_opencl_alloc_device_buffer(devid, roi_rt->width * roi_rt->height * ch * sizeof(float));
@@ -5386,6 +5597,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
                              gd->kernel_retouch_copy_buffer_to_image);
 
 cleanup:
+  rt_free_forms(&usr_data);
   if(dwt_p) dt_dwt_free_cl(dwt_p);
 
   if(in_retouch) dt_opencl_release_mem_object(in_retouch);
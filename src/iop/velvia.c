@@ -35,9 +35,6 @@
 
 #include <gtk/gtk.h>
 #include <inttypes.h>
-#if defined(__SSE__)
-#include <xmmintrin.h>
-#endif
 
 // NaN-safe clip: NaN compares false and will result in 0.0
 #define CLIP(x) (((x) >= 0.0) ? ((x) <= 1.0 ? (x) : 1.0) : 0.0)
@@ -85,7 +82,8 @@ const char *name()
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_SCALE_INVARIANT
+         | IOP_FLAGS_POINTWISE;
 }
 
 int default_group()
@@ -131,116 +129,56 @@ int legacy_params(dt_iop_module_t *self, const void *const old_params, const int
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
-  const dt_iop_velvia_data_t *const data = (dt_iop_velvia_data_t *)piece->data;
+  const int width = roi_out->width;
 
-  const int ch = piece->colors;
-  const float strength = data->strength / 100.0f;
-
-  // Apply velvia saturation
-  if(strength <= 0.0)
-    memcpy(ovoid, ivoid, (size_t)sizeof(float) * ch * roi_out->width * roi_out->height);
-  else
-  {
+  // rows go through process_pixels(), so fused and unfused output can't drift apart
 #ifdef _OPENMP
-#pragma omp parallel for SIMD() default(none) \
-    dt_omp_firstprivate(ch, data, ivoid, ovoid, roi_out, strength) \
-    schedule(static)
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ivoid, ovoid, piece, roi_out, self, width) \
+  schedule(static)
 #endif
-    for(size_t k = 0; k < (size_t)roi_out->width * roi_out->height; k++)
-    {
-      const float *const in = (const float *const)ivoid + (size_t)ch * k;
-      float *const out = (float *const)ovoid + (size_t)ch * k;
-
-      // calculate vibrance, and apply boost velvia saturation at least saturated pixels
-      float pmax = MAX(in[0], MAX(in[1], in[2])); // max value in RGB set
-      float pmin = MIN(in[0], MIN(in[1], in[2])); // min value in RGB set
-      float plum = (pmax + pmin) / 2.0f;          // pixel luminocity
-      float psat = (plum <= 0.5f) ? (pmax - pmin) / (1e-5f + pmax + pmin)
-                                  : (pmax - pmin) / (1e-5f + MAX(0.0f, 2.0f - pmax - pmin));
-
-      float pweight
-          = CLAMPS(((1.0f - (1.5f * psat)) + ((1.0f + (fabsf(plum - 0.5f) * 2.0f)) * (1.0f - data->bias)))
-                       / (1.0f + (1.0f - data->bias)),
-                   0.0f, 1.0f);              // The weight of pixel
-      float saturation = strength * pweight; // So lets calculate the final affection of filter on pixel
-
-      // Apply velvia saturation values
-      out[0] = CLAMPS(in[0] + saturation * (in[0] - 0.5f * (in[1] + in[2])), 0.0f, 1.0f);
-      out[1] = CLAMPS(in[1] + saturation * (in[1] - 0.5f * (in[2] + in[0])), 0.0f, 1.0f);
-      out[2] = CLAMPS(in[2] + saturation * (in[2] - 0.5f * (in[0] + in[1])), 0.0f, 1.0f);
-    }
+  for(int j = 0; j < roi_out->height; j++)
+  {
+    const size_t offset = (size_t)4 * width * j;
+    process_pixels(self, piece, (const float *)ivoid + offset, (float *)ovoid + offset, width);
   }
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
 }
 
-#if defined(__SSE__)
-void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
-                  void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+void process_pixels(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
+                    float *const out, const size_t npixels)
 {
-  dt_iop_velvia_data_t *data = (dt_iop_velvia_data_t *)piece->data;
-  float *in = (float *)ivoid;
-  float *out = (float *)ovoid;
-  const int ch = piece->colors;
+  const dt_iop_velvia_data_t *const data = (dt_iop_velvia_data_t *)piece->data;
   const float strength = data->strength / 100.0f;
 
-  // Apply velvia saturation
   if(strength <= 0.0)
-    memcpy(out, in, (size_t)sizeof(float) * ch * roi_out->width * roi_out->height);
-  else
   {
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-    dt_omp_firstprivate(ch, roi_out, strength) \
-    shared(in, out, data) \
-    schedule(static)
-#endif
-    for(size_t k = 0; k < (size_t)roi_out->width * roi_out->height; k++)
-    {
-      float *inp = in + ch * k;
-      float *outp = out + ch * k;
-      // calculate vibrance, and apply boost velvia saturation at least saturated pixels
-      float pmax = fmaxf(inp[0], fmaxf(inp[1], inp[2])); // max value in RGB set
-      float pmin = fminf(inp[0], fminf(inp[1], inp[2])); // min value in RGB set
-      float plum = (pmax + pmin) / 2.0f;                 // pixel luminocity
-      float psat = (plum <= 0.5f) ? (pmax - pmin) / (1e-5f + pmax + pmin)
-                                  : (pmax - pmin) / (1e-5f + MAX(0.0f, 2.0f - pmax - pmin));
-
-      float pweight
-          = CLAMPS(((1.0f - (1.5f * psat)) + ((1.0f + (fabsf(plum - 0.5f) * 2.0f)) * (1.0f - data->bias)))
-                   / (1.0f + (1.0f - data->bias)),
-                   0.0f, 1.0f);              // The weight of pixel
-      float saturation = strength * pweight; // So lets calculate the final affection of filter on pixel
-
-      // Apply velvia saturation values
-      const __m128 inp_m = _mm_load_ps(inp);
-      const __m128 boost = _mm_set1_ps(saturation);
-      const __m128 min_m = _mm_set1_ps(0.0f);
-      const __m128 max_m = _mm_set1_ps(1.0f);
-
-      const __m128 inp_shuffled
-          = _mm_mul_ps(_mm_add_ps(_mm_shuffle_ps(inp_m, inp_m, _MM_SHUFFLE(3, 0, 2, 1)),
-                                  _mm_shuffle_ps(inp_m, inp_m, _MM_SHUFFLE(3, 1, 0, 2))),
-                       _mm_set1_ps(0.5f));
-
-      _mm_stream_ps(
-          outp, _mm_min_ps(
-                    max_m,
-                    _mm_max_ps(min_m, _mm_add_ps(inp_m, _mm_mul_ps(boost, _mm_sub_ps(inp_m, inp_shuffled))))));
-
-      // equivalent to:
-      /*
-       outp[0]=CLAMPS(inp[0] + saturation*(inp[0]-0.5f*(inp[1]+inp[2])), 0.0f, 1.0f);
-       outp[1]=CLAMPS(inp[1] + saturation*(inp[1]-0.5f*(inp[2]+inp[0])), 0.0f, 1.0f);
-       outp[2]=CLAMPS(inp[2] + saturation*(inp[2]-0.5f*(inp[0]+inp[1])), 0.0f, 1.0f);
-      */
-    }
+    if(out != in) memcpy(out, in, sizeof(float) * 4 * npixels);
+    return;
   }
-  _mm_sfence();
 
-  if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
+  for(size_t k = 0; k < (size_t)4 * npixels; k += 4)
+  {
+    // in and out may alias, so keep the input pixel around
+    const float r = in[k], g = in[k + 1], b = in[k + 2];
+    const float pmax = MAX(r, MAX(g, b));
+    const float pmin = MIN(r, MIN(g, b));
+    const float plum = (pmax + pmin) / 2.0f;
+    const float psat = (plum <= 0.5f) ? (pmax - pmin) / (1e-5f + pmax + pmin)
+                                      : (pmax - pmin) / (1e-5f + MAX(0.0f, 2.0f - pmax - pmin));
+    const float pweight
+        = CLAMPS(((1.0f - (1.5f * psat)) + ((1.0f + (fabsf(plum - 0.5f) * 2.0f)) * (1.0f - data->bias)))
+                     / (1.0f + (1.0f - data->bias)),
+                 0.0f, 1.0f);
+    const float saturation = strength * pweight;
+
+    out[k] = CLAMPS(r + saturation * (r - 0.5f * (g + b)), 0.0f, 1.0f);
+    out[k + 1] = CLAMPS(g + saturation * (g - 0.5f * (b + r)), 0.0f, 1.0f);
+    out[k + 2] = CLAMPS(b + saturation * (b - 0.5f * (r + g)), 0.0f, 1.0f);
+    out[k + 3] = in[k + 3];
+  }
 }
-#endif
 
 #ifdef HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
@@ -66,7 +66,8 @@ const char *name()
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_SCALE_INVARIANT
+         | IOP_FLAGS_POINTWISE;
 }
 
 int default_group()
@@ -95,36 +96,39 @@ void connect_key_accels(dt_iop_module_t *self)
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
-  dt_iop_vibrance_data_t *d = (dt_iop_vibrance_data_t *)piece->data;
-  const float *in = (float *)ivoid;
-  float *out = (float *)ovoid;
-  const int ch = piece->colors;
-
-  const float amount = (d->amount * 0.01);
+  const int width = roi_out->width;
 
+  // see process_pixels(), which the pipe also calls directly for fused runs
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(amount, ch, roi_out) \
-  shared(in, out) \
+  dt_omp_firstprivate(ivoid, ovoid, piece, roi_out, self, width) \
   schedule(static)
 #endif
-  for(int k = 0; k < roi_out->height; k++)
+  for(int j = 0; j < roi_out->height; j++)
   {
-    size_t offs = (size_t)k * roi_out->width * ch;
-    for(int l = 0; l < (roi_out->width * ch); l += ch)
-    {
-      /* saturation weight 0 - 1 */
-      float sw = sqrt((in[offs + l + 1] * in[offs + l + 1]) + (in[offs + l + 2] * in[offs + l + 2])) / 256.0;
-      float ls = 1.0 - ((amount * sw) * .25);
-      float ss = 1.0 + (amount * sw);
-      out[offs + l + 0] = in[offs + l + 0] * ls;
-      out[offs + l + 1] = in[offs + l + 1] * ss;
-      out[offs + l + 2] = in[offs + l + 2] * ss;
-      out[offs + l + 3] = in[offs + l + 3];
-    }
+    const size_t offset = (size_t)4 * width * j;
+    process_pixels(self, piece, (const float *)ivoid + offset, (float *)ovoid + offset, width);
   }
 }
 
+void process_pixels(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
+                    float *const out, const size_t npixels)
+{
+  const dt_iop_vibrance_data_t *const d = (dt_iop_vibrance_data_t *)piece->data;
+  const float amount = (d->amount * 0.01);
+
+  for(size_t k = 0; k < (size_t)4 * npixels; k += 4)
+  {
+    /* saturation weight 0 - 1 */
+    const float sw = sqrt((in[k + 1] * in[k + 1]) + (in[k + 2] * in[k + 2])) / 256.0;
+    const float ls = 1.0 - ((amount * sw) * .25);
+    const float ss = 1.0 + (amount * sw);
+    out[k + 0] = in[k + 0] * ls;
+    out[k + 1] = in[k + 1] * ss;
+    out[k + 2] = in[k + 2] * ss;
+    out[k + 3] = in[k + 3];
+  }
+}
 
 #ifdef HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
@@ -0,0 +1,230 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the half float conversions in common/half.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/tracing.h"
+
+#include "common/half.c"
+
+/*
+ * DEFINITIONS
+ */
+
+// all bit patterns of a half float
+#define N_HALF 65536
+
+// floats and the halfs they have to be converted to (round to nearest even,
+// saturating beyond the largest half)
+static const float from[] = {
+  0.0f, -0.0f, 1.0f, -2.0f, 0.5f, 65504.0f, -65504.0f,
+  65519.0f,              // rounds down to the largest half
+  65520.0f, 1e6f, -1e6f, // beyond, saturate
+  INFINITY, -INFINITY,
+  1.0f + 1.0f / 2048.0f, // tie, rounds to the even 1.0
+  1.0f + 3.0f / 2048.0f, // tie, rounds to the even 1 + 2/1024
+  5.9604645e-8f,         // smallest subnormal half
+  2.9802322e-8f,         // half of it, a tie rounding to zero
+  6.1035156e-5f          // smallest normal half
+};
+static const uint16_t to[] = {
+  0x0000, 0x8000, 0x3c00, 0xc000, 0x3800, 0x7bff, 0xfbff,
+  0x7bff,
+  0x7bff, 0x7bff, 0xfbff,
+  0x7bff, 0xfbff,
+  0x3c00,
+  0x3c02,
+  0x0001,
+  0x0000,
+  0x0400
+};
+
+typedef void (*from_float_t)(const float *const, uint16_t *const, const size_t);
+typedef void (*to_float_t)(const uint16_t *const, float *const, const size_t);
+
+/*
+ * HELPERS
+ */
+
+// every half converted to float and back has to give the same half. nan only
+// has to stay nan, its payload may change, and infinity saturates at the
+// largest half.
+static void check_round_trip(from_float_t from_float, to_float_t to_float)
+{
+  uint16_t *h = malloc(sizeof(uint16_t) * N_HALF);
+  uint16_t *back = malloc(sizeof(uint16_t) * N_HALF);
+  float *f = malloc(sizeof(float) * N_HALF);
+  for(int k = 0; k < N_HALF; k++) h[k] = k;
+
+  to_float(h, f, N_HALF);
+  from_float(f, back, N_HALF);
+
+  for(int k = 0; k < N_HALF; k++)
+  {
+    const int nan = (k & 0x7c00) == 0x7c00 && (k & 0x03ff);
+    const int inf = (k & 0x7fff) == 0x7c00;
+    if(nan)
+    {
+      assert_true(isnan(f[k]));
+      assert_true((back[k] & 0x7c00) == 0x7c00 && (back[k] & 0x03ff));
+    }
+    else if(inf)
+    {
+      assert_true(isinf(f[k]));
+      assert_int_equal(back[k], (k & 0x8000) | 0x7bff);
+    }
+    else
+    {
+      if(back[k] != h[k]) TR_DEBUG("half 0x%04x -> %e -> 0x%04x", k, f[k], back[k]);
+      assert_int_equal(back[k], h[k]);
+    }
+  }
+  free(f);
+  free(back);
+  free(h);
+}
+
+static void check_values(from_float_t from_float)
+{
+  const size_t n = sizeof(from) / sizeof(from[0]);
+  uint16_t h[sizeof(from) / sizeof(from[0])];
+  from_float(from, h, n);
+  for(size_t k = 0; k < n; k++)
+  {
+    if(h[k] != to[k]) TR_DEBUG("%e -> 0x%04x, expected 0x%04x", from[k], h[k], to[k]);
+    assert_int_equal(h[k], to[k]);
+  }
+}
+
+#ifdef DT_HALF_F16C
+static int have_f16c()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+}
+#endif
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_round_trip_plain(void **state)
+{
+  check_round_trip(_from_float_plain, _to_float_plain);
+}
+
+static void test_values_plain(void **state)
+{
+  check_values(_from_float_plain);
+}
+
+static void test_round_trip_f16c(void **state)
+{
+#ifdef DT_HALF_F16C
+  if(!have_f16c()) skip();
+  check_round_trip(_from_float_f16c, _to_float_f16c);
+#else
+  skip();
+#endif
+}
+
+static void test_values_f16c(void **state)
+{
+#ifdef DT_HALF_F16C
+  if(!have_f16c()) skip();
+  check_values(_from_float_f16c);
+#else
+  skip();
+#endif
+}
+
+// both paths have to pack a ramp over the whole half range the same way. the
+// lengths are no multiple of 8, so the tail of the f16c path is covered, too.
+static void test_plain_equals_f16c(void **state)
+{
+#ifdef DT_HALF_F16C
+  if(!have_f16c()) skip();
+  const size_t n = 100003;
+  float *f = malloc(sizeof(float) * n);
+  uint16_t *plain = malloc(sizeof(uint16_t) * n);
+  uint16_t *f16c = malloc(sizeof(uint16_t) * n);
+  for(size_t k = 0; k < n; k++)
+    f[k] = (k & 1 ? -1.0f : 1.0f) * ldexpf((float)k / n, (int)(k % 48) - 28);
+
+  _from_float_plain(f, plain, n);
+  _from_float_f16c(f, f16c, n);
+  for(size_t k = 0; k < n; k++)
+  {
+    if(plain[k] != f16c[k])
+      TR_DEBUG("%e -> 0x%04x (plain), 0x%04x (f16c)", f[k], plain[k], f16c[k]);
+    assert_int_equal(plain[k], f16c[k]);
+  }
+  free(f16c);
+  free(plain);
+  free(f);
+#else
+  skip();
+#endif
+}
+
+// the public functions split the buffer into chunks, one more than fits
+static void test_chunked(void **state)
+{
+  const size_t n = DT_HALF_CHUNK + 5;
+  float *f = malloc(sizeof(float) * n);
+  float *back = malloc(sizeof(float) * n);
+  uint16_t *h = malloc(sizeof(uint16_t) * n);
+  for(size_t k = 0; k < n; k++) f[k] = (float)(k % 2048); // exact in half
+
+  dt_half_from_float(f, h, n);
+  dt_half_to_float(h, back, n);
+  for(size_t k = 0; k < n; k++) assert_true(back[k] == f[k]);
+
+  free(h);
+  free(back);
+  free(f);
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_round_trip_plain),
+    cmocka_unit_test(test_values_plain),
+    cmocka_unit_test(test_round_trip_f16c),
+    cmocka_unit_test(test_values_f16c),
+    cmocka_unit_test(test_plain_equals_f16c),
+    cmocka_unit_test(test_chunked)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
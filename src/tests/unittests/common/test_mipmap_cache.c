@@ -0,0 +1,244 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the spill files of evicted float buffers in
+ * common/mipmap_cache.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <utime.h>
+
+#include <cmocka.h>
+
+#include "../util/tracing.h"
+
+#include "common/mipmap_cache.c"
+
+/*
+ * DEFINITIONS
+ */
+
+#define IMGID 42
+#define WIDTH 37
+#define HEIGHT 19
+
+typedef struct spill_state_t
+{
+  dt_mipmap_cache_t cache;
+  gchar *dir;
+  gchar *source; // stands in for the raw file, spill files are tied to its mtime
+} spill_state_t;
+
+/*
+ * MOCKED FUNCTIONS
+ */
+
+static const char *_source = NULL;
+
+void __wrap_dt_image_full_path(const int imgid, char *pathname, size_t pathname_len, gboolean *from_cache)
+{
+  g_strlcpy(pathname, imgid == IMGID ? _source : "", pathname_len);
+}
+
+/*
+ * HELPERS
+ */
+
+static size_t buffer_size()
+{
+  return sizeof(struct dt_mipmap_buffer_dsc) + sizeof(float) * 4 * WIDTH * HEIGHT;
+}
+
+// a float buffer as the cache would evict it, with a ramp as pixels
+static struct dt_mipmap_buffer_dsc *new_buffer()
+{
+  struct dt_mipmap_buffer_dsc *dsc = dt_alloc_align(64, buffer_size());
+  memset(dsc, 0, sizeof(*dsc));
+  dsc->width = WIDTH;
+  dsc->height = HEIGHT;
+  dsc->iscale = 1.0f;
+  dsc->size = buffer_size();
+  float *const pixels = (float *)(dsc + 1);
+  for(int k = 0; k < 4 * WIDTH * HEIGHT; k++) pixels[k] = 0.25f * k;
+  return dsc;
+}
+
+// evict a copy of the buffer through the queue, the way the cleanup callback does
+static void spill(dt_mipmap_cache_t *cache, const struct dt_mipmap_buffer_dsc *const dsc)
+{
+  struct dt_mipmap_buffer_dsc *copy = dt_alloc_align(64, buffer_size());
+  memcpy(copy, dsc, buffer_size());
+  _spill_queue(cache, IMGID, copy);
+  _spill_drain(cache);
+  assert_null(cache->spill_pending);
+}
+
+static int setup(void **state)
+{
+  spill_state_t *s = calloc(1, sizeof(spill_state_t));
+  s->dir = g_dir_make_tmp("dt_spill_XXXXXX", NULL);
+  if(!s->dir) return -1;
+  s->source = g_build_filename(s->dir, "source.raw", NULL);
+  if(!g_file_set_contents(s->source, "raw", -1, NULL)) return -1;
+  _source = s->source;
+
+  g_snprintf(s->cache.spilldir, sizeof(s->cache.spilldir), "%s/float-scratch", s->dir);
+  if(g_mkdir(s->cache.spilldir, 0750)) return -1;
+  s->cache.spill_quota = (size_t)1 << 30;
+  dt_pthread_mutex_init(&s->cache.spill_lock, NULL);
+  dt_pthread_mutex_init(&s->cache.spill_io_lock, NULL);
+  *state = s;
+  return 0;
+}
+
+static int teardown(void **state)
+{
+  spill_state_t *s = (spill_state_t *)*state;
+  _spill_premap_release();
+  _spill_clear(&s->cache, s->cache.spilldir);
+  g_rmdir(s->cache.spilldir);
+  g_unlink(s->source);
+  g_rmdir(s->dir);
+  dt_pthread_mutex_destroy(&s->cache.spill_lock);
+  dt_pthread_mutex_destroy(&s->cache.spill_io_lock);
+  g_free(s->source);
+  g_free(s->dir);
+  free(s);
+  return 0;
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+// a spilled buffer maps back byte for byte, and counts against the quota
+static void test_round_trip(void **state)
+{
+  spill_state_t *s = (spill_state_t *)*state;
+  struct dt_mipmap_buffer_dsc *dsc = new_buffer();
+
+  spill(&s->cache, dsc);
+  assert_int_equal(s->cache.spill_size, buffer_size());
+
+  _spill_premap(&s->cache, IMGID);
+  assert_non_null(_spill_premapped);
+  assert_int_equal(_spill_premapped_key, get_key(IMGID, DT_MIPMAP_F));
+  assert_int_equal(_spill_premapped_size, buffer_size());
+  assert_memory_equal(_spill_premapped, dsc, buffer_size());
+
+  dt_free_align(dsc);
+}
+
+// spilling the same image again replaces the file without counting it twice
+static void test_replace(void **state)
+{
+  spill_state_t *s = (spill_state_t *)*state;
+  struct dt_mipmap_buffer_dsc *dsc = new_buffer();
+
+  spill(&s->cache, dsc);
+  spill(&s->cache, dsc);
+  assert_int_equal(s->cache.spill_size, buffer_size());
+
+  dt_free_align(dsc);
+}
+
+// a file shorter than its header claims must not be mapped, and is removed
+static void test_truncated(void **state)
+{
+  spill_state_t *s = (spill_state_t *)*state;
+  struct dt_mipmap_buffer_dsc *dsc = new_buffer();
+  char filename[PATH_MAX] = { 0 };
+  _spill_filename(&s->cache, IMGID, filename, sizeof(filename));
+
+  spill(&s->cache, dsc);
+  assert_int_equal(truncate(filename, sysconf(_SC_PAGESIZE) + buffer_size() - 1), 0);
+
+  _spill_premap(&s->cache, IMGID);
+  assert_null(_spill_premapped);
+  assert_false(g_file_test(filename, G_FILE_TEST_EXISTS));
+
+  dt_free_align(dsc);
+}
+
+// a changed source file makes the spilled buffer stale
+static void test_stale(void **state)
+{
+  spill_state_t *s = (spill_state_t *)*state;
+  struct dt_mipmap_buffer_dsc *dsc = new_buffer();
+  char filename[PATH_MAX] = { 0 };
+  _spill_filename(&s->cache, IMGID, filename, sizeof(filename));
+
+  spill(&s->cache, dsc);
+  GStatBuf st;
+  assert_int_equal(g_stat(s->source, &st), 0);
+  struct utimbuf times = { st.st_atime, st.st_mtime + 10 };
+  assert_int_equal(g_utime(s->source, &times), 0);
+
+  _spill_premap(&s->cache, IMGID);
+  assert_null(_spill_premapped);
+  assert_false(g_file_test(filename, G_FILE_TEST_EXISTS));
+  assert_int_equal(s->cache.spill_size, 0);
+
+  dt_free_align(dsc);
+}
+
+// nothing is written beyond the quota, and nothing once spilling is off
+static void test_quota_and_disabled(void **state)
+{
+  spill_state_t *s = (spill_state_t *)*state;
+  struct dt_mipmap_buffer_dsc *dsc = new_buffer();
+  char filename[PATH_MAX] = { 0 };
+  _spill_filename(&s->cache, IMGID, filename, sizeof(filename));
+
+  s->cache.spill_quota = buffer_size() - 1;
+  spill(&s->cache, dsc);
+  assert_false(g_file_test(filename, G_FILE_TEST_EXISTS));
+  assert_int_equal(s->cache.spill_size, 0);
+
+  char spilldir[PATH_MAX] = { 0 };
+  g_strlcpy(spilldir, s->cache.spilldir, sizeof(spilldir));
+  s->cache.spill_quota = (size_t)1 << 30;
+  s->cache.spilldir[0] = '\0';
+  spill(&s->cache, dsc);
+  g_strlcpy(s->cache.spilldir, spilldir, sizeof(s->cache.spilldir));
+  assert_false(g_file_test(filename, G_FILE_TEST_EXISTS));
+
+  dt_free_align(dsc);
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup_teardown(test_round_trip, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_replace, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_truncated, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_stale, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_quota_and_disabled, setup, teardown)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,274 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for develop/pixelpipe_hb.c, on point-wise modules made up
+ * here, so no image or module library is needed
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cmocka.h>
+
+#include "../util/tracing.h"
+
+#include "develop/pixelpipe_hb.c"
+
+/*
+ * DEFINITIONS
+ */
+
+// no multiple of anything, so rows and chunks never line up
+#define WIDTH 67
+#define HEIGHT 43
+#define NUM_PIECES 2
+
+typedef struct test_params_t
+{
+  float gain;
+  float offset;
+} test_params_t;
+
+typedef struct test_pipe_t
+{
+  dt_dev_pixelpipe_t pipe;
+  dt_iop_module_t modules[NUM_PIECES];
+  dt_dev_pixelpipe_iop_t pieces[NUM_PIECES];
+  test_params_t params[NUM_PIECES];
+} test_pipe_t;
+
+/*
+ * POINT-WISE KERNELS
+ */
+
+static void affine_pixels(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
+                          float *const out, const size_t npixels)
+{
+  const test_params_t *const d = (const test_params_t *)piece->data;
+  for(size_t k = 0; k < (size_t)4 * npixels; k++) out[k] = in[k] * d->gain + d->offset;
+}
+
+// what process() does besides touching pixels, as exposure does
+static void affine_setup(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece)
+{
+  const test_params_t *const d = (const test_params_t *)piece->data;
+  for(int k = 0; k < 3; k++) piece->pipe->dsc.processed_maximum[k] *= d->gain;
+}
+
+// mixes the channels of a pixel, so it has to read all of them before writing when in equals out
+static void rotate_pixels(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
+                          float *const out, const size_t npixels)
+{
+  const test_params_t *const d = (const test_params_t *)piece->data;
+  for(size_t k = 0; k < (size_t)4 * npixels; k += 4)
+  {
+    const float r = in[k], g = in[k + 1], b = in[k + 2];
+    out[k] = g + d->gain * b;
+    out[k + 1] = b - d->offset;
+    out[k + 2] = r * d->gain;
+    out[k + 3] = in[k + 3];
+  }
+}
+
+/*
+ * HELPERS
+ */
+
+static test_pipe_t *new_pipe()
+{
+  test_pipe_t *t = calloc(1, sizeof(test_pipe_t));
+  t->modules[0].process_pixels_setup = affine_setup;
+  t->modules[0].process_pixels = affine_pixels;
+  t->modules[1].process_pixels = rotate_pixels;
+  t->params[0] = (test_params_t){ 1.5f, -0.25f };
+  t->params[1] = (test_params_t){ 0.75f, 0.125f };
+  for(int m = 0; m < NUM_PIECES; m++)
+  {
+    t->pieces[m].module = &t->modules[m];
+    t->pieces[m].pipe = &t->pipe;
+    t->pieces[m].data = &t->params[m];
+  }
+  return t;
+}
+
+static float *new_image(const int width, const int height)
+{
+  return dt_alloc_align(64, sizeof(float) * 4 * width * height);
+}
+
+// deterministic pixels, different for every channel
+static void fill_image(float *const img, const int width, const int height, const float seed)
+{
+  for(size_t k = 0; k < (size_t)4 * width * height; k++) img[k] = seed + 0.001f * (k % 997);
+}
+
+// every module after the other into its own output buffer, as the pipe runs them when not fused
+static void run_unfused(test_pipe_t *t, const float *const input, float *const output, const size_t npixels)
+{
+  float *buf[NUM_PIECES];
+  for(int m = 0; m < NUM_PIECES - 1; m++) buf[m] = dt_alloc_align(64, sizeof(float) * 4 * npixels);
+  buf[NUM_PIECES - 1] = output;
+
+  const float *in = input;
+  for(int m = 0; m < NUM_PIECES; m++)
+  {
+    t->modules[m].process_pixels(&t->modules[m], &t->pieces[m], in, buf[m], npixels);
+    in = buf[m];
+  }
+
+  for(int m = 0; m < NUM_PIECES - 1; m++) dt_free_align(buf[m]);
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+// the changed area of a piece is clipped to the roi, and relative to it
+static void test_changed_rect(void **state)
+{
+  const dt_iop_roi_t roi = { 100, 200, WIDTH, HEIGHT, 0.5f };
+
+  const dt_iop_roi_t inside = { 10, 5, 20, 15, 1.0f };
+  dt_iop_roi_t rect = _pixelpipe_changed_rect(&inside, &roi);
+  assert_int_equal(rect.x, 10);
+  assert_int_equal(rect.y, 5);
+  assert_int_equal(rect.width, 20);
+  assert_int_equal(rect.height, 15);
+  assert_true(rect.scale == roi.scale);
+
+  const dt_iop_roi_t across = { -5, HEIGHT - 3, 12, 10, 1.0f };
+  rect = _pixelpipe_changed_rect(&across, &roi);
+  assert_int_equal(rect.x, 0);
+  assert_int_equal(rect.y, HEIGHT - 3);
+  assert_int_equal(rect.width, 7);
+  assert_int_equal(rect.height, 3);
+
+  const dt_iop_roi_t outside = { WIDTH + 1, 0, 10, 10, 1.0f };
+  rect = _pixelpipe_changed_rect(&outside, &roi);
+  assert_int_equal(rect.width, 0);
+}
+
+// running the point-wise rest of the pipe on the changed part only and pasting it into the last output
+// gives the same as running it on everything
+static void test_incremental_equals_full(void **state)
+{
+  test_pipe_t *t = new_pipe();
+  const dt_iop_roi_t roi = { 0, 0, WIDTH, HEIGHT, 1.0f };
+  const size_t npixels = (size_t)WIDTH * HEIGHT;
+  const dt_iop_roi_t areas[] = { { 10, 5, 20, 15, 1.0f },       // inside
+                                 { -5, 30, 40, 100, 1.0f },     // across the border
+                                 { 0, 0, WIDTH, HEIGHT, 1.0f }, // all of it
+                                 { 0, 0, 1, 1, 1.0f } };        // a single pixel
+
+  float *in_old = new_image(WIDTH, HEIGHT), *in_new = new_image(WIDTH, HEIGHT);
+  float *full_old = new_image(WIDTH, HEIGHT), *full_new = new_image(WIDTH, HEIGHT);
+  float *out = new_image(WIDTH, HEIGHT);
+  fill_image(in_old, WIDTH, HEIGHT, 0.1f);
+  run_unfused(t, in_old, full_old, npixels);
+
+  for(int a = 0; a < sizeof(areas) / sizeof(areas[0]); a++)
+  {
+    TR_STEP("changed area %d,%d %dx%d", areas[a].x, areas[a].y, areas[a].width, areas[a].height);
+    const dt_iop_roi_t rect = _pixelpipe_changed_rect(&areas[a], &roi);
+
+    // the changed module's new output differs from the old one inside the area only
+    memcpy(in_new, in_old, sizeof(float) * 4 * npixels);
+    float *changed = new_image(rect.width, rect.height);
+    fill_image(changed, rect.width, rect.height, 0.6f);
+    _pixelpipe_copy_rect(in_new, WIDTH, rect.x, rect.y, changed, rect.width, 0, 0, rect.width, rect.height,
+                         4 * sizeof(float));
+    run_unfused(t, in_new, full_new, npixels);
+
+    float *crop = new_image(rect.width, rect.height), *patch = new_image(rect.width, rect.height);
+    _pixelpipe_copy_rect(crop, rect.width, 0, 0, in_new, WIDTH, rect.x, rect.y, rect.width, rect.height,
+                         4 * sizeof(float));
+    run_unfused(t, crop, patch, (size_t)rect.width * rect.height);
+    memcpy(out, full_old, sizeof(float) * 4 * npixels);
+    _pixelpipe_copy_rect(out, WIDTH, rect.x, rect.y, patch, rect.width, 0, 0, rect.width, rect.height,
+                         4 * sizeof(float));
+
+    assert_memory_equal(out, full_new, sizeof(float) * 4 * npixels);
+
+    dt_free_align(patch);
+    dt_free_align(crop);
+    dt_free_align(changed);
+  }
+
+  dt_free_align(out);
+  dt_free_align(full_new);
+  dt_free_align(full_old);
+  dt_free_align(in_new);
+  dt_free_align(in_old);
+  free(t);
+}
+
+// the fused pass in chunks, in place after the first module, gives the same as the modules one after the
+// other, and runs every setup once
+static void test_fused_equals_unfused(void **state)
+{
+  const int sizes[][2] = { { 1, 1 }, { WIDTH, HEIGHT }, { DT_DEV_PIXELPIPE_FUSED_CHUNK, 1 },
+                           { DT_DEV_PIXELPIPE_FUSED_CHUNK + 1, 2 } };
+
+  for(int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+  {
+    const int width = sizes[s][0], height = sizes[s][1];
+    TR_STEP("%dx%d pixels", width, height);
+    test_pipe_t *t = new_pipe();
+    const dt_iop_roi_t roi = { 0, 0, width, height, 1.0f };
+    dt_dev_pixelpipe_iop_t *fused[NUM_PIECES];
+    for(int m = 0; m < NUM_PIECES; m++) fused[m] = &t->pieces[m];
+    for(int k = 0; k < 3; k++) t->pipe.dsc.processed_maximum[k] = 1.0f;
+
+    float *in = new_image(width, height), *unfused = new_image(width, height), *out = new_image(width, height);
+    fill_image(in, width, height, 0.2f);
+    run_unfused(t, in, unfused, (size_t)width * height);
+    _pixelpipe_process_fused(&t->pipe, fused, NUM_PIECES, in, out, &roi);
+
+    assert_memory_equal(out, unfused, sizeof(float) * 4 * width * height);
+    for(int k = 0; k < 3; k++)
+    {
+      assert_true(t->pieces[0].dsc_in.processed_maximum[k] == 1.0f);
+      assert_true(t->pieces[0].dsc_out.processed_maximum[k] == t->params[0].gain);
+      assert_true(t->pipe.dsc.processed_maximum[k] == t->params[0].gain);
+    }
+
+    dt_free_align(out);
+    dt_free_align(unfused);
+    dt_free_align(in);
+    free(t);
+  }
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main()
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_changed_rect),
+    cmocka_unit_test(test_incremental_equals_full),
+    cmocka_unit_test(test_fused_equals_unfused)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -38,6 +38,7 @@
 #include "develop/develop.h"
 #include "develop/imageop.h"
 #include "develop/masks.h"
+#include "develop/pixelpipe_pool.h"
 #include "dtgtk/button.h"
 #include "dtgtk/thumbtable.h"
 #include "gui/accelerators.h"
@@ -2900,6 +2901,11 @@ void leave(dt_view_t *self)
   dt_dev_pixelpipe_cleanup_nodes(dev->preview2_pipe);
   dt_dev_pixelpipe_cleanup_nodes(dev->preview_pipe);
 
+  // the pipes stay around until the next image is opened, their pools don't need to keep anything meanwhile
+  dt_dev_pixelpipe_pool_trim(dev->pipe->pool);
+  dt_dev_pixelpipe_pool_trim(dev->preview2_pipe->pool);
+  dt_dev_pixelpipe_pool_trim(dev->preview_pipe->pool);
+
   dt_pthread_mutex_lock(&dev->history_mutex);
   while(dev->history)
   {
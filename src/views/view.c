@@ -31,6 +31,7 @@
 #include "control/conf.h"
 #include "control/control.h"
 #include "develop/develop.h"
+#include "develop/pixelpipe_pool.h"
 #include "dtgtk/button.h"
 #include "dtgtk/expander.h"
 #include "dtgtk/thumbtable.h"
@@ -353,6 +354,8 @@ int dt_view_manager_switch_by_view(dt_view_manager_t *vm, const dt_view_t *nv)
   {
     /* leave current view */
     if(old_view->leave) old_view->leave(old_view);
+    // the buffers kept for the pipes of the old view won't fit what the new one runs
+    dt_dev_pixelpipe_pool_trim(darktable.pixelpipe_pool);
     dt_accel_disconnect_list(old_view->accel_closures);
     old_view->accel_closures = NULL;
 